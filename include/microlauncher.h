@@ -7,6 +7,7 @@
 #include <json_types.h>
 #include <microlauncher_account.h>
 #include <microlauncher_instance.h>
+#include <microlauncher_launch.h>
 #include <stdbool.h>
 #ifdef G_OS_WIN32
 #include <shlobj.h>
@@ -23,6 +24,9 @@
 #endif
 
 #define LAUNCHER_NAME "MicroLauncher"
+/* Games run with group write for instances shared between users. posix_spawn has no umask action,
+ * so games are always started with vfork */
+#define GAME_UMASK 0002
 
 extern char *EXEC_BINARY;
 
@@ -31,10 +35,20 @@ struct Settings {
 	MicrolauncherInstance *instance;
 	GSList *javaRuntimes;
 	char *launcher_root;
+	/* Read-only roots below launcher_root which are looked up first, NULL terminated or NULL */
+	char **lower_roots;
 	char *manifest_url;
 	char *gpu_id;
+	/* Versions kept by garbage collection even if no instance uses them */
+	char **gcKeep;
+	/* Comma separated base URLs of LAN peers */
+	char *peers;
 	int width;
 	int height;
+	int monitorInterval;
+	int shaderCacheBudget;
+	/* Not saved, set by GUI from its theme. 0 uses the default size */
+	int cursorSize;
 	bool gpu_explicit;
 	bool fullscreen;
 	bool demo;
@@ -42,19 +56,53 @@ struct Settings {
 	bool use_zink;
 	bool hideOnLaunch;
 	bool useLocalLib;
+	bool classDataSharing;
+	bool prefetch;
+	bool lowFootprint;
+	bool backgroundDownload;
+	bool residentService;
+	bool lanCache;
+	bool sharedStore;
 };
 
+/* argv0 is used to re-execute the launcher */
+bool microlauncher_init(const char *argv0);
+void microlauncher_deinit(void);
 MicrolauncherInstance *microlauncher_instance_get(GSList *list, const char *id);
+/* name, or name followed by a number if an instance has it already. Free with free */
+char *microlauncher_instance_unique_name(const char *name);
 MicrolauncherAccount *microlauncher_account_get(GSList *list, const char *id);
-bool microlauncher_launch_instance(const MicrolauncherInstance *instance, MicrolauncherAccount *user, GCancellable *cancellable);
+bool microlauncher_launch_instance(LaunchContext *ctx);
+/* Downloads and verifies files of versions in the download mode of ctx, without launching them.
+ * Libraries and assets shared between versions are handled once */
+bool microlauncher_fetch(LaunchContext *ctx, const char *const *versionIds);
+/* Calls func for every file in the launcher root that versionId needs, starting with the JSONs it inherits.
+ * Only reads what is already in the launcher root, version must have been fetched before.
+ * Returns false if its JSONs or asset index are missing */
+bool microlauncher_version_foreach_file(LaunchContext *ctx, const char *versionId, DownloadFileFunc func, void *userdata);
+/* Replaces this process with a small supervisor which keeps the game as its child.
+ * Returns only if that failed */
+void microlauncher_hand_off(LaunchContext *ctx);
+/* Entry point of the supervisor, argv[1] is "--supervise" */
+int microlauncher_supervise(int argc, char **argv);
+void microlauncher_load_instance(json_object *obj, MicrolauncherInstance *instance);
+void microlauncher_save_instance(json_object *obj, MicrolauncherInstance *instance);
 void microlauncher_save_settings(void);
 void microlauncher_load_settings(void);
+/* Frees instances, accounts and settings and reads them again. Launch contexts keep what they were created with */
+void microlauncher_reload_config(void);
+/* False if path changed since this process last read or wrote it */
+bool microlauncher_config_is_current(const char *path);
 struct Settings *microlauncher_get_settings(void);
 GSList **microlauncher_get_instances(void);
 GSList **microlauncher_get_accounts(void);
 void microlauncher_set_callbacks(struct Callbacks callbacks);
 void microlauncher_update_launcher(MicrolauncherInstance *instance, bool create);
 bool microlauncher_auth_user(MicrolauncherAccount *user, GCancellable *cancellable);
+void microlauncher_set_curl_opts(CURL *curl);
 String microlauncher_http_get_string(const char *url, struct curl_slist *headers, const char *post);
 json_object *microlauncher_http_get_json(const char *url, struct curl_slist *headers, const char *post);
-GHashTable *microlauncher_get_manifest(void);
\ No newline at end of file
+/* Free with g_hash_table_unref */
+GHashTable *microlauncher_get_manifest(void);
+/* Frees caches that are rebuilt on demand. Jobs still holding the manifest keep their reference */
+void microlauncher_release_memory(void);
\ No newline at end of file
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <microlauncher_instance.h>
+#include <microlauncher_launch.h>
+#include <stdbool.h>
+
+/* First entry of an archive, lists instance settings and sha1 and size of every launcher root file */
+#define ARCHIVE_MANIFEST "microlauncher-export.json"
+#define ARCHIVE_INSTANCE_DIR "instance/"
+#define ARCHIVE_ROOT_DIR "root/"
+#define ARCHIVE_FORMAT 1
+/* Each extracting thread reads the archive through its own handle */
+#define ARCHIVE_THREADS 4
+
+/* Writes instance of ctx with every file of the launcher root its version needs to a zip at archive_path.
+ * Missing files are fetched first. Game files are stored as they are, they don't compress further */
+bool microlauncher_archive_export(LaunchContext *ctx, const char *archive_path);
+
+/* Extracts an archive written by microlauncher_archive_export into the launcher root of ctx.
+ * Only files under versions, libraries and assets are accepted. Files already present are kept, also when their sha1
+ * differs from the manifest. Java location, JVM arguments and prefix command of the archive are dropped.
+ * Instance directory goes to location or the default one when NULL.
+ * Returns the instance, it isn't added to instances. NULL on failure */
+MicrolauncherInstance *microlauncher_archive_import(LaunchContext *ctx, const char *archive_path, const char *location);
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <microlauncher_launch.h>
+#include <stdbool.h>
+
+/* Below the assets directory, one directory per virtual asset index */
+#define ASSETS_VIRTUAL_DIR "virtual"
+/* Below the game directory, for asset indexes with map_to_resources */
+#define ASSETS_RESOURCES_DIR "resources"
+#define ASSETS_LAYOUT_THREADS 4
+
+/* Old versions read assets by name instead of from objects, index sets "virtual" or "map_to_resources" for those.
+ * Links every object of the index under its name and writes the directory the game reads assets from (${game_assets})
+ * to game_assets, which is of PATH_MAX size. Virtual directories get hardlinks where possible, resources in the game
+ * directory get reflinks or copies since the game may change them. Entries already linked to the right object are kept,
+ * stale ones are removed from virtual directories */
+bool microlauncher_assets_prepare(LaunchContext *ctx, const char *index_path, const char *assets_dir, const char *game_dir, char *game_assets);
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <microlauncher_java_runtime.h>
+#include <stdbool.h>
+
+bool java_supports_dynamic_archive(JavaRuntime *runtime);
+
+char *microlauncher_cds_get_option(JavaRuntime *runtime, const char *classpath, const char *cds_dir, char **dump_path);
+
+bool microlauncher_cds_commit(const char *dump_path, bool success);
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <curl/curl.h>
+#include <gio/gio.h>
+#include <microlauncher_types.h>
+#include <stdbool.h>
+
+#define DOWNLOAD_THREADS 8
+#define DOWNLOAD_BACKGROUND_THREADS 2
+/* Per transfer, bytes per second */
+#define DOWNLOAD_BACKGROUND_SPEED (512 * 1024)
+/* Below XDG_CACHE_HOME, lower roots are read-only so their files are hashed only once */
+#define LOWER_CACHE_FILE "microlauncher/lower-verified.json"
+/* Next to the file being fetched, locked with flock so processes sharing a launcher root fetch it once */
+#define DOWNLOAD_LOCK_SUFFIX ".lock"
+
+enum DownloadFlags {
+	DOWNLOAD_NONE = 0,
+	/* URL points to LZMA compressed data, sha1 and size refer to decompressed file */
+	DOWNLOAD_LZMA = 1 << 0,
+	DOWNLOAD_EXECUTABLE = 1 << 1,
+	/* Needed to resolve other files, fetched in every mode */
+	DOWNLOAD_METADATA = 1 << 2
+};
+
+enum DownloadMode {
+	DOWNLOAD_MODE_FETCH,
+	/* Files are hashed and reported, nothing is written */
+	DOWNLOAD_MODE_VERIFY,
+	/* Like verify, but files are only compared by size */
+	DOWNLOAD_MODE_PLAN
+};
+
+struct DownloadStats {
+	/* Files which were already present and valid */
+	guint present;
+	long present_size;
+	/* Files which were fetched, or would have been in verify and plan modes */
+	guint fetched;
+	long fetched_size;
+	/* Part of fetched that came from the shared store instead of the network */
+	guint stored;
+	long stored_size;
+};
+
+typedef struct _DownloadQueue DownloadQueue;
+
+/* sha1 may be NULL if it isn't known */
+typedef void (*DownloadFileFunc)(const char *path, const char *sha1, long size, void *userdata);
+
+DownloadQueue *microlauncher_download_queue_new(void);
+
+void microlauncher_download_queue_add(DownloadQueue *queue, const char *url, const char *path, const char *label, const char *sha1, long size, enum DownloadFlags flags);
+
+/* Transfers of the queue use this share handle for connection reuse */
+void microlauncher_download_queue_set_share(DownloadQueue *queue, CURLSH *share);
+
+void microlauncher_download_queue_set_mode(DownloadQueue *queue, enum DownloadMode mode);
+
+/* Background queues use fewer threads and throttled transfers so they don't slow down foreground ones */
+void microlauncher_download_queue_set_background(DownloadQueue *queue, bool background);
+
+/* Files under launcher_root are tried from the shared store and LAN peers first, see microlauncher_store.h and microlauncher_peer.h */
+void microlauncher_download_queue_set_launcher_root(DownloadQueue *queue, const char *launcher_root);
+
+/* Files under the launcher root are looked up in lower roots first, and symlinked from there when valid.
+ * Their verification is remembered in LOWER_CACHE_FILE */
+void microlauncher_download_queue_set_lower_roots(DownloadQueue *queue, char *const *lower_roots);
+
+/* Files under the launcher root are materialized from the shared store and added to it once downloaded */
+void microlauncher_download_queue_set_store(DownloadQueue *queue, bool store);
+
+long microlauncher_download_queue_get_size(DownloadQueue *queue);
+
+void microlauncher_download_queue_foreach(DownloadQueue *queue, DownloadFileFunc func, void *userdata);
+
+/* Counts of the last run */
+struct DownloadStats microlauncher_download_queue_get_stats(DownloadQueue *queue);
+
+void microlauncher_download_stats_add(struct DownloadStats *stats, const struct DownloadStats *add);
+
+/* On failure failedResource (PATH_MAX) gets the URL of the first file that failed,
+ * or its path when it had none, e.g. a file from a lower root or the store */
+bool microlauncher_download_queue_run(DownloadQueue *queue, struct Callbacks callbacks, GCancellable *cancellable, char *failedResource);
+
+void microlauncher_download_queue_free(DownloadQueue *queue);
+
+/* Forgets files verified so far, they are hashed again next time */
+void microlauncher_download_release_cache(void);
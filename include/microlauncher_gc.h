@@ -0,0 +1,64 @@
+#pragma once
+
+#include <glib.h>
+#include <microlauncher_launch.h>
+#include <stdbool.h>
+
+/* Younger leftovers may belong to a launch or download still in progress */
+#define GC_MIN_AGE (24 * G_TIME_SPAN_HOUR)
+#define GC_THREADS 4
+/* Below the launcher root, versions every data directory using it needs */
+#define GC_ROOTS_DIR "gc-roots"
+
+enum GcCategory {
+	GC_VERSIONS,
+	GC_LIBRARIES,
+	GC_ASSET_INDEXES,
+	GC_ASSET_OBJECTS,
+	/* Natives directories of crashed launches */
+	GC_NATIVES,
+	/* Interrupted downloads */
+	GC_PARTIAL,
+	/* Objects of the shared store, only reported. Other launcher roots may need any of them */
+	GC_STORE,
+	GC_CATEGORY_COUNT
+};
+
+struct GcReport {
+	/* Bytes per category */
+	guint64 used[GC_CATEGORY_COUNT];
+	guint64 unused[GC_CATEGORY_COUNT];
+	/* Bytes removed, or that would be with dry_run */
+	guint64 freed;
+};
+
+/* Called for each path that is removed, or would be with dry_run */
+typedef void (*GcFunc)(const char *path, guint64 size, enum GcCategory category, void *userdata);
+
+/* Unused paths found by a scan */
+typedef struct _GcPlan GcPlan;
+
+const char *microlauncher_gc_category_name(enum GcCategory category);
+
+/* Writes versions of all instances and gcKeep of settings to GC_ROOTS_DIR of the launcher root,
+ * so that other users of it keep them. Must be called from main thread */
+void microlauncher_gc_publish_roots(void);
+
+/* Versions of all instances, gcKeep of settings, keep and those published by every user of the launcher root
+ * without duplicates. Must be called from main thread. Free with g_strfreev */
+char **microlauncher_gc_get_roots(const char *const *keep);
+
+/* Marks every file the versions need from the JSONs and asset indexes in the launcher root of ctx, without fetching
+ * anything, and collects everything else in versions, libraries and assets of it, along with leftovers of crashed
+ * launches. Only files older than GC_MIN_AGE are collected. Directories are scanned with GC_THREADS threads.
+ * Versions that were never fetched are kept as they are. Returns NULL if a version or its asset index couldn't be read.
+ * Free with microlauncher_gc_plan_free */
+GcPlan *microlauncher_gc_scan(LaunchContext *ctx, const char *const *versions, struct GcReport *report);
+
+/* Removes the paths of plan, skipping those changed since the scan or whose download lock is held, and sets freed */
+void microlauncher_gc_remove(LaunchContext *ctx, GcPlan *plan, GcFunc func, void *userdata, struct GcReport *report);
+
+void microlauncher_gc_plan_free(GcPlan *plan);
+
+/* Scans and, without dry_run, removes. Returns false without removing anything if the scan failed */
+bool microlauncher_gc_run(LaunchContext *ctx, const char *const *versions, bool dry_run, GcFunc func, void *userdata, struct GcReport *report);
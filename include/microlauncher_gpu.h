@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+
+/* gpu_id which lets the launcher pick the device */
+#define GPU_AUTO "auto"
+
+struct GpuChoice {
+	/* DRI_PRIME device id such as pci-0000_01_00_0 */
+	char *id;
+	char *driver;
+	/* Human readable explanation */
+	char *reason;
+};
+
+/* Picks the best render device from /sys/class/drm, result is cached in cache_path until GPUs change.
+ * Returns false if the default device is already the best one */
+bool microlauncher_gpu_auto_select(const char *cache_path, struct GpuChoice *choice);
+
+void microlauncher_gpu_choice_clear(struct GpuChoice *choice);
@@ -1,3 +1,10 @@
 #pragma once
 
-int microlauncher_gui_show(void);
\ No newline at end of file
+#include <stdbool.h>
+
+int microlauncher_gui_show(void);
+
+void microlauncher_bench_spawn(void);
+
+/* Returns true if --bench-startup was given, the launcher exits after printing */
+bool microlauncher_bench_startup(void);
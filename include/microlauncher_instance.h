@@ -11,6 +11,12 @@ struct _MicrolauncherInstance {
 	char *version;
 	char *icon;
 	char *javaLocation;
+	char *tuning;
+	char *cpuAffinity;
+	char *ioPriority;
+	int nice;
+	int memoryHigh;
+	int cpuWeight;
 	GSList *extraGameArgs;
 	GSList *jvmArgs;
 	GSList *prefixCommand;
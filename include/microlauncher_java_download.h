@@ -0,0 +1,21 @@
+#pragma once
+
+#include <gio/gio.h>
+#include <microlauncher_types.h>
+
+#define JAVA_RUNTIME_MANIFEST "https://launchermeta.mojang.com/v1/products/java-runtime/2ec0cc96c44e5a76b9c8b7c39df7210883d12871/all.json"
+#ifndef JAVA_MANIFEST_URL
+#define JAVA_MANIFEST_URL JAVA_RUNTIME_MANIFEST
+#endif
+
+#ifdef G_OS_WIN32
+#define JAVA_RUNTIME_EXECUTABLE "bin/java.exe"
+#elif defined(__APPLE__)
+#define JAVA_RUNTIME_EXECUTABLE "jre.bundle/Contents/Home/bin/java"
+#else
+#define JAVA_RUNTIME_EXECUTABLE "bin/java"
+#endif
+
+const char *java_runtime_get_platform(void);
+
+char *microlauncher_java_runtime_install(const char *component, const char *runtime_dir, struct Callbacks callbacks, GCancellable *cancellable, char *failedResource);
@@ -10,6 +10,10 @@ struct _JavaRuntime {
 	GObject parent_instance;
 	char *version;
 	char *location;
+	char *vm;
+	/* Launch threads read version and vm at the same time, java -version runs once */
+	GMutex probe_lock;
+	gboolean probed;
 };
 
 G_DECLARE_FINAL_TYPE(JavaRuntime, microlauncher_java_runtime, MICROLAUNCHER, JAVA_RUNTIME, GObject);
@@ -18,4 +22,6 @@ JavaRuntime *microlauncher_java_runtime_new(const char *location);
 
 int java_get_major_version(JavaRuntime *runtime);
 
+const char *java_get_vm_name(JavaRuntime *runtime);
+
 G_END_DECLS
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <curl/curl.h>
+#include <gio/gio.h>
+#include <microlauncher_account.h>
+#include <microlauncher_download.h>
+#include <microlauncher_instance.h>
+#include <microlauncher_supervisor.h>
+#include <microlauncher_types.h>
+#include <stdbool.h>
+
+struct Settings;
+
+/* State of a single launch. Several launches may run at once, each on its own thread */
+typedef struct _LaunchContext LaunchContext;
+
+LaunchContext *microlauncher_launch_context_new(MicrolauncherInstance *instance, MicrolauncherAccount *user, struct Callbacks callbacks);
+
+MicrolauncherInstance *microlauncher_launch_context_get_instance(LaunchContext *ctx);
+
+MicrolauncherAccount *microlauncher_launch_context_get_user(LaunchContext *ctx);
+
+/* Snapshot of settings at the time launch was requested */
+const struct Settings *microlauncher_launch_context_get_settings(LaunchContext *ctx);
+
+struct Callbacks microlauncher_launch_context_get_callbacks(LaunchContext *ctx);
+
+GCancellable *microlauncher_launch_context_get_cancellable(LaunchContext *ctx);
+
+/* Connection, DNS and TLS session cache shared by all transfers of this launch */
+CURLSH *microlauncher_launch_context_get_share(LaunchContext *ctx);
+
+/* Uses share instead of the context's own, it must outlive the context */
+void microlauncher_launch_context_set_share(LaunchContext *ctx, CURLSH *share);
+
+/* Mode of queues for game files, metadata is always fetched. Defaults to DOWNLOAD_MODE_FETCH */
+void microlauncher_launch_context_set_download_mode(LaunchContext *ctx, enum DownloadMode mode);
+
+enum DownloadMode microlauncher_launch_context_get_download_mode(LaunchContext *ctx);
+
+/* Queues of a background context are throttled, see microlauncher_download_queue_set_background */
+void microlauncher_launch_context_set_background(LaunchContext *ctx, bool background);
+
+bool microlauncher_launch_context_get_background(LaunchContext *ctx);
+
+void microlauncher_launch_context_add_stats(LaunchContext *ctx, const struct DownloadStats *stats);
+
+/* Totals of all game file queues run for this context */
+struct DownloadStats microlauncher_launch_context_get_stats(LaunchContext *ctx);
+
+/* Supervises spawned game, func is called from default main context after it exits */
+void microlauncher_launch_context_watch(LaunchContext *ctx, GPid pid, ChildExitFunc func, void *userdata);
+
+/* 0 if game isn't running */
+GPid microlauncher_launch_context_get_pid(LaunchContext *ctx);
+
+/* Cancels preparation or terminates the game if it is already running.
+ * Must be called from default main context */
+void microlauncher_launch_context_cancel(LaunchContext *ctx);
+
+void microlauncher_launch_context_free(LaunchContext *ctx);
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <gmodule.h>
+#include <gtk/gtk.h>
+
+/* WebKit is only linked into the module, which is loaded when the browser is first opened */
+#define MOD_BROWSER_SYMBOL "microlauncher_mod_browser_show"
+
+typedef void (*ModBrowserShowFunc)(GtkWindow *parent);
+
+G_MODULE_EXPORT void microlauncher_mod_browser_show(GtkWindow *parent);
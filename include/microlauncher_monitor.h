@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glib.h>
+
+#define MONITOR_DEFAULT_INTERVAL 1000
+/* Sessions kept per instance */
+#define MONITOR_HISTORY_MAX 50
+
+/* Totals for the game process and its descendants */
+struct ProcessSample {
+	/* Percent of one core */
+	double cpu;
+	guint64 rss;
+	guint64 swap;
+	int threads;
+	int processes;
+	/* Bytes per second hitting storage */
+	double read_rate;
+	double write_rate;
+};
+
+struct SessionSummary {
+	/* Unix time */
+	gint64 start;
+	/* Seconds */
+	gint64 length;
+	guint64 peak_rss;
+	guint64 peak_swap;
+	double avg_cpu;
+};
+
+typedef struct _ProcessMonitor ProcessMonitor;
+
+typedef void (*MonitorFunc)(const struct ProcessSample *sample, void *userdata);
+
+/* Samples pid and its descendants every interval_ms from default main context.
+ * Returns NULL where /proc isn't available */
+ProcessMonitor *microlauncher_monitor_new(GPid pid, guint interval_ms, MonitorFunc func, void *userdata);
+
+/* Stops sampling and appends the session to history_path unless it's NULL */
+void microlauncher_monitor_free(ProcessMonitor *monitor, const char *history_path);
+
+char *microlauncher_monitor_history_path(const char *launcher_root, const char *game_dir);
+
+/* Fills sessions with up to count most recent sessions, newest first */
+int microlauncher_monitor_load_history(const char *history_path, struct SessionSummary *sessions, int count);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <gio/gio.h>
+#include <stdbool.h>
+
+#define PEER_DEFAULT_PORT 25590
+/* mDNS service type, peers are discovered with it when built with Avahi */
+#define PEER_SERVICE_TYPE "_microlauncher._tcp"
+#define PEER_SERVER_THREADS 8
+/* Seconds, peers are only worth it when they answer quickly */
+#define PEER_CONNECT_TIMEOUT 2
+/* Transfers from a peer slower than PEER_LOW_SPEED_LIMIT bytes per second for PEER_LOW_SPEED_TIME seconds are aborted */
+#define PEER_LOW_SPEED_LIMIT 65536
+#define PEER_LOW_SPEED_TIME 5
+
+typedef struct _PeerServer PeerServer;
+
+/* Serves versions, libraries and assets of launcher_root read-only over HTTP, port 0 uses PEER_DEFAULT_PORT.
+ * Runs in the thread default main context, announced via mDNS when available */
+PeerServer *microlauncher_peer_server_new(const char *launcher_root, guint16 port, GError **error);
+
+void microlauncher_peer_server_free(PeerServer *server);
+
+/* Downloads try peers from configured, a comma separated list of base URLs, and those found via mDNS.
+ * Calling again replaces the configured list */
+void microlauncher_peer_discovery_start(const char *configured);
+
+void microlauncher_peer_discovery_stop(void);
+
+/* Base URLs of known peers, NULL if there are none. Free with g_strfreev */
+char **microlauncher_peer_get_urls(void);
+
+/* True for paths relative to the launcher root that are served to peers */
+bool microlauncher_peer_path_served(const char *relative);
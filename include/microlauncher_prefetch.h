@@ -0,0 +1,17 @@
+#pragma once
+
+#include <glib.h>
+
+typedef struct _Prefetch Prefetch;
+
+Prefetch *microlauncher_prefetch_new(const char *prefetch_dir, const char *game_dir);
+
+void microlauncher_prefetch_add(Prefetch *prefetch, const char *path);
+
+void microlauncher_prefetch_add_classpath(Prefetch *prefetch, const char *classpath);
+
+void microlauncher_prefetch_start(Prefetch *prefetch);
+
+void microlauncher_prefetch_record(Prefetch *prefetch, GPid pid);
+
+void microlauncher_prefetch_free(Prefetch *prefetch);
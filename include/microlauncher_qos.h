@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glib.h>
+#include <util/util.h>
+
+enum IoPriority {
+	IO_PRIORITY_DEFAULT,
+	IO_PRIORITY_LOW,
+	IO_PRIORITY_IDLE,
+	IO_PRIORITY_N
+};
+
+/* Names stored in instances.json */
+extern const char *const IO_PRIORITY_NAMES[IO_PRIORITY_N];
+/* NULL terminated, for GUI */
+extern const char *const IO_PRIORITY_LABELS[IO_PRIORITY_N + 1];
+
+enum IoPriority io_priority_from_name(const char *name);
+
+struct QosSettings {
+	/* CPU list such as "0-7,16", NULL for all CPUs */
+	const char *cpu_affinity;
+	/* 0-19 */
+	int nice;
+	enum IoPriority io_priority;
+	/* MiB, 0 for no limit */
+	int memory_high;
+	/* 1-10000, 0 for default */
+	int cpu_weight;
+};
+
+/* Spawns argv with CPU affinity, nice and I/O priority of qos applied before exec */
+GPid microlauncher_qos_spawn(const struct QosSettings *qos, char *const *argv, const struct SpawnOptions *opts);
+
+/* Creates a cgroup v2 next to the launcher's own with memory.high and cpu.weight set, for cgroup of SpawnOptions.
+ * Returns path of the cgroup or NULL if no limits are set or the hierarchy isn't writable */
+char *microlauncher_qos_cgroup_new(const struct QosSettings *qos);
+
+/* Moves pid to the cgroup at path in case the kernel couldn't start it there.
+ * Processes it started before are left behind */
+void microlauncher_qos_cgroup_attach(const char *path, GPid pid);
+
+void microlauncher_qos_cgroup_remove(const char *path);
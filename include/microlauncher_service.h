@@ -0,0 +1,23 @@
+#pragma once
+
+#include <gio/gio.h>
+#include <stdbool.h>
+
+#define SERVICE_NAME "io.github.lassebq.microlauncher.Service"
+#define SERVICE_PATH "/io/github/lassebq/microlauncher/Service"
+#define SERVICE_INTERFACE SERVICE_NAME
+#define SERVICE_ERROR_FAILED SERVICE_INTERFACE ".Error.Failed"
+
+/* Owns SERVICE_NAME on the session bus and launches instances for clients.
+ * Manifest, verified files, tokens and connections are kept between launches.
+ * Config changed by other processes is reloaded once no launch is being prepared.
+ * Returns exit code */
+int microlauncher_service_run(void);
+
+/* Launches instance through the service, user NULL for the saved one.
+ * Returns false without setting error when no service is running or activatable */
+bool microlauncher_service_launch(const char *instance, const char *user, GError **error);
+
+/* Installs or removes the D-Bus activation file of the service for the user.
+ * Returns false if it couldn't be written */
+bool microlauncher_service_set_activatable(bool activatable);
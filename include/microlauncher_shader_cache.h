@@ -0,0 +1,23 @@
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+
+/* MiB shared by shader caches of all instances */
+#define SHADER_CACHE_DEFAULT_BUDGET 4096
+/* Caches are walked at most this often, launches in between don't trim */
+#define SHADER_CACHE_TRIM_INTERVAL (6 * G_TIME_SPAN_HOUR)
+
+/* Cache directory of an instance on a GPU, gpu_id may be NULL for the default device */
+char *microlauncher_shader_cache_dir(const char *launcher_root, const char *game_dir, const char *gpu_id);
+
+/* Points Mesa and NVIDIA disk caches to cache_dir unless already set in envp, marks it as used */
+char **microlauncher_shader_cache_setenv(char **envp, const char *cache_dir, int budget);
+
+/* Bytes used on disk */
+guint64 microlauncher_shader_cache_size(const char *path);
+
+/* Removes least recently used caches until all fit in budget MiB. keep and caches of running games are never removed.
+ * Returns false without walking the caches if they were trimmed less than SHADER_CACHE_TRIM_INTERVAL ago,
+ * otherwise sets total to bytes left in use */
+bool microlauncher_shader_cache_trim(const char *launcher_root, int budget, const char *keep, guint64 *total);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <microlauncher_instance.h>
+#include <microlauncher_launch.h>
+#include <stdbool.h>
+
+/* Appended to the instance directory, snapshots live next to it so they can share extents and inodes with it */
+#define SNAPSHOT_DIR_SUFFIX ".snapshots"
+#define SNAPSHOT_THREADS 4
+
+/* Instance directories are cloned file by file with SNAPSHOT_THREADS threads. Jars and zips (mods, resource packs,
+ * shader packs) are hardlinked since they are replaced rather than changed, everything else is reflinked where
+ * the filesystem supports it and copied otherwise. Stats of ctx count hardlinked files as present, others as fetched */
+
+/* Copy of the instance of ctx with its directory cloned next to the original one.
+ * Returns the copy, it isn't added to instances. NULL on failure */
+MicrolauncherInstance *microlauncher_snapshot_duplicate(LaunchContext *ctx);
+
+/* Clones the instance directory of ctx into a snapshot called name, current date and time when NULL.
+ * Returns the name of the snapshot, NULL on failure. Free with free */
+char *microlauncher_snapshot_create(LaunchContext *ctx, const char *name);
+
+/* Names of snapshots of instance, oldest first. Free with g_strfreev */
+char **microlauncher_snapshot_list(MicrolauncherInstance *instance);
+
+/* Replaces the instance directory of ctx with a clone of the snapshot, which is kept.
+ * The instance must not be running */
+bool microlauncher_snapshot_restore(LaunchContext *ctx, const char *name);
+
+bool microlauncher_snapshot_delete(LaunchContext *ctx, const char *name);
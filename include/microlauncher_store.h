@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdbool.h>
+
+/* Below XDG_DATA_HOME, shared by every launcher root */
+#define STORE_DIR "microlauncher/store"
+
+/* Directory of the store, free with free */
+char *microlauncher_store_get_dir(void);
+
+/* Location of the object with sha1 in the store, free with free */
+char *microlauncher_store_object_path(const char *sha1);
+
+/* Creates dest from the stored object with sha1 as a hardlink, reflink or copy.
+ * Returns false if the store doesn't have the object */
+bool microlauncher_store_materialize(const char *sha1, const char *dest);
+
+/* Adds a file which matches sha1 to the store unless it is there already */
+void microlauncher_store_add(const char *path, const char *sha1);
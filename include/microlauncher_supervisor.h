@@ -0,0 +1,20 @@
+#pragma once
+
+#include <glib.h>
+#include <microlauncher_types.h>
+
+/* Seconds to wait after SIGTERM before killing */
+#define SUPERVISOR_TERM_TIMEOUT 10
+
+typedef struct _ChildWatch ChildWatch;
+
+typedef void (*ChildExitFunc)(GPid pid, const struct ExitStatus *status, void *userdata);
+
+/* func is called from default main context once child is reaped, watch is freed after it returns */
+ChildWatch *microlauncher_supervisor_watch(GPid pid, ChildExitFunc func, void *userdata);
+
+GPid microlauncher_supervisor_get_pid(ChildWatch *watch);
+
+/* Asks child to exit and kills it after SUPERVISOR_TERM_TIMEOUT, or right away if called again.
+ * Must be called from default main context */
+void microlauncher_supervisor_terminate(ChildWatch *watch);
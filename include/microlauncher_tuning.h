@@ -0,0 +1,23 @@
+#pragma once
+
+#include <glib.h>
+
+enum TuningProfile {
+	TUNING_OFF,
+	TUNING_BALANCED,
+	TUNING_LOW_LATENCY,
+	TUNING_LOW_MEMORY,
+	TUNING_N
+};
+
+/* For new instances. Instances saved without a profile keep running untuned */
+#define TUNING_DEFAULT TUNING_BALANCED
+
+/* Names stored in instances.json */
+extern const char *const TUNING_PROFILE_NAMES[TUNING_N];
+/* NULL terminated, for GUI */
+extern const char *const TUNING_PROFILE_LABELS[TUNING_N + 1];
+
+enum TuningProfile tuning_profile_from_name(const char *name);
+
+int microlauncher_tuning_get_args(enum TuningProfile profile, int javaMajor, const char *vmName, const char *gameDir, GSList *userArgs, char **argv, char **str_to_free);
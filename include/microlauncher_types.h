@@ -1,12 +1,27 @@
 #pragma once
 #include <gio/gio.h>
+#include <stdbool.h>
+
+struct ExitStatus {
+	/* false if killed by signal */
+	bool exited;
+	int code;
+	int signal;
+	bool core_dumped;
+};
+
+struct ProcessSample;
 
 struct Callbacks {
 	void (*instance_started)(GPid pid, void *userdata);
-	void (*instance_finished)(void *userdata);
+	void (*instance_finished)(const struct ExitStatus *status, void *userdata);
 	void (*progress_update)(double precentage, const char *progress_msg, void *userdata);
 	void (*stage_update)(const char *progress_msg, void *userdata);
 	void (*show_error)(const char *error_message, void *userdata);
+	/* Called from default main context while the game runs */
+	void (*process_sample)(const struct ProcessSample *sample, void *userdata);
+	/* Called once a download queue finished for each file it fetched, or found missing or corrupt when only verifying */
+	void (*file_update)(const char *path, const char *url, long size, void *userdata);
 	void *userdata;
 };
 
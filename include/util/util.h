@@ -87,6 +87,9 @@ void get_sha1(FILE *fd, char *hash);
 
 bool str_ends_with(const char *str, const char *suffix);
 
+/* True if path is dir or inside of it, "/a/bc" isn't inside of "/a/b". False for an empty dir */
+bool path_is_under(const char *path, const char *dir);
+
 void replace_chr(char *src, char replace, char replacement);
 
 void replace_str(String *src, const char *replace, const char *replacement);
@@ -103,11 +106,47 @@ char *random_uuid(void);
 
 void extract_zip(const char *sourcepath, const char *destpath, const char **exclusions);
 
+bool util_copy_file(const char *src, const char *dest);
+
+/* Reflinks src to dest where the filesystem supports it, copies otherwise */
+bool util_clone_file(const char *src, const char *dest);
+
+/* Hardlinks src to dest, falls back to util_clone_file across filesystems */
+bool util_link_or_copy(const char *src, const char *dest);
+
+/* Blocks until the exclusive lock at lock_path is held by this process, creating the file.
+ * Returns -1 where locking isn't possible, callers go on without it */
+int util_lock_path(const char *lock_path);
+
+/* Like util_lock_path without waiting. Returns false if another holder has the lock,
+ * fd is -1 where locking isn't possible */
+bool util_try_lock_path(const char *lock_path, int *fd);
+
+/* Removes the lock file, waiters then lock a new one */
+void util_unlock_path(int fd, const char *lock_path);
+
 char *get_escaped_command(char *const *cmdline);
 
 char **get_commandv(char *cmdline);
 
-GPid util_fork_execv(const char *dir, char *const *argv, mode_t umask);
+struct SpawnOptions {
+	/* Working directory, NULL to inherit */
+	const char *dir;
+	/* Environment, NULL to inherit */
+	char *const *envp;
+	/* -1 to inherit */
+	int umask;
+	/* Descriptors inherited besides stdio, terminated by -1. Everything else is closed */
+	const int *keep_fds;
+	/* Redirects for stdout and stderr, -1 to inherit */
+	int stdout_fd;
+	int stderr_fd;
+	/* Directory of a cgroup v2 the child starts in, NULL to inherit. Ignored where the kernel can't do that */
+	const char *cgroup;
+};
+
+/* Returns 0 on failure */
+GPid util_spawn(char *const *argv, const struct SpawnOptions *opts);
 
 char *util_str_execv(const char *dir, char *const *argv);
 
@@ -115,6 +154,8 @@ bool util_waitpid(GPid pid, int *status);
 
 bool util_kill_process(GPid pid);
 
+guint64 util_get_total_memory(void);
+
 #define offset_apply(pointer, offs) ((void *)((char *)pointer + offs))
 
 #ifdef _WIN32
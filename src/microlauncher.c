@@ -1,8 +1,7 @@
-#include "gdk/gdk.h"
 #include "glib/gstdio.h"
-#include "gtk/gtk.h"
 #include "microlauncher_java_runtime.h"
 #include <ctype.h>
+#include <errno.h>
 #include <curl/curl.h>
 #include <curl/easy.h>
 #include <gio/gio.h>
@@ -11,9 +10,24 @@
 #include <json.h>
 #include <json_object.h>
 #include <json_types.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 #include <microlauncher.h>
-#include <microlauncher_gui.h>
+#include <microlauncher_assets.h>
+#include <microlauncher_cds.h>
+#include <microlauncher_download.h>
+#include <microlauncher_gc.h>
+#include <microlauncher_gpu.h>
+#include <microlauncher_java_download.h>
+#include <microlauncher_monitor.h>
 #include <microlauncher_msa.h>
+#include <microlauncher_peer.h>
+#include <microlauncher_prefetch.h>
+#include <microlauncher_qos.h>
+#include <microlauncher_shader_cache.h>
+#include <microlauncher_supervisor.h>
+#include <microlauncher_tuning.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -36,14 +50,14 @@
 static GSList *instances;
 static GSList *accounts;
 
-static CURL *globalCurlHandle;
 static GHashTable *manifest;
 static struct Settings settings = {0};
 char *EXEC_BINARY;
 
-static char *active_instance = NULL;
-static char *active_user = NULL;
-static bool use_saved_user = false;
+static gint supervise_pid = 0;
+static char *supervise_natives = NULL;
+static char *supervise_cds_dump = NULL;
+static char *supervise_cgroup = NULL;
 
 #ifdef G_OS_WIN32
 const char *JVM_LOCATIONS[] = {"C:/Program Files/Java/*/bin/java.exe", NULL};
@@ -56,11 +70,13 @@ const char *JVM_LOCATIONS[] = {
 const char *JVM_LOCATIONS[] = {"/Library/Java/JavaVirtualMachines/*/Contents/Home/bin/java", NULL};
 #endif
 
-static GOptionEntry entries[] =
+/* Used by the launcher when it execs into a supervisor after starting the game */
+static GOptionEntry supervise_entries[] =
 	{
-		{"instance", 'i', 0, G_OPTION_ARG_STRING, &active_instance, "Instance to launch", NULL},
-		{"user", 'u', 0, G_OPTION_ARG_STRING, &active_user, "Saved user GUID to authenticate as", NULL},
-		{"saved-user", 0, 0, G_OPTION_ARG_NONE, &use_saved_user, "Use saved user instead of explicitly specifying user", NULL},
+		{"supervise", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_INT, &supervise_pid, "Wait for game process and clean up after it", "PID"},
+		{"natives", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_FILENAME, &supervise_natives, "Natives directory to remove", "DIR"},
+		{"cds-dump", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_FILENAME, &supervise_cds_dump, "Class data sharing archive to commit", "PATH"},
+		{"cgroup", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_FILENAME, &supervise_cgroup, "cgroup to remove", "PATH"},
 		G_OPTION_ENTRY_NULL};
 
 struct Callbacks callbacks;
@@ -78,6 +94,15 @@ MicrolauncherInstance *microlauncher_instance_get(GSList *list, const char *id)
 	return NULL;
 }
 
+char *microlauncher_instance_unique_name(const char *name) {
+	char *unique = g_strdup(name);
+	for(int i = 2; microlauncher_instance_get(instances, unique); i++) {
+		free(unique);
+		unique = g_strdup_printf("%s (%d)", name, i);
+	}
+	return unique;
+}
+
 MicrolauncherAccount *microlauncher_account_get(GSList *list, const char *id) {
 	MicrolauncherAccount *usr;
 	GSList *node = list;
@@ -107,6 +132,46 @@ static json_object *save_list(GSList *list, json_object *(*func)(void *element))
 	return arr;
 }
 
+/* NULL if arr isn't an array */
+static char **load_strv(json_object *arr) {
+	if(!json_object_is_type(arr, json_type_array)) {
+		return NULL;
+	}
+	size_t n = json_object_array_length(arr);
+	char **strv = g_new0(char *, n + 1);
+	for(size_t i = 0; i < n; i++) {
+		strv[i] = g_strdup(json_object_get_string(json_object_array_get_idx(arr, i)));
+	}
+	return strv;
+}
+
+/* Frees strv and returns its non-empty strings, NULL if there are none */
+static char **drop_empty(char **strv) {
+	GPtrArray *arr = g_ptr_array_new();
+	for(char **str = strv; str && *str; str++) {
+		if(**str) {
+			g_ptr_array_add(arr, *str);
+		} else {
+			free(*str);
+		}
+	}
+	free(strv);
+	if(arr->len == 0) {
+		g_ptr_array_free(arr, TRUE);
+		return NULL;
+	}
+	g_ptr_array_add(arr, NULL);
+	return (char **)g_ptr_array_free(arr, FALSE);
+}
+
+static json_object *save_strv(char **strv) {
+	json_object *arr = json_object_new_array();
+	for(char **str = strv; str && *str; str++) {
+		json_object_array_add(arr, json_object_new_string(*str));
+	}
+	return arr;
+}
+
 void *add_string_val(json_object *obj) {
 	return g_strdup(json_object_get_string(obj));
 }
@@ -176,6 +241,12 @@ void microlauncher_load_instance(json_object *obj, MicrolauncherInstance *instan
 	instance->location = g_strdup(json_get_string(obj, "location"));
 	instance->version = g_strdup(json_get_string(obj, "version"));
 	instance->icon = g_strdup(json_get_string(obj, "icon"));
+	instance->tuning = g_strdup(json_get_string(obj, "tuning"));
+	instance->cpuAffinity = g_strdup(json_get_string(obj, "cpuAffinity"));
+	instance->ioPriority = g_strdup(json_get_string(obj, "ioPriority"));
+	instance->nice = json_get_int(obj, "nice");
+	instance->memoryHigh = json_get_int(obj, "memoryHigh");
+	instance->cpuWeight = json_get_int(obj, "cpuWeight");
 	load_list(json_object_object_get(obj, "gameArgs"), &instance->extraGameArgs, add_string_val);
 	load_list(json_object_object_get(obj, "jvmArgs"), &instance->jvmArgs, add_string_val);
 	load_list(json_object_object_get(obj, "prefixCommand"), &instance->prefixCommand, add_string_val);
@@ -187,11 +258,55 @@ void microlauncher_save_instance(json_object *obj, MicrolauncherInstance *instan
 	json_set_string(obj, "location", instance->location);
 	json_set_string(obj, "version", instance->version);
 	json_set_string(obj, "icon", instance->icon);
+	json_set_string(obj, "tuning", instance->tuning);
+	json_set_string(obj, "cpuAffinity", instance->cpuAffinity);
+	json_set_string(obj, "ioPriority", instance->ioPriority);
+	json_set_int(obj, "nice", instance->nice);
+	json_set_int(obj, "memoryHigh", instance->memoryHigh);
+	json_set_int(obj, "cpuWeight", instance->cpuWeight);
 	json_object_object_add(obj, "gameArgs", save_list(instance->extraGameArgs, put_string_obj));
 	json_object_object_add(obj, "jvmArgs", save_list(instance->jvmArgs, put_string_obj));
 	json_object_object_add(obj, "prefixCommand", save_list(instance->prefixCommand, put_string_obj));
 }
 
+/* Checksums of config files as this process last read or wrote them, tells its own writes from others' */
+static GHashTable *configSums;
+G_LOCK_DEFINE_STATIC(config);
+
+static char *file_checksum(const char *path) {
+	char *contents;
+	gsize len;
+	if(!g_file_get_contents(path, &contents, &len, NULL)) {
+		return NULL;
+	}
+	char *sum = g_compute_checksum_for_data(G_CHECKSUM_SHA1, (const guchar *)contents, len);
+	free(contents);
+	return sum;
+}
+
+static void remember_config(const char *path) {
+	char *sum = file_checksum(path);
+	G_LOCK(config);
+	if(!configSums) {
+		configSums = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	}
+	if(sum) {
+		g_hash_table_replace(configSums, g_strdup(path), sum);
+	} else {
+		g_hash_table_remove(configSums, path);
+	}
+	G_UNLOCK(config);
+}
+
+bool microlauncher_config_is_current(const char *path) {
+	char *sum = file_checksum(path);
+	G_LOCK(config);
+	bool current = configSums && strequal(sum, g_hash_table_lookup(configSums, path));
+	G_UNLOCK(config);
+	free(sum);
+	return current;
+}
+
 bool microlauncher_init_config(void) {
 	char pathbuf[PATH_MAX];
 	snprintf(pathbuf, PATH_MAX, "%s/microlauncher/instances.json", XDG_DATA_HOME);
@@ -200,6 +315,7 @@ bool microlauncher_init_config(void) {
 	accounts = NULL;
 
 	arr = json_from_file(pathbuf);
+	remember_config(pathbuf);
 
 	if(arr && json_object_is_type(arr, json_type_array)) {
 		size_t length = json_object_array_length(arr);
@@ -215,6 +331,7 @@ bool microlauncher_init_config(void) {
 
 	snprintf(pathbuf, PATH_MAX, "%s/microlauncher/accounts.json", XDG_DATA_HOME);
 	arr = json_from_file(pathbuf);
+	remember_config(pathbuf);
 	if(arr && json_object_is_type(arr, json_type_array)) {
 		size_t length = json_object_array_length(arr);
 
@@ -251,49 +368,67 @@ void microlauncher_version_destroy(void *p) {
 	free(ver);
 }
 
-bool microlauncher_init(int argc, char **argv) {
-	char path[PATH_MAX];
+bool microlauncher_init(const char *argv0) {
 	if(!xdgutil_init()) {
 		fprintf(stderr, "Failed to initialize environment\n");
 		return false;
 	}
 	enum Platform plat = platform_get();
 	g_print("OS name: %s, arch: %s\n", platform_get_name(plat), platform_get_arch(plat));
-	globalCurlHandle = curl_easy_init();
-	if(!globalCurlHandle) {
+	// Handles are created from several threads later, which is only safe after global init
+	if(curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) {
 		fprintf(stderr, "Can't initialize curl\n"); // Non fatal
 	}
-	GFile *file = g_file_new_for_path(argv[0]);
+	GFile *file = g_file_new_for_path(argv0);
 	if(file && g_file_query_exists(file, NULL)) {
 		EXEC_BINARY = g_file_get_path(file);
 	} else {
-		EXEC_BINARY = argv[0];
+		EXEC_BINARY = g_strdup(argv0);
 	}
-	GOptionContext *context;
-	context = g_option_context_new("");
-	g_option_context_add_main_entries(context, entries, NULL);
-	g_option_context_parse(context, &argc, &argv, NULL);
+	g_object_unref(file);
 
 	if(!microlauncher_init_config()) {
-		fprintf(stdout, "No config, using fresh config\n");
+		g_print("No config, using fresh config\n");
 	}
-	const char *manifest_url = MANIFEST_URL;
-	json_object *manifestJson = microlauncher_http_get_json(manifest_url, NULL, NULL);
-	manifest = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, microlauncher_version_destroy);
+	// Lets two launcher roots on one machine be tested against each other
+	const char *peers = getenv("MICROLAUNCHER_PEERS");
+	if(peers || settings.lanCache) {
+		microlauncher_peer_discovery_start(peers ? peers : settings.peers);
+	}
+	return true;
+}
 
-	snprintf(path, PATH_MAX, "%s/versions", settings.launcher_root);
+static void scan_versions(GHashTable *table, const char *root) {
+	char path[PATH_MAX];
+	snprintf(path, PATH_MAX, "%s/versions", root);
 	GDir *dir = g_dir_open(path, 0, NULL);
 	const char *filename;
 	while(dir && (filename = g_dir_read_name(dir))) {
-		snprintf(path, PATH_MAX, "%s/versions/%s/%s.json", settings.launcher_root, filename, filename);
+		snprintf(path, PATH_MAX, "%s/versions/%s/%s.json", root, filename, filename);
 		if(access(path, F_OK) == 0) {
 			json_object *obj = json_from_file(path);
 			if(obj) {
 				struct Version *ver = microlauncher_version_new(json_get_string(obj, "id"), json_get_string(obj, "type"), json_get_string(obj, "releaseTime"), NULL, NULL);
-				g_hash_table_replace(manifest, ver->id, ver);
+				g_hash_table_replace(table, ver->id, ver);
+				json_object_put(obj);
 			}
 		}
 	}
+	if(dir) {
+		g_dir_close(dir);
+	}
+}
+
+static GHashTable *load_manifest(void) {
+	const char *manifest_url = MANIFEST_URL;
+	json_object *manifestJson = microlauncher_http_get_json(manifest_url, NULL, NULL);
+	GHashTable *table = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, microlauncher_version_destroy);
+
+	// Lower roots first so that versions of the launcher root replace them
+	for(char **root = settings.lower_roots; root && *root; root++) {
+		scan_versions(table, *root);
+	}
+	scan_versions(table, settings.launcher_root);
 
 	json_object *versions = json_object_object_get(manifestJson, "versions");
 	if(json_object_is_type(versions, json_type_array)) {
@@ -306,19 +441,36 @@ bool microlauncher_init(int argc, char **argv) {
 				json_get_string(iter, "releaseTime"),
 				json_get_string(iter, "sha1"),
 				json_get_string(iter, "url"));
-			g_hash_table_replace(manifest, ver->id, ver);
+			g_hash_table_replace(table, ver->id, ver);
 		}
 	}
-	return true;
+	json_object_put(manifestJson);
+	return table;
 }
 
+/* Loaded again on first use after microlauncher_release_memory */
+G_LOCK_DEFINE_STATIC(manifest_lock);
+
 GHashTable *microlauncher_get_manifest(void) {
-	return manifest;
+	G_LOCK(manifest_lock);
+	if(!manifest) {
+		manifest = load_manifest();
+	}
+	// Threads still using the table keep it alive when memory is released meanwhile
+	GHashTable *ret = g_hash_table_ref(manifest);
+	G_UNLOCK(manifest_lock);
+	return ret;
 }
 
-size_t write_callback(void *ptr, size_t size, size_t nmemb, void *userdata) {
-	FILE *file = (FILE *)userdata;
-	return fwrite(ptr, size, nmemb, file);
+void microlauncher_release_memory(void) {
+	G_LOCK(manifest_lock);
+	g_clear_pointer(&manifest, g_hash_table_unref);
+	G_UNLOCK(manifest_lock);
+	microlauncher_download_release_cache();
+#ifdef __GLIBC__
+	// Return freed heap to the system instead of keeping it for later allocations
+	malloc_trim(0);
+#endif
 }
 
 void microlauncher_set_curl_opts(CURL *curl) {
@@ -327,36 +479,6 @@ void microlauncher_set_curl_opts(CURL *curl) {
 	curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 20L);
 }
 
-bool microlauncher_http_get_with_handle(CURL *curl, const char *url, const char *save_location) {
-	CURLcode code;
-	if(!curl) {
-		return false;
-	}
-	FILE *file = fopen_mkdir(save_location, "wb");
-	if(!file) {
-		return false;
-	}
-	curl_easy_setopt(curl, CURLOPT_URL, url);
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, file);
-	microlauncher_set_curl_opts(curl);
-	code = curl_easy_perform(curl);
-	fclose(file);
-	if(code == CURLE_OK) {
-		return true;
-	} else {
-		g_print("CURL error (%d) on %s\n", code, url);
-		return false;
-	}
-}
-
-bool microlauncher_http_get(const char *url, const char *save_location) {
-	CURL *curl = curl_easy_init();
-	bool b = microlauncher_http_get_with_handle(curl, url, save_location);
-	curl_easy_cleanup(curl);
-	return b;
-}
-
 size_t write_callback_string(void *ptr, size_t size, size_t nmemb, void *userdata) {
 	String *string = (String *)userdata;
 	string_append_n(string, ptr, size * nmemb);
@@ -428,57 +550,37 @@ char *microlauncher_get_library_path(const char *name, const char *classifier, c
 	return NULL;
 }
 
-bool microlauncher_fetch_artifact(const char *url, const char *path, const char *label, const char *sha1, long size, long total_size, long *download_size) {
-	if(!path) {
-		return false;
-	}
-	if(download_size) {
-		*download_size += size;
-	}
-	if(!label) {
-		label = util_basename(path); /* basepath */
-	}
-	if(total_size > 0) {
-		run_callback(progress_update, (double)(*download_size) / total_size, label);
-	}
-	struct stat st;
-	if(stat(path, &st) != 0) {
-		goto redownload;
-	}
-	if(size != 0 && st.st_size != size) {
-		goto redownload;
-	}
-#ifndef FAST_RESOURCE_CHECK
-	Sha1 hash;
-	FILE *fd = fopen(path, "rb");
-	if(!fd) {
-		goto redownload;
-	}
-	get_sha1(fd, hash);
-	if(sha1 && strcmp(hash, sha1) != 0) {
-		goto redownload;
-	}
-#endif
-	return true; /* everything is fine and we can keep local lib */
+static bool fetch_file(LaunchContext *ctx, const char *url, const char *path, const char *sha1) {
+	const struct Settings *settings = microlauncher_launch_context_get_settings(ctx);
+	DownloadQueue *queue = microlauncher_download_queue_new();
+	microlauncher_download_queue_set_share(queue, microlauncher_launch_context_get_share(ctx));
+	microlauncher_download_queue_set_launcher_root(queue, settings->launcher_root);
+	microlauncher_download_queue_set_lower_roots(queue, settings->lower_roots);
+	microlauncher_download_queue_add(queue, url, path, NULL, sha1, 0, DOWNLOAD_NONE);
+	bool ok = microlauncher_download_queue_run(queue, (struct Callbacks){0}, microlauncher_launch_context_get_cancellable(ctx), NULL);
+	microlauncher_download_queue_free(queue);
+	return ok;
+}
 
-redownload:
-	if(url && strlen(url) > 0) {
-		/* Sharing curl handle has better performance, but doesn't work in multithreaded scenario */
-		if(!microlauncher_http_get_with_handle(globalCurlHandle, url, path)) {
-			return false;
-		}
-	}
-	return true;
+struct NativeJar {
+	char *path;
+	json_object *exclude;
+};
+
+static void native_jar_free(void *data) {
+	struct NativeJar *jar = data;
+	free(jar->path);
+	free(jar);
 }
 
-bool microlauncher_fetch_library(json_object *libObj, const char *libraries_path, const char *natives_path, long total_size, long *download_size, char *failedUrl) {
+static void queue_library(DownloadQueue *queue, json_object *libObj, const char *libraries_path, bool useLocalLib, GSList **nativeJars) {
 	json_object *downloads = json_object_object_get(libObj, "downloads");
 	json_object *artifact = json_object_object_get(downloads, "artifact");
 	json_object *classifiers = json_object_object_get(downloads, "classifiers");
 	json_object *natives = json_object_object_get(libObj, "natives");
 	const char *classifier;
 	enum Platform plat = platform_get();
-	json_object *obj, *iter;
+	json_object *obj;
 
 	const char *name = json_get_string(libObj, "name");
 	const char *url_base = json_get_string(libObj, "url");
@@ -496,21 +598,12 @@ bool microlauncher_fetch_library(json_object *libObj, const char *libraries_path
 		url = url2;
 	}
 
-	if(!settings.useLocalLib || access(realpath, R_OK) != 0) {
-		if(!microlauncher_fetch_artifact(
-			   url,
-			   realpath,
-			   NULL,
-			   json_get_string(artifact, "sha1"),
-			   json_get_int64(artifact, "size"),
-			   total_size, download_size)) {
-			snprintf(failedUrl, PATH_MAX, "%s", url);
-			return false;
-		}
+	if(!useLocalLib || access(realpath, R_OK) != 0) {
+		microlauncher_download_queue_add(queue, url, realpath, NULL, json_get_string(artifact, "sha1"), json_get_int64(artifact, "size"), DOWNLOAD_NONE);
 	}
 
 	if(!natives) {
-		return true;
+		return;
 	}
 	json_object_object_foreach(natives, key, val) {
 		if(!platform_is_valid_alias(plat, key)) {
@@ -520,7 +613,7 @@ bool microlauncher_fetch_library(json_object *libObj, const char *libraries_path
 		if(classifier) {
 			obj = json_object_object_get(classifiers, classifier);
 			if(!obj) {
-				return true;
+				return;
 			}
 			path = json_get_string(obj, "path");
 			url = json_get_string(obj, "url");
@@ -532,32 +625,29 @@ bool microlauncher_fetch_library(json_object *libObj, const char *libraries_path
 				snprintf(url2, PATH_MAX, "%s/%s", url_base, path);
 				url = url2;
 			}
-			if(!microlauncher_fetch_artifact(
-				   url,
-				   realpath,
-				   NULL,
-				   json_get_string(obj, "sha1"),
-				   json_get_int64(obj, "size"),
-				   total_size, download_size)) {
-				snprintf(failedUrl, PATH_MAX, "%s", url);
-				return false;
-			}
+			microlauncher_download_queue_add(queue, url, realpath, NULL, json_get_string(obj, "sha1"), json_get_int64(obj, "size"), DOWNLOAD_NONE);
 
+			// Extracted once everything is downloaded
 			obj = json_object_object_get(libObj, "extract");
 			obj = json_object_object_get(obj, "exclude");
 			if(json_object_is_type(obj, json_type_array)) {
-				size_t n = json_object_array_length(obj);
-				const char *exclusions[n + 1];
-				exclusions[n] = NULL;
-				for(size_t i = 0; i < n; i++) {
-					iter = json_object_array_get_idx(obj, i);
-					exclusions[i] = json_object_get_string(iter);
-				}
-				extract_zip(realpath, natives_path, exclusions);
+				struct NativeJar *jar = g_new(struct NativeJar, 1);
+				jar->path = g_strdup(realpath);
+				jar->exclude = obj;
+				*nativeJars = g_slist_append(*nativeJars, jar);
 			}
 		}
 	}
-	return true;
+}
+
+static void extract_native_jar(struct NativeJar *jar, const char *natives_path) {
+	size_t n = json_object_array_length(jar->exclude);
+	const char *exclusions[n + 1];
+	exclusions[n] = NULL;
+	for(size_t i = 0; i < n; i++) {
+		exclusions[i] = json_object_get_string(json_object_array_get_idx(jar->exclude, i));
+	}
+	extract_zip(jar->path, natives_path, exclusions);
 }
 
 json_object *merge_json_object(json_object *base, json_object *overlay, bool incrementRef, bool append) {
@@ -596,23 +686,33 @@ json_object *merge_json_object(json_object *base, json_object *overlay, bool inc
 	return base;
 }
 
-json_object *inherit_json(const char *versions_path, const char *id, bool allowUpdate) {
+/* Without fetch only JSONs already in versions_path are read */
+static json_object *inherit_json(LaunchContext *ctx, const char *versions_path, const char *id, bool fetch) {
 	char path[PATH_MAX];
 	if(!id) {
 		return NULL;
 	}
 	snprintf(path, PATH_MAX, "%s/%s/%s.json", versions_path, id, id);
-	struct Version *version = g_hash_table_lookup(manifest, id);
-	GFile *file = g_file_new_for_path(path);
-	if(version && (allowUpdate || g_file_query_file_type(file, G_FILE_QUERY_INFO_NONE, NULL) != G_FILE_TYPE_REGULAR)) {
-		microlauncher_fetch_artifact(version->url, path, NULL, version->sha1, 0, 0, NULL);
+	if(fetch) {
+		GHashTable *versions = microlauncher_get_manifest();
+		struct Version *version = g_hash_table_lookup(versions, id);
+		GFile *file = g_file_new_for_path(path);
+		const struct Settings *settings = microlauncher_launch_context_get_settings(ctx);
+		bool missing = g_file_query_file_type(file, G_FILE_QUERY_INFO_NONE, NULL) != G_FILE_TYPE_REGULAR;
+		if(version && (settings->allowUpdate || missing)) {
+			fetch_file(ctx, version->url, path, version->sha1);
+		} else if(missing && settings->lower_roots) {
+			// Versions that aren't in the manifest may still come from a lower root
+			fetch_file(ctx, NULL, path, NULL);
+		}
+		g_hash_table_unref(versions);
+		g_object_unref(file);
 	}
-	g_object_unref(file);
 	json_object *thisObj = json_from_file(path);
 	if(!thisObj) {
 		return NULL;
 	}
-	json_object *obj = inherit_json(versions_path, json_get_string(thisObj, "inheritsFrom"), allowUpdate);
+	json_object *obj = inherit_json(ctx, versions_path, json_get_string(thisObj, "inheritsFrom"), fetch);
 	if(json_object_is_type(obj, json_type_object)) {
 		if(json_get_string(thisObj, "minecraftArguments")) {
 			json_object_object_del(obj, "arguments");
@@ -710,80 +810,40 @@ static bool check_rules(json_object *rules, GSList *featuresList) {
 	return appliedAction == RULE_ACTION_ALLOW;
 }
 
-json_object *microlauncher_fetch_version(const char *versionId, const char *versions_path, const char *libraries_path, const char *natives_path, const char *assets_dir, GCancellable *cancellable, char *failedUrl, bool allowUpdate) {
-	json_object *json, *libraries, *downloads, *artifact, *client, *iter, *assets_json, *obj, *natives;
+static DownloadQueue *new_queue(LaunchContext *ctx) {
+	DownloadQueue *queue = microlauncher_download_queue_new();
+	microlauncher_download_queue_set_share(queue, microlauncher_launch_context_get_share(ctx));
+	microlauncher_download_queue_set_mode(queue, microlauncher_launch_context_get_download_mode(ctx));
+	microlauncher_download_queue_set_background(queue, microlauncher_launch_context_get_background(ctx));
+	microlauncher_download_queue_set_launcher_root(queue, microlauncher_launch_context_get_settings(ctx)->launcher_root);
+	microlauncher_download_queue_set_store(queue, microlauncher_launch_context_get_settings(ctx)->sharedStore);
+	microlauncher_download_queue_set_lower_roots(queue, microlauncher_launch_context_get_settings(ctx)->lower_roots);
+	return queue;
+}
+
+static bool run_queue(LaunchContext *ctx, DownloadQueue *queue, char *failedResource) {
+	bool ok = microlauncher_download_queue_run(queue, microlauncher_launch_context_get_callbacks(ctx), microlauncher_launch_context_get_cancellable(ctx), failedResource);
+	struct DownloadStats stats = microlauncher_download_queue_get_stats(queue);
+	microlauncher_launch_context_add_stats(ctx, &stats);
+	microlauncher_download_queue_free(queue);
+	return ok;
+}
+
+/* Queues client jar, libraries and asset index of a resolved version. Writes asset index location to index_path.
+ * With useLocalLib libraries which are present aren't queued */
+static void queue_version(DownloadQueue *queue, json_object *json, const char *versions_path, const char *libraries_path, const char *assets_dir, bool useLocalLib, GSList **nativeJars, char *index_path) {
+	json_object *libraries, *downloads, *client, *iter, *obj;
 	char path[PATH_MAX];
-	char url[PATH_MAX];
-	snprintf(path, PATH_MAX, "%s/%s/%s.json", versions_path, versionId, versionId);
-	json = inherit_json(versions_path, versionId, allowUpdate);
-	if(!json) {
-		return NULL;
-	}
-	enum Platform plat = platform_get();
-	const char *str = json_get_string(json, "id");
 	libraries = json_object_object_get(json, "libraries");
 	downloads = json_object_object_get(json, "downloads");
 	client = json_object_object_get(downloads, "client");
-	snprintf(path, PATH_MAX, "%s/%s/%s.jar", versions_path, str, str);
-	// Count total size
-	long total_size = json_get_int64(client, "size");
-	long current_size = 0;
-	if(json_object_is_type(libraries, json_type_array)) {
-		size_t length = json_object_array_length(libraries);
 
-		for(size_t i = 0; i < length; i++) {
-			iter = json_object_array_get_idx(libraries, i);
-			if(!check_rules(json_object_object_get(iter, "rules"), NULL)) {
-				continue;
-			}
-			downloads = json_object_object_get(iter, "downloads");
-			artifact = json_object_object_get(downloads, "artifact");
-			if(artifact) {
-				total_size += json_get_int64(artifact, "size");
-			}
-
-			const char *classifier;
-			natives = json_object_object_get(iter, "natives");
-			if(!natives) {
-				continue;
-			}
-			json_object_object_foreach(natives, key, val) {
-				if(!platform_is_valid_alias(plat, key)) {
-					continue;
-				}
-				classifier = json_get_string(natives, key);
-				if(classifier) {
-					obj = json_object_object_get(downloads, "classifiers");
-					obj = json_object_object_get(obj, classifier);
-					if(obj) {
-						total_size += json_get_int64(obj, "size");
-					}
-				}
-			}
-		}
-	}
-	// Perform download
-	run_callback(stage_update, "Downloading libraries");
 	const char *clientJarId = json_get_string(client, "id");
 	if(!clientJarId) {
-		clientJarId = str;
+		clientJarId = json_get_string(json, "id");
 	}
 	snprintf(path, PATH_MAX, "%s/%s/%s.jar", versions_path, clientJarId, clientJarId);
-
-	str = json_get_string(client, "url");
-	if(!microlauncher_fetch_artifact(
-		   str,
-		   path,
-		   NULL,
-		   json_get_string(client, "sha1"),
-		   json_get_int64(client, "size"),
-		   total_size, &current_size)) {
-		snprintf(failedUrl, PATH_MAX, "%s", str);
-		goto cancel;
-	}
-	if(cancellable && g_cancellable_is_cancelled(cancellable)) {
-		goto cancel;
-	}
+	microlauncher_download_queue_add(queue, json_get_string(client, "url"), path, NULL, json_get_string(client, "sha1"), json_get_int64(client, "size"), DOWNLOAD_NONE);
 
 	if(json_object_is_type(libraries, json_type_array)) {
 		size_t length = json_object_array_length(libraries);
@@ -791,47 +851,179 @@ json_object *microlauncher_fetch_version(const char *versionId, const char *vers
 		for(size_t i = 0; i < length; i++) {
 			iter = json_object_array_get_idx(libraries, i);
 			if(check_rules(json_object_object_get(iter, "rules"), NULL)) {
-				if(!microlauncher_fetch_library(iter, libraries_path, natives_path, total_size, &current_size, failedUrl)) {
-					goto cancel;
-				}
-			}
-			if(cancellable && g_cancellable_is_cancelled(cancellable)) {
-				goto cancel;
+				queue_library(queue, iter, libraries_path, useLocalLib, nativeJars);
 			}
 		}
 	}
-	run_callback(stage_update, "Downloading assets");
 	obj = json_object_object_get(json, "assetIndex");
-	snprintf(path, PATH_MAX, "%s/indexes/%s.json", assets_dir, json_get_string(obj, "id"));
-	total_size = json_get_int64(obj, "totalSize") + json_get_int64(obj, "size"); // assets.json + all assets size
-	current_size = 0;
-	microlauncher_fetch_artifact(json_get_string(obj, "url"), path, NULL, json_get_string(obj, "sha1"), json_get_int64(obj, "size"), total_size, &current_size);
-	assets_json = json_from_file(path);
-	obj = json_object_object_get(assets_json, "objects");
+	snprintf(index_path, PATH_MAX, "%s/indexes/%s.json", assets_dir, json_get_string(obj, "id"));
+	microlauncher_download_queue_add(queue, json_get_string(obj, "url"), index_path, NULL, json_get_string(obj, "sha1"), json_get_int64(obj, "size"), DOWNLOAD_METADATA);
+}
+
+/* Returns false if the index couldn't be read */
+static bool queue_assets(DownloadQueue *queue, const char *index_path, const char *assets_dir) {
+	char path[PATH_MAX];
+	char url[PATH_MAX];
+	json_object *assets_json = json_from_file(index_path);
+	if(!assets_json) {
+		return false;
+	}
+	json_object *obj = json_object_object_get(assets_json, "objects");
 	if(json_object_is_type(obj, json_type_object)) {
 		json_object_object_foreach(obj, key, val) {
 			const char *hash = json_get_string(val, "hash");
+			if(!hash || strlen(hash) < 2) {
+				continue;
+			}
 			snprintf(path, PATH_MAX, "%s/objects/%c%c/%s", assets_dir, *hash, *(hash + 1), hash);
 			snprintf(url, PATH_MAX, "https://resources.download.minecraft.net/%c%c/%s", *hash, *(hash + 1), hash);
-			if(!microlauncher_fetch_artifact(url, path, key, hash, json_get_int64(val, "size"), total_size, &current_size)) {
-				snprintf(failedUrl, PATH_MAX, "%s", url);
-				goto cancel;
-			}
-			if(cancellable && g_cancellable_is_cancelled(cancellable)) {
-				goto cancel;
-			}
+			microlauncher_download_queue_add(queue, url, path, key, hash, json_get_int64(val, "size"), DOWNLOAD_NONE);
 		}
 	}
+	json_object_put(assets_json);
+	return true;
+}
+
+json_object *microlauncher_fetch_version(LaunchContext *ctx, const char *versionId, const char *versions_path, const char *libraries_path, const char *natives_path, const char *assets_dir, char *failedResource) {
+	json_object *json;
+	char index_path[PATH_MAX];
+	struct Callbacks callbacks = microlauncher_launch_context_get_callbacks(ctx);
+	GSList *nativeJars = NULL;
+	json = inherit_json(ctx, versions_path, versionId, true);
+	if(!json) {
+		return NULL;
+	}
+
+	// Perform download
+	run_callback(stage_update, "Downloading libraries");
+	DownloadQueue *queue = new_queue(ctx);
+	queue_version(queue, json, versions_path, libraries_path, assets_dir, microlauncher_launch_context_get_settings(ctx)->useLocalLib, &nativeJars, index_path);
+	if(!run_queue(ctx, queue, failedResource)) {
+		goto cancel;
+	}
+	if(natives_path && microlauncher_launch_context_get_download_mode(ctx) == DOWNLOAD_MODE_FETCH) {
+		for(GSList *node = nativeJars; node; node = node->next) {
+			extract_native_jar(node->data, natives_path);
+		}
+	}
+
+	run_callback(stage_update, "Downloading assets");
+	queue = new_queue(ctx);
+	queue_assets(queue, index_path, assets_dir);
+	if(!run_queue(ctx, queue, failedResource)) {
+		goto cancel;
+	}
 
 	// Finished
+	g_slist_free_full(nativeJars, native_jar_free);
 	run_callback(stage_update, NULL);
 	return json;
 cancel:
+	g_slist_free_full(nativeJars, native_jar_free);
 	json_object_put(json);
 	run_callback(stage_update, NULL);
 	return NULL;
 }
 
+bool microlauncher_fetch(LaunchContext *ctx, const char *const *versionIds) {
+	const struct Settings *settings = microlauncher_launch_context_get_settings(ctx);
+	struct Callbacks callbacks = microlauncher_launch_context_get_callbacks(ctx);
+	char versions_dir[PATH_MAX];
+	char libraries_dir[PATH_MAX];
+	char assets_dir[PATH_MAX];
+	char index_path[PATH_MAX];
+	char failedResource[PATH_MAX] = {0};
+	char *str;
+	snprintf(versions_dir, PATH_MAX, "%s/versions", settings->launcher_root);
+	snprintf(libraries_dir, PATH_MAX, "%s/libraries", settings->launcher_root);
+	snprintf(assets_dir, PATH_MAX, "%s/assets", settings->launcher_root);
+	bool ok = true;
+	GSList *nativeJars = NULL;
+	// Versions share most libraries and asset indexes, queues skip paths added before
+	GHashTable *seen = g_hash_table_new(g_str_hash, g_str_equal);
+	GPtrArray *indexes = g_ptr_array_new_with_free_func(free);
+	DownloadQueue *queue = new_queue(ctx);
+	run_callback(stage_update, "Resolving versions");
+	for(const char *const *id = versionIds; *id; id++) {
+		if(!g_hash_table_add(seen, (gpointer)*id)) {
+			continue;
+		}
+		json_object *json = inherit_json(ctx, versions_dir, *id, true);
+		if(!json) {
+			str = g_strdup_printf("Failed to get version JSON of %s", *id);
+			run_callback(show_error, str);
+			free(str);
+			ok = false;
+			continue;
+		}
+		queue_version(queue, json, versions_dir, libraries_dir, assets_dir, settings->useLocalLib, &nativeJars, index_path);
+		if(!g_ptr_array_find_with_equal_func(indexes, index_path, g_str_equal, NULL)) {
+			g_ptr_array_add(indexes, g_strdup(index_path));
+		}
+		json_object_put(json);
+	}
+	g_slist_free_full(nativeJars, native_jar_free);
+	g_hash_table_destroy(seen);
+
+	run_callback(stage_update, "Downloading libraries");
+	if(run_queue(ctx, queue, failedResource)) {
+		run_callback(stage_update, "Downloading assets");
+		queue = new_queue(ctx);
+		for(guint i = 0; i < indexes->len; i++) {
+			queue_assets(queue, g_ptr_array_index(indexes, i), assets_dir);
+		}
+		ok &= run_queue(ctx, queue, failedResource);
+	} else {
+		ok = false;
+	}
+	g_ptr_array_free(indexes, TRUE);
+	run_callback(stage_update, NULL);
+	if(failedResource[0]) {
+		str = g_strdup_printf("Failed to fetch resource: %s", failedResource);
+		run_callback(show_error, str);
+		free(str);
+	}
+	return ok;
+}
+
+bool microlauncher_version_foreach_file(LaunchContext *ctx, const char *versionId, DownloadFileFunc func, void *userdata) {
+	const struct Settings *settings = microlauncher_launch_context_get_settings(ctx);
+	char versions_dir[PATH_MAX];
+	char libraries_dir[PATH_MAX];
+	char assets_dir[PATH_MAX];
+	char index_path[PATH_MAX];
+	char path[PATH_MAX];
+	snprintf(versions_dir, PATH_MAX, "%s/versions", settings->launcher_root);
+	snprintf(libraries_dir, PATH_MAX, "%s/libraries", settings->launcher_root);
+	snprintf(assets_dir, PATH_MAX, "%s/assets", settings->launcher_root);
+	json_object *json = inherit_json(ctx, versions_dir, versionId, false);
+	if(!json) {
+		return false;
+	}
+	char *id = g_strdup(versionId);
+	while(id) {
+		snprintf(path, PATH_MAX, "%s/%s/%s.json", versions_dir, id, id);
+		func(path, NULL, 0, userdata);
+		json_object *obj = json_from_file(path);
+		free(id);
+		id = g_strdup(json_get_string(obj, "inheritsFrom"));
+		json_object_put(obj);
+	}
+	GSList *nativeJars = NULL;
+	DownloadQueue *queue = microlauncher_download_queue_new();
+	// Local libraries are needed as much as downloaded ones
+	queue_version(queue, json, versions_dir, libraries_dir, assets_dir, false, &nativeJars, index_path);
+	// Objects of an index that can't be read would go unnoticed
+	bool ok = !json_object_object_get(json, "assetIndex") || queue_assets(queue, index_path, assets_dir);
+	if(ok) {
+		microlauncher_download_queue_foreach(queue, func, userdata);
+	}
+	microlauncher_download_queue_free(queue);
+	g_slist_free_full(nativeJars, native_jar_free);
+	json_object_put(json);
+	return ok;
+}
+
 char *microlauncher_get_javacp(json_object *json, const char *versions_path, const char *libraries_path) {
 	json_object *libraries, *iter, *downloads, *artifact;
 	char path[PATH_MAX];
@@ -886,6 +1078,39 @@ struct Settings *microlauncher_get_settings(void) {
 	return &settings;
 }
 
+/* Launches on other threads may register runtimes */
+G_LOCK_DEFINE_STATIC(runtimes);
+
+static JavaRuntime *find_runtime_locked(const char *location) {
+	GSList *data = settings.javaRuntimes;
+	while(data) {
+		JavaRuntime *runtime = data->data;
+		if(strequal(runtime->location, location)) {
+			return runtime;
+		}
+		data = data->next;
+	}
+	return NULL;
+}
+
+static JavaRuntime *find_runtime(const char *location) {
+	G_LOCK(runtimes);
+	JavaRuntime *runtime = find_runtime_locked(location);
+	G_UNLOCK(runtimes);
+	return runtime;
+}
+
+static JavaRuntime *register_runtime(const char *location) {
+	G_LOCK(runtimes);
+	JavaRuntime *runtime = find_runtime_locked(location);
+	if(!runtime) {
+		runtime = microlauncher_java_runtime_new(location);
+		settings.javaRuntimes = g_slist_append(settings.javaRuntimes, runtime);
+	}
+	G_UNLOCK(runtimes);
+	return runtime;
+}
+
 static void load_default_runtimes(void) {
 	char path[PATH_MAX];
 	const char *jvmPath;
@@ -916,26 +1141,34 @@ static void load_default_runtimes(void) {
 			jvmPath = path;
 #endif
 			if(g_file_query_file_type(g_file_new_for_path(jvmPath), 0, NULL) == G_FILE_TYPE_REGULAR) {
-				GSList *data = settings.javaRuntimes;
-				while(data) {
-					JavaRuntime *runtime = data->data;
-					if(strequal(runtime->location, jvmPath)) {
-						break;
-					}
-					data = data->next;
-				}
-				// We left inner loop early
-				if(data) {
-					continue;
-				}
-				JavaRuntime *runtime = microlauncher_java_runtime_new(jvmPath);
-				settings.javaRuntimes = g_slist_append(settings.javaRuntimes, runtime);
+				register_runtime(jvmPath);
 			}
 			free(full_path);
 		}
 	}
 }
 
+static void load_provisioned_runtimes(const char *root) {
+	char path[PATH_MAX];
+	const char *platform = java_runtime_get_platform();
+	if(!platform) {
+		return;
+	}
+	snprintf(path, PATH_MAX, "%s/runtime", root);
+	GDir *gdir = g_dir_open(path, 0, NULL);
+	if(!gdir) {
+		return;
+	}
+	const char *component;
+	while((component = g_dir_read_name(gdir))) {
+		snprintf(path, PATH_MAX, "%s/runtime/%s/%s/%s/%s", root, component, platform, component, JAVA_RUNTIME_EXECUTABLE);
+		if(access(path, F_OK) == 0) {
+			register_runtime(path);
+		}
+	}
+	g_dir_close(gdir);
+}
+
 static void *load_runtime(json_object *elem) {
 	JavaRuntime *runtime = microlauncher_java_runtime_new(json_object_get_string(elem));
 	return runtime;
@@ -945,6 +1178,7 @@ void microlauncher_load_settings(void) {
 	char pathbuf[PATH_MAX];
 	snprintf(pathbuf, PATH_MAX, "%s/microlauncher/settings.json", XDG_DATA_HOME);
 	json_object *obj = json_from_file(pathbuf);
+	remember_config(pathbuf);
 	settings.instance = microlauncher_instance_get(instances, json_get_string(obj, "instance"));
 	settings.user = microlauncher_account_get(accounts, json_get_string(obj, "user"));
 	settings.fullscreen = json_get_bool(obj, "fullscreen");
@@ -956,12 +1190,20 @@ void microlauncher_load_settings(void) {
 	settings.gpu_explicit = json_get_bool(obj, "gpu_explicit");
 	settings.gpu_id = g_strdup(getenv("DRI_PRIME"));
 	settings.hideOnLaunch = json_get_bool(obj, "hideOnLaunch");
-	load_list(json_object_object_get(obj, "javaRuntimes"), &settings.javaRuntimes, load_runtime);
-
-	load_default_runtimes();
-
+	settings.classDataSharing = json_get_bool_fallback(obj, "classDataSharing", true);
+	settings.prefetch = json_get_bool_fallback(obj, "prefetch", true);
+	settings.lowFootprint = json_get_bool(obj, "lowFootprint");
+	settings.backgroundDownload = json_get_bool_fallback(obj, "backgroundDownload", true);
+	settings.residentService = json_get_bool(obj, "residentService");
+	settings.lanCache = json_get_bool(obj, "lanCache");
+	settings.sharedStore = json_get_bool(obj, "sharedStore");
+	settings.peers = g_strdup(json_get_string(obj, "peers"));
+	settings.monitorInterval = json_object_object_get(obj, "monitorInterval") ? json_get_int(obj, "monitorInterval") : MONITOR_DEFAULT_INTERVAL;
+	settings.shaderCacheBudget = json_object_object_get(obj, "shaderCacheBudget") ? json_get_int(obj, "shaderCacheBudget") : SHADER_CACHE_DEFAULT_BUDGET;
 	if(!settings.gpu_id) {
-		settings.gpu_id = g_strdup(json_get_string(obj, "gpu"));
+		const char *gpu = json_get_string(obj, "gpu");
+		// NULL stands for the default device, which is stored explicitly
+		settings.gpu_id = strequal(gpu, "default") ? NULL : g_strdup(gpu ? gpu : GPU_AUTO);
 	}
 
 	const char *root = getenv("MICROLAUNCHER_LAUNCHER_ROOT");
@@ -978,6 +1220,21 @@ void microlauncher_load_settings(void) {
 		settings.launcher_root = g_strdup_printf("%s/minecraft", XDG_DATA_HOME);
 #endif
 	}
+	// Several paths separated like PATH, e.g. a copy maintained by the administrator under /opt
+	const char *lower = getenv("MICROLAUNCHER_LOWER_ROOTS");
+	if(lower) {
+		settings.lower_roots = drop_empty(g_strsplit(lower, G_SEARCHPATH_SEPARATOR_S, -1));
+	} else {
+		settings.lower_roots = drop_empty(load_strv(json_object_object_get(obj, "lowerRoots")));
+	}
+	settings.gcKeep = load_strv(json_object_object_get(obj, "gcKeep"));
+	load_list(json_object_object_get(obj, "javaRuntimes"), &settings.javaRuntimes, load_runtime);
+
+	load_default_runtimes();
+	load_provisioned_runtimes(settings.launcher_root);
+	for(char **lower = settings.lower_roots; lower && *lower; lower++) {
+		load_provisioned_runtimes(*lower);
+	}
 	json_object_put(obj);
 }
 
@@ -1006,14 +1263,33 @@ void microlauncher_save_settings(void) {
 	json_set_bool(obj, "zink", settings.use_zink);
 	json_set_bool(obj, "gpu_explicit", settings.gpu_explicit);
 	json_set_bool(obj, "hideOnLaunch", settings.hideOnLaunch);
+	json_set_bool(obj, "classDataSharing", settings.classDataSharing);
+	json_set_bool(obj, "prefetch", settings.prefetch);
+	json_set_bool(obj, "lowFootprint", settings.lowFootprint);
+	json_set_bool(obj, "backgroundDownload", settings.backgroundDownload);
+	json_set_bool(obj, "residentService", settings.residentService);
+	json_set_bool(obj, "lanCache", settings.lanCache);
+	json_set_bool(obj, "sharedStore", settings.sharedStore);
+	if(settings.peers) {
+		json_set_string(obj, "peers", settings.peers);
+	}
+	json_set_int(obj, "monitorInterval", settings.monitorInterval);
+	json_set_int(obj, "shaderCacheBudget", settings.shaderCacheBudget);
+	if(settings.lower_roots && !getenv("MICROLAUNCHER_LOWER_ROOTS")) {
+		json_object_object_add(obj, "lowerRoots", save_strv(settings.lower_roots));
+	}
+	if(settings.gcKeep) {
+		json_object_object_add(obj, "gcKeep", save_strv(settings.gcKeep));
+	}
 	if(settings.launcher_root) {
 		json_set_string(obj, "launcherRoot", settings.launcher_root);
 	}
-	json_set_string(obj, "gpu", settings.gpu_id);
+	json_set_string(obj, "gpu", settings.gpu_id ? settings.gpu_id : "default");
 	json_object_object_add(obj, "javaRuntimes", save_list(settings.javaRuntimes, write_runtimes));
 
 	snprintf(pathbuf, PATH_MAX, "%s/microlauncher/settings.json", XDG_DATA_HOME);
 	json_to_file(obj, pathbuf, JSON_C_TO_STRING_NOSLASHESCAPE | JSON_C_TO_STRING_PRETTY);
+	remember_config(pathbuf);
 	json_object_put(obj);
 
 	obj = json_object_new_array();
@@ -1027,6 +1303,7 @@ void microlauncher_save_settings(void) {
 	}
 	snprintf(pathbuf, PATH_MAX, "%s/microlauncher/accounts.json", XDG_DATA_HOME);
 	json_to_file(obj, pathbuf, JSON_C_TO_STRING_NOSLASHESCAPE | JSON_C_TO_STRING_PRETTY);
+	remember_config(pathbuf);
 	json_object_put(obj);
 
 	obj = json_object_new_array();
@@ -1040,7 +1317,32 @@ void microlauncher_save_settings(void) {
 	}
 	snprintf(pathbuf, PATH_MAX, "%s/microlauncher/instances.json", XDG_DATA_HOME);
 	json_to_file(obj, pathbuf, JSON_C_TO_STRING_NOSLASHESCAPE | JSON_C_TO_STRING_PRETTY);
+	remember_config(pathbuf);
 	json_object_put(obj);
+	microlauncher_gc_publish_roots();
+}
+
+void microlauncher_reload_config(void) {
+	bool lanCache = settings.lanCache;
+	char *peers = g_steal_pointer(&settings.peers);
+	g_slist_free_full(instances, g_object_unref);
+	g_slist_free_full(accounts, g_object_unref);
+	g_clear_pointer(&settings.launcher_root, free);
+	g_clear_pointer(&settings.lower_roots, g_strfreev);
+	g_clear_pointer(&settings.gcKeep, g_strfreev);
+	g_clear_pointer(&settings.gpu_id, free);
+	G_LOCK(runtimes);
+	g_slist_free_full(settings.javaRuntimes, g_object_unref);
+	settings.javaRuntimes = NULL;
+	G_UNLOCK(runtimes);
+	microlauncher_init_config();
+	if(!getenv("MICROLAUNCHER_PEERS") && (lanCache != settings.lanCache || !strequal(peers, settings.peers))) {
+		microlauncher_peer_discovery_stop();
+		if(settings.lanCache) {
+			microlauncher_peer_discovery_start(settings.peers);
+		}
+	}
+	free(peers);
 }
 
 static char *instance_name_to_id(const char *name) {
@@ -1119,6 +1421,16 @@ static char *apply_replaces(const char *const *replaces, const char *str) {
 	return strBuff.data;
 }
 
+static bool has_jvm_arg(GSList *args, const char *prefix) {
+	while(args) {
+		if(strncmp(args->data, prefix, strlen(prefix)) == 0) {
+			return true;
+		}
+		args = args->next;
+	}
+	return false;
+}
+
 static int add_arguments(json_object *array, const char *const *replaces, GSList *features, char **argv, char **str_to_free) {
 	json_object *iter, *iter2;
 
@@ -1160,7 +1472,132 @@ bool microlauncher_auth_user(MicrolauncherAccount *user, GCancellable *cancellab
 	return microlauncher_account_auth_user(callbacks, user, cancellable);
 }
 
-bool microlauncher_launch_instance(const MicrolauncherInstance *instance, MicrolauncherAccount *user, GCancellable *cancellable) {
+/* Per-launch resources released once the game exits */
+struct RunningGame {
+	LaunchContext *ctx;
+	char *natives_dir;
+	char *cds_dump;
+	Prefetch *prefetch;
+	ProcessMonitor *monitor;
+	char *history_path;
+	char *cgroup;
+};
+
+/* Games started by this process, used to hand them off to a supervisor */
+static GSList *runningGames;
+G_LOCK_DEFINE_STATIC(games);
+
+/* Returns false if natives directory couldn't be removed */
+static bool finish_game(struct RunningGame *game, const struct ExitStatus *status) {
+	if(status->exited) {
+		g_print("Process exited with code %d\n", status->code);
+	} else if(status->signal) {
+		g_print("Process killed by signal %d%s\n", status->signal, status->core_dumped ? " (core dumped)" : "");
+	} else {
+		g_print("Process stopped with error\n");
+	}
+	if(game->cds_dump && microlauncher_cds_commit(game->cds_dump, status->exited && status->code == 0)) {
+		g_print("Class data sharing archive created, next launches will use it\n");
+	}
+	microlauncher_prefetch_free(game->prefetch);
+	microlauncher_monitor_free(game->monitor, game->history_path);
+	microlauncher_qos_cgroup_remove(game->cgroup);
+	return !game->natives_dir || rmdir_recursive(game->natives_dir, NULL);
+}
+
+static void game_exited(GPid pid, const struct ExitStatus *status, void *userdata) {
+	struct RunningGame *game = userdata;
+	struct Callbacks callbacks = microlauncher_launch_context_get_callbacks(game->ctx);
+	G_LOCK(games);
+	runningGames = g_slist_remove(runningGames, game);
+	G_UNLOCK(games);
+	if(!finish_game(game, status)) {
+		run_callback(show_error, "Failed to delete natives directory");
+	}
+	free(game->natives_dir);
+	free(game->cds_dump);
+	free(game->history_path);
+	free(game->cgroup);
+	free(game);
+	if(callbacks.instance_finished) {
+		callbacks.instance_finished(status, callbacks.userdata);
+	}
+}
+
+void microlauncher_hand_off(LaunchContext *ctx) {
+#ifdef G_OS_UNIX
+	struct RunningGame *game = NULL;
+	G_LOCK(games);
+	for(GSList *node = runningGames; node; node = node->next) {
+		if(((struct RunningGame *)node->data)->ctx == ctx) {
+			game = node->data;
+		}
+	}
+	G_UNLOCK(games);
+	GPid pid = microlauncher_launch_context_get_pid(ctx);
+	if(!game || !pid) {
+		return;
+	}
+	char pidStr[16];
+	snprintf(pidStr, sizeof(pidStr), "%d", pid);
+	char *argv[] = {EXEC_BINARY, "--supervise", pidStr, "--natives", game->natives_dir, NULL, NULL, NULL, NULL, NULL};
+	int c = 5;
+	if(game->cds_dump) {
+		argv[c++] = "--cds-dump";
+		argv[c++] = game->cds_dump;
+	}
+	if(game->cgroup) {
+		argv[c++] = "--cgroup";
+		argv[c++] = game->cgroup;
+	}
+	// Session history and file access recording don't survive the exec
+	microlauncher_prefetch_free(game->prefetch);
+	game->prefetch = NULL;
+	microlauncher_monitor_free(game->monitor, NULL);
+	game->monitor = NULL;
+	fflush(stdout);
+	fflush(stderr);
+	execvp(argv[0], argv);
+	g_print("Failed to hand off game to supervisor: %s\n", strerror(errno));
+#endif
+}
+
+static void supervised_exited(GPid pid, const struct ExitStatus *status, void *userdata) {
+	struct RunningGame game = {
+		.natives_dir = supervise_natives,
+		.cds_dump = supervise_cds_dump,
+		.cgroup = supervise_cgroup};
+	if(!finish_game(&game, status)) {
+		g_print("Failed to delete natives directory\n");
+	}
+	g_main_loop_quit(userdata);
+}
+
+int microlauncher_supervise(int argc, char **argv) {
+	GOptionContext *context = g_option_context_new("");
+	g_option_context_add_main_entries(context, supervise_entries, NULL);
+	if(!g_option_context_parse(context, &argc, &argv, NULL) || supervise_pid <= 0) {
+		g_option_context_free(context);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free(context);
+	GMainLoop *loop = g_main_loop_new(NULL, false);
+	microlauncher_supervisor_watch(supervise_pid, supervised_exited, loop);
+	g_main_loop_run(loop);
+	g_main_loop_unref(loop);
+	return EXIT_SUCCESS;
+}
+
+/* Serializes token refresh when several launches use the same account */
+G_LOCK_DEFINE_STATIC(auth);
+
+bool microlauncher_launch_instance(LaunchContext *ctx) {
+	const MicrolauncherInstance *instance = microlauncher_launch_context_get_instance(ctx);
+	MicrolauncherAccount *user = microlauncher_launch_context_get_user(ctx);
+	GCancellable *cancellable = microlauncher_launch_context_get_cancellable(ctx);
+	// Shadow globals, launch must only use its own snapshot and progress channel
+	struct Settings settings = *microlauncher_launch_context_get_settings(ctx);
+	struct Callbacks callbacks = microlauncher_launch_context_get_callbacks(ctx);
 	if(!instance || !user) {
 		return false;
 	}
@@ -1183,7 +1620,9 @@ bool microlauncher_launch_instance(const MicrolauncherInstance *instance, Microl
 	char versions_dir[PATH_MAX];
 	char libraries_dir[PATH_MAX];
 	char assets_dir[PATH_MAX];
+	char game_assets[PATH_MAX];
 	char natives_dir[PATH_MAX];
+	char failedResource[PATH_MAX] = {0};
 	const char *main_class;
 	memset(path, 0, PATH_MAX);
 	snprintf(versions_dir, PATH_MAX, "%s/versions", settings.launcher_root);
@@ -1192,7 +1631,7 @@ bool microlauncher_launch_instance(const MicrolauncherInstance *instance, Microl
 	str = random_uuid();
 	snprintf(natives_dir, PATH_MAX, "%s/natives-%s", TEMPDIR, str);
 	free(str);
-	json_object *json = microlauncher_fetch_version(instance->version, versions_dir, libraries_dir, natives_dir, assets_dir, cancellable, path, settings.allowUpdate);
+	json_object *json = microlauncher_fetch_version(ctx, instance->version, versions_dir, libraries_dir, natives_dir, assets_dir, path);
 	if(path[0]) {
 		char *format = g_strdup_printf("Failed to fetch resource: %s", path);
 		run_callback(show_error, format);
@@ -1205,14 +1644,39 @@ bool microlauncher_launch_instance(const MicrolauncherInstance *instance, Microl
 		}
 		return false;
 	}
-	if(!microlauncher_auth_user(user, cancellable)) {
+	snprintf(path, PATH_MAX, "%s/indexes/%s.json", assets_dir, json_get_string(json_object_object_get(json, "assetIndex"), "id"));
+	if(!microlauncher_assets_prepare(ctx, path, assets_dir, instance->location, game_assets)) {
+		json_object_put(json);
+		return false;
+	}
+	char *cp = microlauncher_get_javacp(json, versions_dir, libraries_dir);
+	Prefetch *prefetch = NULL;
+	if(settings.prefetch) {
+		// Warm up page cache while authenticating and building arguments
+		snprintf(path, PATH_MAX, "%s/prefetch", settings.launcher_root);
+		prefetch = microlauncher_prefetch_new(path, instance->location);
+		microlauncher_prefetch_add_classpath(prefetch, cp);
+		microlauncher_prefetch_add(prefetch, natives_dir);
+		snprintf(path, PATH_MAX, "%s/indexes/%s.json", assets_dir, json_get_string(json, "assets"));
+		microlauncher_prefetch_add(prefetch, path);
+		microlauncher_prefetch_start(prefetch);
+	}
+	G_LOCK(auth);
+	bool authenticated = microlauncher_account_auth_user(callbacks, user, cancellable);
+	G_UNLOCK(auth);
+	if(!authenticated) {
+		microlauncher_prefetch_free(prefetch);
+		free(cp);
 		return false;
 	}
 	const char *javaExec = instance->javaLocation;
+	// Referenced for the duration of launch, runtimes list can change meanwhile
+	JavaRuntime *javaRuntime = NULL;
 	if(!javaExec) {
 		json_object *javaVer = json_object_object_get(json, "javaVersion");
 		int lastVer = 0, minVer = json_get_int(javaVer, "minVersion");
 		int recommendedVer = json_get_int(javaVer, "majorVersion");
+		G_LOCK(runtimes);
 		GSList *runtime = settings.javaRuntimes;
 		while(runtime) {
 			JavaRuntime *jre = runtime->data;
@@ -1220,17 +1684,41 @@ bool microlauncher_launch_instance(const MicrolauncherInstance *instance, Microl
 			if(jreMajor >= minVer && jreMajor <= recommendedVer && lastVer <= jreMajor) {
 				lastVer = jreMajor;
 				javaExec = jre->location;
+				javaRuntime = jre;
 			}
 			runtime = runtime->next;
 		}
+		if(javaRuntime) {
+			g_object_ref(javaRuntime);
+		}
+		G_UNLOCK(runtimes);
+		const char *component = json_get_string(javaVer, "component");
+		if(!javaExec && component) {
+			snprintf(path, PATH_MAX, "%s/runtime", settings.launcher_root);
+			str = microlauncher_java_runtime_install(component, path, callbacks, cancellable, failedResource);
+			if(str) {
+				javaRuntime = g_object_ref(register_runtime(str));
+				javaExec = javaRuntime->location;
+				free(str);
+			} else if(failedResource[0]) {
+				str = g_strdup_printf("Failed to fetch resource: %s", failedResource);
+				run_callback(show_error, str);
+				free(str);
+				microlauncher_prefetch_free(prefetch);
+				free(cp);
+				json_object_put(json);
+				return false;
+			}
+		}
 	}
 	if(!javaExec) {
 		run_callback(show_error, "Failed to determine used Java runtime");
+		microlauncher_prefetch_free(prefetch);
+		free(cp);
 		return false;
 	}
 	const char *id = json_get_string(json, "id");
 	const char *minecraftArguments = json_get_string(json, "minecraftArguments");
-	char *cp = microlauncher_get_javacp(json, versions_dir, libraries_dir);
 	json_object *obj = json_object_object_get(json, "arguments");
 	json_object *argumentsGame = json_object_object_get(obj, "game");
 	json_object *argumentsJvm = json_object_object_get(obj, "jvm");
@@ -1263,6 +1751,7 @@ bool microlauncher_launch_instance(const MicrolauncherInstance *instance, Microl
 		"${version_name}", id,
 		"${game_directory}", instance->location,
 		"${assets_root}", assets_dir,
+		"${game_assets}", game_assets,
 		"${assets_index_name}", json_get_string(json, "assets"),
 		"${auth_access_token}", auth_token,
 		"${user_properties}", "{}",
@@ -1296,38 +1785,50 @@ bool microlauncher_launch_instance(const MicrolauncherInstance *instance, Microl
 
 	c = 0;
 	char *argv[256];
+	char **envp = g_get_environ();
+	const char *gpuId = settings.gpu_id;
+	struct GpuChoice gpuChoice = {0};
+	if(strequal(gpuId, GPU_AUTO)) {
+		char *cachePath = g_build_filename(XDG_CACHE_HOME, "microlauncher", "gpu.json", NULL);
+		microlauncher_gpu_auto_select(cachePath, &gpuChoice);
+		free(cachePath);
+		g_print("GPU: %s\n", gpuChoice.reason);
+		gpuId = gpuChoice.id;
+	}
 #ifdef G_OS_UNIX
 	GSList *prefixArg = instance->prefixCommand;
 	while(prefixArg) {
 		argv[c++] = prefixArg->data;
 		prefixArg = prefixArg->next;
 	}
-	argv[c++] = "env";
-	GtkSettings *gtksettings = gtk_settings_get_default();
-	int xcursize = 24;
-	if(gtksettings) {
-		GValue value = G_VALUE_INIT;
-		g_object_get_property(G_OBJECT(gtksettings), "gtk-cursor-theme-size", &value);
-		if(g_value_get_int(&value) > 0) {
-			xcursize = g_value_get_int(&value);
-			// GLFW uses this env to determine client cursor size (smh when will it use server-side cursor already?)
-		}
+	// GLFW uses this env to determine client cursor size (smh when will it use server-side cursor already?)
+	str = g_strdup_printf("%d", settings.cursorSize > 0 ? settings.cursorSize : 24);
+	envp = g_environ_setenv(envp, "XCURSOR_SIZE", str, TRUE);
+	free(str);
+	if(gpuId) {
+		str = g_strdup_printf(settings.gpu_explicit ? "%s!" : "%s", gpuId);
+		envp = g_environ_setenv(envp, "DRI_PRIME", str, TRUE);
+		free(str);
 	}
-	argv[c++] = malloc_strs[m++] = g_strdup_printf("XCURSOR_SIZE=%d", xcursize);
-	if(settings.gpu_id) {
-		argv[c++] = malloc_strs[m++] = g_strdup_printf(settings.gpu_explicit ? "DRI_PRIME=%s!" : "DRI_PRIME=%s", settings.gpu_id);
+	if(strequal(gpuChoice.driver, "nvidia") && !settings.use_zink) {
+		// Proprietary driver ignores DRI_PRIME
+		envp = g_environ_setenv(envp, "__NV_PRIME_RENDER_OFFLOAD", "1", TRUE);
+		envp = g_environ_setenv(envp, "__GLX_VENDOR_LIBRARY_NAME", "nvidia", TRUE);
+		envp = g_environ_setenv(envp, "__VK_LAYER_NV_optimus", "NVIDIA_only", TRUE);
 	}
 	if(settings.use_zink) {
 		// Force nvidia drivers to use Mesa
-		argv[c++] = "__GLX_VENDOR_LIBRARY_NAME=mesa";
-		argv[c++] = "__EGL_VENDOR_LIBRARY_FILENAMES=/usr/share/glvnd/egl_vendor.d/50_mesa.json";
+		envp = g_environ_setenv(envp, "__GLX_VENDOR_LIBRARY_NAME", "mesa", TRUE);
+		envp = g_environ_setenv(envp, "__EGL_VENDOR_LIBRARY_FILENAMES", "/usr/share/glvnd/egl_vendor.d/50_mesa.json", TRUE);
 
-		argv[c++] = "MESA_LOADER_DRIVER_OVERRIDE=zink";
+		envp = g_environ_setenv(envp, "MESA_LOADER_DRIVER_OVERRIDE", "zink", TRUE);
 	}
 	if(access("/lib/libgcompat.so.0", R_OK) == 0) {
-		argv[c++] = malloc_strs[m++] = g_strdup_printf("LD_PRELOAD=%s", "/lib/libgcompat.so.0");
+		envp = g_environ_setenv(envp, "LD_PRELOAD", "/lib/libgcompat.so.0", TRUE);
 	}
 #endif
+	char *shaderCache = microlauncher_shader_cache_dir(settings.launcher_root, instance->location, gpuId);
+	envp = microlauncher_shader_cache_setenv(envp, shaderCache, settings.shaderCacheBudget);
 	argv[c++] = (char *)javaExec;
 
 	// JVM args
@@ -1347,6 +1848,28 @@ bool microlauncher_launch_instance(const MicrolauncherInstance *instance, Microl
 	}
 #endif
 
+	if(!javaRuntime) {
+		javaRuntime = find_runtime(javaExec);
+		javaRuntime = javaRuntime ? g_object_ref(javaRuntime) : NULL;
+	}
+	if(!javaRuntime) {
+		// Runtime set per instance which isn't in the list, probe it just for this launch
+		javaRuntime = microlauncher_java_runtime_new(javaExec);
+	}
+	// Tuning goes before user args so the user can still override anything
+	int tuned = microlauncher_tuning_get_args(tuning_profile_from_name(instance->tuning), java_get_major_version(javaRuntime), java_get_vm_name(javaRuntime), instance->location, instance->jvmArgs, argv + c, malloc_strs + m);
+	c += tuned;
+	m += tuned;
+
+	char *cdsDump = NULL;
+	if(settings.classDataSharing && !has_jvm_arg(instance->jvmArgs, "-Xshare") && !has_jvm_arg(instance->jvmArgs, "-XX:SharedArchiveFile") && !has_jvm_arg(instance->jvmArgs, "-XX:ArchiveClassesAtExit")) {
+		snprintf(path, PATH_MAX, "%s/cds", settings.launcher_root);
+		str = microlauncher_cds_get_option(javaRuntime, cp, path, &cdsDump);
+		if(str) {
+			argv[c++] = malloc_strs[m++] = str;
+		}
+	}
+
 	GSList *node = instance->jvmArgs;
 	while(node) {
 		argv[c++] = node->data;
@@ -1398,27 +1921,70 @@ bool microlauncher_launch_instance(const MicrolauncherInstance *instance, Microl
 	for(int i = 0; i < c; i++) {
 		g_print("%s\n", argv[i]);
 	}
-	// umask 002 for less restrictive permissions when using shared between users instances
-	GPid pid = util_fork_execv(instance->location, argv, 0002);
-
+	struct SpawnOptions spawnOpts = {
+		.dir = instance->location,
+		.envp = envp,
+		.umask = GAME_UMASK,
+		.stdout_fd = -1,
+		.stderr_fd = -1};
+	struct QosSettings qos = {
+		.cpu_affinity = instance->cpuAffinity,
+		.nice = instance->nice,
+		.io_priority = io_priority_from_name(instance->ioPriority),
+		.memory_high = instance->memoryHigh,
+		.cpu_weight = instance->cpuWeight};
+	// The game starts in its cgroup, along with anything a wrapper forks before it
+	char *cgroup = microlauncher_qos_cgroup_new(&qos);
+	spawnOpts.cgroup = cgroup;
+	GPid pid = microlauncher_qos_spawn(&qos, argv, &spawnOpts);
+	if(!pid) {
+		run_callback(show_error, "Failed to start game process");
+		microlauncher_qos_cgroup_remove(cgroup);
+		free(cgroup);
+		rmdir_recursive(natives_dir, NULL);
+		ret = false;
+		goto cleanup;
+	}
+
+	if(prefetch) {
+		microlauncher_prefetch_record(prefetch, pid);
+	}
+	struct RunningGame *game = g_new0(struct RunningGame, 1);
+	game->ctx = ctx;
+	game->natives_dir = g_strdup(natives_dir);
+	game->cds_dump = cdsDump;
+	game->prefetch = prefetch;
+	microlauncher_qos_cgroup_attach(cgroup, pid);
+	game->cgroup = cgroup;
+	cdsDump = NULL;
+	prefetch = NULL;
+	if(settings.monitorInterval > 0) {
+		game->monitor = microlauncher_monitor_new(pid, settings.monitorInterval, callbacks.process_sample, callbacks.userdata);
+		game->history_path = microlauncher_monitor_history_path(settings.launcher_root, instance->location);
+	}
+	G_LOCK(games);
+	runningGames = g_slist_prepend(runningGames, game);
+	G_UNLOCK(games);
+	microlauncher_launch_context_watch(ctx, pid, game_exited, game);
 	run_callback(instance_started, pid);
-	int status = 0;
-	if(util_waitpid(pid, &status)) {
-		g_print("Process exited with code %d\n", status);
-	} else {
-		g_print("Process stopped with error\n");
-	}
-	if(!rmdir_recursive(natives_dir, NULL)) {
-		run_callback(show_error, "Failed to delete natives directory");
-	}
-	if(callbacks.instance_finished) {
-		callbacks.instance_finished(callbacks.userdata);
+
+	// Game is already starting, walking the caches doesn't delay it
+	guint64 shaderTotal;
+	if(microlauncher_shader_cache_trim(settings.launcher_root, settings.shaderCacheBudget, shaderCache, &shaderTotal)) {
+		g_print("Shader cache: %" G_GUINT64_FORMAT " MiB for this instance, %" G_GUINT64_FORMAT " MiB in total\n",
+				microlauncher_shader_cache_size(shaderCache) >> 20, shaderTotal >> 20);
 	}
 cleanup:
 
 	for(int i = 0; i < m; i++) {
 		free(malloc_strs[i]);
 	}
+	free(cdsDump);
+	g_strfreev(envp);
+	free(shaderCache);
+	microlauncher_gpu_choice_clear(&gpuChoice);
+	microlauncher_prefetch_free(prefetch);
+	g_object_unref(javaRuntime);
 	free(cp);
 	json_object_put(json);
 	return ret;
@@ -1436,29 +2002,6 @@ GSList **microlauncher_get_instances(void) {
 	return &instances;
 }
 
-static void microlauncher_deinit(void) {
-	curl_easy_cleanup(globalCurlHandle);
-}
-
-int main(int argc, char **argv) {
-	if(!microlauncher_init(argc, argv)) {
-		return EXIT_FAILURE;
-	}
-
-	GSList *instances = *microlauncher_get_instances();
-	GSList *accounts = *microlauncher_get_accounts();
-	MicrolauncherAccount *user;
-	if(use_saved_user) {
-		user = settings.user;
-	} else {
-		user = microlauncher_account_get(accounts, active_user);
-	}
-	if(microlauncher_launch_instance(microlauncher_instance_get(instances, active_instance), user, NULL)) {
-		return EXIT_SUCCESS;
-	}
-
-	int exit = microlauncher_gui_show();
-	microlauncher_save_settings();
-	microlauncher_deinit();
-	return exit;
+void microlauncher_deinit(void) {
+	curl_global_cleanup();
 }
@@ -0,0 +1,512 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <json.h>
+#include <microlauncher.h>
+#include <microlauncher_archive.h>
+#include <microlauncher_download.h>
+#include <microlauncher_peer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/json_util.h>
+#include <util/util.h>
+#include <util/xdgutil.h>
+#include <zip.h>
+
+struct ArchiveEntry {
+	char *name;
+	char *path;
+	bool store;
+};
+
+struct ExportState {
+	const char *launcher_root;
+	GHashTable *seen;
+	GPtrArray *entries;
+	json_object *files;
+	struct Callbacks callbacks;
+	GCancellable *cancellable;
+};
+
+struct ImportState {
+	const char *archive_path;
+	const char *launcher_root;
+	const char *location;
+	/* Archive entry name to manifest object of a launcher root file */
+	GHashTable *files;
+	GCancellable *cancellable;
+	GMutex mutex;
+	GCond cond;
+	guint running;
+	guint next_thread;
+	guint64 done_size;
+	const char *label;
+	char *error;
+	struct DownloadStats stats;
+};
+
+static void archive_entry_free(void *data) {
+	struct ArchiveEntry *entry = data;
+	free(entry->name);
+	free(entry->path);
+	free(entry);
+}
+
+static void add_entry(GPtrArray *entries, const char *name, const char *path, bool store) {
+	struct ArchiveEntry *entry = g_new(struct ArchiveEntry, 1);
+	entry->name = g_strdup(name);
+	entry->path = g_strdup(path);
+	entry->store = store;
+	g_ptr_array_add(entries, entry);
+}
+
+/* Entry names come from the archive, they must stay below the directory they are extracted to */
+static bool relative_safe(const char *rel) {
+	if(!rel || !*rel || *rel == '/' || strchr(rel, '\\') || strchr(rel, ':')) {
+		return false;
+	}
+	char **parts = g_strsplit(rel, "/", -1);
+	bool ok = true;
+	for(char **part = parts; *part; part++) {
+		if(strequal(*part, "..")) {
+			ok = false;
+		}
+	}
+	g_strfreev(parts);
+	return ok;
+}
+
+static void export_file(const char *path, const char *sha1, long size, void *userdata) {
+	struct ExportState *state = userdata;
+	size_t root_len = strlen(state->launcher_root);
+	if(strncmp(path, state->launcher_root, root_len) != 0 || path[root_len] != '/') {
+		return;
+	}
+	const char *rel = path + root_len + 1;
+	if(!g_hash_table_add(state->seen, g_strdup(rel))) {
+		return;
+	}
+	GStatBuf st;
+	if(g_stat(path, &st) != 0) {
+		return;
+	}
+	Sha1 hash;
+	if(!sha1) {
+		FILE *fd = fopen(path, "rb");
+		if(!fd) {
+			return;
+		}
+		get_sha1(fd, hash);
+		fclose(fd);
+		sha1 = hash;
+	}
+	char *name = g_strconcat(ARCHIVE_ROOT_DIR, rel, NULL);
+	json_object *file = json_object_new_object();
+	json_set_string(file, "path", rel);
+	json_set_string(file, "sha1", sha1);
+	json_object_object_add(file, "size", json_object_new_int64(st.st_size));
+	json_object_array_add(state->files, file);
+	add_entry(state->entries, name, path, !str_ends_with(path, ".json"));
+	free(name);
+}
+
+static void export_directory(struct ExportState *state, const char *dir, const char *prefix) {
+	GDir *handle = g_dir_open(dir, 0, NULL);
+	const char *child;
+	while(handle && (child = g_dir_read_name(handle))) {
+		char *path = g_build_filename(dir, child, NULL);
+		char *name = g_strconcat(prefix, child, NULL);
+		if(g_file_test(path, G_FILE_TEST_IS_SYMLINK)) {
+			// Links may point outside of the instance
+		} else if(g_file_test(path, G_FILE_TEST_IS_DIR)) {
+			char *sub = g_strconcat(name, "/", NULL);
+			export_directory(state, path, sub);
+			free(sub);
+		} else if(g_file_test(path, G_FILE_TEST_IS_REGULAR)) {
+			add_entry(state->entries, name, path, false);
+		}
+		free(name);
+		free(path);
+	}
+	if(handle) {
+		g_dir_close(handle);
+	}
+}
+
+static void export_progress(zip_t *zip, double fraction, void *userdata) {
+	struct ExportState *state = userdata;
+	struct Callbacks callbacks = state->callbacks;
+	run_callback(progress_update, fraction, "Writing archive");
+}
+
+static int export_cancelled(zip_t *zip, void *userdata) {
+	struct ExportState *state = userdata;
+	return state->cancellable && g_cancellable_is_cancelled(state->cancellable);
+}
+
+bool microlauncher_archive_export(LaunchContext *ctx, const char *archive_path) {
+	MicrolauncherInstance *inst = microlauncher_launch_context_get_instance(ctx);
+	struct Callbacks callbacks = microlauncher_launch_context_get_callbacks(ctx);
+	const struct Settings *settings = microlauncher_launch_context_get_settings(ctx);
+	char *str;
+	if(!inst || !inst->version) {
+		run_callback(show_error, "Instance has no version to export");
+		return false;
+	}
+	const char *versions[] = {inst->version, NULL};
+	if(!microlauncher_fetch(ctx, versions)) {
+		return false;
+	}
+	struct ExportState state = {
+		.launcher_root = settings->launcher_root,
+		.seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL),
+		.entries = g_ptr_array_new_with_free_func(archive_entry_free),
+		.files = json_object_new_array(),
+		.callbacks = callbacks,
+		.cancellable = microlauncher_launch_context_get_cancellable(ctx)};
+	json_object *manifest = json_object_new_object();
+	json_set_int(manifest, "format", ARCHIVE_FORMAT);
+	json_object *instance = json_object_new_object();
+	microlauncher_save_instance(instance, inst);
+	json_object_object_add(manifest, "instance", instance);
+	json_object_object_add(manifest, "files", state.files);
+	bool ok = microlauncher_version_foreach_file(ctx, inst->version, export_file, &state);
+	if(inst->location) {
+		export_directory(&state, inst->location, ARCHIVE_INSTANCE_DIR);
+	}
+
+	if(!ok) {
+		str = g_strdup_printf("Failed to get version JSON of %s", inst->version);
+		run_callback(show_error, str);
+		free(str);
+		goto cleanup;
+	}
+	zip_t *zip = zip_open(archive_path, ZIP_CREATE | ZIP_TRUNCATE, NULL);
+	if(!zip) {
+		str = g_strdup_printf("Failed to create %s", archive_path);
+		run_callback(show_error, str);
+		free(str);
+		ok = false;
+		goto cleanup;
+	}
+	run_callback(stage_update, "Writing archive");
+	// Manifest goes first so that an importer knows every hash before the files arrive
+	const char *manifest_str = json_object_to_json_string_ext(manifest, JSON_C_TO_STRING_PLAIN);
+	zip_source_t *src = zip_source_buffer(zip, manifest_str, strlen(manifest_str), 0);
+	if(!src || zip_file_add(zip, ARCHIVE_MANIFEST, src, ZIP_FL_ENC_UTF_8) < 0) {
+		zip_source_free(src);
+		ok = false;
+	}
+	for(guint i = 0; ok && i < state.entries->len; i++) {
+		struct ArchiveEntry *entry = g_ptr_array_index(state.entries, i);
+		src = zip_source_file(zip, entry->path, 0, 0);
+		zip_int64_t index = src ? zip_file_add(zip, entry->name, src, ZIP_FL_ENC_UTF_8 | ZIP_FL_OVERWRITE) : -1;
+		if(index < 0) {
+			zip_source_free(src);
+			str = g_strdup_printf("Failed to add %s: %s", entry->path, zip_strerror(zip));
+			run_callback(show_error, str);
+			free(str);
+			ok = false;
+		} else if(entry->store) {
+			zip_set_file_compression(zip, index, ZIP_CM_STORE, 0);
+		}
+	}
+	zip_register_progress_callback_with_state(zip, 0.01, export_progress, NULL, &state);
+	zip_register_cancel_callback_with_state(zip, export_cancelled, NULL, &state);
+	if(!ok || zip_close(zip) != 0) {
+		if(ok && !export_cancelled(zip, &state)) {
+			str = g_strdup_printf("Failed to write %s: %s", archive_path, zip_strerror(zip));
+			run_callback(show_error, str);
+			free(str);
+		}
+		zip_discard(zip);
+		g_remove(archive_path);
+		ok = false;
+	}
+	run_callback(stage_update, NULL);
+cleanup:
+	json_object_put(manifest);
+	g_ptr_array_free(state.entries, TRUE);
+	g_hash_table_destroy(state.seen);
+	return ok;
+}
+
+static void import_fail(struct ImportState *state, const char *fmt, const char *arg) {
+	g_mutex_lock(&state->mutex);
+	if(!state->error) {
+		state->error = g_strdup_printf(fmt, arg);
+	}
+	g_mutex_unlock(&state->mutex);
+}
+
+static bool import_stopped(struct ImportState *state) {
+	g_mutex_lock(&state->mutex);
+	bool stopped = state->error != NULL;
+	g_mutex_unlock(&state->mutex);
+	return stopped || (state->cancellable && g_cancellable_is_cancelled(state->cancellable));
+}
+
+static bool file_matches(const char *path, const char *sha1, gint64 size) {
+	GStatBuf st;
+	if(g_stat(path, &st) != 0 || st.st_size != size) {
+		return false;
+	}
+	FILE *fd = fopen(path, "rb");
+	if(!fd) {
+		return false;
+	}
+	Sha1 hash;
+	get_sha1(fd, hash);
+	fclose(fd);
+	return strequal(hash, sha1);
+}
+
+/* Writes to a partial file which is renamed once complete, so interrupted imports don't leave corrupt files behind */
+static bool extract_entry(struct ImportState *state, zip_t *zip, zip_uint64_t index, const char *dest, const char *sha1) {
+	char buf[BUFSIZ];
+	unsigned char digest[SHA_DIGEST_LENGTH];
+	Sha1 hash;
+	SHA_CTX sha1_ctx;
+	zip_int64_t n;
+	bool ok = true;
+	zip_file_t *file = zip_fopen_index(zip, index, 0);
+	if(!file) {
+		return false;
+	}
+	char *part = g_strconcat(dest, ".part", NULL);
+	FILE *out = fopen_mkdir(part, "wb");
+	if(!out) {
+		zip_fclose(file);
+		free(part);
+		return false;
+	}
+	SHA1_Init(&sha1_ctx);
+	while((n = zip_fread(file, buf, sizeof(buf))) > 0) {
+		if(fwrite(buf, 1, n, out) != (size_t)n) {
+			ok = false;
+			break;
+		}
+		SHA1_Update(&sha1_ctx, buf, n);
+		g_mutex_lock(&state->mutex);
+		state->done_size += n;
+		g_mutex_unlock(&state->mutex);
+		if(import_stopped(state)) {
+			ok = false;
+			break;
+		}
+	}
+	ok &= n == 0;
+	ok &= fclose(out) == 0;
+	zip_fclose(file);
+	SHA1_Final(digest, &sha1_ctx);
+	bytes_as_hex(digest, SHA_DIGEST_LENGTH, hash);
+	hash[SHA_DIGEST_LENGTH * 2] = '\0';
+	if(ok && sha1 && !strequal(hash, sha1)) {
+		ok = false;
+	}
+	if(!ok || g_rename(part, dest) != 0) {
+		g_remove(part);
+		ok = false;
+	}
+	free(part);
+	return ok;
+}
+
+static gpointer import_thread(gpointer data) {
+	struct ImportState *state = data;
+	guint thread;
+	g_mutex_lock(&state->mutex);
+	thread = state->next_thread++;
+	g_mutex_unlock(&state->mutex);
+	zip_t *zip = zip_open(state->archive_path, ZIP_RDONLY, NULL);
+	if(!zip) {
+		import_fail(state, "Failed to open %s", state->archive_path);
+	}
+	zip_int64_t count = zip ? zip_get_num_entries(zip, 0) : 0;
+	for(zip_int64_t i = thread; i < count && !import_stopped(state); i += ARCHIVE_THREADS) {
+		zip_stat_t st;
+		if(zip_stat_index(zip, i, 0, &st) != 0 || g_str_has_suffix(st.name, "/") || strequal(st.name, ARCHIVE_MANIFEST)) {
+			continue;
+		}
+		char *dest = NULL;
+		const char *sha1 = NULL;
+		json_object *file = g_hash_table_lookup(state->files, st.name);
+		if(file) {
+			sha1 = json_get_string(file, "sha1");
+			dest = g_build_filename(state->launcher_root, st.name + strlen(ARCHIVE_ROOT_DIR), NULL);
+		} else if(g_str_has_prefix(st.name, ARCHIVE_INSTANCE_DIR) && relative_safe(st.name + strlen(ARCHIVE_INSTANCE_DIR))) {
+			dest = g_build_filename(state->location, st.name + strlen(ARCHIVE_INSTANCE_DIR), NULL);
+		} else {
+			import_fail(state, "Unexpected entry %s", st.name);
+			break;
+		}
+		// Launches of other processes may be fetching the same game file
+		char *lock_path = file ? g_strconcat(dest, DOWNLOAD_LOCK_SUFFIX, NULL) : NULL;
+		int lock = lock_path ? util_lock_path(lock_path) : -1;
+		bool skip = sha1 && file_matches(dest, sha1, st.size);
+		// The sha1 comes from the archive too, files other instances use are never replaced by it
+		if(!skip && file && g_file_test(dest, G_FILE_TEST_EXISTS)) {
+			g_print("Keeping %s, it differs from the archive\n", dest);
+			skip = true;
+		}
+		if(!skip && !extract_entry(state, zip, i, dest, sha1) && !import_stopped(state)) {
+			import_fail(state, "Failed to extract %s", st.name);
+		}
+		util_unlock_path(lock, lock_path);
+		free(lock_path);
+		g_mutex_lock(&state->mutex);
+		if(skip) {
+			state->done_size += st.size;
+			state->stats.present++;
+			state->stats.present_size += st.size;
+		} else {
+			state->stats.fetched++;
+			state->stats.fetched_size += st.size;
+		}
+		state->label = file ? "Extracting game files" : "Extracting instance";
+		g_mutex_unlock(&state->mutex);
+		free(dest);
+	}
+	if(zip) {
+		zip_discard(zip);
+	}
+	g_mutex_lock(&state->mutex);
+	state->running--;
+	g_cond_signal(&state->cond);
+	g_mutex_unlock(&state->mutex);
+	return NULL;
+}
+
+static json_object *read_manifest(zip_t *zip) {
+	zip_stat_t st;
+	if(zip_stat(zip, ARCHIVE_MANIFEST, 0, &st) != 0) {
+		return NULL;
+	}
+	zip_file_t *file = zip_fopen(zip, ARCHIVE_MANIFEST, 0);
+	if(!file) {
+		return NULL;
+	}
+	char *str = g_malloc(st.size + 1);
+	zip_int64_t n = zip_fread(file, str, st.size);
+	zip_fclose(file);
+	str[n > 0 ? n : 0] = '\0';
+	json_object *manifest = json_tokener_parse(str);
+	free(str);
+	if(!json_object_is_type(manifest, json_type_object) || json_get_int(manifest, "format") != ARCHIVE_FORMAT) {
+		json_object_put(manifest);
+		return NULL;
+	}
+	return manifest;
+}
+
+MicrolauncherInstance *microlauncher_archive_import(LaunchContext *ctx, const char *archive_path, const char *location) {
+	struct Callbacks callbacks = microlauncher_launch_context_get_callbacks(ctx);
+	const struct Settings *settings = microlauncher_launch_context_get_settings(ctx);
+	char *str;
+	zip_t *zip = zip_open(archive_path, ZIP_RDONLY, NULL);
+	json_object *manifest = zip ? read_manifest(zip) : NULL;
+	guint64 total_size = 0;
+	if(!manifest) {
+		str = g_strdup_printf("%s is not an instance archive", archive_path);
+		run_callback(show_error, str);
+		free(str);
+		if(zip) {
+			zip_discard(zip);
+		}
+		return NULL;
+	}
+	zip_int64_t count = zip_get_num_entries(zip, 0);
+	for(zip_int64_t i = 0; i < count; i++) {
+		zip_stat_t st;
+		if(zip_stat_index(zip, i, 0, &st) == 0) {
+			total_size += st.size;
+		}
+	}
+	zip_discard(zip);
+
+	MicrolauncherInstance *inst = microlauncher_instance_new();
+	microlauncher_load_instance(json_object_object_get(manifest, "instance"), inst);
+	// Would run whatever the author of the archive chose on the next launch
+	if(inst->javaLocation || inst->prefixCommand || inst->jvmArgs) {
+		g_print("Dropping Java location, JVM arguments and prefix command of the archive\n");
+	}
+	g_clear_pointer(&inst->javaLocation, free);
+	g_slist_free_full(g_steal_pointer(&inst->prefixCommand), free);
+	g_slist_free_full(g_steal_pointer(&inst->jvmArgs), free);
+	char *name = microlauncher_instance_unique_name(inst->name ? inst->name : "Imported instance");
+	free(inst->name);
+	inst->name = name;
+	char *old_location = inst->location;
+	inst->location = location ? g_strdup(location) : g_strdup_printf("%s/microlauncher/instances/%s", XDG_DATA_HOME, inst->name);
+	if(old_location && inst->icon && g_str_has_prefix(inst->icon, old_location)) {
+		char *icon = g_build_filename(inst->location, inst->icon + strlen(old_location), NULL);
+		free(inst->icon);
+		inst->icon = icon;
+	}
+	free(old_location);
+
+	struct ImportState state = {
+		.archive_path = archive_path,
+		.launcher_root = settings->launcher_root,
+		.location = inst->location,
+		.files = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL),
+		.cancellable = microlauncher_launch_context_get_cancellable(ctx)};
+	json_object *files = json_object_object_get(manifest, "files");
+	for(size_t i = 0; json_object_is_type(files, json_type_array) && i < json_object_array_length(files); i++) {
+		json_object *file = json_object_array_get_idx(files, i);
+		const char *rel = json_get_string(file, "path");
+		if(!relative_safe(rel) || !microlauncher_peer_path_served(rel) || !json_get_string(file, "sha1")) {
+			import_fail(&state, "Invalid manifest entry %s", rel);
+			continue;
+		}
+		g_hash_table_insert(state.files, g_strconcat(ARCHIVE_ROOT_DIR, rel, NULL), file);
+	}
+	if(!state.error && g_file_test(inst->location, G_FILE_TEST_EXISTS)) {
+		import_fail(&state, "%s already exists", inst->location);
+	}
+
+	bool extracted = false;
+	if(!state.error) {
+		run_callback(stage_update, "Importing instance");
+		GThread *threads[ARCHIVE_THREADS];
+		state.running = ARCHIVE_THREADS;
+		for(int i = 0; i < ARCHIVE_THREADS; i++) {
+			threads[i] = g_thread_new("archive-import", import_thread, &state);
+		}
+		// Progress is reported from the calling thread so callbacks don't have to be thread safe
+		g_mutex_lock(&state.mutex);
+		while(state.running > 0) {
+			g_cond_wait_until(&state.cond, &state.mutex, g_get_monotonic_time() + 100 * G_TIME_SPAN_MILLISECOND);
+			guint64 done_size = state.done_size;
+			const char *label = state.label;
+			g_mutex_unlock(&state.mutex);
+			if(label && total_size > 0) {
+				run_callback(progress_update, (double)done_size / total_size, label);
+			}
+			g_mutex_lock(&state.mutex);
+		}
+		g_mutex_unlock(&state.mutex);
+		for(int i = 0; i < ARCHIVE_THREADS; i++) {
+			g_thread_join(threads[i]);
+		}
+		run_callback(stage_update, NULL);
+		extracted = true;
+	}
+	microlauncher_launch_context_add_stats(ctx, &state.stats);
+
+	bool cancelled = state.cancellable && g_cancellable_is_cancelled(state.cancellable);
+	if(state.error || cancelled) {
+		if(state.error) {
+			run_callback(show_error, state.error);
+		}
+		if(extracted) {
+			rmdir_recursive(inst->location, NULL);
+		}
+		g_object_unref(inst);
+		inst = NULL;
+	}
+	free(state.error);
+	g_hash_table_destroy(state.files);
+	json_object_put(manifest);
+	return inst;
+}
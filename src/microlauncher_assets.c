@@ -0,0 +1,184 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <json.h>
+#include <microlauncher.h>
+#include <microlauncher_assets.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <util/json_util.h>
+#include <util/util.h>
+#ifdef G_OS_WIN32
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+#define PARTIAL_SUFFIX ".part"
+
+struct LayoutState {
+	GCancellable *cancellable;
+	/* Games may write to what is in their resources directory, which must not reach the objects */
+	bool hardlink;
+	GMutex mutex;
+	char *failed_path;
+};
+
+struct LayoutEntry {
+	char *object;
+	char *dest;
+};
+
+/* Hardlinks share the inode with the object, reflinks and copies are given its mtime */
+static bool entry_current(const char *object, const char *dest, bool hardlink) {
+	GStatBuf objectSt, destSt;
+	if(g_stat(object, &objectSt) != 0 || g_stat(dest, &destSt) != 0) {
+		return false;
+	}
+	if(objectSt.st_dev == destSt.st_dev && objectSt.st_ino == destSt.st_ino) {
+		return hardlink;
+	}
+	return objectSt.st_size == destSt.st_size && objectSt.st_mtime == destSt.st_mtime;
+}
+
+/* Replaces dest through a temporary name, so a running game keeps reading the old file */
+static bool link_entry(const char *object, const char *dest, bool hardlink) {
+	GStatBuf objectSt, tmpSt;
+	if(g_stat(object, &objectSt) != 0) {
+		return false;
+	}
+	char *tmp_path = g_strdup_printf("%s.%08x" PARTIAL_SUFFIX, dest, g_random_int());
+	bool ok = hardlink ? util_link_or_copy(object, tmp_path) : util_clone_file(object, tmp_path);
+	if(ok && g_stat(tmp_path, &tmpSt) == 0 && tmpSt.st_ino != objectSt.st_ino) {
+		struct utimbuf times = {objectSt.st_atime, objectSt.st_mtime};
+		g_utime(tmp_path, &times);
+	}
+#ifdef G_OS_WIN32
+	g_remove(dest);
+#endif
+	ok = ok && g_rename(tmp_path, dest) == 0;
+	if(!ok) {
+		g_remove(tmp_path);
+	}
+	free(tmp_path);
+	return ok;
+}
+
+static void layout_job(gpointer data, gpointer userdata) {
+	struct LayoutEntry *entry = data;
+	struct LayoutState *state = userdata;
+	g_mutex_lock(&state->mutex);
+	bool stopped = state->failed_path != NULL || g_cancellable_is_cancelled(state->cancellable);
+	g_mutex_unlock(&state->mutex);
+	if(!stopped && !entry_current(entry->object, entry->dest, state->hardlink) && !link_entry(entry->object, entry->dest, state->hardlink)) {
+		g_mutex_lock(&state->mutex);
+		if(!state->failed_path) {
+			state->failed_path = g_strdup(entry->dest);
+		}
+		g_mutex_unlock(&state->mutex);
+	}
+	free(entry->object);
+	free(entry->dest);
+	free(entry);
+}
+
+/* Removes files the index doesn't list anymore. Returns true if path is empty afterwards */
+static bool prune_stale(const char *path, GHashTable *expected) {
+	GDir *dir = g_dir_open(path, 0, NULL);
+	if(!dir) {
+		return false;
+	}
+	bool empty = true;
+	const char *name;
+	while((name = g_dir_read_name(dir))) {
+		char *child = g_build_filename(path, name, NULL);
+		bool removed = false;
+		if(g_file_test(child, G_FILE_TEST_IS_DIR) && !g_file_test(child, G_FILE_TEST_IS_SYMLINK)) {
+			removed = prune_stale(child, expected) && g_rmdir(child) == 0;
+		} else if(!g_hash_table_contains(expected, child) && !str_ends_with(name, PARTIAL_SUFFIX)) {
+			// Partial files may belong to another launch linking the same index
+			removed = g_remove(child) == 0;
+		}
+		empty &= removed;
+		free(child);
+	}
+	g_dir_close(dir);
+	return empty;
+}
+
+static bool key_safe(const char *key) {
+	return key[0] != '\0' && key[0] != '/' && !strstr(key, "..") && !strchr(key, '\\');
+}
+
+bool microlauncher_assets_prepare(LaunchContext *ctx, const char *index_path, const char *assets_dir, const char *game_dir, char *game_assets) {
+	struct Callbacks callbacks = microlauncher_launch_context_get_callbacks(ctx);
+	snprintf(game_assets, PATH_MAX, "%s", assets_dir);
+	json_object *index = json_from_file(index_path);
+	bool resources = json_get_bool(index, "map_to_resources");
+	if(!resources && !json_get_bool(index, "virtual")) {
+		json_object_put(index);
+		return true;
+	}
+	if(resources) {
+		snprintf(game_assets, PATH_MAX, "%s/%s", game_dir, ASSETS_RESOURCES_DIR);
+	} else {
+		char *name = g_path_get_basename(index_path);
+		if(str_ends_with(name, ".json")) {
+			name[strlen(name) - strlen(".json")] = '\0';
+		}
+		snprintf(game_assets, PATH_MAX, "%s/%s/%s", assets_dir, ASSETS_VIRTUAL_DIR, name);
+		free(name);
+	}
+	run_callback(stage_update, "Linking assets");
+	// Path under the layout to object
+	GHashTable *expected = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	json_object *obj = json_object_object_get(index, "objects");
+	if(json_object_is_type(obj, json_type_object)) {
+		json_object_object_foreach(obj, key, val) {
+			const char *hash = json_get_string(val, "hash");
+			if(!hash || strlen(hash) < 2 || !key_safe(key)) {
+				continue;
+			}
+			char *relative = g_strdup(key);
+			replace_chr(relative, '/', G_DIR_SEPARATOR);
+			char *dest = g_build_filename(game_assets, relative, NULL);
+			char *object = g_strdup_printf("%s/objects/%c%c/%s", assets_dir, *hash, *(hash + 1), hash);
+			g_hash_table_replace(expected, dest, object);
+			free(relative);
+		}
+	}
+	json_object_put(index);
+	// Whatever is in resources may have been put there by the game itself
+	if(!resources) {
+		prune_stale(game_assets, expected);
+	}
+
+	struct LayoutState state = {0};
+	state.cancellable = microlauncher_launch_context_get_cancellable(ctx);
+	state.hardlink = !resources;
+	g_mutex_init(&state.mutex);
+	GThreadPool *pool = g_thread_pool_new(layout_job, &state, ASSETS_LAYOUT_THREADS, FALSE, NULL);
+	GHashTableIter iter;
+	gpointer dest, object;
+	g_hash_table_iter_init(&iter, expected);
+	while(g_hash_table_iter_next(&iter, &dest, &object)) {
+		struct LayoutEntry *entry = g_new(struct LayoutEntry, 1);
+		entry->dest = g_strdup(dest);
+		entry->object = g_strdup(object);
+		g_thread_pool_push(pool, entry, NULL);
+	}
+	g_thread_pool_free(pool, FALSE, TRUE);
+	g_hash_table_destroy(expected);
+	g_mutex_clear(&state.mutex);
+
+	bool ok = !state.failed_path && !g_cancellable_is_cancelled(state.cancellable);
+	if(state.failed_path) {
+		char *str = g_strdup_printf("Failed to link asset %s", state.failed_path);
+		run_callback(show_error, str);
+		free(str);
+		free(state.failed_path);
+	}
+	run_callback(stage_update, NULL);
+	return ok;
+}
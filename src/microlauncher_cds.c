@@ -0,0 +1,107 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <microlauncher_cds.h>
+#include <microlauncher_java_runtime.h>
+#include <openssl/sha.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <util/util.h>
+
+#define CDS_ARCHIVE_SUFFIX ".jsa"
+#define CDS_DUMP_SUFFIX ".tmp"
+
+bool java_supports_dynamic_archive(JavaRuntime *runtime) {
+	// -XX:ArchiveClassesAtExit was added in JDK 13 and only exists in HotSpot
+	if(java_get_major_version(runtime) < 13) {
+		return false;
+	}
+	const char *vm = java_get_vm_name(runtime);
+	return vm && !strstr(vm, "OpenJ9");
+}
+
+/* Archive is only valid for exact runtime and classpath, so both are part of its name */
+static void get_archive_key(JavaRuntime *runtime, const char *classpath, Sha1 key) {
+	unsigned char digest[SHA_DIGEST_LENGTH];
+	SHA_CTX ctx;
+	struct stat st;
+	char entry[PATH_MAX];
+	SHA1_Init(&ctx);
+	SHA1_Update(&ctx, runtime->location, strlen(runtime->location) + 1);
+	SHA1_Update(&ctx, runtime->version, strlen(runtime->version) + 1);
+	if(stat(runtime->location, &st) == 0) {
+		SHA1_Update(&ctx, &st.st_mtime, sizeof(st.st_mtime));
+	}
+	const char *str = classpath;
+	while(*str) {
+#ifdef G_OS_WIN32
+		const char *end = strchr(str, ';');
+#else
+		const char *end = strchr(str, ':');
+#endif
+		size_t len = end ? (size_t)(end - str) : strlen(str);
+		snprintf(entry, PATH_MAX, "%.*s", (int)len, str);
+		SHA1_Update(&ctx, entry, len + 1);
+		// Replaced jar invalidates the archive, JVM would refuse to map it anyway
+		if(stat(entry, &st) == 0) {
+			SHA1_Update(&ctx, &st.st_size, sizeof(st.st_size));
+			SHA1_Update(&ctx, &st.st_mtime, sizeof(st.st_mtime));
+		}
+		str += len;
+		if(*str) {
+			str++;
+		}
+	}
+	SHA1_Final(digest, &ctx);
+	bytes_as_hex(digest, SHA_DIGEST_LENGTH, key);
+	key[SHA_DIGEST_LENGTH * 2] = '\0';
+}
+
+char *microlauncher_cds_get_option(JavaRuntime *runtime, const char *classpath, const char *cds_dir, char **dump_path) {
+	char path[PATH_MAX];
+	Sha1 key;
+	*dump_path = NULL;
+	if(!runtime || !classpath || !java_supports_dynamic_archive(runtime)) {
+		return NULL;
+	}
+	get_archive_key(runtime, classpath, key);
+	snprintf(path, PATH_MAX, "%s/%s" CDS_ARCHIVE_SUFFIX, cds_dir, key);
+	if(access(path, R_OK) == 0) {
+		g_print("Using class data sharing archive %s\n", path);
+		return g_strdup_printf("-XX:SharedArchiveFile=%s", path);
+	}
+	if(g_mkdir_with_parents(cds_dir, 0775) != 0) {
+		return NULL;
+	}
+	// Training launch. Archive is written on JVM exit and only kept if the game exited cleanly.
+	// Concurrent launches with the same key each dump to their own file
+	*dump_path = g_strdup_printf("%s.%d-%08x" CDS_DUMP_SUFFIX, path, (int)getpid(), g_random_int());
+	g_print("Creating class data sharing archive %s\n", path);
+	return g_strdup_printf("-XX:ArchiveClassesAtExit=%s", *dump_path);
+}
+
+bool microlauncher_cds_commit(const char *dump_path, bool success) {
+	if(!dump_path) {
+		return false;
+	}
+	if(!success || access(dump_path, R_OK) != 0) {
+		g_remove(dump_path);
+		return false;
+	}
+	const char *suffix = g_strrstr(dump_path, CDS_ARCHIVE_SUFFIX ".");
+	if(!suffix) {
+		g_remove(dump_path);
+		return false;
+	}
+	char *path = g_strndup(dump_path, suffix - dump_path + strlen(CDS_ARCHIVE_SUFFIX));
+	// Replaces an archive a concurrent training launch committed first, both are complete
+	bool ok = g_rename(dump_path, path) == 0;
+	if(!ok) {
+		g_remove(dump_path);
+	}
+	free(path);
+	return ok;
+}
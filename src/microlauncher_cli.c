@@ -0,0 +1,637 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <json.h>
+#include <microlauncher.h>
+#include <microlauncher_archive.h>
+#include <microlauncher_download.h>
+#include <microlauncher_gc.h>
+#include <microlauncher_launch.h>
+#include <microlauncher_monitor.h>
+#include <microlauncher_peer.h>
+#include <microlauncher_service.h>
+#include <microlauncher_snapshot.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <util/json_util.h>
+#include <util/util.h>
+
+#define CLI_NAME "microlauncher-cli"
+
+struct Command {
+	const char *name;
+	const char *summary;
+	GOptionEntry *entries;
+	int (*run)(void);
+};
+
+static char **instance_names = NULL;
+static char **version_ids = NULL;
+static char *user_id = NULL;
+static bool dry_run = false;
+static int port = 0;
+static char *archive_path = NULL;
+static char *directory = NULL;
+static char **keep_ids = NULL;
+static char *snapshot_name = NULL;
+static bool delete_snapshot = false;
+
+static GOptionEntry fetch_entries[] =
+	{
+		{"instance", 'i', 0, G_OPTION_ARG_STRING_ARRAY, &instance_names, "Instance to use, can be repeated", "NAME"},
+		{"version", 'v', 0, G_OPTION_ARG_STRING_ARRAY, &version_ids, "Version id to use, can be repeated", "ID"},
+		G_OPTION_ENTRY_NULL};
+
+static GOptionEntry launch_entries[] =
+	{
+		{"instance", 'i', 0, G_OPTION_ARG_STRING_ARRAY, &instance_names, "Instance to launch", "NAME"},
+		{"user", 'u', 0, G_OPTION_ARG_STRING, &user_id, "Saved user GUID to authenticate as, selected user is used otherwise", "GUID"},
+		G_OPTION_ENTRY_NULL};
+
+static GOptionEntry export_entries[] =
+	{
+		{"instance", 'i', 0, G_OPTION_ARG_STRING_ARRAY, &instance_names, "Instance to export", "NAME"},
+		{"archive", 'a', 0, G_OPTION_ARG_FILENAME, &archive_path, "Archive to write", "FILE"},
+		G_OPTION_ENTRY_NULL};
+
+static GOptionEntry import_entries[] =
+	{
+		{"archive", 'a', 0, G_OPTION_ARG_FILENAME, &archive_path, "Archive to import", "FILE"},
+		{"directory", 'd', 0, G_OPTION_ARG_FILENAME, &directory, "Instance directory, a new one in the data directory by default", "DIR"},
+		G_OPTION_ENTRY_NULL};
+
+static GOptionEntry duplicate_entries[] =
+	{
+		{"instance", 'i', 0, G_OPTION_ARG_STRING_ARRAY, &instance_names, "Instance to duplicate", "NAME"},
+		G_OPTION_ENTRY_NULL};
+
+static GOptionEntry snapshot_entries[] =
+	{
+		{"instance", 'i', 0, G_OPTION_ARG_STRING_ARRAY, &instance_names, "Instance to take a snapshot of", "NAME"},
+		{"name", 'n', 0, G_OPTION_ARG_STRING, &snapshot_name, "Name of the snapshot, current date and time by default", "SNAPSHOT"},
+		{"delete", 0, 0, G_OPTION_ARG_NONE, &delete_snapshot, "Delete the snapshot instead", NULL},
+		G_OPTION_ENTRY_NULL};
+
+static GOptionEntry snapshots_entries[] =
+	{
+		{"instance", 'i', 0, G_OPTION_ARG_STRING_ARRAY, &instance_names, "Instance to list snapshots of", "NAME"},
+		G_OPTION_ENTRY_NULL};
+
+static GOptionEntry restore_entries[] =
+	{
+		{"instance", 'i', 0, G_OPTION_ARG_STRING_ARRAY, &instance_names, "Instance to restore", "NAME"},
+		{"name", 'n', 0, G_OPTION_ARG_STRING, &snapshot_name, "Snapshot to restore", "SNAPSHOT"},
+		G_OPTION_ENTRY_NULL};
+
+static GOptionEntry service_entries[] =
+	{
+		G_OPTION_ENTRY_NULL};
+
+static GOptionEntry serve_entries[] =
+	{
+		{"port", 'p', 0, G_OPTION_ARG_INT, &port, "Port to listen on, " G_STRINGIFY(PEER_DEFAULT_PORT) " by default", "PORT"},
+		G_OPTION_ENTRY_NULL};
+
+static GOptionEntry gc_entries[] =
+	{
+		{"dry-run", 'n', 0, G_OPTION_ARG_NONE, &dry_run, "Only report what would be removed", NULL},
+		{"keep", 'k', 0, G_OPTION_ARG_STRING_ARRAY, &keep_ids, "Version to keep besides those of instances, can be repeated", "ID"},
+		G_OPTION_ENTRY_NULL};
+
+/* Events go to the original stdout, everything else printed by the launcher and the game goes to stderr */
+static FILE *events;
+static GMutex events_lock;
+
+static json_object *event_new(const char *type) {
+	json_object *event = json_object_new_object();
+	json_set_string(event, "event", type);
+	return event;
+}
+
+static void emit(json_object *event) {
+	g_mutex_lock(&events_lock);
+	fprintf(events, "%s\n", json_object_to_json_string_ext(event, JSON_C_TO_STRING_PLAIN | JSON_C_TO_STRING_NOSLASHESCAPE));
+	fflush(events);
+	g_mutex_unlock(&events_lock);
+	json_object_put(event);
+}
+
+static void cli_stage_update(const char *msg, void *userdata) {
+	if(!msg) {
+		return;
+	}
+	json_object *event = event_new("stage");
+	json_set_string(event, "stage", msg);
+	emit(event);
+}
+
+static void cli_progress_update(double fraction, const char *msg, void *userdata) {
+	json_object *event = event_new("progress");
+	json_object_object_add(event, "fraction", json_object_new_double(fraction));
+	json_set_string(event, "file", msg);
+	emit(event);
+}
+
+static void cli_show_error(const char *msg, void *userdata) {
+	json_object *event = event_new("error");
+	json_set_string(event, "message", msg);
+	emit(event);
+}
+
+static void cli_file_update(const char *path, const char *url, long size, void *userdata) {
+	enum DownloadMode *mode = userdata;
+	json_object *event = event_new("file");
+	json_set_string(event, "status", *mode == DOWNLOAD_MODE_FETCH ? "fetched" : "missing");
+	json_set_string(event, "path", path);
+	json_set_string(event, "url", url);
+	json_object_object_add(event, "size", json_object_new_int64(size));
+	emit(event);
+}
+
+static bool resolve_targets(GPtrArray *instances, GPtrArray *versions) {
+	for(char **name = instance_names; name && *name; name++) {
+		MicrolauncherInstance *inst = microlauncher_instance_get(*microlauncher_get_instances(), *name);
+		if(!inst) {
+			char *msg = g_strdup_printf("No instance named %s", *name);
+			cli_show_error(msg, NULL);
+			free(msg);
+			return false;
+		}
+		g_ptr_array_add(instances, inst);
+		g_ptr_array_add(versions, inst->version);
+	}
+	for(char **id = version_ids; id && *id; id++) {
+		g_ptr_array_add(instances, NULL);
+		g_ptr_array_add(versions, *id);
+	}
+	if(versions->len > 0) {
+		return true;
+	}
+	// Everything in instances.json by default
+	for(GSList *node = *microlauncher_get_instances(); node; node = node->next) {
+		MicrolauncherInstance *inst = node->data;
+		if(inst->version) {
+			g_ptr_array_add(instances, inst);
+			g_ptr_array_add(versions, inst->version);
+		}
+	}
+	if(versions->len == 0) {
+		cli_show_error("No instances or versions given", NULL);
+		return false;
+	}
+	return true;
+}
+
+static int run_fetch(enum DownloadMode mode) {
+	GPtrArray *instances = g_ptr_array_new();
+	GPtrArray *versions = g_ptr_array_new();
+	if(!resolve_targets(instances, versions)) {
+		g_ptr_array_free(instances, TRUE);
+		g_ptr_array_free(versions, TRUE);
+		return EXIT_FAILURE;
+	}
+	struct Callbacks callbacks = {
+		.stage_update = cli_stage_update,
+		.progress_update = cli_progress_update,
+		.show_error = cli_show_error,
+		.file_update = cli_file_update,
+		.userdata = &mode};
+	for(guint i = 0; i < versions->len; i++) {
+		MicrolauncherInstance *inst = g_ptr_array_index(instances, i);
+		json_object *event = event_new("target");
+		json_set_string(event, "instance", inst ? inst->name : NULL);
+		json_set_string(event, "version", g_ptr_array_index(versions, i));
+		emit(event);
+	}
+	g_ptr_array_add(versions, NULL);
+	LaunchContext *ctx = microlauncher_launch_context_new(NULL, NULL, callbacks);
+	microlauncher_launch_context_set_download_mode(ctx, mode);
+	bool ok = microlauncher_fetch(ctx, (const char *const *)versions->pdata);
+	struct DownloadStats total = microlauncher_launch_context_get_stats(ctx);
+	microlauncher_launch_context_free(ctx);
+	json_object *event = event_new("summary");
+	json_set_bool(event, "ok", ok);
+	json_object_object_add(event, "present", json_object_new_int64(total.present));
+	json_object_object_add(event, "presentBytes", json_object_new_int64(total.present_size));
+	json_object_object_add(event, mode == DOWNLOAD_MODE_FETCH ? "fetched" : "missing", json_object_new_int64(total.fetched));
+	json_object_object_add(event, mode == DOWNLOAD_MODE_FETCH ? "fetchedBytes" : "missingBytes", json_object_new_int64(total.fetched_size));
+	if(mode == DOWNLOAD_MODE_FETCH) {
+		json_object_object_add(event, "fromStore", json_object_new_int64(total.stored));
+		json_object_object_add(event, "fromStoreBytes", json_object_new_int64(total.stored_size));
+	}
+	emit(event);
+	g_ptr_array_free(instances, TRUE);
+	g_ptr_array_free(versions, TRUE);
+	// Verification fails on anything missing or corrupt, a plan only reports it
+	if(!ok || (mode == DOWNLOAD_MODE_VERIFY && total.fetched > 0)) {
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+static int run_prefetch(void) {
+	return run_fetch(DOWNLOAD_MODE_FETCH);
+}
+
+static int run_verify(void) {
+	return run_fetch(DOWNLOAD_MODE_VERIFY);
+}
+
+static int run_plan(void) {
+	return run_fetch(DOWNLOAD_MODE_PLAN);
+}
+
+struct LaunchState {
+	GMainLoop *loop;
+	int exit_code;
+};
+
+static void cli_instance_started(GPid pid, void *userdata) {
+	json_object *event = event_new("started");
+	json_object_object_add(event, "pid", json_object_new_int(pid));
+	emit(event);
+}
+
+static void cli_instance_finished(const struct ExitStatus *status, void *userdata) {
+	struct LaunchState *state = userdata;
+	json_object *event = event_new("exited");
+	if(status->exited) {
+		json_set_int(event, "code", status->code);
+		state->exit_code = status->code;
+	} else {
+		json_set_int(event, "signal", status->signal);
+		json_set_bool(event, "coreDumped", status->core_dumped);
+		state->exit_code = 128 + status->signal;
+	}
+	emit(event);
+	g_main_loop_quit(state->loop);
+}
+
+static void cli_process_sample(const struct ProcessSample *sample, void *userdata) {
+	json_object *event = event_new("sample");
+	json_object_object_add(event, "cpu", json_object_new_double(sample->cpu));
+	json_object_object_add(event, "rss", json_object_new_int64(sample->rss));
+	json_object_object_add(event, "swap", json_object_new_int64(sample->swap));
+	json_set_int(event, "threads", sample->threads);
+	json_set_int(event, "processes", sample->processes);
+	json_object_object_add(event, "readRate", json_object_new_double(sample->read_rate));
+	json_object_object_add(event, "writeRate", json_object_new_double(sample->write_rate));
+	emit(event);
+}
+
+static int run_launch(void) {
+	if(!instance_names || !instance_names[0] || instance_names[1]) {
+		cli_show_error("Exactly one instance must be given", NULL);
+		return EXIT_FAILURE;
+	}
+	MicrolauncherInstance *inst = microlauncher_instance_get(*microlauncher_get_instances(), instance_names[0]);
+	MicrolauncherAccount *user = user_id ? microlauncher_account_get(*microlauncher_get_accounts(), user_id) : microlauncher_get_settings()->user;
+	if(!inst || !user) {
+		cli_show_error(inst ? "No such user" : "No such instance", NULL);
+		return EXIT_FAILURE;
+	}
+	struct LaunchState state = {
+		.loop = g_main_loop_new(NULL, false),
+		.exit_code = EXIT_FAILURE};
+	struct Callbacks callbacks = {
+		.instance_started = cli_instance_started,
+		.instance_finished = cli_instance_finished,
+		.stage_update = cli_stage_update,
+		.progress_update = cli_progress_update,
+		.show_error = cli_show_error,
+		.process_sample = cli_process_sample,
+		.userdata = &state};
+	LaunchContext *ctx = microlauncher_launch_context_new(inst, user, callbacks);
+	if(microlauncher_launch_instance(ctx)) {
+		g_main_loop_run(state.loop);
+	}
+	microlauncher_launch_context_free(ctx);
+	g_main_loop_unref(state.loop);
+	return state.exit_code;
+}
+
+static void cli_gc_collected(const char *path, guint64 size, enum GcCategory category, void *userdata) {
+	json_object *event = event_new(dry_run ? "garbage" : "removed");
+	json_set_string(event, "path", path);
+	json_set_string(event, "category", microlauncher_gc_category_name(category));
+	json_object_object_add(event, "size", json_object_new_int64(size));
+	emit(event);
+}
+
+static int run_gc(void) {
+	struct Callbacks callbacks = {
+		.stage_update = cli_stage_update,
+		.show_error = cli_show_error};
+	struct GcReport report;
+	char **roots = microlauncher_gc_get_roots((const char *const *)keep_ids);
+	LaunchContext *ctx = microlauncher_launch_context_new(NULL, NULL, callbacks);
+	bool ok = microlauncher_gc_run(ctx, (const char *const *)roots, dry_run, cli_gc_collected, NULL, &report);
+	microlauncher_launch_context_free(ctx);
+	g_strfreev(roots);
+	json_object *event = event_new("summary");
+	json_set_bool(event, "ok", ok);
+	json_set_bool(event, "dryRun", dry_run);
+	if(ok) {
+		json_object *categories = json_object_new_object();
+		for(int i = 0; i < GC_CATEGORY_COUNT; i++) {
+			json_object *category = json_object_new_object();
+			json_object_object_add(category, "usedBytes", json_object_new_int64(report.used[i]));
+			json_object_object_add(category, "unusedBytes", json_object_new_int64(report.unused[i]));
+			json_object_object_add(categories, microlauncher_gc_category_name(i), category);
+		}
+		json_object_object_add(event, "categories", categories);
+		json_object_object_add(event, "freedBytes", json_object_new_int64(report.freed));
+	}
+	emit(event);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Adds elapsed time and rate since start to a summary event and emits it */
+static void emit_throughput(json_object *event, guint64 bytes, gint64 start) {
+	double seconds = (double)(g_get_monotonic_time() - start) / G_TIME_SPAN_SECOND;
+	json_object_object_add(event, "seconds", json_object_new_double(seconds));
+	json_object_object_add(event, "bytesPerSecond", json_object_new_double(seconds > 0 ? bytes / seconds : 0));
+	emit(event);
+}
+
+static int run_export(void) {
+	if(!instance_names || !instance_names[0] || instance_names[1] || !archive_path) {
+		cli_show_error("Exactly one instance and an archive must be given", NULL);
+		return EXIT_FAILURE;
+	}
+	MicrolauncherInstance *inst = microlauncher_instance_get(*microlauncher_get_instances(), instance_names[0]);
+	if(!inst) {
+		cli_show_error("No such instance", NULL);
+		return EXIT_FAILURE;
+	}
+	enum DownloadMode mode = DOWNLOAD_MODE_FETCH;
+	struct Callbacks callbacks = {
+		.stage_update = cli_stage_update,
+		.progress_update = cli_progress_update,
+		.show_error = cli_show_error,
+		.file_update = cli_file_update,
+		.userdata = &mode};
+	gint64 start = g_get_monotonic_time();
+	LaunchContext *ctx = microlauncher_launch_context_new(inst, NULL, callbacks);
+	bool ok = microlauncher_archive_export(ctx, archive_path);
+	struct DownloadStats total = microlauncher_launch_context_get_stats(ctx);
+	microlauncher_launch_context_free(ctx);
+	GStatBuf st;
+	guint64 size = ok && g_stat(archive_path, &st) == 0 ? st.st_size : 0;
+	json_object *event = event_new("summary");
+	json_set_bool(event, "ok", ok);
+	json_object_object_add(event, "fetchedBytes", json_object_new_int64(total.fetched_size));
+	json_object_object_add(event, "archiveBytes", json_object_new_int64(size));
+	emit_throughput(event, size, start);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int run_import(void) {
+	if(!archive_path) {
+		cli_show_error("No archive given", NULL);
+		return EXIT_FAILURE;
+	}
+	struct Callbacks callbacks = {
+		.stage_update = cli_stage_update,
+		.progress_update = cli_progress_update,
+		.show_error = cli_show_error};
+	gint64 start = g_get_monotonic_time();
+	LaunchContext *ctx = microlauncher_launch_context_new(NULL, NULL, callbacks);
+	MicrolauncherInstance *inst = microlauncher_archive_import(ctx, archive_path, directory);
+	if(inst) {
+		*microlauncher_get_instances() = g_slist_append(*microlauncher_get_instances(), inst);
+		microlauncher_save_settings();
+		json_object *imported = event_new("imported");
+		json_set_string(imported, "instance", inst->name);
+		json_set_string(imported, "version", inst->version);
+		json_set_string(imported, "location", inst->location);
+		emit(imported);
+	}
+	struct DownloadStats total = microlauncher_launch_context_get_stats(ctx);
+	microlauncher_launch_context_free(ctx);
+	json_object *event = event_new("summary");
+	json_set_bool(event, "ok", inst != NULL);
+	json_object_object_add(event, "present", json_object_new_int64(total.present));
+	json_object_object_add(event, "presentBytes", json_object_new_int64(total.present_size));
+	json_object_object_add(event, "extracted", json_object_new_int64(total.fetched));
+	json_object_object_add(event, "extractedBytes", json_object_new_int64(total.fetched_size));
+	emit_throughput(event, total.present_size + total.fetched_size, start);
+	return inst ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static MicrolauncherInstance *single_instance(void) {
+	if(!instance_names || !instance_names[0] || instance_names[1]) {
+		cli_show_error("Exactly one instance must be given", NULL);
+		return NULL;
+	}
+	MicrolauncherInstance *inst = microlauncher_instance_get(*microlauncher_get_instances(), instance_names[0]);
+	if(!inst) {
+		cli_show_error("No such instance", NULL);
+	}
+	return inst;
+}
+
+/* Hardlinked files share their data, only cloned ones may take space */
+static void emit_clone_summary(LaunchContext *ctx, bool ok, gint64 start) {
+	struct DownloadStats total = microlauncher_launch_context_get_stats(ctx);
+	json_object *event = event_new("summary");
+	json_set_bool(event, "ok", ok);
+	json_object_object_add(event, "linked", json_object_new_int64(total.present));
+	json_object_object_add(event, "linkedBytes", json_object_new_int64(total.present_size));
+	json_object_object_add(event, "cloned", json_object_new_int64(total.fetched));
+	json_object_object_add(event, "clonedBytes", json_object_new_int64(total.fetched_size));
+	emit_throughput(event, total.present_size + total.fetched_size, start);
+}
+
+static int run_duplicate(void) {
+	MicrolauncherInstance *inst = single_instance();
+	if(!inst) {
+		return EXIT_FAILURE;
+	}
+	struct Callbacks callbacks = {
+		.stage_update = cli_stage_update,
+		.progress_update = cli_progress_update,
+		.show_error = cli_show_error};
+	gint64 start = g_get_monotonic_time();
+	LaunchContext *ctx = microlauncher_launch_context_new(inst, NULL, callbacks);
+	MicrolauncherInstance *copy = microlauncher_snapshot_duplicate(ctx);
+	if(copy) {
+		GSList **instances = microlauncher_get_instances();
+		*instances = g_slist_insert(*instances, copy, g_slist_index(*instances, inst) + 1);
+		microlauncher_save_settings();
+		json_object *event = event_new("duplicated");
+		json_set_string(event, "instance", copy->name);
+		json_set_string(event, "location", copy->location);
+		emit(event);
+	}
+	emit_clone_summary(ctx, copy != NULL, start);
+	microlauncher_launch_context_free(ctx);
+	return copy ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int run_snapshot(void) {
+	MicrolauncherInstance *inst = single_instance();
+	if(!inst) {
+		return EXIT_FAILURE;
+	}
+	if(delete_snapshot && !snapshot_name) {
+		cli_show_error("No snapshot given", NULL);
+		return EXIT_FAILURE;
+	}
+	struct Callbacks callbacks = {
+		.stage_update = cli_stage_update,
+		.progress_update = cli_progress_update,
+		.show_error = cli_show_error};
+	LaunchContext *ctx = microlauncher_launch_context_new(inst, NULL, callbacks);
+	if(delete_snapshot) {
+		bool ok = microlauncher_snapshot_delete(ctx, snapshot_name);
+		microlauncher_launch_context_free(ctx);
+		return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	gint64 start = g_get_monotonic_time();
+	char *name = microlauncher_snapshot_create(ctx, snapshot_name);
+	if(name) {
+		json_object *event = event_new("snapshot");
+		json_set_string(event, "instance", inst->name);
+		json_set_string(event, "name", name);
+		emit(event);
+	}
+	emit_clone_summary(ctx, name != NULL, start);
+	microlauncher_launch_context_free(ctx);
+	bool ok = name != NULL;
+	free(name);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int run_snapshots(void) {
+	MicrolauncherInstance *inst = single_instance();
+	if(!inst) {
+		return EXIT_FAILURE;
+	}
+	char **names = microlauncher_snapshot_list(inst);
+	for(char **name = names; *name; name++) {
+		json_object *event = event_new("snapshot");
+		json_set_string(event, "instance", inst->name);
+		json_set_string(event, "name", *name);
+		emit(event);
+	}
+	g_strfreev(names);
+	return EXIT_SUCCESS;
+}
+
+static int run_restore(void) {
+	MicrolauncherInstance *inst = single_instance();
+	if(!inst) {
+		return EXIT_FAILURE;
+	}
+	if(!snapshot_name) {
+		cli_show_error("No snapshot given", NULL);
+		return EXIT_FAILURE;
+	}
+	struct Callbacks callbacks = {
+		.stage_update = cli_stage_update,
+		.progress_update = cli_progress_update,
+		.show_error = cli_show_error};
+	gint64 start = g_get_monotonic_time();
+	LaunchContext *ctx = microlauncher_launch_context_new(inst, NULL, callbacks);
+	bool ok = microlauncher_snapshot_restore(ctx, snapshot_name);
+	emit_clone_summary(ctx, ok, start);
+	microlauncher_launch_context_free(ctx);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int run_serve(void) {
+	if(port < 0 || port > G_MAXUINT16) {
+		cli_show_error("Invalid port", NULL);
+		return EXIT_FAILURE;
+	}
+	const char *root = microlauncher_get_settings()->launcher_root;
+	GError *error = NULL;
+	PeerServer *server = microlauncher_peer_server_new(root, port, &error);
+	if(!server) {
+		cli_show_error(error->message, NULL);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+	json_object *event = event_new("serving");
+	json_set_string(event, "root", root);
+	json_set_int(event, "port", port ? port : PEER_DEFAULT_PORT);
+	emit(event);
+	GMainLoop *loop = g_main_loop_new(NULL, false);
+	g_main_loop_run(loop);
+	g_main_loop_unref(loop);
+	microlauncher_peer_server_free(server);
+	return EXIT_SUCCESS;
+}
+
+static int run_service(void) {
+	return microlauncher_service_run();
+}
+
+static const struct Command commands[] = {
+	{"prefetch", "Download and verify everything the given instances or versions need, all instances by default", fetch_entries, run_prefetch},
+	{"verify", "Check files of the given instances or versions without downloading them", fetch_entries, run_verify},
+	{"plan", "List files that prefetch would download, comparing sizes only", fetch_entries, run_plan},
+	{"launch", "Launch an instance and wait for the game to exit", launch_entries, run_launch},
+	{"gc", "Remove files no instance needs and leftovers of interrupted launches and downloads", gc_entries, run_gc},
+	{"export", "Write an instance with every game file it needs to a single archive", export_entries, run_export},
+	{"import", "Add the instance of an archive, game files already present are kept", import_entries, run_import},
+	{"duplicate", "Copy an instance together with its directory, cloning files where the filesystem can", duplicate_entries, run_duplicate},
+	{"snapshot", "Save the directory of an instance so it can be restored later", snapshot_entries, run_snapshot},
+	{"snapshots", "List snapshots of an instance, oldest first", snapshots_entries, run_snapshots},
+	{"restore", "Replace the directory of an instance with a snapshot, which is kept", restore_entries, run_restore},
+	{"serve", "Share downloaded versions, libraries and assets with launchers on the local network", serve_entries, run_serve},
+	{"service", "Stay running on the session bus and launch instances for desktop shortcuts", service_entries, run_service},
+	{NULL}};
+
+static void print_usage(void) {
+	fprintf(stderr, "Usage: " CLI_NAME " COMMAND [OPTION...]\n\nCommands:\n");
+	for(const struct Command *cmd = commands; cmd->name; cmd++) {
+		fprintf(stderr, "  %-10s %s\n", cmd->name, cmd->summary);
+	}
+	fprintf(stderr, "\nProgress is written to stdout as one JSON object per line.\n");
+}
+
+int main(int argc, char **argv) {
+	const struct Command *cmd = NULL;
+	for(int i = 0; argc > 1 && commands[i].name; i++) {
+		if(strequal(commands[i].name, argv[1])) {
+			cmd = &commands[i];
+		}
+	}
+	if(!cmd) {
+		print_usage();
+		return 2;
+	}
+	char *parameter = g_strdup_printf("%s - %s", cmd->name, cmd->summary);
+	GOptionContext *context = g_option_context_new(parameter);
+	free(parameter);
+	g_option_context_add_main_entries(context, cmd->entries, NULL);
+	argv[1] = argv[0];
+	argc--;
+	argv++;
+	GError *error = NULL;
+	if(!g_option_context_parse(context, &argc, &argv, &error)) {
+		fprintf(stderr, "%s\n", error->message);
+		g_error_free(error);
+		g_option_context_free(context);
+		return 2;
+	}
+	g_option_context_free(context);
+
+	fflush(stdout);
+	events = fdopen(dup(STDOUT_FILENO), "w");
+	dup2(STDERR_FILENO, STDOUT_FILENO);
+	if(!events) {
+		return EXIT_FAILURE;
+	}
+	if(!microlauncher_init(argv[0])) {
+		return EXIT_FAILURE;
+	}
+	int ret = cmd->run();
+	microlauncher_deinit();
+	fclose(events);
+	return ret;
+}
@@ -0,0 +1,725 @@
+#include <curl/curl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <json.h>
+#include <lzma.h>
+#include <microlauncher.h>
+#include <microlauncher_download.h>
+#include <microlauncher_peer.h>
+#include <microlauncher_store.h>
+#include <openssl/sha.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <util/json_util.h>
+#include <util/util.h>
+#include <util/xdgutil.h>
+
+struct Download {
+	char *url;
+	char *path;
+	char *label;
+	char *sha1;
+	long size;
+	enum DownloadFlags flags;
+	bool fetched;
+	bool stored;
+	/* Linked from a lower root */
+	bool lower;
+};
+
+struct _DownloadQueue {
+	GPtrArray *downloads;
+	GHashTable *paths;
+	long total_size;
+	GCancellable *cancellable;
+	GMutex mutex;
+	GCond cond;
+	guint pending;
+	long done_size;
+	const char *label;
+	/* URL of the first failed download, path for files without one */
+	char *failed_resource;
+	CURLSH *share;
+	enum DownloadMode mode;
+	bool background;
+	bool store;
+	char *launcher_root;
+	char **lower_roots;
+	/* Base URLs of LAN peers for the current run */
+	char **peers;
+	/* Peers that couldn't be reached or stalled, skipped for the rest of the run. Guarded by mutex */
+	GHashTable *dead_peers;
+	struct DownloadStats stats;
+};
+
+struct DownloadSink {
+	FILE *file;
+	SHA_CTX sha1_ctx;
+	long written;
+	bool lzma;
+	lzma_stream stream;
+	bool error;
+};
+
+// Sharing curl handle between transfers has better performance, but a handle can't be used from several threads
+static GPrivate curl_handle = G_PRIVATE_INIT((GDestroyNotify)curl_easy_cleanup);
+
+/* Shared by all queues so concurrent launches don't fetch or hash the same file twice */
+struct VerifiedFile {
+	char sha1[SHA_DIGEST_LENGTH * 2 + 1];
+	goffset size;
+	gint64 mtime;
+	guint64 inode;
+};
+
+static GMutex shared_mutex;
+static GCond shared_cond;
+static GHashTable *in_flight;
+static GHashTable *verified;
+static bool lower_cache_loaded;
+static bool lower_cache_dirty;
+
+static void download_free(gpointer data) {
+	struct Download *dl = data;
+	free(dl->url);
+	free(dl->path);
+	free(dl->label);
+	free(dl->sha1);
+	free(dl);
+}
+
+DownloadQueue *microlauncher_download_queue_new(void) {
+	DownloadQueue *queue = g_new0(DownloadQueue, 1);
+	queue->downloads = g_ptr_array_new_with_free_func(download_free);
+	queue->paths = g_hash_table_new(g_str_hash, g_str_equal);
+	g_mutex_init(&queue->mutex);
+	g_cond_init(&queue->cond);
+	return queue;
+}
+
+void microlauncher_download_queue_add(DownloadQueue *queue, const char *url, const char *path, const char *label, const char *sha1, long size, enum DownloadFlags flags) {
+	if(!path || g_hash_table_contains(queue->paths, path)) {
+		return;
+	}
+	struct Download *dl = g_new0(struct Download, 1);
+	dl->url = g_strdup(url);
+	dl->path = g_strdup(path);
+	dl->label = g_strdup(label ? label : util_basename(path));
+	dl->sha1 = g_strdup(sha1);
+	dl->size = size;
+	dl->flags = flags;
+	g_hash_table_add(queue->paths, dl->path);
+	g_ptr_array_add(queue->downloads, dl);
+	queue->total_size += size;
+}
+
+void microlauncher_download_queue_set_share(DownloadQueue *queue, CURLSH *share) {
+	queue->share = share;
+}
+
+void microlauncher_download_queue_set_mode(DownloadQueue *queue, enum DownloadMode mode) {
+	queue->mode = mode;
+}
+
+void microlauncher_download_queue_set_background(DownloadQueue *queue, bool background) {
+	queue->background = background;
+}
+
+void microlauncher_download_queue_set_store(DownloadQueue *queue, bool store) {
+	queue->store = store;
+}
+
+void microlauncher_download_queue_set_lower_roots(DownloadQueue *queue, char *const *lower_roots) {
+	g_strfreev(queue->lower_roots);
+	queue->lower_roots = g_strdupv((char **)lower_roots);
+}
+
+void microlauncher_download_queue_set_launcher_root(DownloadQueue *queue, const char *launcher_root) {
+	free(queue->launcher_root);
+	queue->launcher_root = g_strdup(launcher_root);
+}
+
+long microlauncher_download_queue_get_size(DownloadQueue *queue) {
+	return queue->total_size;
+}
+
+void microlauncher_download_queue_foreach(DownloadQueue *queue, DownloadFileFunc func, void *userdata) {
+	for(guint i = 0; i < queue->downloads->len; i++) {
+		struct Download *dl = g_ptr_array_index(queue->downloads, i);
+		func(dl->path, dl->sha1, dl->size, userdata);
+	}
+}
+
+struct DownloadStats microlauncher_download_queue_get_stats(DownloadQueue *queue) {
+	return queue->stats;
+}
+
+void microlauncher_download_stats_add(struct DownloadStats *stats, const struct DownloadStats *add) {
+	stats->present += add->present;
+	stats->present_size += add->present_size;
+	stats->fetched += add->fetched;
+	stats->fetched_size += add->fetched_size;
+	stats->stored += add->stored;
+	stats->stored_size += add->stored_size;
+}
+
+void microlauncher_download_queue_free(DownloadQueue *queue) {
+	if(!queue) {
+		return;
+	}
+	g_hash_table_destroy(queue->paths);
+	g_ptr_array_free(queue->downloads, TRUE);
+	g_mutex_clear(&queue->mutex);
+	g_cond_clear(&queue->cond);
+	free(queue->failed_resource);
+	free(queue->launcher_root);
+	g_strfreev(queue->lower_roots);
+	g_strfreev(queue->peers);
+	if(queue->dead_peers) {
+		g_hash_table_destroy(queue->dead_peers);
+	}
+	free(queue);
+}
+
+static bool queue_aborted(DownloadQueue *queue) {
+	bool aborted;
+	g_mutex_lock(&queue->mutex);
+	aborted = queue->failed_resource != NULL;
+	g_mutex_unlock(&queue->mutex);
+	return aborted || (queue->cancellable && g_cancellable_is_cancelled(queue->cancellable));
+}
+
+/* Must be called with shared_mutex held */
+static void shared_init(void) {
+	if(!in_flight) {
+		in_flight = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+		verified = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	}
+}
+
+/* Waits if another queue or another process sharing the launcher root is working on the same file, then claims it.
+ * Returns the descriptor of the lock file, -1 if there is none */
+static int path_claim(const char *path, bool lock) {
+	g_mutex_lock(&shared_mutex);
+	shared_init();
+	while(g_hash_table_contains(in_flight, path)) {
+		g_cond_wait(&shared_cond, &shared_mutex);
+	}
+	g_hash_table_add(in_flight, g_strdup(path));
+	g_mutex_unlock(&shared_mutex);
+	if(!lock) {
+		return -1;
+	}
+	char *lock_path = g_strconcat(path, DOWNLOAD_LOCK_SUFFIX, NULL);
+	int fd = util_lock_path(lock_path);
+	free(lock_path);
+	return fd;
+}
+
+static void path_release(const char *path, int fd) {
+	if(fd >= 0) {
+		char *lock_path = g_strconcat(path, DOWNLOAD_LOCK_SUFFIX, NULL);
+		util_unlock_path(fd, lock_path);
+		free(lock_path);
+	}
+	g_mutex_lock(&shared_mutex);
+	g_hash_table_remove(in_flight, path);
+	g_cond_broadcast(&shared_cond);
+	g_mutex_unlock(&shared_mutex);
+}
+
+static void verified_set(const char *path, const char *sha1, GStatBuf *st) {
+	struct VerifiedFile *file = g_new(struct VerifiedFile, 1);
+	snprintf(file->sha1, sizeof(file->sha1), "%s", sha1);
+	file->size = st->st_size;
+	file->mtime = st->st_mtime;
+	file->inode = st->st_ino;
+	g_mutex_lock(&shared_mutex);
+	g_hash_table_replace(verified, g_strdup(path), file);
+	lower_cache_dirty = true;
+	g_mutex_unlock(&shared_mutex);
+}
+
+static void lower_cache_load(void) {
+	g_mutex_lock(&shared_mutex);
+	shared_init();
+	if(lower_cache_loaded) {
+		g_mutex_unlock(&shared_mutex);
+		return;
+	}
+	lower_cache_loaded = true;
+	char *path = g_build_filename(XDG_CACHE_HOME, LOWER_CACHE_FILE, NULL);
+	json_object *obj = json_from_file(path);
+	free(path);
+	if(json_object_is_type(obj, json_type_object)) {
+		json_object_object_foreach(obj, key, val) {
+			const char *sha1 = json_get_string(val, "sha1");
+			if(!sha1 || g_hash_table_contains(verified, key)) {
+				continue;
+			}
+			struct VerifiedFile *file = g_new(struct VerifiedFile, 1);
+			snprintf(file->sha1, sizeof(file->sha1), "%s", sha1);
+			file->size = json_get_int64(val, "size");
+			file->mtime = json_get_int64(val, "mtime");
+			file->inode = json_get_int64(val, "inode");
+			g_hash_table_replace(verified, g_strdup(key), file);
+		}
+	}
+	json_object_put(obj);
+	g_mutex_unlock(&shared_mutex);
+}
+
+static bool under_any(const char *path, char *const *roots) {
+	for(char *const *root = roots; *root; root++) {
+		if(path_is_under(path, *root)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Only entries of lower roots are kept, files of the launcher root may change any time */
+static void lower_cache_save(char *const *lower_roots) {
+	GHashTableIter iter;
+	gpointer key, value;
+	g_mutex_lock(&shared_mutex);
+	if(!lower_cache_dirty) {
+		g_mutex_unlock(&shared_mutex);
+		return;
+	}
+	lower_cache_dirty = false;
+	json_object *obj = json_object_new_object();
+	g_hash_table_iter_init(&iter, verified);
+	while(g_hash_table_iter_next(&iter, &key, &value)) {
+		struct VerifiedFile *file = value;
+		if(!under_any(key, lower_roots)) {
+			continue;
+		}
+		json_object *entry = json_object_new_object();
+		json_set_string(entry, "sha1", file->sha1);
+		json_object_object_add(entry, "size", json_object_new_int64(file->size));
+		json_object_object_add(entry, "mtime", json_object_new_int64(file->mtime));
+		json_object_object_add(entry, "inode", json_object_new_int64(file->inode));
+		json_object_object_add(obj, key, entry);
+	}
+	g_mutex_unlock(&shared_mutex);
+	char *path = g_build_filename(XDG_CACHE_HOME, LOWER_CACHE_FILE, NULL);
+	char *dir = g_path_get_dirname(path);
+	g_mkdir_with_parents(dir, 0755);
+	json_to_file(obj, path, JSON_C_TO_STRING_PLAIN);
+	free(dir);
+	free(path);
+	json_object_put(obj);
+}
+
+static bool verified_get(const char *path, const char *sha1, GStatBuf *st) {
+	g_mutex_lock(&shared_mutex);
+	struct VerifiedFile *file = g_hash_table_lookup(verified, path);
+	bool ok = file && strequal(file->sha1, sha1) && file->size == st->st_size && file->mtime == st->st_mtime && file->inode == (guint64)st->st_ino;
+	g_mutex_unlock(&shared_mutex);
+	return ok;
+}
+
+void microlauncher_download_release_cache(void) {
+	g_mutex_lock(&shared_mutex);
+	if(verified) {
+		g_hash_table_remove_all(verified);
+	}
+	lower_cache_loaded = false;
+	g_mutex_unlock(&shared_mutex);
+}
+
+static bool download_verify(struct Download *dl, bool hash_files) {
+	GStatBuf st;
+	if(g_stat(dl->path, &st) != 0) {
+		return false;
+	}
+	if(dl->size != 0 && st.st_size != dl->size) {
+		return false;
+	}
+#ifndef FAST_RESOURCE_CHECK
+	if(hash_files && dl->sha1 && !verified_get(dl->path, dl->sha1, &st)) {
+		Sha1 hash;
+		FILE *fd = fopen(dl->path, "rb");
+		if(!fd) {
+			return false;
+		}
+		get_sha1(fd, hash);
+		if(strcmp(hash, dl->sha1) != 0) {
+			return false;
+		}
+		verified_set(dl->path, dl->sha1, &st);
+	}
+#endif
+	return true;
+}
+
+static bool sink_output(struct DownloadSink *sink, const void *data, size_t n) {
+	if(fwrite(data, 1, n, sink->file) != n) {
+		return false;
+	}
+	SHA1_Update(&sink->sha1_ctx, data, n);
+	sink->written += n;
+	return true;
+}
+
+static bool sink_decompress(struct DownloadSink *sink, const void *data, size_t n, lzma_action action) {
+	uint8_t buf[BUFSIZ];
+	lzma_ret ret;
+	sink->stream.next_in = data;
+	sink->stream.avail_in = n;
+	do {
+		sink->stream.next_out = buf;
+		sink->stream.avail_out = sizeof(buf);
+		ret = lzma_code(&sink->stream, action);
+		if(ret != LZMA_OK && ret != LZMA_STREAM_END) {
+			return false;
+		}
+		if(!sink_output(sink, buf, sizeof(buf) - sink->stream.avail_out)) {
+			return false;
+		}
+	} while(ret != LZMA_STREAM_END && (sink->stream.avail_in > 0 || action == LZMA_FINISH));
+	return true;
+}
+
+static size_t sink_write_callback(void *ptr, size_t size, size_t nmemb, void *userdata) {
+	struct DownloadSink *sink = userdata;
+	bool ok;
+	if(sink->lzma) {
+		ok = sink_decompress(sink, ptr, size * nmemb, LZMA_RUN);
+	} else {
+		ok = sink_output(sink, ptr, size * nmemb);
+	}
+	if(!ok) {
+		sink->error = true;
+		return 0;
+	}
+	return size * nmemb;
+}
+
+static int xferinfo_callback(void *userdata, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+	return queue_aborted(userdata) ? 1 : 0;
+}
+
+/* Peers serve files as stored, so lzma only applies to upstream URLs. peer_code is set to the result of peer requests */
+static bool download_perform(struct Download *dl, DownloadQueue *queue, const char *url, bool lzma, CURLcode *peer_code) {
+	CURLcode code;
+	Sha1 hash;
+	unsigned char digest[SHA_DIGEST_LENGTH];
+	CURL *curl = g_private_get(&curl_handle);
+	if(!curl) {
+		curl = curl_easy_init();
+		if(!curl) {
+			return false;
+		}
+		g_private_set(&curl_handle, curl);
+	}
+	char *tmp_path = g_strdup_printf("%s.part", dl->path);
+	struct DownloadSink sink = {0};
+	sink.file = fopen_mkdir(tmp_path, "wb");
+	if(!sink.file) {
+		free(tmp_path);
+		return false;
+	}
+	SHA1_Init(&sink.sha1_ctx);
+	if(lzma) {
+		sink.lzma = true;
+		sink.stream = (lzma_stream)LZMA_STREAM_INIT;
+		// Mojang serves legacy .lzma streams, auto decoder accepts those as well as .xz
+		if(lzma_auto_decoder(&sink.stream, UINT64_MAX, 0) != LZMA_OK) {
+			fclose(sink.file);
+			g_remove(tmp_path);
+			free(tmp_path);
+			return false;
+		}
+	}
+	curl_easy_reset(curl);
+	curl_easy_setopt(curl, CURLOPT_URL, url);
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, sink_write_callback);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &sink);
+	curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, xferinfo_callback);
+	curl_easy_setopt(curl, CURLOPT_XFERINFODATA, queue);
+	curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+	curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+	// Reset doesn't detach a share, it must not outlive the queue's context
+	curl_easy_setopt(curl, CURLOPT_SHARE, queue->share);
+	if(queue->background) {
+		curl_easy_setopt(curl, CURLOPT_MAX_RECV_SPEED_LARGE, (curl_off_t)DOWNLOAD_BACKGROUND_SPEED);
+	}
+	if(peer_code) {
+		curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, (long)PEER_CONNECT_TIMEOUT);
+		curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, (long)PEER_LOW_SPEED_LIMIT);
+		curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long)PEER_LOW_SPEED_TIME);
+	}
+	microlauncher_set_curl_opts(curl);
+	code = curl_easy_perform(curl);
+	curl_easy_setopt(curl, CURLOPT_SHARE, NULL);
+	if(peer_code) {
+		*peer_code = code;
+	}
+	if(code == CURLE_OK && sink.lzma) {
+		sink.error = !sink_decompress(&sink, NULL, 0, LZMA_FINISH);
+	}
+	if(sink.lzma) {
+		lzma_end(&sink.stream);
+	}
+	SHA1_Final(digest, &sink.sha1_ctx);
+	bytes_as_hex(digest, SHA_DIGEST_LENGTH, hash);
+	hash[SHA_DIGEST_LENGTH * 2] = '\0';
+	fclose(sink.file);
+
+	bool ok = code == CURLE_OK && !sink.error;
+	if(code != CURLE_OK && code != CURLE_ABORTED_BY_CALLBACK) {
+		g_print("CURL error (%d) on %s\n", code, url);
+	}
+	if(ok && dl->size != 0 && sink.written != dl->size) {
+		g_print("Size mismatch on %s\n", url);
+		ok = false;
+	}
+	if(ok && dl->sha1 && strcmp(hash, dl->sha1) != 0) {
+		g_print("Checksum mismatch on %s\n", url);
+		ok = false;
+	}
+	if(ok) {
+#ifdef G_OS_WIN32
+		g_remove(dl->path);
+#else
+		if(dl->flags & DOWNLOAD_EXECUTABLE) {
+			chmod(tmp_path, 0755);
+		}
+#endif
+		ok = g_rename(tmp_path, dl->path) == 0;
+	}
+	GStatBuf st;
+	if(ok && dl->sha1 && g_stat(dl->path, &st) == 0) {
+		verified_set(dl->path, dl->sha1, &st);
+	}
+	if(!ok) {
+		g_remove(tmp_path);
+	}
+	free(tmp_path);
+	return ok;
+}
+
+static bool in_launcher_root(struct Download *dl, DownloadQueue *queue) {
+	return path_is_under(dl->path, queue->launcher_root);
+}
+
+/* Points dest at a file of a lower root. Replaces through a partial file so dest is never missing */
+static bool link_lower(const char *lower, const char *dest) {
+	char *target = g_file_read_link(dest, NULL);
+	bool linked = strequal(target, lower);
+	free(target);
+	if(linked) {
+		return true;
+	}
+	char *tmp_path = g_strdup_printf("%s.part", dest);
+	char *dir = g_path_get_dirname(dest);
+	g_mkdir_with_parents(dir, 0755);
+	free(dir);
+	g_remove(tmp_path);
+#ifdef G_OS_WIN32
+	bool ok = util_link_or_copy(lower, tmp_path);
+#else
+	bool ok = symlink(lower, tmp_path) == 0;
+#endif
+	ok = ok && g_rename(tmp_path, dest) == 0;
+	if(!ok) {
+		g_remove(tmp_path);
+	}
+	free(tmp_path);
+	return ok;
+}
+
+/* Lower roots take precedence, a copy the launcher root has of the same file is replaced by a link.
+ * Without link the file of the lower root is only checked */
+static bool download_from_lower(struct Download *dl, DownloadQueue *queue, bool hash_files, bool link) {
+	if(!queue->lower_roots || !in_launcher_root(dl, queue)) {
+		return false;
+	}
+	const char *relative = dl->path + strlen(queue->launcher_root);
+	for(char **root = queue->lower_roots; *root; root++) {
+		struct Download lower = *dl;
+		lower.path = g_build_filename(*root, relative, NULL);
+		bool ok = download_verify(&lower, hash_files) && (!link || link_lower(lower.path, dl->path));
+		free(lower.path);
+		if(ok) {
+			dl->lower = true;
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Objects are hashed once materialized, a hardlink may have been changed through another root */
+static bool download_from_store(struct Download *dl, DownloadQueue *queue) {
+	if(!queue->store || !dl->sha1 || !in_launcher_root(dl, queue) || !microlauncher_store_materialize(dl->sha1, dl->path)) {
+		return false;
+	}
+	if(!download_verify(dl, true)) {
+		g_remove(dl->path);
+		return false;
+	}
+	dl->stored = true;
+	return true;
+}
+
+/* Files are only taken from peers when they can be checked against the upstream sha1 */
+static bool download_from_peers(struct Download *dl, DownloadQueue *queue) {
+	if(!queue->peers || !dl->sha1 || !in_launcher_root(dl, queue)) {
+		return false;
+	}
+	const char *relative = dl->path + strlen(queue->launcher_root);
+	while(*relative == '/') {
+		relative++;
+	}
+	if(!microlauncher_peer_path_served(relative)) {
+		return false;
+	}
+	char *escaped = g_uri_escape_string(relative, "/", false);
+	bool ok = false;
+	for(char **peer = queue->peers; *peer && !ok && !queue_aborted(queue); peer++) {
+		g_mutex_lock(&queue->mutex);
+		bool dead = g_hash_table_contains(queue->dead_peers, *peer);
+		g_mutex_unlock(&queue->mutex);
+		if(dead) {
+			continue;
+		}
+		char *url = g_strdup_printf("%s/%s", *peer, escaped);
+		CURLcode code = CURLE_OK;
+		ok = download_perform(dl, queue, url, false, &code);
+		free(url);
+		// A missing file is expected, anything else means the peer is gone or too slow
+		if(code == CURLE_COULDNT_RESOLVE_HOST || code == CURLE_COULDNT_CONNECT || code == CURLE_OPERATION_TIMEDOUT) {
+			g_mutex_lock(&queue->mutex);
+			g_hash_table_add(queue->dead_peers, g_strdup(*peer));
+			g_mutex_unlock(&queue->mutex);
+		}
+	}
+	free(escaped);
+	return ok;
+}
+
+static bool download_fetch(struct Download *dl, DownloadQueue *queue) {
+	if(download_from_store(dl, queue)) {
+		return true;
+	}
+	if(!download_from_peers(dl, queue)) {
+		if(!dl->url || strlen(dl->url) == 0) {
+			return true; /* nothing to download from, keep whatever is there */
+		}
+		if(!download_perform(dl, queue, dl->url, dl->flags & DOWNLOAD_LZMA, NULL)) {
+			return false;
+		}
+	}
+	if(queue->store && in_launcher_root(dl, queue)) {
+		microlauncher_store_add(dl->path, dl->sha1);
+	}
+	return true;
+}
+
+static void download_job(gpointer data, gpointer userdata) {
+	struct Download *dl = data;
+	DownloadQueue *queue = userdata;
+	bool ok = true;
+	if(!queue_aborted(queue)) {
+		// Planning only looks at files, the process holding the lock replaces them atomically.
+		// Metadata is written in every mode since the other files can't be resolved without it
+		bool write = queue->mode == DOWNLOAD_MODE_FETCH || (dl->flags & DOWNLOAD_METADATA);
+		int lock = path_claim(dl->path, queue->mode != DOWNLOAD_MODE_PLAN || write);
+		bool present = download_from_lower(dl, queue, queue->mode != DOWNLOAD_MODE_PLAN, write) || download_verify(dl, queue->mode != DOWNLOAD_MODE_PLAN);
+		if(!present) {
+			dl->fetched = true;
+			if(write) {
+				ok = download_fetch(dl, queue);
+			}
+		}
+#ifndef FAST_RESOURCE_CHECK
+		// Files downloaded before the store was enabled, or by roots without it, are shared from now on
+		if(present && !dl->lower && queue->store && queue->mode != DOWNLOAD_MODE_PLAN && in_launcher_root(dl, queue)) {
+			microlauncher_store_add(dl->path, dl->sha1);
+		}
+#endif
+		path_release(dl->path, lock);
+	}
+	g_mutex_lock(&queue->mutex);
+	if(dl->fetched) {
+		queue->stats.fetched++;
+		queue->stats.fetched_size += dl->size;
+		if(dl->stored) {
+			queue->stats.stored++;
+			queue->stats.stored_size += dl->size;
+		}
+	} else if(ok) {
+		queue->stats.present++;
+		queue->stats.present_size += dl->size;
+	}
+	if(!ok && !queue->failed_resource && !(queue->cancellable && g_cancellable_is_cancelled(queue->cancellable))) {
+		queue->failed_resource = g_strdup(dl->url ? dl->url : dl->path);
+	}
+	queue->done_size += dl->size;
+	queue->label = dl->label;
+	queue->pending--;
+	g_cond_signal(&queue->cond);
+	g_mutex_unlock(&queue->mutex);
+}
+
+bool microlauncher_download_queue_run(DownloadQueue *queue, struct Callbacks callbacks, GCancellable *cancellable, char *failedResource) {
+	if(queue->downloads->len == 0) {
+		return true;
+	}
+	queue->cancellable = cancellable;
+	queue->pending = queue->downloads->len;
+	queue->done_size = 0;
+	queue->stats = (struct DownloadStats){0};
+	g_strfreev(queue->peers);
+	queue->peers = queue->launcher_root ? microlauncher_peer_get_urls() : NULL;
+	if(queue->dead_peers) {
+		g_hash_table_destroy(queue->dead_peers);
+	}
+	queue->dead_peers = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	if(queue->lower_roots) {
+		lower_cache_load();
+	}
+	GThreadPool *pool = g_thread_pool_new(download_job, queue, queue->background ? DOWNLOAD_BACKGROUND_THREADS : DOWNLOAD_THREADS, FALSE, NULL);
+	for(guint i = 0; i < queue->downloads->len; i++) {
+		g_thread_pool_push(pool, g_ptr_array_index(queue->downloads, i), NULL);
+	}
+	// Progress is reported from the calling thread so callbacks don't have to be thread safe
+	g_mutex_lock(&queue->mutex);
+	while(queue->pending > 0) {
+		g_cond_wait_until(&queue->cond, &queue->mutex, g_get_monotonic_time() + 100 * G_TIME_SPAN_MILLISECOND);
+		long done = queue->done_size;
+		const char *label = queue->label;
+		g_mutex_unlock(&queue->mutex);
+		if(label && queue->total_size > 0) {
+			run_callback(progress_update, (double)done / queue->total_size, label);
+		}
+		g_mutex_lock(&queue->mutex);
+	}
+	g_mutex_unlock(&queue->mutex);
+	g_thread_pool_free(pool, FALSE, TRUE);
+	if(queue->lower_roots) {
+		lower_cache_save(queue->lower_roots);
+	}
+	if(callbacks.file_update) {
+		for(guint i = 0; i < queue->downloads->len; i++) {
+			struct Download *dl = g_ptr_array_index(queue->downloads, i);
+			if(dl->fetched) {
+				callbacks.file_update(dl->path, dl->url, dl->size, callbacks.userdata);
+			}
+		}
+	}
+
+	if(queue->failed_resource) {
+		if(failedResource) {
+			snprintf(failedResource, PATH_MAX, "%s", queue->failed_resource);
+		}
+		return false;
+	}
+	return !(cancellable && g_cancellable_is_cancelled(cancellable));
+}
@@ -0,0 +1,516 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <json.h>
+#include <microlauncher.h>
+#include <microlauncher_download.h>
+#include <microlauncher_gc.h>
+#include <microlauncher_shader_cache.h>
+#include <microlauncher_store.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <util/json_util.h>
+#include <util/util.h>
+#include <util/xdgutil.h>
+
+#define NATIVES_PREFIX "natives-"
+#define PARTIAL_SUFFIX ".part"
+
+static const char *CATEGORY_NAMES[GC_CATEGORY_COUNT] = {
+	[GC_VERSIONS] = "versions",
+	[GC_LIBRARIES] = "libraries",
+	[GC_ASSET_INDEXES] = "assetIndexes",
+	[GC_ASSET_OBJECTS] = "assetObjects",
+	[GC_NATIVES] = "natives",
+	[GC_PARTIAL] = "partial",
+	[GC_STORE] = "store"};
+
+struct GcState {
+	gint64 now;
+	struct GcReport *report;
+	/* Absolute paths of every file the versions need */
+	GHashTable *marked;
+	/* Ids of directories in versions that are kept as a whole */
+	GHashTable *versions;
+	char *versions_dir;
+	GMutex mutex;
+	GPtrArray *garbage;
+};
+
+struct Garbage {
+	char *path;
+	guint64 size;
+	enum GcCategory category;
+	bool dir;
+};
+
+struct _GcPlan {
+	char *launcher_root;
+	GPtrArray *garbage;
+};
+
+struct SweepJob {
+	char *path;
+	enum GcCategory category;
+};
+
+const char *microlauncher_gc_category_name(enum GcCategory category) {
+	return CATEGORY_NAMES[category];
+}
+
+static bool old_enough(const char *path, gint64 now) {
+	GStatBuf st;
+	return g_lstat(path, &st) == 0 && now - (gint64)st.st_mtime * G_TIME_SPAN_SECOND >= GC_MIN_AGE;
+}
+
+static void garbage_free(void *data) {
+	struct Garbage *garbage = data;
+	free(garbage->path);
+	free(garbage);
+}
+
+/* Thread safe, paths are only removed once scanning finished */
+static void add_garbage(struct GcState *state, const char *path, guint64 size, enum GcCategory category, bool dir) {
+	struct Garbage *garbage = g_new(struct Garbage, 1);
+	garbage->path = g_strdup(path);
+	garbage->size = size;
+	garbage->category = category;
+	garbage->dir = dir;
+	g_mutex_lock(&state->mutex);
+	g_ptr_array_add(state->garbage, garbage);
+	state->report->unused[category] += size;
+	g_mutex_unlock(&state->mutex);
+}
+
+static void add_used(struct GcState *state, guint64 size, enum GcCategory category) {
+	g_mutex_lock(&state->mutex);
+	state->report->used[category] += size;
+	g_mutex_unlock(&state->mutex);
+}
+
+/* Names of natives directories the running JVMs have libraries mapped from */
+static GHashTable *natives_in_use(void) {
+	GHashTable *used = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+#ifdef __linux__
+	char *prefix = g_build_filename(TEMPDIR, NATIVES_PREFIX, NULL);
+	GDir *proc = g_dir_open("/proc", 0, NULL);
+	const char *pid;
+	while(proc && (pid = g_dir_read_name(proc))) {
+		if(!g_ascii_isdigit(*pid)) {
+			continue;
+		}
+		char *path = g_build_filename("/proc", pid, "maps", NULL);
+		char *maps = NULL;
+		g_file_get_contents(path, &maps, NULL, NULL);
+		free(path);
+		for(char *line = maps; line && *line;) {
+			char *next = strchr(line, '\n');
+			if(next) {
+				*next++ = '\0';
+			}
+			char *file = strstr(line, prefix);
+			if(file) {
+				char *end = strchr(file + strlen(prefix), '/');
+				if(end) {
+					*end = '\0';
+				}
+				g_hash_table_add(used, g_path_get_basename(file));
+			}
+			line = next;
+		}
+		free(maps);
+	}
+	if(proc) {
+		g_dir_close(proc);
+	}
+	free(prefix);
+#endif
+	return used;
+}
+
+static void collect_natives(struct GcState *state) {
+	GHashTable *used = natives_in_use();
+	GDir *dir = g_dir_open(TEMPDIR, 0, NULL);
+	const char *entry;
+	while(dir && (entry = g_dir_read_name(dir))) {
+		if(!g_str_has_prefix(entry, NATIVES_PREFIX) || g_hash_table_contains(used, entry)) {
+			continue;
+		}
+		char *path = g_build_filename(TEMPDIR, entry, NULL);
+		if(g_file_test(path, G_FILE_TEST_IS_DIR) && old_enough(path, state->now)) {
+			add_garbage(state, path, microlauncher_shader_cache_size(path), GC_NATIVES, true);
+		}
+		free(path);
+	}
+	if(dir) {
+		g_dir_close(dir);
+	}
+	g_hash_table_destroy(used);
+}
+
+/* Only used for files, directories of symlinks aren't followed */
+static guint64 file_size(GStatBuf *st) {
+#ifdef G_OS_WIN32
+	return st->st_size;
+#else
+	return (guint64)st->st_blocks * 512;
+#endif
+}
+
+static void sweep_entry(const char *path, enum GcCategory category, struct GcState *state) {
+	GStatBuf st;
+	if(g_lstat(path, &st) != 0) {
+		return; /* removed meanwhile */
+	}
+	if(S_ISDIR(st.st_mode)) {
+		GDir *dir = g_dir_open(path, 0, NULL);
+		const char *entry;
+		while(dir && (entry = g_dir_read_name(dir))) {
+			char *child = g_build_filename(path, entry, NULL);
+			sweep_entry(child, category, state);
+			free(child);
+		}
+		if(dir) {
+			g_dir_close(dir);
+		}
+	} else if(str_ends_with(path, PARTIAL_SUFFIX) || str_ends_with(path, DOWNLOAD_LOCK_SUFFIX)) {
+		if(old_enough(path, state->now)) {
+			add_garbage(state, path, file_size(&st), GC_PARTIAL, false);
+		}
+	} else if(category == GC_PARTIAL) {
+		// Only partial downloads are collected from runtimes
+	} else if(category == GC_STORE || g_hash_table_contains(state->marked, path)) {
+		// Launcher roots the store is shared with aren't known, a link count can't tell whether they need an object
+		add_used(state, file_size(&st), category);
+	} else if(old_enough(path, state->now)) {
+		add_garbage(state, path, file_size(&st), category, false);
+	} else {
+		add_used(state, file_size(&st), category);
+	}
+}
+
+static void sweep_job(gpointer data, gpointer userdata) {
+	struct SweepJob *job = data;
+	struct GcState *state = userdata;
+	if(job->category == GC_VERSIONS) {
+		guint64 size = microlauncher_shader_cache_size(job->path);
+		char *id = g_path_get_basename(job->path);
+		if(g_hash_table_contains(state->versions, id) || !old_enough(job->path, state->now)) {
+			add_used(state, size, GC_VERSIONS);
+		} else {
+			add_garbage(state, job->path, size, GC_VERSIONS, true);
+		}
+		free(id);
+	} else {
+		sweep_entry(job->path, job->category, state);
+	}
+	free(job->path);
+	free(job);
+}
+
+/* One job per entry so that large directories like asset objects are split between threads */
+static void push_children(GThreadPool *pool, const char *path, enum GcCategory category) {
+	GDir *dir = g_dir_open(path, 0, NULL);
+	const char *entry;
+	while(dir && (entry = g_dir_read_name(dir))) {
+		char *child = g_build_filename(path, entry, NULL);
+		// Versions are whole directories, anything else in versions isn't ours
+		if(category == GC_VERSIONS && (g_file_test(child, G_FILE_TEST_IS_SYMLINK) || !g_file_test(child, G_FILE_TEST_IS_DIR))) {
+			free(child);
+			continue;
+		}
+		struct SweepJob *job = g_new(struct SweepJob, 1);
+		job->path = child;
+		job->category = category;
+		g_thread_pool_push(pool, job, NULL);
+	}
+	if(dir) {
+		g_dir_close(dir);
+	}
+}
+
+static void mark_file(const char *path, const char *sha1, long size, void *userdata) {
+	struct GcState *state = userdata;
+	g_hash_table_add(state->marked, g_strdup(path));
+	size_t len = strlen(state->versions_dir);
+	if(strncmp(path, state->versions_dir, len) == 0 && path[len] == '/') {
+		const char *id = path + len + 1;
+		const char *end = strchr(id, '/');
+		if(end) {
+			g_hash_table_add(state->versions, g_strndup(id, end - id));
+		}
+	}
+}
+
+/* Removes directories left empty by removing files, up to stop */
+static void prune_empty(const char *path, const char *stop) {
+	char *dir = g_path_get_dirname(path);
+	while(g_str_has_prefix(dir, stop) && !strequal(dir, stop) && g_rmdir(dir) == 0) {
+		char *parent = g_path_get_dirname(dir);
+		free(dir);
+		dir = parent;
+	}
+	free(dir);
+}
+
+static void add_root(GPtrArray *roots, const char *id) {
+	if(id && !g_ptr_array_find_with_equal_func(roots, id, g_str_equal, NULL)) {
+		g_ptr_array_add(roots, g_strdup(id));
+	}
+}
+
+/* Versions of instances and gcKeep of this data directory */
+static GPtrArray *own_roots(void) {
+	GPtrArray *roots = g_ptr_array_new_with_free_func(free);
+	for(GSList *node = *microlauncher_get_instances(); node; node = node->next) {
+		MicrolauncherInstance *inst = node->data;
+		add_root(roots, inst->version);
+	}
+	for(char **id = microlauncher_get_settings()->gcKeep; id && *id; id++) {
+		add_root(roots, *id);
+	}
+	return roots;
+}
+
+void microlauncher_gc_publish_roots(void) {
+	const char *launcher_root = microlauncher_get_settings()->launcher_root;
+	if(!launcher_root) {
+		return;
+	}
+	// One user may have several data directories sharing a launcher root too
+	char *data_dir = g_build_filename(XDG_DATA_HOME, "microlauncher", NULL);
+	char *hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, data_dir, -1);
+	char *name = g_strdup_printf("%s-%.8s.json", g_get_user_name(), hash);
+	char *dir = g_build_filename(launcher_root, GC_ROOTS_DIR, NULL);
+	char *path = g_build_filename(dir, name, NULL);
+	g_mkdir_with_parents(dir, 0775);
+	GPtrArray *roots = own_roots();
+	json_object *obj = json_object_new_object();
+	json_object *versions = json_object_new_array();
+	for(guint i = 0; i < roots->len; i++) {
+		json_object_array_add(versions, json_object_new_string(g_ptr_array_index(roots, i)));
+	}
+	json_object_object_add(obj, "versions", versions);
+	json_to_file(obj, path, JSON_C_TO_STRING_NOSLASHESCAPE | JSON_C_TO_STRING_PRETTY);
+	json_object_put(obj);
+	g_ptr_array_free(roots, TRUE);
+	free(path);
+	free(dir);
+	free(name);
+	free(hash);
+	free(data_dir);
+}
+
+char **microlauncher_gc_get_roots(const char *const *keep) {
+	microlauncher_gc_publish_roots();
+	GPtrArray *roots = own_roots();
+	for(const char *const *id = keep; id && *id; id++) {
+		add_root(roots, *id);
+	}
+	char *path = g_build_filename(microlauncher_get_settings()->launcher_root, GC_ROOTS_DIR, NULL);
+	GDir *dir = g_dir_open(path, 0, NULL);
+	const char *entry;
+	while(dir && (entry = g_dir_read_name(dir))) {
+		if(!str_ends_with(entry, ".json")) {
+			continue;
+		}
+		char *file = g_build_filename(path, entry, NULL);
+		json_object *obj = json_from_file(file);
+		json_object *versions = json_object_object_get(obj, "versions");
+		size_t n = json_object_is_type(versions, json_type_array) ? json_object_array_length(versions) : 0;
+		for(size_t i = 0; i < n; i++) {
+			add_root(roots, json_object_get_string(json_object_array_get_idx(versions, i)));
+		}
+		json_object_put(obj);
+		free(file);
+	}
+	if(dir) {
+		g_dir_close(dir);
+	}
+	free(path);
+	g_ptr_array_set_free_func(roots, NULL);
+	g_ptr_array_add(roots, NULL);
+	return (char **)g_ptr_array_free(roots, FALSE);
+}
+
+GcPlan *microlauncher_gc_scan(LaunchContext *ctx, const char *const *versions, struct GcReport *report) {
+	const char *launcher_root = microlauncher_launch_context_get_settings(ctx)->launcher_root;
+	struct Callbacks callbacks = microlauncher_launch_context_get_callbacks(ctx);
+	struct GcState state = {
+		.now = g_get_real_time(),
+		.report = report,
+		.marked = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL),
+		.versions = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL),
+		.versions_dir = g_build_filename(launcher_root, "versions", NULL),
+		.garbage = g_ptr_array_new_with_free_func(garbage_free)};
+	*report = (struct GcReport){0};
+	g_mutex_init(&state.mutex);
+	bool ok = true;
+
+	run_callback(stage_update, "Marking files in use");
+	for(const char *const *id = versions; *id && ok; id++) {
+		char *json = g_strdup_printf("%s/%s/%s.json", state.versions_dir, *id, *id);
+		bool fetched = g_file_test(json, G_FILE_TEST_IS_REGULAR);
+		free(json);
+		if(!fetched) {
+			// Never fetched, or not yet by another user of the launcher root
+			g_hash_table_add(state.versions, g_strdup(*id));
+			continue;
+		}
+		// Anything a version we can't resolve needs would look unused
+		if(!microlauncher_version_foreach_file(ctx, *id, mark_file, &state)) {
+			char *str = g_strdup_printf("Failed to resolve version %s or its asset index, nothing was removed", *id);
+			run_callback(show_error, str);
+			free(str);
+			ok = false;
+		}
+	}
+
+	GcPlan *plan = NULL;
+	if(ok) {
+		run_callback(stage_update, "Scanning launcher root");
+		struct {
+			const char *dir;
+			enum GcCategory category;
+		} dirs[] = {
+			{"versions", GC_VERSIONS},
+			{"libraries", GC_LIBRARIES},
+			{"assets/indexes", GC_ASSET_INDEXES},
+			{"assets/objects", GC_ASSET_OBJECTS}};
+		GThreadPool *pool = g_thread_pool_new(sweep_job, &state, GC_THREADS, FALSE, NULL);
+		for(size_t i = 0; i < G_N_ELEMENTS(dirs); i++) {
+			char *path = g_build_filename(launcher_root, dirs[i].dir, NULL);
+			push_children(pool, path, dirs[i].category);
+			free(path);
+		}
+		struct SweepJob *job = g_new(struct SweepJob, 1);
+		job->path = g_build_filename(launcher_root, "runtime", NULL);
+		job->category = GC_PARTIAL;
+		g_thread_pool_push(pool, job, NULL);
+		char *store = microlauncher_store_get_dir();
+		char *objects = g_build_filename(store, "objects", NULL);
+		push_children(pool, objects, GC_STORE);
+		free(objects);
+		free(store);
+		g_thread_pool_free(pool, FALSE, TRUE);
+		collect_natives(&state);
+		plan = g_new(GcPlan, 1);
+		plan->launcher_root = g_strdup(launcher_root);
+		plan->garbage = g_steal_pointer(&state.garbage);
+	}
+	run_callback(stage_update, NULL);
+	g_mutex_clear(&state.mutex);
+	if(state.garbage) {
+		g_ptr_array_free(state.garbage, TRUE);
+	}
+	g_hash_table_destroy(state.marked);
+	g_hash_table_destroy(state.versions);
+	free(state.versions_dir);
+	return plan;
+}
+
+/* Takes the download lock of target, false if a download holds it */
+static bool try_lock_target(const char *target, int *fd, char **lock_path) {
+	*lock_path = g_strconcat(target, DOWNLOAD_LOCK_SUFFIX, NULL);
+	if(!util_try_lock_path(*lock_path, fd)) {
+		g_clear_pointer(lock_path, free);
+		return false;
+	}
+	return true;
+}
+
+/* Skips garbage a download is writing or that changed since it was scanned */
+static bool remove_garbage(struct Garbage *garbage, const char *launcher_root) {
+	if(!old_enough(garbage->path, g_get_real_time())) {
+		return false;
+	}
+	int fds[2] = {-1, -1};
+	char *locks[2] = {NULL, NULL};
+	bool locked = true;
+	if(str_ends_with(garbage->path, DOWNLOAD_LOCK_SUFFIX)) {
+		// Releasing a lock removes its file
+		if(!util_try_lock_path(garbage->path, &fds[0])) {
+			return false;
+		}
+		if(fds[0] >= 0) {
+			util_unlock_path(fds[0], garbage->path);
+			return true;
+		}
+	} else if(garbage->category == GC_VERSIONS) {
+		char *id = g_path_get_basename(garbage->path);
+		const char *exts[] = {".json", ".jar"};
+		for(int i = 0; i < 2 && locked; i++) {
+			char *target = g_strdup_printf("%s/%s%s", garbage->path, id, exts[i]);
+			locked = try_lock_target(target, &fds[i], &locks[i]);
+			free(target);
+		}
+		free(id);
+	} else if(garbage->category != GC_NATIVES) {
+		char *target = g_strdup(garbage->path);
+		if(str_ends_with(target, PARTIAL_SUFFIX)) {
+			target[strlen(target) - strlen(PARTIAL_SUFFIX)] = '\0';
+		}
+		locked = try_lock_target(target, &fds[0], &locks[0]);
+		free(target);
+	}
+	bool removed = locked && (garbage->dir ? rmdir_recursive(garbage->path, NULL) : g_remove(garbage->path) == 0);
+	for(int i = 0; i < 2; i++) {
+		if(locks[i]) {
+			util_unlock_path(fds[i], locks[i]);
+			free(locks[i]);
+		}
+	}
+	if(removed && garbage->category == GC_LIBRARIES) {
+		char *stop = g_build_filename(launcher_root, "libraries", NULL);
+		prune_empty(garbage->path, stop);
+		free(stop);
+	}
+	return removed;
+}
+
+void microlauncher_gc_remove(LaunchContext *ctx, GcPlan *plan, GcFunc func, void *userdata, struct GcReport *report) {
+	struct Callbacks callbacks = microlauncher_launch_context_get_callbacks(ctx);
+	run_callback(stage_update, "Removing unused files");
+	report->freed = 0;
+	for(guint i = 0; i < plan->garbage->len; i++) {
+		struct Garbage *garbage = g_ptr_array_index(plan->garbage, i);
+		if(!remove_garbage(garbage, plan->launcher_root)) {
+			continue;
+		}
+		report->freed += garbage->size;
+		if(func) {
+			func(garbage->path, garbage->size, garbage->category, userdata);
+		}
+	}
+	run_callback(stage_update, NULL);
+}
+
+void microlauncher_gc_plan_free(GcPlan *plan) {
+	if(!plan) {
+		return;
+	}
+	g_ptr_array_free(plan->garbage, TRUE);
+	free(plan->launcher_root);
+	free(plan);
+}
+
+bool microlauncher_gc_run(LaunchContext *ctx, const char *const *versions, bool dry_run, GcFunc func, void *userdata, struct GcReport *report) {
+	GcPlan *plan = microlauncher_gc_scan(ctx, versions, report);
+	if(!plan) {
+		return false;
+	}
+	if(dry_run) {
+		for(guint i = 0; i < plan->garbage->len; i++) {
+			struct Garbage *garbage = g_ptr_array_index(plan->garbage, i);
+			report->freed += garbage->size;
+			if(func) {
+				func(garbage->path, garbage->size, garbage->category, userdata);
+			}
+		}
+	} else {
+		microlauncher_gc_remove(ctx, plan, func, userdata, report);
+	}
+	microlauncher_gc_plan_free(plan);
+	return true;
+}
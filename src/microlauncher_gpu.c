@@ -0,0 +1,203 @@
+#include <glib.h>
+#include <json.h>
+#include <microlauncher_gpu.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/json_util.h>
+#include <util/util.h>
+
+#define DRM_DIR "/sys/class/drm"
+#define PCI_CLASS_VGA 0x0300
+#define PCI_CLASS_3D 0x0302
+#define IORESOURCE_MEM 0x200
+
+struct GpuCandidate {
+	char *id;
+	char *driver;
+	guint64 vram;
+	bool boot_vga;
+	bool discrete;
+	int score;
+};
+
+#ifdef __linux__
+static char *read_sysfs(const char *dir, const char *file) {
+	char *path = g_build_filename(dir, file, NULL);
+	char *contents = NULL;
+	g_file_get_contents(path, &contents, NULL, NULL);
+	free(path);
+	if(contents) {
+		g_strstrip(contents);
+	}
+	return contents;
+}
+
+static guint64 read_sysfs_u64(const char *dir, const char *file) {
+	char *str = read_sysfs(dir, file);
+	guint64 value = str ? g_ascii_strtoull(str, NULL, 0) : 0;
+	free(str);
+	return value;
+}
+
+/* Largest memory BAR, close to VRAM size with resizable BAR */
+static guint64 largest_bar(const char *dev) {
+	char *resources = read_sysfs(dev, "resource");
+	if(!resources) {
+		return 0;
+	}
+	guint64 largest = 0;
+	char **lines = g_strsplit(resources, "\n", -1);
+	for(int i = 0; lines[i]; i++) {
+		unsigned long long start, end, flags;
+		if(sscanf(lines[i], "%llx %llx %llx", &start, &end, &flags) == 3 &&
+		   (flags & IORESOURCE_MEM) && end > start) {
+			largest = MAX(largest, end - start + 1);
+		}
+	}
+	g_strfreev(lines);
+	free(resources);
+	return largest;
+}
+
+static bool probe_card(const char *card, struct GpuCandidate *gpu) {
+	char *dev = g_build_filename(DRM_DIR, card, "device", NULL);
+	char *real = realpath(dev, NULL);
+	unsigned int domain, bus, slot, func;
+	int pciClass = read_sysfs_u64(dev, "class") >> 8;
+	if(!real || (pciClass != PCI_CLASS_VGA && pciClass != PCI_CLASS_3D) ||
+	   sscanf(strrchr(real, '/') + 1, "%x:%x:%x.%x", &domain, &bus, &slot, &func) != 4) {
+		free(real);
+		free(dev);
+		return false;
+	}
+	gpu->id = g_strdup_printf("pci-%04x_%02x_%02x_%01x", domain, bus, slot, func);
+	char *driverLink = g_build_filename(dev, "driver", NULL);
+	char *driver = realpath(driverLink, NULL);
+	gpu->driver = g_path_get_basename(driver ? driver : "unknown");
+	free(driver);
+	free(driverLink);
+	gpu->boot_vga = read_sysfs_u64(dev, "boot_vga") == 1;
+	gpu->vram = read_sysfs_u64(dev, "mem_info_vram_total");
+	if(!gpu->vram) {
+		gpu->vram = largest_bar(dev);
+	}
+
+	const char *drv = gpu->driver;
+	if(strequal(drv, "nvidia") || strequal(drv, "nouveau")) {
+		gpu->discrete = true;
+	} else if(strequal(drv, "amdgpu") || strequal(drv, "radeon")) {
+		// APUs report their small carve-out as VRAM
+		gpu->discrete = gpu->vram >= (guint64)2 << 30;
+	} else if(strequal(drv, "i915") || strequal(drv, "xe")) {
+		// Integrated graphics always sit on the root bus, Arc cards don't
+		gpu->discrete = bus != 0;
+	}
+	gpu->score = (gpu->discrete ? 1000 : 0) + (int)MIN(gpu->vram >> 28, 500) + (gpu->boot_vga ? 0 : 1);
+	free(real);
+	free(dev);
+	return true;
+}
+
+static void candidate_clear(struct GpuCandidate *gpu) {
+	free(gpu->id);
+	free(gpu->driver);
+}
+
+static bool load_cached(const char *cache_path, const char *fingerprint, struct GpuChoice *choice) {
+	json_object *obj = json_from_file(cache_path);
+	bool hit = obj && strequal(json_get_string(obj, "fingerprint"), fingerprint);
+	if(hit) {
+		choice->id = g_strdup(json_get_string(obj, "id"));
+		choice->driver = g_strdup(json_get_string(obj, "driver"));
+		choice->reason = g_strdup(json_get_string(obj, "reason"));
+	}
+	json_object_put(obj);
+	return hit;
+}
+
+static void save_cached(const char *cache_path, const char *fingerprint, const struct GpuChoice *choice) {
+	json_object *obj = json_object_new_object();
+	json_set_string(obj, "fingerprint", fingerprint);
+	json_set_string(obj, "id", choice->id);
+	json_set_string(obj, "driver", choice->driver);
+	json_set_string(obj, "reason", choice->reason);
+	// Cache directory doesn't exist on a fresh system
+	char *dir = g_path_get_dirname(cache_path);
+	g_mkdir_with_parents(dir, 0755);
+	free(dir);
+	json_to_file(obj, cache_path, JSON_C_TO_STRING_NOSLASHESCAPE);
+	json_object_put(obj);
+}
+
+#endif
+
+bool microlauncher_gpu_auto_select(const char *cache_path, struct GpuChoice *choice) {
+	memset(choice, 0, sizeof(*choice));
+#ifndef __linux__
+	choice->reason = g_strdup("Automatic GPU selection is only supported on Linux, using default");
+	return false;
+#else
+	GArray *gpus = g_array_new(false, true, sizeof(struct GpuCandidate));
+	GString *fingerprint = g_string_new(NULL);
+	GDir *dir = g_dir_open(DRM_DIR, 0, NULL);
+	const char *entry;
+	while(dir && (entry = g_dir_read_name(dir))) {
+		// cardN only, connectors are cardN-<output>
+		if(!g_str_has_prefix(entry, "card") || strchr(entry, '-')) {
+			continue;
+		}
+		struct GpuCandidate gpu = {0};
+		if(probe_card(entry, &gpu)) {
+			g_array_append_val(gpus, gpu);
+			g_string_append_printf(fingerprint, "%s:%s;", gpu.id, gpu.driver);
+		}
+	}
+	if(dir) {
+		g_dir_close(dir);
+	}
+
+	if(!cache_path || !load_cached(cache_path, fingerprint->str, choice)) {
+		struct GpuCandidate *best = NULL;
+		for(guint i = 0; i < gpus->len; i++) {
+			struct GpuCandidate *gpu = &g_array_index(gpus, struct GpuCandidate, i);
+			if(!best || gpu->score > best->score) {
+				best = gpu;
+			}
+		}
+		if(!best) {
+			choice->reason = g_strdup("No render devices found, using default");
+		} else if(gpus->len == 1) {
+			choice->reason = g_strdup_printf("Only one GPU (%s), using default", best->driver);
+		} else {
+			char *vram = g_format_size(best->vram);
+			choice->reason = g_strdup_printf("%s GPU with %s driver, %s VRAM%s",
+											 best->discrete ? "Discrete" : "Integrated", best->driver, vram,
+											 best->boot_vga ? ", already the default" : "");
+			free(vram);
+			// Default device needs no DRI_PRIME
+			if(!best->boot_vga) {
+				choice->id = g_strdup(best->id);
+				choice->driver = g_strdup(best->driver);
+			}
+		}
+		if(cache_path) {
+			save_cached(cache_path, fingerprint->str, choice);
+		}
+	}
+	for(guint i = 0; i < gpus->len; i++) {
+		candidate_clear(&g_array_index(gpus, struct GpuCandidate, i));
+	}
+	g_array_free(gpus, true);
+	g_string_free(fingerprint, true);
+	return choice->id != NULL;
+#endif
+}
+
+void microlauncher_gpu_choice_clear(struct GpuChoice *choice) {
+	free(choice->id);
+	free(choice->driver);
+	free(choice->reason);
+	memset(choice, 0, sizeof(*choice));
+}
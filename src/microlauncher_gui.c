@@ -10,8 +10,20 @@
 #include <json_types.h>
 #include <microlauncher.h>
 #include <microlauncher_account.h>
+#include <microlauncher_archive.h>
+#include <microlauncher_gc.h>
+#include <microlauncher_snapshot.h>
+#include <microlauncher_gpu.h>
+#include <microlauncher_gui.h>
 #include <microlauncher_instance.h>
+#include <microlauncher_monitor.h>
+#include <microlauncher_mod_browser.h>
 #include <microlauncher_msa.h>
+#include <microlauncher_peer.h>
+#include <microlauncher_qos.h>
+#include <microlauncher_service.h>
+#include <microlauncher_shader_cache.h>
+#include <microlauncher_tuning.h>
 #include <microlauncher_version_item.h>
 #include <stdatomic.h>
 #include <stddef.h>
@@ -19,7 +31,6 @@
 #include <util/json_util.h>
 #include <util/util.h>
 #include <util/xdgutil.h>
-#include <webkit/webkit.h>
 #ifdef G_OS_WIN32
 #include <shlobj.h>
 #include <windows.h>
@@ -40,6 +51,10 @@
 #include <unistd.h>
 
 #define APPID "io.github.lassebq.microlauncher"
+/* Seconds an instance has to stay selected before it is downloaded in background */
+#define BACKGROUND_DOWNLOAD_DELAY 2
+/* Ready instances are verified again when selected after this many seconds, files may have been removed since */
+#define READY_MAX_AGE (10 * 60)
 
 static GtkApplication *app;
 static GtkWindow *window;
@@ -57,8 +72,20 @@ static GtkCheckButton *checkUseZink;
 static GtkCheckButton *checkExplicitGpu;
 static GtkCheckButton *checkHideOnLaunch;
 static GtkCheckButton *checkUseLocalLib;
+static GtkCheckButton *checkClassDataSharing;
+static GtkCheckButton *checkPrefetch;
+static GtkCheckButton *checkLowFootprint;
+static GtkCheckButton *checkBackgroundDownload;
+static GtkCheckButton *checkResidentService;
+static GtkCheckButton *checkLanCache;
+static GtkCheckButton *checkSharedStore;
+static GtkEntry *peersEntry;
 static GtkEntry *widthEntry;
 static GtkEntry *heightEntry;
+static GtkEntry *monitorEntry;
+static GtkEntry *shaderCacheEntry;
+static GtkLabel *shaderCacheLabel;
+static GtkLabel *monitorLabel;
 static GtkRevealer *revealer;
 
 static GtkWidget *accountsPage;
@@ -74,15 +101,43 @@ static GtkProgressBar *msaTimeout;
 static GtkSpinner *msaSpinner;
 static int msaSecondsLeft;
 
-static GPid instancePid = 0;
-static GCancellable *instanceCancellable;
+/* Launches in progress or running, instance -> LaunchContext */
+static GHashTable *runningInstances;
+static struct Callbacks launchCallbacks;
+/* Download of all instances' files, NULL when not running */
+static GTask *prefetchAll;
+static GtkWidget *prefetchAllButton;
+static GTask *archiveTask;
+/* Duplicating an instance or working on its snapshots, NULL when not running */
+static GTask *snapshotTask;
+/* Download of the selected instance while idle, NULL when not running */
+static GTask *backgroundDownload;
+static guint backgroundDownloadSource;
+/* Versions fully downloaded in background, instance -> ReadyVersion */
+static GHashTable *readyVersions;
+/* Ready badges of instance rows, the bound instance is set as "instance" data */
+static GPtrArray *readyBadges;
+/* Serves downloaded files to LAN peers while lanCache is set */
+static PeerServer *peerServer;
+/* Latest resource usage of running games, instance -> ProcessSample */
+static GHashTable *processSamples;
 
 static GSList *gpuIds;
 static GtkStringList *gpuLabels;
+static GtkLabel *gpuAutoLabel;
+static char *gpuAutoReason;
 
 static struct Settings *settings;
 
 static void microlauncher_gui_refresh_instance(void);
+static void update_play_button(void);
+static void update_monitor_label(void);
+static void build_main_window(void);
+static gboolean microlauncher_gui_show_err(char *data);
+static void show_message(const char *title, const char *data);
+static void schedule_background_download(void);
+static void cancel_background_download(void);
+static bool launches_preparing(void);
 
 static void remove_account(MicrolauncherAccount *account) {
 	GSList **accounts = microlauncher_get_accounts();
@@ -103,6 +158,7 @@ static void remove_instance(MicrolauncherInstance *instance) {
 	g_list_store_find(instancesList, instance, &index);
 	g_list_store_remove(instancesList, index);
 	*instances = g_slist_remove(*instances, instance);
+	g_hash_table_remove(readyVersions, instance);
 	if(settings->instance == instance) {
 		settings->instance = NULL;
 	}
@@ -360,6 +416,12 @@ struct CreateInstance {
 	GtkImage *instanceIcon;
 	GtkEntry *instanceGameArgs;
 	GtkEntry *instanceJvmArgs;
+	GtkDropDown *instanceTuning;
+	GtkEntry *instanceAffinity;
+	GtkEntry *instanceNice;
+	GtkDropDown *instanceIoPriority;
+	GtkEntry *instanceMemoryHigh;
+	GtkEntry *instanceCpuWeight;
 	GtkEntry *instancePrefixCommand;
 	GtkColumnView *versionView;
 	GtkWindow *dialog;
@@ -394,6 +456,25 @@ static void create_or_modify_instance(GtkButton *button, void *userdata) {
 	g_value_set_string(&strVal, g_object_get_data(G_OBJECT(createInstance->instanceIcon), "icon-location"));
 	g_object_set_property(G_OBJECT(inst), "icon", &strVal);
 
+	g_value_set_string(&strVal, TUNING_PROFILE_NAMES[gtk_drop_down_get_selected(createInstance->instanceTuning)]);
+	g_object_set_property(G_OBJECT(inst), "tuning", &strVal);
+
+	strConst = gtk_entry_get_text(createInstance->instanceAffinity);
+	g_value_set_string(&strVal, strlen(strConst) > 0 ? strConst : NULL);
+	g_object_set_property(G_OBJECT(inst), "cpu-affinity", &strVal);
+
+	g_value_set_string(&strVal, IO_PRIORITY_NAMES[gtk_drop_down_get_selected(createInstance->instanceIoPriority)]);
+	g_object_set_property(G_OBJECT(inst), "io-priority", &strVal);
+
+	GValue intVal = G_VALUE_INIT;
+	g_value_init(&intVal, G_TYPE_INT);
+	g_value_set_int(&intVal, CLAMP(atoi(gtk_entry_get_text(createInstance->instanceNice)), 0, 19));
+	g_object_set_property(G_OBJECT(inst), "nice", &intVal);
+	g_value_set_int(&intVal, atoi(gtk_entry_get_text(createInstance->instanceMemoryHigh)));
+	g_object_set_property(G_OBJECT(inst), "memory-high", &intVal);
+	g_value_set_int(&intVal, CLAMP(atoi(gtk_entry_get_text(createInstance->instanceCpuWeight)), 0, 10000));
+	g_object_set_property(G_OBJECT(inst), "cpu-weight", &intVal);
+
 	inst->extraGameArgs = NULL;
 	inst->jvmArgs = NULL;
 	inst->prefixCommand = NULL;
@@ -655,6 +736,73 @@ static void microlauncher_modify_instance_window(GtkButton *button, Microlaunche
 	}
 	gtk_grid_attach(grid, widget, 2, row++, 1, 1);
 
+	widget = gtk_label_new("JVM tuning:");
+	gtk_widget_set_halign(widget, GTK_ALIGN_START);
+	gtk_grid_attach(grid, widget, 1, row, 1, 1);
+
+	widget = gtk_drop_down_new_from_strings(TUNING_PROFILE_LABELS);
+	createInstance->instanceTuning = GTK_DROP_DOWN(widget);
+	gtk_drop_down_set_selected(createInstance->instanceTuning, instance ? tuning_profile_from_name(instance->tuning) : TUNING_DEFAULT);
+	gtk_grid_attach(grid, widget, 2, row++, 1, 1);
+
+	widget = gtk_label_new("CPU affinity:");
+	gtk_widget_set_halign(widget, GTK_ALIGN_START);
+	gtk_grid_attach(grid, widget, 1, row, 1, 1);
+
+	widget = gtk_entry_new();
+	entry = GTK_ENTRY(widget);
+	createInstance->instanceAffinity = entry;
+	gtk_entry_set_placeholder_text(entry, "All CPUs (e.g. 0-7,16)");
+	if(instance && instance->cpuAffinity) {
+		gtk_entry_set_text(entry, instance->cpuAffinity);
+	}
+	gtk_grid_attach(grid, widget, 2, row++, 1, 1);
+
+	widget = gtk_label_new("Priority:");
+	gtk_widget_set_halign(widget, GTK_ALIGN_START);
+	gtk_grid_attach(grid, widget, 1, row, 1, 1);
+
+	container = GTK_BOX(gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 10));
+	entry = gtk_entry_digits_only();
+	createInstance->instanceNice = entry;
+	gtk_entry_set_placeholder_text(entry, "0");
+	if(instance && instance->nice) {
+		char *str = g_strdup_printf("%d", instance->nice);
+		gtk_entry_set_text(entry, str);
+		free(str);
+	}
+	gtk_box_append(container, gtk_widget_with_label("Nice:", GTK_WIDGET(entry)));
+	widget = gtk_drop_down_new_from_strings(IO_PRIORITY_LABELS);
+	createInstance->instanceIoPriority = GTK_DROP_DOWN(widget);
+	gtk_drop_down_set_selected(createInstance->instanceIoPriority, io_priority_from_name(instance ? instance->ioPriority : NULL));
+	gtk_box_append(container, gtk_widget_with_label("I/O:", widget));
+	gtk_grid_attach(grid, GTK_WIDGET(container), 2, row++, 1, 1);
+
+	widget = gtk_label_new("cgroup limits:");
+	gtk_widget_set_halign(widget, GTK_ALIGN_START);
+	gtk_grid_attach(grid, widget, 1, row, 1, 1);
+
+	container = GTK_BOX(gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 10));
+	entry = gtk_entry_digits_only();
+	createInstance->instanceMemoryHigh = entry;
+	gtk_entry_set_placeholder_text(entry, "No limit");
+	if(instance && instance->memoryHigh) {
+		char *str = g_strdup_printf("%d", instance->memoryHigh);
+		gtk_entry_set_text(entry, str);
+		free(str);
+	}
+	gtk_box_append(container, gtk_widget_with_label("Memory (MiB):", GTK_WIDGET(entry)));
+	entry = gtk_entry_digits_only();
+	createInstance->instanceCpuWeight = entry;
+	gtk_entry_set_placeholder_text(entry, "100");
+	if(instance && instance->cpuWeight) {
+		char *str = g_strdup_printf("%d", instance->cpuWeight);
+		gtk_entry_set_text(entry, str);
+		free(str);
+	}
+	gtk_box_append(container, gtk_widget_with_label("CPU weight:", GTK_WIDGET(entry)));
+	gtk_grid_attach(grid, GTK_WIDGET(container), 2, row++, 1, 1);
+
 	widget = gtk_label_new("Prefix command:");
 	gtk_widget_set_halign(widget, GTK_ALIGN_START);
 	gtk_grid_attach(grid, widget, 1, row, 1, 1);
@@ -688,6 +836,7 @@ static void microlauncher_modify_instance_window(GtkButton *button, Microlaunche
 	GListStore *store = g_list_store_new(G_TYPE_OBJECT);
 	GHashTable *manifest = microlauncher_get_manifest();
 	g_hash_table_foreach(manifest, (GHFunc)add_version, store);
+	g_hash_table_unref(manifest);
 	widget = gtk_column_view_new(NULL);
 	GtkColumnView *columnView = GTK_COLUMN_VIEW(widget);
 	createInstance->versionView = columnView;
@@ -891,37 +1040,322 @@ static void microlauncher_gui_refresh_instance(void) {
 	gtk_box_append(GTK_BOX(box), widget);
 	gtk_frame_set_child(userFrame, box);
 
-	gtk_widget_set_sensitive(GTK_WIDGET(playButton), inst && settings->user);
+	update_play_button();
+	update_monitor_label();
+	schedule_background_download();
+}
+
+static LaunchContext *get_running_launch(MicrolauncherInstance *inst) {
+	return inst ? g_hash_table_lookup(runningInstances, inst) : NULL;
 }
 
-static gboolean microlauncher_gui_enable_cancel(void *userdata) {
-	gtk_button_set_label(playButton, "Cancel");
+static void update_play_button(void) {
+	LaunchContext *ctx = get_running_launch(settings->instance);
+	if(!ctx) {
+		gtk_button_set_label(playButton, "Play");
+		gtk_widget_set_sensitive(GTK_WIDGET(playButton), settings->instance && settings->user);
+		return;
+	}
+	gtk_button_set_label(playButton, microlauncher_launch_context_get_pid(ctx) ? "Kill" : "Cancel");
 	gtk_widget_set_sensitive(GTK_WIDGET(playButton), true);
+}
+
+static void update_monitor_label(void) {
+	if(!window) {
+		return;
+	}
+	MicrolauncherInstance *inst = settings->instance;
+	struct ProcessSample *sample = inst ? g_hash_table_lookup(processSamples, inst) : NULL;
+	char *text = NULL;
+	if(sample) {
+		char *rss = g_format_size(sample->rss);
+		char *swap = g_format_size(sample->swap);
+		char *readRate = g_format_size(sample->read_rate);
+		char *writeRate = g_format_size(sample->write_rate);
+		text = g_strdup_printf("CPU %.0f%%   RSS %s   Swap %s   %d threads   Read %s/s   Write %s/s",
+							   sample->cpu, rss, swap, sample->threads, readRate, writeRate);
+		free(rss);
+		free(swap);
+		free(readRate);
+		free(writeRate);
+	} else if(inst && inst->location) {
+		struct SessionSummary session;
+		char *path = microlauncher_monitor_history_path(settings->launcher_root, inst->location);
+		if(microlauncher_monitor_load_history(path, &session, 1)) {
+			char *peak = g_format_size(session.peak_rss);
+			text = g_strdup_printf("Last session: %d:%02d:%02d, peak RSS %s, average CPU %.0f%%",
+								   (int)(session.length / 3600), (int)(session.length / 60 % 60), (int)(session.length % 60),
+								   peak, session.avg_cpu);
+			free(peak);
+		}
+		free(path);
+	}
+	gtk_label_set_text(monitorLabel, text ? text : "");
+	gtk_widget_set_visible(GTK_WIDGET(monitorLabel), text != NULL);
+	free(text);
+}
+
+static void shader_cache_size_thread(GTask *task, gpointer source_object, const char *root, GCancellable *cancellable) {
+	char *path = g_build_filename(root, "shadercache", NULL);
+	guint64 *size = g_new(guint64, 1);
+	*size = microlauncher_shader_cache_size(path);
+	free(path);
+	g_task_return_pointer(task, size, free);
+}
+
+static const char *GC_CATEGORY_LABELS[GC_CATEGORY_COUNT] = {
+	[GC_VERSIONS] = "Versions",
+	[GC_LIBRARIES] = "Libraries",
+	[GC_ASSET_INDEXES] = "Asset indexes",
+	[GC_ASSET_OBJECTS] = "Asset objects",
+	[GC_NATIVES] = "Natives of crashed launches",
+	[GC_PARTIAL] = "Partial downloads",
+	[GC_STORE] = "Shared store"};
+
+struct StorageDialog {
+	GtkWindow *window;
+	GtkLabel *used[GC_CATEGORY_COUNT];
+	GtkLabel *unused[GC_CATEGORY_COUNT];
+	GtkLabel *status;
+	GtkWidget *removeButton;
+	/* Of the last scan, what "Remove unused" removes */
+	GcPlan *plan;
+};
+
+/* NULL while the storage dialog is closed */
+static struct StorageDialog *storageDialog;
+static GTask *gcTask;
+
+struct GcJob {
+	LaunchContext *ctx;
+	char **roots;
+	/* Scanned, or to remove when set at start */
+	GcPlan *plan;
+	bool dry_run;
+	bool ok;
+	struct GcReport report;
+};
+
+static void gc_job_free(struct GcJob *job) {
+	microlauncher_launch_context_free(job->ctx);
+	g_strfreev(job->roots);
+	microlauncher_gc_plan_free(job->plan);
+	free(job);
+}
+
+static void gc_thread(GTask *task, gpointer source_object, struct GcJob *job, GCancellable *cancellable) {
+	if(job->dry_run) {
+		job->plan = microlauncher_gc_scan(job->ctx, (const char *const *)job->roots, &job->report);
+		job->ok = job->plan != NULL;
+	} else {
+		microlauncher_gc_remove(job->ctx, job->plan, NULL, NULL, &job->report);
+		job->ok = true;
+	}
+}
+
+static void gc_finished(GObject *source_object, GAsyncResult *res, gpointer data) {
+	struct GcJob *job = g_task_get_task_data(G_TASK(res));
+	gcTask = NULL;
+	if(!job->dry_run) {
+		// Any ready version may have lost files
+		g_hash_table_remove_all(readyVersions);
+		schedule_background_download();
+	}
+	if(!storageDialog) {
+		return;
+	}
+	guint64 unused = 0;
+	for(int i = 0; job->dry_run && i < GC_CATEGORY_COUNT; i++) {
+		char *str = g_format_size(job->report.used[i]);
+		gtk_label_set_text(storageDialog->used[i], str);
+		free(str);
+		// Store objects are only reported
+		str = g_format_size(job->report.unused[i]);
+		gtk_label_set_text(storageDialog->unused[i], str);
+		free(str);
+		unused += job->report.unused[i];
+	}
+	if(!job->dry_run) {
+		// What is left is only known after another scan
+		for(int i = 0; i < GC_CATEGORY_COUNT; i++) {
+			gtk_label_set_text(storageDialog->unused[i], "-");
+		}
+	} else if(job->ok) {
+		storageDialog->plan = g_steal_pointer(&job->plan);
+	}
+	char *str;
+	if(!job->ok) {
+		str = g_strdup("Not every version could be resolved, nothing can be removed.");
+	} else if(job->dry_run) {
+		char *size = g_format_size(unused);
+		str = g_strdup_printf("%s can be freed.", size);
+		free(size);
+	} else {
+		char *size = g_format_size(job->report.freed);
+		str = g_strdup_printf("Freed %s.", size);
+		free(size);
+	}
+	gtk_label_set_text(storageDialog->status, str);
+	free(str);
+	gtk_widget_set_sensitive(storageDialog->removeButton, job->ok && job->dry_run && unused > 0);
+}
+
+static void gc_start(bool dry_run) {
+	if(gcTask) {
+		return;
+	}
+	struct Callbacks callbacks = launchCallbacks;
+	callbacks.userdata = NULL;
+	struct GcJob *job = g_new0(struct GcJob, 1);
+	job->ctx = microlauncher_launch_context_new(NULL, NULL, callbacks);
+	job->dry_run = dry_run;
+	if(dry_run) {
+		job->roots = microlauncher_gc_get_roots(NULL);
+	} else {
+		// Removes what the dialog showed, not what a new scan finds
+		job->plan = g_steal_pointer(&storageDialog->plan);
+	}
+	if(storageDialog) {
+		gtk_label_set_text(storageDialog->status, dry_run ? "Scanning..." : "Removing unused files...");
+		gtk_widget_set_sensitive(storageDialog->removeButton, false);
+	}
+	gcTask = g_task_new(NULL, NULL, gc_finished, NULL);
+	g_task_set_task_data(gcTask, job, (GDestroyNotify)gc_job_free);
+	g_task_run_in_thread(gcTask, (GTaskThreadFunc)gc_thread);
+	g_object_unref(gcTask);
+}
+
+static void remove_unused_clicked(GtkButton *button, gpointer data) {
+	if(storageDialog->plan) {
+		gc_start(false);
+	}
+}
+
+static void storage_dialog_destroy(GtkWidget *widget, gpointer data) {
+	microlauncher_gc_plan_free(storageDialog->plan);
+	g_clear_pointer(&storageDialog, free);
+}
+
+static void show_storage_dialog(void) {
+	if(storageDialog) {
+		gtk_window_present(storageDialog->window);
+		return;
+	}
+	storageDialog = g_new0(struct StorageDialog, 1);
+	GtkWindow *dialog = gtk_modal_dialog_new(window);
+	storageDialog->window = dialog;
+	gtk_window_set_title(dialog, "Storage usage");
+	GtkBox *box = GTK_BOX(gtk_box_new(GTK_ORIENTATION_VERTICAL, 10));
+	gtk_widget_set_margin(GTK_WIDGET(box), 10, 10, 10, 10);
+	GtkGrid *grid = GTK_GRID(gtk_grid_new());
+	gtk_grid_set_column_spacing(grid, 20);
+	gtk_grid_set_row_spacing(grid, 5);
+	const char *headers[] = {"", "In use", "Unused"};
+	for(int i = 0; i < 3; i++) {
+		GtkWidget *widget = gtk_label_new(headers[i]);
+		gtk_widget_add_css_class(widget, "heading");
+		gtk_grid_attach(grid, widget, i, 0, 1, 1);
+	}
+	for(int i = 0; i < GC_CATEGORY_COUNT; i++) {
+		GtkWidget *widget = gtk_label_new(GC_CATEGORY_LABELS[i]);
+		gtk_widget_set_halign(widget, GTK_ALIGN_START);
+		gtk_grid_attach(grid, widget, 0, i + 1, 1, 1);
+		widget = gtk_label_new("-");
+		gtk_widget_set_halign(widget, GTK_ALIGN_END);
+		storageDialog->used[i] = GTK_LABEL(widget);
+		gtk_grid_attach(grid, widget, 1, i + 1, 1, 1);
+		widget = gtk_label_new("-");
+		gtk_widget_set_halign(widget, GTK_ALIGN_END);
+		storageDialog->unused[i] = GTK_LABEL(widget);
+		gtk_grid_attach(grid, widget, 2, i + 1, 1, 1);
+	}
+	gtk_box_append(box, GTK_WIDGET(grid));
+	GtkWidget *widget = gtk_label_new("Files are unused when no instance and no version in gcKeep of settings needs them.");
+	gtk_label_set_wrap(GTK_LABEL(widget), true);
+	gtk_widget_add_css_class(widget, "dim-label");
+	gtk_box_append(box, widget);
+	widget = gtk_label_new(NULL);
+	storageDialog->status = GTK_LABEL(widget);
+	gtk_box_append(box, widget);
+	GtkBox *buttons = GTK_BOX(gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 10));
+	gtk_widget_set_halign(GTK_WIDGET(buttons), GTK_ALIGN_END);
+	widget = gtk_button_new_with_label("Remove unused");
+	gtk_widget_add_css_class(widget, "destructive-action");
+	gtk_widget_set_sensitive(widget, false);
+	g_signal_connect(widget, "clicked", G_CALLBACK(remove_unused_clicked), NULL);
+	storageDialog->removeButton = widget;
+	gtk_box_append(buttons, widget);
+	widget = gtk_button_new_with_label("Close");
+	g_signal_connect(widget, "clicked", G_CALLBACK(cancel_callback), dialog);
+	gtk_box_append(buttons, widget);
+	gtk_box_append(box, GTK_WIDGET(buttons));
+	gtk_window_set_child(dialog, GTK_WIDGET(box));
+	g_signal_connect(dialog, "destroy", G_CALLBACK(storage_dialog_destroy), NULL);
+	gtk_window_present(dialog);
+	gc_start(true);
+}
+
+static void shader_cache_size_ready(GObject *source_object, GAsyncResult *res, gpointer userdata) {
+	guint64 *size = g_task_propagate_pointer(G_TASK(res), NULL);
+	if(!window) {
+		free(size);
+		return;
+	}
+	char *formatted = g_format_size(*size);
+	char *text = g_strdup_printf("%s in use", formatted);
+	gtk_label_set_text(shaderCacheLabel, text);
+	free(text);
+	free(formatted);
+	free(size);
+}
+
+/* Caches can have many small files, so size is computed off the main thread */
+static void update_shader_cache_size(void) {
+	GTask *task = g_task_new(NULL, NULL, shader_cache_size_ready, NULL);
+	g_task_set_task_data(task, g_strdup(settings->launcher_root), free);
+	g_task_run_in_thread(task, (GTaskThreadFunc)shader_cache_size_thread);
+	g_object_unref(task);
+}
+
+static gboolean bench_spawn_idle(void *userdata) {
+	microlauncher_bench_spawn();
 	return false;
 }
 
-static gboolean microlauncher_gui_enable_play(void *userdata) {
-	instancePid = 0;
-	if(instanceCancellable) {
-		g_object_unref(instanceCancellable);
-		instanceCancellable = NULL;
+static gboolean bench_startup_idle(void *userdata) {
+	// Exits so tools/measure-startup.sh can run it repeatedly
+	if(microlauncher_bench_startup()) {
+		g_application_quit(G_APPLICATION(app));
 	}
-	gtk_button_set_label(playButton, "Play");
-	gtk_widget_set_sensitive(GTK_WIDGET(playButton), true);
-	gtk_widget_set_sensitive(GTK_WIDGET(instancesPage), true);
-	gtk_widget_set_sensitive(GTK_WIDGET(accountsPage), true);
-	if(settings->hideOnLaunch) {
+	return false;
+}
+
+static gboolean microlauncher_gui_launch_finished(MicrolauncherInstance *inst) {
+	g_hash_table_remove(processSamples, inst);
+	g_hash_table_remove(runningInstances, inst);
+	if(!window) {
+		// Torn down by low footprint mode
+		if(g_hash_table_size(runningInstances) == 0) {
+			build_main_window();
+		}
+		g_application_release(G_APPLICATION(app));
+		return false;
+	}
+	update_play_button();
+	update_monitor_label();
+	update_shader_cache_size();
+	if(settings->hideOnLaunch && g_hash_table_size(runningInstances) == 0) {
 		gtk_widget_set_visible(GTK_WIDGET(window), true);
 	}
+	g_application_release(G_APPLICATION(app));
 	return false;
 }
 
-static void launch_instance_thread(GTask *gtask, gpointer source_object, gpointer task_data, GCancellable *cancellable) {
-	g_application_hold(G_APPLICATION(app));
-	g_idle_add(microlauncher_gui_enable_cancel, NULL);
-	microlauncher_launch_instance(settings->instance, settings->user, cancellable);
-	g_idle_add(microlauncher_gui_enable_play, NULL);
-	g_application_release(G_APPLICATION(app));
+static void launch_instance_thread(GTask *gtask, gpointer source_object, LaunchContext *ctx, GCancellable *cancellable) {
+	// Once started, the game is supervised from main loop and this thread is done
+	if(!microlauncher_launch_instance(ctx)) {
+		g_idle_add(G_SOURCE_FUNC(microlauncher_gui_launch_finished), microlauncher_launch_context_get_instance(ctx));
+	}
 }
 
 static void apply_settings(void) {
@@ -936,92 +1370,578 @@ static void apply_settings(void) {
 	settings->demo = gtk_check_button_get_active(checkDemo);
 	settings->hideOnLaunch = gtk_check_button_get_active(checkHideOnLaunch);
 	settings->useLocalLib = gtk_check_button_get_active(checkUseLocalLib);
+	settings->classDataSharing = gtk_check_button_get_active(checkClassDataSharing);
+	settings->prefetch = gtk_check_button_get_active(checkPrefetch);
+	settings->lowFootprint = gtk_check_button_get_active(checkLowFootprint);
+	settings->backgroundDownload = gtk_check_button_get_active(checkBackgroundDownload);
+	settings->sharedStore = gtk_check_button_get_active(checkSharedStore);
+	free(settings->peers);
+	settings->peers = g_strdup(gtk_entry_buffer_get_text(gtk_entry_get_buffer(peersEntry)));
+	if(settings->lanCache) {
+		microlauncher_peer_discovery_start(settings->peers);
+	}
+	settings->monitorInterval = atoi(gtk_entry_buffer_get_text(gtk_entry_get_buffer(monitorEntry)));
+	settings->shaderCacheBudget = atoi(gtk_entry_buffer_get_text(gtk_entry_get_buffer(shaderCacheEntry)));
 }
 
-static gboolean on_decide_policy(WebKitWebView *web_view,
-								 WebKitPolicyDecision *decision,
-								 WebKitPolicyDecisionType type,
-								 gpointer user_data) {
-
-	if(type == WEBKIT_POLICY_DECISION_TYPE_NAVIGATION_ACTION) {
-		WebKitNavigationPolicyDecision *nav_decision = WEBKIT_NAVIGATION_POLICY_DECISION(decision);
-		WebKitNavigationAction *action = webkit_navigation_policy_decision_get_navigation_action(nav_decision);
-		WebKitURIRequest *request = webkit_navigation_action_get_request(action);
-		const gchar *uri = webkit_uri_request_get_uri(request);
+#ifdef HAVE_MOD_BROWSER
+static ModBrowserShowFunc modBrowserShow;
 
-		// If you want to block specific file extensions or patterns
-		if(g_str_has_suffix(uri, ".jar") || g_str_has_suffix(uri, ".zip") || g_str_has_suffix(uri, ".mrpack")) {
-			webkit_policy_decision_download(decision); // Stop the navigation/download entirely
-			g_print("Blocked download attempt for: %s\n", uri);
-			return TRUE; // Signal handled
+static bool load_mod_browser(void) {
+	if(modBrowserShow) {
+		return true;
+	}
+	// Next to the executable in build trees and on Windows
+	char *dir = g_path_get_dirname(EXEC_BINARY);
+	const char *dirs[] = {dir, MOD_BROWSER_DIR, NULL};
+	GModule *module = NULL;
+	for(int i = 0; dirs[i] && !module; i++) {
+		char *path = g_build_filename(dirs[i], MOD_BROWSER_FILE, NULL);
+		if(g_file_test(path, G_FILE_TEST_EXISTS)) {
+			module = g_module_open(path, G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
 		}
+		free(path);
+	}
+	free(dir);
+	if(!module) {
+		microlauncher_gui_show_err(g_strdup_printf("Could not load mod browser: %s", g_module_error() ? g_module_error() : MOD_BROWSER_FILE " not found"));
+		return false;
+	}
+	if(!g_module_symbol(module, MOD_BROWSER_SYMBOL, (gpointer *)&modBrowserShow)) {
+		microlauncher_gui_show_err(g_strdup_printf("Could not load mod browser: %s", g_module_error()));
+		g_module_close(module);
+		return false;
 	}
+	// WebKit can't be unloaded safely
+	g_module_make_resident(module);
+	return true;
+}
+
+static void show_get_mods(GtkWindow *parent) {
+	if(load_mod_browser()) {
+		modBrowserShow(parent);
+	}
+}
+#endif
+
+struct PrefetchAll {
+	LaunchContext *ctx;
+	char **versions;
+	bool ok;
+};
+
+static void prefetch_all_free(struct PrefetchAll *job) {
+	microlauncher_launch_context_free(job->ctx);
+	g_strfreev(job->versions);
+	free(job);
+}
+
+static void prefetch_all_thread(GTask *task, gpointer source_object, struct PrefetchAll *job, GCancellable *cancellable) {
+	job->ok = microlauncher_fetch(job->ctx, (const char *const *)job->versions);
+}
 
-	else if(type == WEBKIT_POLICY_DECISION_TYPE_RESPONSE) {
-		WebKitResponsePolicyDecision *res_decision = WEBKIT_RESPONSE_POLICY_DECISION(decision);
-		WebKitURIResponse *response = webkit_response_policy_decision_get_response(res_decision);
+static void prefetch_all_finished(GObject *source_object, GAsyncResult *res, gpointer data) {
+	struct PrefetchAll *job = g_task_get_task_data(G_TASK(res));
+	struct DownloadStats stats = microlauncher_launch_context_get_stats(job->ctx);
+	prefetchAll = NULL;
+	if(window) {
+		gtk_widget_set_sensitive(prefetchAllButton, true);
+		char *fetched = g_format_size(stats.fetched_size);
+		char *present = g_format_size(stats.present_size);
+		char *str = g_strdup_printf("%s\n\nDownloaded %u files (%s), %u files (%s) were already present.",
+									job->ok ? "All instances are ready to be launched offline." : "Some files couldn't be downloaded.",
+									stats.fetched, fetched, stats.present, present);
+		show_message("Download all instances", str);
+		free(str);
+		free(fetched);
+		free(present);
+	}
+}
 
-		// If the server explicitly says "this is a download" (Content-Disposition: attachment)
-		if(webkit_response_policy_decision_is_mime_type_supported(res_decision) == FALSE) {
-			webkit_policy_decision_ignore(decision);
-			g_print("Ignored unsupported MIME type (download prevented)\n");
-			return TRUE;
+static void prefetch_all(void) {
+	if(prefetchAll) {
+		return;
+	}
+	GPtrArray *versions = g_ptr_array_new();
+	for(GSList *node = *microlauncher_get_instances(); node; node = node->next) {
+		MicrolauncherInstance *inst = node->data;
+		if(inst->version) {
+			g_ptr_array_add(versions, g_strdup(inst->version));
 		}
 	}
+	g_ptr_array_add(versions, NULL);
+	cancel_background_download();
+	struct Callbacks callbacks = launchCallbacks;
+	callbacks.userdata = NULL;
+	struct PrefetchAll *job = g_new0(struct PrefetchAll, 1);
+	job->ctx = microlauncher_launch_context_new(NULL, NULL, callbacks);
+	job->versions = (char **)g_ptr_array_free(versions, FALSE);
+	gtk_widget_set_sensitive(prefetchAllButton, false);
+	prefetchAll = g_task_new(NULL, NULL, prefetch_all_finished, NULL);
+	g_task_set_task_data(prefetchAll, job, (GDestroyNotify)prefetch_all_free);
+	g_task_run_in_thread(prefetchAll, (GTaskThreadFunc)prefetch_all_thread);
+	g_object_unref(prefetchAll);
+}
+
+struct ArchiveJob {
+	LaunchContext *ctx;
+	char *path;
+	MicrolauncherInstance *imported;
+	bool ok;
+};
 
-	return FALSE; // Let WebKit handle it normally
+static void archive_job_free(struct ArchiveJob *job) {
+	microlauncher_launch_context_free(job->ctx);
+	free(job->path);
+	free(job);
 }
 
-static void on_download_mod_or_pack(WebKitNetworkSession *session, WebKitDownload *download, void *data) {
-	webkit_download_cancel(download);
+static void archive_thread(GTask *task, gpointer source_object, struct ArchiveJob *job, GCancellable *cancellable) {
+	if(microlauncher_launch_context_get_instance(job->ctx)) {
+		job->ok = microlauncher_archive_export(job->ctx, job->path);
+	} else {
+		job->imported = microlauncher_archive_import(job->ctx, job->path, NULL);
+		job->ok = job->imported != NULL;
+	}
 }
 
-static void show_get_mods(GtkWindow *parent) {
-	GtkWidget *widget;
-	GtkWindow *window = gtk_modal_dialog_new(parent);
-	gtk_window_set_default_size(window, 600, 800);
-	gtk_window_set_title(window, "Browse Mods");
-	gtk_window_set_transient_for(window, NULL);
-	gtk_window_set_modal(window, false);
-	GtkBox *box = GTK_BOX(gtk_box_new(GTK_ORIENTATION_VERTICAL, 0));
-	widget = gtk_entry_new();
-	gtk_widget_set_margin(widget, 10, 10, 10, 10);
-	gtk_editable_set_editable(GTK_EDITABLE(widget), false);
-	gtk_box_append(box, widget);
-	widget = webkit_web_view_new();
-	g_signal_connect(widget, "decide-policy", G_CALLBACK(on_decide_policy), NULL);
-	gtk_widget_set_vexpand(widget, true);
-	webkit_web_view_load_uri(WEBKIT_WEB_VIEW(widget), "https://modrinth.com/discover/mods");
-	WebKitNetworkSession *session = webkit_web_view_get_network_session(WEBKIT_WEB_VIEW(widget));
-	g_signal_connect(session, "download-started", G_CALLBACK(on_download_mod_or_pack), NULL);
+static void archive_finished(GObject *source_object, GAsyncResult *res, gpointer data) {
+	struct ArchiveJob *job = g_task_get_task_data(G_TASK(res));
+	archiveTask = NULL;
+	if(job->imported) {
+		add_instance(job->imported, g_slist_length(*microlauncher_get_instances()));
+		char *str = g_strdup_printf("Imported %s.", job->imported->name);
+		show_message("Import instance", str);
+		free(str);
+	} else if(job->ok) {
+		char *str = g_strdup_printf("Instance was exported to %s.", job->path);
+		show_message("Export instance", str);
+		free(str);
+	}
+}
+
+static void archive_start(MicrolauncherInstance *instance, GFile *file) {
+	struct Callbacks callbacks = launchCallbacks;
+	callbacks.userdata = NULL;
+	struct ArchiveJob *job = g_new0(struct ArchiveJob, 1);
+	job->ctx = microlauncher_launch_context_new(instance, NULL, callbacks);
+	job->path = g_file_get_path(file);
+	archiveTask = g_task_new(NULL, NULL, archive_finished, NULL);
+	g_task_set_task_data(archiveTask, job, (GDestroyNotify)archive_job_free);
+	g_task_run_in_thread(archiveTask, (GTaskThreadFunc)archive_thread);
+	g_object_unref(archiveTask);
+}
+
+static void select_export_archive(GtkFileDialog *dialog, GAsyncResult *res, MicrolauncherInstance *instance) {
+	GFile *file = gtk_file_dialog_save_finish(dialog, res, NULL);
+	if(file && !archiveTask) {
+		archive_start(instance, file);
+	}
+	if(file) {
+		g_object_unref(file);
+	}
+	g_object_unref(instance);
+}
+
+static void export_instance(MicrolauncherInstance *instance) {
+	GtkFileDialog *dialog = gtk_file_dialog_new();
+	gtk_file_dialog_set_title(dialog, "Export instance");
+	char *name = g_strdup_printf("%s.zip", instance->name);
+	gtk_file_dialog_set_initial_name(dialog, name);
+	free(name);
+	gtk_file_dialog_save(dialog, window, NULL, (GAsyncReadyCallback)select_export_archive, g_object_ref(instance));
+}
+
+static void select_import_archive(GtkFileDialog *dialog, GAsyncResult *res, gpointer data) {
+	GFile *file = gtk_file_dialog_open_finish(dialog, res, NULL);
+	if(file && !archiveTask) {
+		archive_start(NULL, file);
+	}
+	if(file) {
+		g_object_unref(file);
+	}
+}
+
+static void import_instance(void) {
+	GtkFileDialog *dialog = gtk_file_dialog_new();
+	gtk_file_dialog_set_title(dialog, "Import instance");
+	gtk_file_dialog_open(dialog, window, NULL, (GAsyncReadyCallback)select_import_archive, NULL);
+}
+
+enum SnapshotOperation {
+	SNAPSHOT_DUPLICATE,
+	SNAPSHOT_CREATE,
+	SNAPSHOT_RESTORE,
+	SNAPSHOT_DELETE
+};
+
+struct SnapshotJob {
+	LaunchContext *ctx;
+	enum SnapshotOperation operation;
+	char *name;
+	MicrolauncherInstance *copy;
+	bool ok;
+};
+
+struct SnapshotDialog {
+	GtkWindow *window;
+	MicrolauncherInstance *instance;
+	GtkListBox *list;
+};
+
+/* NULL while the snapshots dialog is closed */
+static struct SnapshotDialog *snapshotDialog;
+
+static void snapshot_dialog_refresh(void);
+
+static void snapshot_job_free(struct SnapshotJob *job) {
+	microlauncher_launch_context_free(job->ctx);
+	free(job->name);
+	free(job);
+}
+
+static void snapshot_thread(GTask *task, gpointer source_object, struct SnapshotJob *job, GCancellable *cancellable) {
+	switch(job->operation) {
+		case SNAPSHOT_DUPLICATE:
+			job->copy = microlauncher_snapshot_duplicate(job->ctx);
+			job->ok = job->copy != NULL;
+			break;
+		case SNAPSHOT_CREATE:
+			free(job->name);
+			job->name = microlauncher_snapshot_create(job->ctx, NULL);
+			job->ok = job->name != NULL;
+			break;
+		case SNAPSHOT_RESTORE:
+			job->ok = microlauncher_snapshot_restore(job->ctx, job->name);
+			break;
+		case SNAPSHOT_DELETE:
+			job->ok = microlauncher_snapshot_delete(job->ctx, job->name);
+			break;
+	}
+}
+
+static void snapshot_finished(GObject *source_object, GAsyncResult *res, gpointer data) {
+	struct SnapshotJob *job = g_task_get_task_data(G_TASK(res));
+	snapshotTask = NULL;
+	MicrolauncherInstance *instance = microlauncher_launch_context_get_instance(job->ctx);
+	if(job->copy) {
+		add_instance(job->copy, g_slist_index(*microlauncher_get_instances(), instance) + 1);
+	} else if(job->ok && job->operation == SNAPSHOT_RESTORE) {
+		g_hash_table_remove(readyVersions, instance);
+		schedule_background_download();
+		char *str = g_strdup_printf("%s was restored to %s.", instance->name, job->name);
+		show_message("Snapshots", str);
+		free(str);
+	}
+	if(snapshotDialog && snapshotDialog->instance == instance) {
+		snapshot_dialog_refresh();
+	}
+}
+
+static void snapshot_start(MicrolauncherInstance *instance, enum SnapshotOperation operation, const char *name) {
+	if(snapshotTask) {
+		show_message("Snapshots", "Another instance is being copied, wait for it to finish.");
+		return;
+	}
+	if(operation == SNAPSHOT_RESTORE && g_hash_table_contains(runningInstances, instance)) {
+		show_message("Snapshots", "The instance is running, exit the game before restoring a snapshot.");
+		return;
+	}
+	struct Callbacks callbacks = launchCallbacks;
+	callbacks.userdata = NULL;
+	struct SnapshotJob *job = g_new0(struct SnapshotJob, 1);
+	job->ctx = microlauncher_launch_context_new(instance, NULL, callbacks);
+	job->operation = operation;
+	job->name = g_strdup(name);
+	snapshotTask = g_task_new(NULL, NULL, snapshot_finished, NULL);
+	g_task_set_task_data(snapshotTask, job, (GDestroyNotify)snapshot_job_free);
+	g_task_run_in_thread(snapshotTask, (GTaskThreadFunc)snapshot_thread);
+	g_object_unref(snapshotTask);
+}
+
+static void restore_snapshot_confirm(GtkDialog *self, gint response_id, gpointer user_data) {
+	gtk_window_destroy(GTK_WINDOW(self));
+	if(response_id == GTK_RESPONSE_YES && snapshotDialog) {
+		snapshot_start(snapshotDialog->instance, SNAPSHOT_RESTORE, user_data);
+	}
+	free(user_data);
+}
+
+static void restore_snapshot_clicked(GtkButton *button, gpointer data) {
+	const char *name = g_object_get_data(G_OBJECT(button), "snapshot");
+	char *str = g_strdup_printf("Replace the instance directory with snapshot %s?\nChanges made since then are lost", name);
+	gtk_show_modal_dialog(str, DIALOG_YN, GTK_MESSAGE_QUESTION, snapshotDialog->window, G_CALLBACK(restore_snapshot_confirm), g_strdup(name));
+	free(str);
+}
+
+static void delete_snapshot_clicked(GtkButton *button, gpointer data) {
+	snapshot_start(snapshotDialog->instance, SNAPSHOT_DELETE, g_object_get_data(G_OBJECT(button), "snapshot"));
+}
+
+static void take_snapshot_clicked(GtkButton *button, gpointer data) {
+	snapshot_start(snapshotDialog->instance, SNAPSHOT_CREATE, NULL);
+}
+
+static void snapshot_dialog_refresh(void) {
+	GtkWidget *child;
+	while((child = gtk_widget_get_first_child(GTK_WIDGET(snapshotDialog->list)))) {
+		gtk_list_box_remove(snapshotDialog->list, child);
+	}
+	char **names = microlauncher_snapshot_list(snapshotDialog->instance);
+	for(char **name = names; *name; name++) {
+		GtkBox *box = GTK_BOX(gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 10));
+		gtk_widget_set_margin(GTK_WIDGET(box), 5, 5, 5, 5);
+		GtkWidget *widget = gtk_label_new(*name);
+		gtk_widget_set_hexpand(widget, true);
+		gtk_widget_set_halign(widget, GTK_ALIGN_START);
+		gtk_box_append(box, widget);
+		widget = gtk_button_new_with_label("Restore");
+		g_object_set_data_full(G_OBJECT(widget), "snapshot", g_strdup(*name), free);
+		g_signal_connect(widget, "clicked", G_CALLBACK(restore_snapshot_clicked), NULL);
+		gtk_box_append(box, widget);
+		widget = gtk_button_new_from_icon_name("user-trash-full-symbolic");
+		gtk_widget_add_css_class(widget, "destructive-action");
+		gtk_widget_set_tooltip_text(widget, "Delete snapshot");
+		g_object_set_data_full(G_OBJECT(widget), "snapshot", g_strdup(*name), free);
+		g_signal_connect(widget, "clicked", G_CALLBACK(delete_snapshot_clicked), NULL);
+		gtk_box_append(box, widget);
+		gtk_list_box_append(snapshotDialog->list, GTK_WIDGET(box));
+	}
+	if(!names[0]) {
+		GtkWidget *widget = gtk_label_new("No snapshots yet");
+		gtk_widget_add_css_class(widget, "dim-label");
+		gtk_widget_set_margin(widget, 10, 10, 10, 10);
+		gtk_list_box_append(snapshotDialog->list, widget);
+	}
+	g_strfreev(names);
+}
+
+static void snapshot_dialog_destroy(GtkWidget *widget, gpointer data) {
+	g_object_unref(snapshotDialog->instance);
+	g_clear_pointer(&snapshotDialog, free);
+}
+
+static void show_snapshot_dialog(MicrolauncherInstance *instance) {
+	if(snapshotDialog) {
+		gtk_window_destroy(snapshotDialog->window);
+	}
+	snapshotDialog = g_new0(struct SnapshotDialog, 1);
+	snapshotDialog->instance = g_object_ref(instance);
+	GtkWindow *dialog = gtk_modal_dialog_new(window);
+	snapshotDialog->window = dialog;
+	char *title = g_strdup_printf("Snapshots of %s", instance->name);
+	gtk_window_set_title(dialog, title);
+	free(title);
+	gtk_window_set_default_size(dialog, 400, 300);
+	GtkBox *box = GTK_BOX(gtk_box_new(GTK_ORIENTATION_VERTICAL, 10));
+	gtk_widget_set_margin(GTK_WIDGET(box), 10, 10, 10, 10);
+	GtkWidget *widget = gtk_label_new("Snapshots share unchanged files with the instance, mods and resource packs are hardlinked.");
+	gtk_label_set_wrap(GTK_LABEL(widget), true);
+	gtk_widget_add_css_class(widget, "dim-label");
 	gtk_box_append(box, widget);
-	gtk_window_set_child(window, GTK_WIDGET(box));
-	gtk_window_present(window);
+	widget = gtk_list_box_new();
+	gtk_list_box_set_selection_mode(GTK_LIST_BOX(widget), GTK_SELECTION_NONE);
+	snapshotDialog->list = GTK_LIST_BOX(widget);
+	GtkWidget *scrolled = gtk_scrolled_window_new();
+	gtk_scrolled_window_set_child(GTK_SCROLLED_WINDOW(scrolled), widget);
+	gtk_widget_set_vexpand(scrolled, true);
+	gtk_box_append(box, scrolled);
+	GtkBox *buttons = GTK_BOX(gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 10));
+	gtk_widget_set_halign(GTK_WIDGET(buttons), GTK_ALIGN_END);
+	widget = gtk_button_new_with_label("Take snapshot");
+	gtk_widget_add_css_class(widget, "suggested-action");
+	g_signal_connect(widget, "clicked", G_CALLBACK(take_snapshot_clicked), NULL);
+	gtk_box_append(buttons, widget);
+	widget = gtk_button_new_with_label("Close");
+	g_signal_connect(widget, "clicked", G_CALLBACK(cancel_callback), dialog);
+	gtk_box_append(buttons, widget);
+	gtk_box_append(box, GTK_WIDGET(buttons));
+	gtk_window_set_child(dialog, GTK_WIDGET(box));
+	g_signal_connect(dialog, "destroy", G_CALLBACK(snapshot_dialog_destroy), NULL);
+	snapshot_dialog_refresh();
+	gtk_window_present(dialog);
+}
+
+struct BackgroundDownload {
+	LaunchContext *ctx;
+	MicrolauncherInstance *instance;
+	char *version;
+	bool ok;
+};
+
+static void background_download_free(struct BackgroundDownload *job) {
+	microlauncher_launch_context_free(job->ctx);
+	g_object_unref(job->instance);
+	free(job->version);
+	free(job);
+}
+
+struct ReadyVersion {
+	char *version;
+	gint64 verified;
+};
+
+static void ready_version_free(struct ReadyVersion *ready) {
+	free(ready->version);
+	free(ready);
+}
+
+static bool instance_ready(MicrolauncherInstance *inst) {
+	struct ReadyVersion *ready = g_hash_table_lookup(readyVersions, inst);
+	return inst->version && ready && strequal(ready->version, inst->version);
+}
+
+static bool instance_verified_recently(MicrolauncherInstance *inst) {
+	struct ReadyVersion *ready = g_hash_table_lookup(readyVersions, inst);
+	return instance_ready(inst) && g_get_monotonic_time() - ready->verified < READY_MAX_AGE * G_TIME_SPAN_SECOND;
+}
+
+static void update_ready_badges(void) {
+	for(guint i = 0; i < readyBadges->len; i++) {
+		GtkWidget *badge = g_ptr_array_index(readyBadges, i);
+		MicrolauncherInstance *inst = g_object_get_data(G_OBJECT(badge), "instance");
+		gtk_widget_set_visible(badge, inst && instance_ready(inst));
+	}
+}
+
+static void background_download_thread(GTask *task, gpointer source_object, struct BackgroundDownload *job, GCancellable *cancellable) {
+	const char *versions[] = {job->version, NULL};
+	job->ok = microlauncher_fetch(job->ctx, versions);
+}
+
+static void background_download_finished(GObject *source_object, GAsyncResult *res, gpointer data) {
+	struct BackgroundDownload *job = g_task_get_task_data(G_TASK(res));
+	backgroundDownload = NULL;
+	// Instance may have been removed while downloading
+	if(job->ok && g_slist_find(*microlauncher_get_instances(), job->instance)) {
+		struct ReadyVersion *ready = g_new(struct ReadyVersion, 1);
+		ready->version = g_strdup(job->version);
+		ready->verified = g_get_monotonic_time();
+		g_hash_table_insert(readyVersions, job->instance, ready);
+	} else if(!job->ok && !g_cancellable_is_cancelled(microlauncher_launch_context_get_cancellable(job->ctx))) {
+		g_hash_table_remove(readyVersions, job->instance);
+	}
+	if(window) {
+		update_ready_badges();
+	}
+	// Selection may have changed in the meantime
+	schedule_background_download();
+}
+
+static gboolean background_download_start(void *data) {
+	MicrolauncherInstance *inst = settings->instance;
+	backgroundDownloadSource = 0;
+	if(!window || backgroundDownload || prefetchAll || !settings->backgroundDownload) {
+		return false;
+	}
+	if(!inst || !inst->version || instance_verified_recently(inst) || get_running_launch(inst) || launches_preparing()) {
+		return false;
+	}
+	struct BackgroundDownload *job = g_new0(struct BackgroundDownload, 1);
+	// Errors are reported when the instance is launched
+	job->ctx = microlauncher_launch_context_new(NULL, NULL, (struct Callbacks){0});
+	microlauncher_launch_context_set_background(job->ctx, true);
+	job->instance = g_object_ref(inst);
+	job->version = g_strdup(inst->version);
+	backgroundDownload = g_task_new(NULL, microlauncher_launch_context_get_cancellable(job->ctx), background_download_finished, NULL);
+	g_task_set_task_data(backgroundDownload, job, (GDestroyNotify)background_download_free);
+	g_task_run_in_thread(backgroundDownload, (GTaskThreadFunc)background_download_thread);
+	g_object_unref(backgroundDownload);
+	return false;
+}
+
+static void cancel_background_download(void) {
+	if(backgroundDownload) {
+		struct BackgroundDownload *job = g_task_get_task_data(backgroundDownload);
+		microlauncher_launch_context_cancel(job->ctx);
+	}
+}
+
+/* Downloads the selected instance after it stays selected for a while */
+static void schedule_background_download(void) {
+	MicrolauncherInstance *inst = settings->instance;
+	update_ready_badges();
+	if(backgroundDownload) {
+		struct BackgroundDownload *job = g_task_get_task_data(backgroundDownload);
+		if(job->instance != inst || !inst || !strequal(job->version, inst->version)) {
+			cancel_background_download();
+		}
+	}
+	if(backgroundDownloadSource) {
+		g_source_remove(backgroundDownloadSource);
+	}
+	backgroundDownloadSource = g_timeout_add_seconds(BACKGROUND_DOWNLOAD_DELAY, background_download_start, NULL);
+}
+
+static void launch_selected(void) {
+	MicrolauncherInstance *inst = settings->instance;
+	if(!inst || !settings->user || get_running_launch(inst)) {
+		return;
+	}
+	apply_settings();
+	// Launch fetches the same files at full speed
+	cancel_background_download();
+	// Progress of each launch is reported with its instance
+	struct Callbacks callbacks = launchCallbacks;
+	callbacks.userdata = inst;
+	LaunchContext *ctx = microlauncher_launch_context_new(inst, settings->user, callbacks);
+	g_hash_table_insert(runningInstances, inst, ctx);
+	g_application_hold(G_APPLICATION(app));
+	update_play_button();
+	GTask *task = g_task_new(playButton, microlauncher_launch_context_get_cancellable(ctx), NULL, NULL);
+	g_task_set_task_data(task, ctx, NULL);
+	g_task_run_in_thread(task, (GTaskThreadFunc)launch_instance_thread);
+	g_object_unref(task);
 }
 
 static void clicked_play(void) {
-	if(instancePid != 0) {
-		util_kill_process(instancePid);
+	LaunchContext *ctx = get_running_launch(settings->instance);
+	if(ctx) {
+		microlauncher_launch_context_cancel(ctx);
 		return;
 	}
-	if(instanceCancellable) {
-		g_cancellable_cancel(instanceCancellable);
-		g_object_unref(instanceCancellable);
-		instanceCancellable = NULL;
+	launch_selected();
+}
+
+static void update_lan_cache(void) {
+	if(!settings->lanCache) {
+		microlauncher_peer_discovery_stop();
+		g_clear_pointer(&peerServer, microlauncher_peer_server_free);
 		return;
 	}
-	gtk_widget_set_sensitive(GTK_WIDGET(playButton), false);
-	gtk_widget_set_sensitive(GTK_WIDGET(instancesPage), false);
-	gtk_widget_set_sensitive(GTK_WIDGET(accountsPage), false);
-	apply_settings();
-	instanceCancellable = g_cancellable_new();
-	GTask *task = g_task_new(playButton, instanceCancellable, NULL, NULL);
-	g_task_run_in_thread(task, launch_instance_thread);
+	microlauncher_peer_discovery_start(settings->peers);
+	if(!peerServer) {
+		GError *error = NULL;
+		peerServer = microlauncher_peer_server_new(settings->launcher_root, 0, &error);
+		if(!peerServer) {
+			char *str = g_strdup_printf("Can't share downloads: %s", error->message);
+			show_message("LAN cache", str);
+			free(str);
+			g_error_free(error);
+		}
+	}
+}
+
+static void toggled_lan_cache(GtkCheckButton *self, gpointer user_data) {
+	settings->lanCache = gtk_check_button_get_active(self);
+	update_lan_cache();
+}
+
+static void toggled_resident_service(GtkCheckButton *self, gpointer user_data) {
+	settings->residentService = gtk_check_button_get_active(self);
+	if(!microlauncher_service_set_activatable(settings->residentService)) {
+		show_message("Launcher service", "Couldn't install the D-Bus service file, microlauncher-cli was not found.");
+		settings->residentService = false;
+		gtk_check_button_set_active(self, false);
+	}
 }
 
 static void notify_gpu_change(GtkDropDown *dropDown, GParamSpec *pspec, GSList *gpuList) {
 	free(settings->gpu_id);
 	settings->gpu_id = g_strdup(g_slist_nth_data(gpuList, gtk_drop_down_get_selected(dropDown)));
+	if(gpuAutoLabel) {
+		gtk_widget_set_visible(GTK_WIDGET(gpuAutoLabel), strequal(settings->gpu_id, GPU_AUTO));
+	}
 }
 
 static GtkWidget *microlauncher_gui_page_launcher(void) {
@@ -1090,13 +2010,17 @@ static GtkWidget *microlauncher_gui_page_launcher(void) {
 	gtk_grid_attach(grid, widget, 0, grid_row++, 2, 1);
 
 #ifndef DISABLE_GPU
+	widget = gtk_label_new(gpuAutoReason);
+	gpuAutoLabel = GTK_LABEL(widget);
+	gtk_label_set_xalign(gpuAutoLabel, 0.0F);
+	gtk_label_set_wrap(gpuAutoLabel, true);
+	gtk_widget_add_css_class(widget, "dim-label");
+
 	widget = gtk_drop_down_simple_new(gpuLabels, NULL);
 	g_signal_connect(widget, "notify::selected", G_CALLBACK(notify_gpu_change), gpuIds);
-	gtk_drop_down_set_selected(GTK_DROP_DOWN(widget), 0);
-	GSList *node;
-	if(settings->gpu_id && (node = g_slist_find_custom(gpuIds, settings->gpu_id, (GCompareFunc)g_strcmp0))) {
-		gtk_drop_down_set_selected(GTK_DROP_DOWN(widget), g_slist_index(gpuIds, node->data));
-	}
+	GSList *node = g_slist_find_custom(gpuIds, settings->gpu_id, (GCompareFunc)g_strcmp0);
+	gtk_drop_down_set_selected(GTK_DROP_DOWN(widget), node ? g_slist_position(gpuIds, node) : 0);
+	gtk_widget_set_visible(GTK_WIDGET(gpuAutoLabel), strequal(settings->gpu_id, GPU_AUTO));
 
 	box2 = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 10);
 	widget = gtk_widget_with_label("Preferred GPU:", widget);
@@ -1105,6 +2029,8 @@ static GtkWidget *microlauncher_gui_page_launcher(void) {
 	checkExplicitGpu = GTK_CHECK_BUTTON(widget);
 	gtk_box_append(GTK_BOX(box2), widget);
 	gtk_grid_attach(grid, box2, 0, grid_row++, 2, 1);
+	gtk_widget_set_margin_start(GTK_WIDGET(gpuAutoLabel), 10);
+	gtk_grid_attach(grid, GTK_WIDGET(gpuAutoLabel), 0, grid_row++, 2, 1);
 
 	widget = gtk_check_button_new_with_label("Use Zink");
 	checkUseZink = GTK_CHECK_BUTTON(widget);
@@ -1127,8 +2053,79 @@ static GtkWidget *microlauncher_gui_page_launcher(void) {
 	gtk_widget_set_hexpand(widget, false);
 	gtk_grid_attach(grid, widget, 0, grid_row++, 2, 1);
 
+	widget = gtk_check_button_new_with_label("Class data sharing (faster startup after first launch)");
+	checkClassDataSharing = GTK_CHECK_BUTTON(widget);
+	gtk_widget_set_hexpand(widget, false);
+	gtk_grid_attach(grid, widget, 0, grid_row++, 2, 1);
+
+	widget = gtk_check_button_new_with_label("Warm up game files before launch");
+	checkPrefetch = GTK_CHECK_BUTTON(widget);
+	gtk_widget_set_hexpand(widget, false);
+	gtk_grid_attach(grid, widget, 0, grid_row++, 2, 1);
+
+	widget = gtk_check_button_new_with_label("Free launcher memory while playing (closes launcher window)");
+	checkLowFootprint = GTK_CHECK_BUTTON(widget);
+	gtk_widget_set_hexpand(widget, false);
+	gtk_grid_attach(grid, widget, 0, grid_row++, 2, 1);
+
+	widget = gtk_check_button_new_with_label("Download selected instance in background");
+	checkBackgroundDownload = GTK_CHECK_BUTTON(widget);
+	gtk_widget_set_hexpand(widget, false);
+	gtk_grid_attach(grid, widget, 0, grid_row++, 2, 1);
+
+#ifdef G_OS_UNIX
+	widget = gtk_check_button_new_with_label("Start launcher service for desktop shortcuts (faster launches)");
+	checkResidentService = GTK_CHECK_BUTTON(widget);
+	gtk_widget_set_hexpand(widget, false);
+	gtk_grid_attach(grid, widget, 0, grid_row++, 2, 1);
+#endif
+
+	widget = gtk_check_button_new_with_label("Share game files between launcher roots (hardlinks)");
+	checkSharedStore = GTK_CHECK_BUTTON(widget);
+	gtk_widget_set_hexpand(widget, false);
+	gtk_grid_attach(grid, widget, 0, grid_row++, 2, 1);
+
+	widget = gtk_check_button_new_with_label("Share downloads with launchers on the local network");
+	checkLanCache = GTK_CHECK_BUTTON(widget);
+	gtk_widget_set_hexpand(widget, false);
+	gtk_grid_attach(grid, widget, 0, grid_row++, 2, 1);
+
+	peersEntry = GTK_ENTRY(gtk_entry_new());
+	widget = gtk_widget_with_label("LAN peers:", GTK_WIDGET(peersEntry));
+	gtk_entry_set_placeholder_text(peersEntry, "http://host:" G_STRINGIFY(PEER_DEFAULT_PORT) ", found automatically if empty");
+	gtk_grid_attach(grid, widget, 0, grid_row++, 2, 1);
+
+	monitorEntry = gtk_entry_digits_only();
+	widget = gtk_widget_with_label("Resource monitor interval (ms):", GTK_WIDGET(monitorEntry));
+	gtk_entry_set_placeholder_text(monitorEntry, "0 to disable");
+	gtk_grid_attach(grid, widget, 0, grid_row++, 2, 1);
+
+	box2 = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 10);
+	shaderCacheEntry = gtk_entry_digits_only();
+	gtk_entry_set_placeholder_text(shaderCacheEntry, "Unlimited");
+	widget = gtk_widget_with_label("Shader cache budget (MiB):", GTK_WIDGET(shaderCacheEntry));
+	gtk_box_append(GTK_BOX(box2), widget);
+	widget = gtk_label_new(NULL);
+	shaderCacheLabel = GTK_LABEL(widget);
+	gtk_widget_add_css_class(widget, "dim-label");
+	gtk_box_append(GTK_BOX(box2), widget);
+	gtk_grid_attach(grid, box2, 0, grid_row++, 2, 1);
+
+	widget = gtk_button_new_with_label("Storage usage");
+	gtk_widget_set_tooltip_text(widget, "Show what takes space in the launcher root and remove files no instance needs");
+	gtk_widget_set_halign(widget, GTK_ALIGN_START);
+	g_signal_connect(widget, "clicked", G_CALLBACK(show_storage_dialog), NULL);
+	gtk_grid_attach(grid, widget, 0, grid_row++, 2, 1);
+
 	gtk_box_append(GTK_BOX(box), frame);
 
+	widget = gtk_label_new(NULL);
+	monitorLabel = GTK_LABEL(widget);
+	gtk_label_set_ellipsize(monitorLabel, PANGO_ELLIPSIZE_END);
+	gtk_widget_add_css_class(widget, "dim-label");
+	gtk_widget_set_visible(widget, false);
+	gtk_box_append(GTK_BOX(boxOuter), widget);
+
 	widget = gtk_button_new_with_label("Play");
 	gtk_widget_set_sensitive(widget, false);
 	playButton = GTK_BUTTON(widget);
@@ -1141,6 +2138,7 @@ struct InstanceRowWidgets {
 	GtkWidget *grid;
 	GtkLabel *instanceLabel;
 	GtkLabel *versionLabel;
+	GtkWidget *readyBadge;
 	GtkLabel *locationLabel;
 	GtkImage *icon;
 	GtkButton *buttonEdit;
@@ -1175,8 +2173,12 @@ static void show_row_menu(GtkGestureClick *gesture, gint n_press, gdouble x, gdo
 	g_signal_connect(row_widget, "destroy", G_CALLBACK(popover_destroy), popover);
 }
 
+static void ready_badge_destroy(GtkWidget *self, gpointer user_data) {
+	g_ptr_array_remove_fast(readyBadges, self);
+}
+
 static void instance_list_view_setup_factory(GtkListItemFactory *factory, GtkListItem *list_item, gpointer user_data) {
-	GtkWidget *widget;
+	GtkWidget *widget, *box;
 	widget = gtk_grid_new();
 	gtk_widget_set_hexpand(widget, true);
 	GtkGrid *grid = GTK_GRID(widget);
@@ -1205,11 +2207,23 @@ static void instance_list_view_setup_factory(GtkListItemFactory *factory, GtkLis
 	gtk_widget_add_css_class(widget, "subtitle");
 	gtk_grid_attach(grid, widget, 2, 0, 1, 2);
 
+	box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 10);
+	gtk_grid_attach(grid, box, 1, 1, 1, 1);
+
 	widget = gtk_label_new(NULL);
 	rw->versionLabel = GTK_LABEL(widget);
 	gtk_widget_set_halign(widget, GTK_ALIGN_START);
 	gtk_widget_add_css_class(widget, "subtitle");
-	gtk_grid_attach(grid, widget, 1, 1, 1, 1);
+	gtk_box_append(GTK_BOX(box), widget);
+
+	widget = gtk_label_new("Ready to launch");
+	rw->readyBadge = widget;
+	gtk_widget_add_css_class(widget, "success");
+	gtk_widget_add_css_class(widget, "caption");
+	gtk_widget_set_visible(widget, false);
+	g_ptr_array_add(readyBadges, widget);
+	g_signal_connect(widget, "destroy", G_CALLBACK(ready_badge_destroy), NULL);
+	gtk_box_append(GTK_BOX(box), widget);
 
 	widget = gtk_button_new_from_icon_name("emblem-system-symbolic");
 	rw->buttonEdit = GTK_BUTTON(widget);
@@ -1232,7 +2246,7 @@ static void instance_action(GSimpleAction *simple_action, G_GNUC_UNUSED GVariant
 		settings->instance = inst;
 		microlauncher_gui_refresh_instance();
 		microlauncher_gui_switch_to_tab(NULL, "launcher");
-		clicked_play();
+		launch_selected();
 	} else if(strcmp(g_action_get_name(G_ACTION(simple_action)), "edit") == 0) {
 		microlauncher_modify_instance_window(NULL, inst);
 	} else if(strcmp(g_action_get_name(G_ACTION(simple_action)), "copy") == 0) {
@@ -1245,6 +2259,12 @@ static void instance_action(GSimpleAction *simple_action, G_GNUC_UNUSED GVariant
 		g_object_set_property(G_OBJECT(copy), "name", &val);
 		free(str);
 		add_instance(copy, g_slist_index(instances, inst) + 1);
+	} else if(strcmp(g_action_get_name(G_ACTION(simple_action)), "duplicate") == 0) {
+		snapshot_start(inst, SNAPSHOT_DUPLICATE, NULL);
+	} else if(strcmp(g_action_get_name(G_ACTION(simple_action)), "snapshots") == 0) {
+		show_snapshot_dialog(inst);
+	} else if(strcmp(g_action_get_name(G_ACTION(simple_action)), "export") == 0) {
+		export_instance(inst);
 	} else if(strcmp(g_action_get_name(G_ACTION(simple_action)), "create-launcher") == 0) {
 		microlauncher_update_launcher(inst, true);
 	} else if(strcmp(g_action_get_name(G_ACTION(simple_action)), "delete") == 0) {
@@ -1340,6 +2360,9 @@ static void instance_list_view_bind_factory(GtkListItemFactory *factory, GtkList
 	g_menu_append(menu, "Play", "instance.play");
 	g_menu_append(menu, "Edit", "instance.edit");
 	g_menu_append(menu, "Copy", "instance.copy");
+	g_menu_append(menu, "Duplicate with files", "instance.duplicate");
+	g_menu_append(menu, "Snapshots", "instance.snapshots");
+	g_menu_append(menu, "Export", "instance.export");
 #ifdef G_OS_WIN32
 	g_menu_append(menu, "Create shortcut", "instance.create-launcher");
 #else
@@ -1364,7 +2387,7 @@ static void instance_list_view_bind_factory(GtkListItemFactory *factory, GtkList
 	g_signal_connect(rw->buttonEdit, "clicked", G_CALLBACK(microlauncher_modify_instance_window), instance);
 	g_signal_connect(rw->buttonDelete, "clicked", G_CALLBACK(remove_instance_button_cb), instance);
 
-	const char *action_names[] = {"play", "edit", "copy", "create-launcher", "delete", NULL};
+	const char *action_names[] = {"play", "edit", "copy", "duplicate", "snapshots", "export", "create-launcher", "delete", NULL};
 	int i = 0;
 	while(action_names[i]) {
 		action = g_simple_action_new(action_names[i], NULL);
@@ -1405,6 +2428,8 @@ static void instance_list_view_bind_factory(GtkListItemFactory *factory, GtkList
 	gtk_label_set_label(rw->locationLabel, instance->location);
 	g_object_bind_property(instance, "version", rw->versionLabel, "label", G_BINDING_SYNC_CREATE);
 	gtk_label_set_label(rw->versionLabel, instance->version);
+	g_object_set_data(G_OBJECT(rw->readyBadge), "instance", instance);
+	gtk_widget_set_visible(rw->readyBadge, instance_ready(instance));
 }
 
 static void instance_selection_changed(GtkSingleSelection *self, guint position, guint n_items, GListStore *user_data) {
@@ -1416,7 +2441,7 @@ static void activate_instance_row(GtkListView *self, guint position, GListStore
 	settings->instance = g_list_model_get_item(G_LIST_MODEL(user_data), position);
 	microlauncher_gui_refresh_instance();
 	microlauncher_gui_switch_to_tab(NULL, "launcher");
-	clicked_play();
+	launch_selected();
 }
 
 static void account_selection_changed(GtkSingleSelection *self, guint position, guint n_items, GtkStringList *user_data) {
@@ -1478,6 +2503,21 @@ static GtkWidget *microlauncher_gui_page_instances(void) {
 	widget = gtk_button_new_with_label("New instance");
 	g_signal_connect(widget, "clicked", G_CALLBACK(microlauncher_modify_instance_window), NULL);
 	gtk_box_append(GTK_BOX(boxOuter), widget);
+	widget = gtk_button_new_with_label("Import instance");
+	gtk_widget_set_tooltip_text(widget, "Add an instance exported with the files it needs");
+	g_signal_connect(widget, "clicked", G_CALLBACK(import_instance), NULL);
+	gtk_box_append(GTK_BOX(boxOuter), widget);
+	widget = gtk_button_new_with_label("Download all instances");
+	gtk_widget_set_tooltip_text(widget, "Download everything the instances need so they can be launched offline");
+	gtk_widget_set_sensitive(widget, prefetchAll == NULL);
+	g_signal_connect(widget, "clicked", G_CALLBACK(prefetch_all), NULL);
+	gtk_box_append(GTK_BOX(boxOuter), widget);
+	prefetchAllButton = widget;
+#ifdef HAVE_MOD_BROWSER
+	widget = gtk_button_new_with_label("Browse Mods");
+	g_signal_connect_swapped(widget, "clicked", G_CALLBACK(show_get_mods), window);
+	gtk_box_append(GTK_BOX(boxOuter), widget);
+#endif
 	instancesPage = boxOuter;
 	return boxOuter;
 }
@@ -2018,18 +3058,45 @@ static gboolean close_request(GtkWindow *self, gpointer user_data) {
 	return true;
 }
 
-struct AsyncPid {
-	GPid pid;
-	void *userdata;
-};
+static gboolean release_memory_idle(void *userdata) {
+	microlauncher_release_memory();
+	return false;
+}
 
-static gboolean microlauncher_gui_enable_kill(void *userdata) {
-	struct AsyncPid *asyncPid = userdata;
-	instancePid = asyncPid->pid;
-	g_object_unref(instanceCancellable);
-	instanceCancellable = NULL;
-	gtk_button_set_label(playButton, "Kill");
-	gtk_widget_set_sensitive(GTK_WIDGET(playButton), true);
+static bool launches_preparing(void) {
+	GHashTableIter iter;
+	LaunchContext *ctx;
+	g_hash_table_iter_init(&iter, runningInstances);
+	while(g_hash_table_iter_next(&iter, NULL, (gpointer *)&ctx)) {
+		if(!microlauncher_launch_context_get_pid(ctx)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Destroys all windows while games run, main window is built again after the last one exits */
+static void enter_low_footprint(void) {
+	GList *windows = g_list_copy(gtk_application_get_windows(app));
+	for(GList *node = windows; node; node = node->next) {
+		gtk_window_destroy(node->data);
+	}
+	g_list_free(windows);
+	window = NULL;
+	popupWindow = NULL;
+	// After destroyed widgets and textures have been finalized
+	g_idle_add_full(G_PRIORITY_LOW, release_memory_idle, NULL, NULL);
+}
+
+static gboolean microlauncher_gui_instance_started(void *userdata) {
+	if(!window) {
+		return false;
+	}
+	if(settings->lowFootprint && !launches_preparing()) {
+		enter_low_footprint();
+		return false;
+	}
+	update_play_button();
 	if(settings->hideOnLaunch) {
 		gtk_widget_set_visible(GTK_WIDGET(window), false);
 	}
@@ -2037,14 +3104,20 @@ static gboolean microlauncher_gui_enable_kill(void *userdata) {
 }
 
 static void scheduled_launcher_set_pid(GPid pid, void *userdata) {
-	struct AsyncPid *data = g_new(struct AsyncPid, 1);
-	data->pid = pid;
-	data->userdata = userdata;
-	g_idle_add(microlauncher_gui_enable_kill, data);
+	g_idle_add(microlauncher_gui_instance_started, userdata);
+}
+
+static void scheduled_launcher_finished(const struct ExitStatus *status, void *userdata) {
+	g_idle_add(G_SOURCE_FUNC(microlauncher_gui_launch_finished), userdata);
 }
 
-static void scheduled_launcher_enable_play(void *userdata) {
-	g_idle_add(microlauncher_gui_enable_play, userdata);
+static void launcher_process_sample(const struct ProcessSample *sample, void *userdata) {
+	struct ProcessSample *copy = g_new(struct ProcessSample, 1);
+	*copy = *sample;
+	g_hash_table_insert(processSamples, userdata, copy);
+	if(userdata == settings->instance) {
+		update_monitor_label();
+	}
 }
 
 struct ProgressUpdate {
@@ -2054,7 +3127,7 @@ struct ProgressUpdate {
 
 static gboolean microlauncher_gui_progress_update(struct ProgressUpdate *data) {
 	char *str;
-	if(progressBar && data->label) {
+	if(window && progressBar && data->label) {
 		int percent = (int)round(data->progress * 100);
 		gtk_progress_bar_set_fraction(progressBar, data->progress);
 		str = g_strdup_printf("%d%%: %s", percent, data->label);
@@ -2074,29 +3147,44 @@ static void scheduled_progress_update(double progress, const char *label, void *
 	g_idle_add(G_SOURCE_FUNC(microlauncher_gui_progress_update), data);
 }
 
-static gboolean microlauncher_gui_set_stage(char *data) {
-	gtk_revealer_set_reveal_child(revealer, data != NULL);
-	if(!data) {
+struct StageUpdate {
+	MicrolauncherInstance *instance;
+	char *stage;
+};
+
+static gboolean microlauncher_gui_set_stage(struct StageUpdate *data) {
+	if(!window) {
+		free(data->stage);
+		free(data);
 		return false;
 	}
-	gtk_label_set_text(progressStage, data);
+	gtk_revealer_set_reveal_child(revealer, data->stage != NULL);
+	if(data->stage) {
+		if(data->instance && g_hash_table_size(runningInstances) > 1) {
+			char *str = g_strdup_printf("%s: %s", data->instance->name, data->stage);
+			gtk_label_set_text(progressStage, str);
+			free(str);
+		} else {
+			gtk_label_set_text(progressStage, data->stage);
+		}
+		gtk_progress_bar_set_fraction(progressBar, 0);
+	}
+	free(data->stage);
 	free(data);
-	gtk_progress_bar_set_fraction(progressBar, 0);
 	return false;
 }
 
 static void scheduled_set_stage(const char *stage, void *userdata) {
-	char *data = g_strdup(stage);
+	struct StageUpdate *data = g_new(struct StageUpdate, 1);
+	data->instance = userdata;
+	data->stage = g_strdup(stage);
 	g_idle_add(G_SOURCE_FUNC(microlauncher_gui_set_stage), data);
 }
 
-static gboolean microlauncher_gui_show_err(char *data) {
-	if(!data) {
-		return false;
-	}
+static void show_message(const char *title, const char *data) {
 	GtkWindow *dialog = gtk_modal_dialog_new(window);
 	// gtk_window_set_resizable(dialog, false);
-	gtk_window_set_title(dialog, "Error");
+	gtk_window_set_title(dialog, title);
 	GtkBox *box = GTK_BOX(gtk_box_new(GTK_ORIENTATION_VERTICAL, 10));
 	gtk_widget_set_margin(GTK_WIDGET(box), 10, 10, 10, 10);
 	GtkWidget *widget = gtk_label_new(data);
@@ -2110,6 +3198,17 @@ static gboolean microlauncher_gui_show_err(char *data) {
 	gtk_box_append(box, widget);
 	gtk_window_set_child(dialog, GTK_WIDGET(box));
 	gtk_window_present(dialog);
+}
+
+static gboolean microlauncher_gui_show_err(char *data) {
+	if(!data) {
+		return false;
+	}
+	if(!window) {
+		g_printerr("%s\n", data);
+	} else {
+		show_message("Error", data);
+	}
 	free(data);
 	return false;
 }
@@ -2130,8 +3229,10 @@ static void init_gpus(void) {
 	char devbuf[256];
 	char bdfbuf[256];
 	struct pci_dev *p;
-	gpuIds = g_slist_append(NULL, NULL);
+	gpuIds = g_slist_append(NULL, g_strdup(GPU_AUTO));
+	gpuIds = g_slist_append(gpuIds, NULL);
 	gpuLabels = gtk_string_list_new(NULL);
+	gtk_string_list_append(gpuLabels, "Auto");
 	gtk_string_list_append(gpuLabels, "Default");
 
 	pci_init(acc);
@@ -2152,6 +3253,18 @@ static void init_gpus(void) {
 		g_print("%s\n", s);
 	}
 	pci_cleanup(acc);
+
+	struct GpuChoice choice;
+	char *cachePath = g_build_filename(XDG_CACHE_HOME, "microlauncher", "gpu.json", NULL);
+	if(microlauncher_gpu_auto_select(cachePath, &choice)) {
+		GSList *node = g_slist_find_custom(gpuIds, choice.id, (GCompareFunc)g_strcmp0);
+		const char *name = node ? gtk_string_list_get_string(gpuLabels, g_slist_position(gpuIds, node)) : choice.id;
+		gpuAutoReason = g_strdup_printf("Auto picks %s: %s", name, choice.reason);
+	} else {
+		gpuAutoReason = g_strdup_printf("Auto: %s", choice.reason);
+	}
+	free(cachePath);
+	microlauncher_gpu_choice_clear(&choice);
 #endif
 }
 
@@ -2171,12 +3284,8 @@ static void on_launcher_stack_page_changed(GObject *obj, GParamSpec *pspec, gpoi
 	}
 }
 
-static void activate(GtkApplication *app, gpointer user_data) {
+static void build_main_window(void) {
 	GtkWidget *widget, *box;
-	GtkCssProvider *provider = gtk_css_provider_new();
-	gtk_css_provider_load_from_string(provider, ".msa-code { font-size: 64px; }");
-	gtk_style_context_add_provider_for_display(gdk_display_get_default(), GTK_STYLE_PROVIDER(provider), GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-
 	window = GTK_WINDOW(gtk_window_new());
 	gtk_application_add_window(app, window);
 	gtk_window_set_default_size(window, 0, 480);
@@ -2236,7 +3345,6 @@ static void activate(GtkApplication *app, gpointer user_data) {
 
 	microlauncher_gui_refresh_instance();
 	struct Callbacks callbacks = {
-		.instance_finished = scheduled_launcher_enable_play,
 		.instance_started = scheduled_launcher_set_pid,
 		.progress_update = scheduled_progress_update,
 		.show_error = scheduled_show_error,
@@ -2256,6 +3364,17 @@ static void activate(GtkApplication *app, gpointer user_data) {
 		free(str);
 	}
 
+	str = g_strdup_printf("%d", settings->monitorInterval);
+	gtk_entry_set_text(monitorEntry, str);
+	free(str);
+
+	if(settings->shaderCacheBudget) {
+		str = g_strdup_printf("%d", settings->shaderCacheBudget);
+		gtk_entry_set_text(shaderCacheEntry, str);
+		free(str);
+	}
+	update_shader_cache_size();
+
 	gtk_check_button_set_active(checkFullscreen, settings->fullscreen);
 	gtk_check_button_set_active(checkDemo, settings->demo);
 	gtk_check_button_set_active(checkUpdate, settings->allowUpdate);
@@ -2265,18 +3384,53 @@ static void activate(GtkApplication *app, gpointer user_data) {
 #endif
 	gtk_check_button_set_active(checkHideOnLaunch, settings->hideOnLaunch);
 	gtk_check_button_set_active(checkUseLocalLib, settings->useLocalLib);
+	gtk_check_button_set_active(checkClassDataSharing, settings->classDataSharing);
+	gtk_check_button_set_active(checkPrefetch, settings->prefetch);
+	gtk_check_button_set_active(checkLowFootprint, settings->lowFootprint);
+	gtk_check_button_set_active(checkBackgroundDownload, settings->backgroundDownload);
+	gtk_check_button_set_active(checkSharedStore, settings->sharedStore);
+	gtk_check_button_set_active(checkLanCache, settings->lanCache);
+	g_signal_connect(checkLanCache, "toggled", G_CALLBACK(toggled_lan_cache), NULL);
+	if(settings->peers) {
+		gtk_entry_set_text(peersEntry, settings->peers);
+	}
+#ifdef G_OS_UNIX
+	gtk_check_button_set_active(checkResidentService, settings->residentService);
+	g_signal_connect(checkResidentService, "toggled", G_CALLBACK(toggled_resident_service), NULL);
+#endif
 
 	microlauncher_set_callbacks(callbacks);
+	launchCallbacks = callbacks;
+	launchCallbacks.instance_finished = scheduled_launcher_finished;
+	launchCallbacks.process_sample = launcher_process_sample;
 	g_signal_connect(window, "close-request", G_CALLBACK(close_request), NULL);
 	gtk_window_set_focus(window, GTK_WIDGET(playButton));
 	gtk_window_present(window);
 }
 
+static void activate(GtkApplication *app, gpointer user_data) {
+	GtkCssProvider *provider = gtk_css_provider_new();
+	gtk_css_provider_load_from_string(provider, ".msa-code { font-size: 64px; }");
+	gtk_style_context_add_provider_for_display(gdk_display_get_default(), GTK_STYLE_PROVIDER(provider), GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+	// Passed on to the game, the core doesn't depend on GTK
+	g_object_get(gtk_settings_get_default(), "gtk-cursor-theme-size", &settings->cursorSize, NULL);
+	build_main_window();
+	update_lan_cache();
+	// Runs after the first frame has been drawn
+	g_idle_add_full(G_PRIORITY_LOW, bench_startup_idle, NULL, NULL);
+	// Measured with the GUI and WebKit loaded to reflect real launch conditions
+	g_idle_add(bench_spawn_idle, NULL);
+}
+
 int microlauncher_gui_show(void) {
 	int status;
 	int argc = 1;
 	char *argv[] = {APPID, NULL};
 	settings = microlauncher_get_settings();
+	runningInstances = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)microlauncher_launch_context_free);
+	processSamples = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free);
+	readyVersions = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)ready_version_free);
+	readyBadges = g_ptr_array_new();
 	init_gpus();
 
 	app = gtk_application_new(APPID, G_APPLICATION_NON_UNIQUE);
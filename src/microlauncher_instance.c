@@ -11,6 +11,12 @@ enum {
 	PROP_VERSION,
 	PROP_ICON,
 	PROP_JAVA_LOCATION,
+	PROP_TUNING,
+	PROP_CPU_AFFINITY,
+	PROP_IO_PRIORITY,
+	PROP_NICE,
+	PROP_MEMORY_HIGH,
+	PROP_CPU_WEIGHT,
 	PROP_GAME_ARGS_LIST,
 	PROP_JVM_ARGS_LIST,
 	PROP_PREFIX_COMMAND_LIST,
@@ -49,6 +55,48 @@ static PropertyDef prop_definitions[N_PROPERTIES] = {
 		G_PARAM_READWRITE,
 		g_free
 	},
+	[PROP_TUNING] = {
+		"tuning",
+		G_TYPE_STRING,
+		offsetof(MicrolauncherInstance, tuning),
+		G_PARAM_READWRITE,
+		g_free
+	},
+	[PROP_CPU_AFFINITY] = {
+		"cpu-affinity",
+		G_TYPE_STRING,
+		offsetof(MicrolauncherInstance, cpuAffinity),
+		G_PARAM_READWRITE,
+		g_free
+	},
+	[PROP_IO_PRIORITY] = {
+		"io-priority",
+		G_TYPE_STRING,
+		offsetof(MicrolauncherInstance, ioPriority),
+		G_PARAM_READWRITE,
+		g_free
+	},
+	[PROP_NICE] = {
+		"nice",
+		G_TYPE_INT,
+		offsetof(MicrolauncherInstance, nice),
+		G_PARAM_READWRITE,
+		NULL
+	},
+	[PROP_MEMORY_HIGH] = {
+		"memory-high",
+		G_TYPE_INT,
+		offsetof(MicrolauncherInstance, memoryHigh),
+		G_PARAM_READWRITE,
+		NULL
+	},
+	[PROP_CPU_WEIGHT] = {
+		"cpu-weight",
+		G_TYPE_INT,
+		offsetof(MicrolauncherInstance, cpuWeight),
+		G_PARAM_READWRITE,
+		NULL
+	},
 	[PROP_ICON] = {
 		"icon",
 		G_TYPE_STRING,
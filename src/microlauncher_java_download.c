@@ -0,0 +1,191 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <json.h>
+#include <json_object.h>
+#include <json_types.h>
+#include <microlauncher.h>
+#include <microlauncher_download.h>
+#include <microlauncher_java_download.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <util/json_util.h>
+#include <util/util.h>
+
+const char *java_runtime_get_platform(void) {
+	// Platform names used by java-runtime manifest
+	switch(platform_get()) {
+		case OS_WINDOWS_X86:
+			return "windows-x86";
+		case OS_WINDOWS_X86_64:
+			return "windows-x64";
+		case OS_WINDOWS_ARM64:
+			return "windows-arm64";
+		case OS_LINUX_X86:
+			return "linux-i386";
+		case OS_LINUX_X86_64:
+			return "linux";
+		case OS_MACOS_X86_64:
+			return "mac-os";
+		case OS_MACOS_ARM64:
+			return "mac-os-arm64";
+		default:
+			return NULL;
+	}
+}
+
+static const char *java_manifest_url(void) {
+	// Allows pointing at a local mirror, e.g. file:///srv/mirror/all.json
+	const char *url = getenv("MICROLAUNCHER_JAVA_MANIFEST");
+	return url ? url : JAVA_MANIFEST_URL;
+}
+
+/* Files are stored by their hash so identical files are shared between runtime versions */
+static char *get_object_path(const char *runtime_dir, const char *sha1, char *path) {
+	snprintf(path, PATH_MAX, "%s/objects/%c%c/%s", runtime_dir, sha1[0], sha1[1], sha1);
+	return path;
+}
+
+static void queue_runtime_files(DownloadQueue *queue, json_object *files, const char *runtime_dir) {
+	char path[PATH_MAX];
+	json_object_object_foreach(files, key, val) {
+		if(!strequal(json_get_string(val, "type"), "file")) {
+			continue;
+		}
+		json_object *downloads = json_object_object_get(val, "downloads");
+		json_object *raw = json_object_object_get(downloads, "raw");
+		json_object *lzma = json_object_object_get(downloads, "lzma");
+		const char *sha1 = json_get_string(raw, "sha1");
+		if(!sha1) {
+			continue;
+		}
+		enum DownloadFlags flags = json_get_bool(val, "executable") ? DOWNLOAD_EXECUTABLE : DOWNLOAD_NONE;
+		get_object_path(runtime_dir, sha1, path);
+		if(json_get_string(lzma, "url")) {
+			microlauncher_download_queue_add(queue, json_get_string(lzma, "url"), path, key, sha1, json_get_int64(raw, "size"), flags | DOWNLOAD_LZMA);
+		} else {
+			microlauncher_download_queue_add(queue, json_get_string(raw, "url"), path, key, sha1, json_get_int64(raw, "size"), flags);
+		}
+	}
+}
+
+static bool link_runtime_files(json_object *files, const char *runtime_dir, const char *install_dir, char *failedPath) {
+	char path[PATH_MAX];
+	char object[PATH_MAX];
+	json_object_object_foreach(files, key, val) {
+		const char *type = json_get_string(val, "type");
+		snprintf(path, PATH_MAX, "%s/%s", install_dir, key);
+		if(strequal(type, "directory")) {
+			g_mkdir_with_parents(path, 0755);
+		} else if(strequal(type, "file")) {
+			const char *sha1 = json_get_string(json_object_object_get(json_object_object_get(val, "downloads"), "raw"), "sha1");
+			if(!sha1 || !util_link_or_copy(get_object_path(runtime_dir, sha1, object), path)) {
+				snprintf(failedPath, PATH_MAX, "%s", path);
+				return false;
+			}
+#ifndef G_OS_WIN32
+			if(json_get_bool(val, "executable")) {
+				chmod(path, 0755);
+			}
+#endif
+		} else if(strequal(type, "link")) {
+#ifndef G_OS_WIN32
+			g_remove(path);
+			char *dirname = g_path_get_dirname(path);
+			g_mkdir_with_parents(dirname, 0755);
+			g_free(dirname);
+			if(symlink(json_get_string(val, "target"), path) != 0) {
+				snprintf(failedPath, PATH_MAX, "%s", path);
+				return false;
+			}
+#endif
+		}
+	}
+	return true;
+}
+
+/* Concurrent launches may need the same runtime */
+G_LOCK_DEFINE_STATIC(install);
+
+static char *java_runtime_install_locked(const char *component, const char *runtime_dir, struct Callbacks callbacks, GCancellable *cancellable, char *failedResource) {
+	char install_dir[PATH_MAX];
+	char manifest_path[PATH_MAX];
+	char object[PATH_MAX];
+	Sha1 hash = {0};
+	const char *platform = java_runtime_get_platform();
+	if(!component || !platform) {
+		return NULL;
+	}
+	snprintf(install_dir, PATH_MAX, "%s/%s/%s/%s", runtime_dir, component, platform, component);
+	snprintf(manifest_path, PATH_MAX, "%s/%s/%s/%s.json", runtime_dir, component, platform, component);
+	char *java = g_build_filename(install_dir, JAVA_RUNTIME_EXECUTABLE, NULL);
+	bool installed = access(java, F_OK) == 0;
+	FILE *fd = fopen(manifest_path, "rb");
+	if(fd) {
+		get_sha1(fd, hash);
+	}
+
+	run_callback(stage_update, "Checking Java runtime");
+	json_object *all = microlauncher_http_get_json(java_manifest_url(), NULL, NULL);
+	json_object *versions = json_object_object_get(json_object_object_get(all, platform), component);
+	json_object *manifestRef = NULL;
+	if(json_object_is_type(versions, json_type_array) && json_object_array_length(versions) > 0) {
+		manifestRef = json_object_object_get(json_object_array_get_idx(versions, 0), "manifest");
+	}
+	const char *sha1 = json_get_string(manifestRef, "sha1");
+	if(!sha1 || (installed && strequal(hash, sha1))) {
+		// Up to date, or offline/unavailable in which case use existing install if there is one
+		json_object_put(all);
+		run_callback(stage_update, NULL);
+		if(installed) {
+			return java;
+		}
+		free(java);
+		return NULL;
+	}
+
+	get_object_path(runtime_dir, sha1, object);
+	DownloadQueue *queue = microlauncher_download_queue_new();
+	microlauncher_download_queue_add(queue, json_get_string(manifestRef, "url"), object, NULL, sha1, json_get_int64(manifestRef, "size"), DOWNLOAD_NONE);
+	bool ok = microlauncher_download_queue_run(queue, callbacks, cancellable, failedResource);
+	microlauncher_download_queue_free(queue);
+	json_object_put(all);
+
+	json_object *runtimeManifest = ok ? json_from_file(object) : NULL;
+	json_object *files = json_object_object_get(runtimeManifest, "files");
+	if(ok && json_object_is_type(files, json_type_object)) {
+		run_callback(stage_update, "Downloading Java runtime");
+		queue = microlauncher_download_queue_new();
+		queue_runtime_files(queue, files, runtime_dir);
+		ok = microlauncher_download_queue_run(queue, callbacks, cancellable, failedResource);
+		microlauncher_download_queue_free(queue);
+		if(ok) {
+			// Remove files left over from the previous version of this runtime
+			if(installed) {
+				rmdir_recursive(install_dir, NULL);
+			}
+			ok = link_runtime_files(files, runtime_dir, install_dir, failedResource);
+		}
+		// Manifest is written last and marks the install as complete
+		ok = ok && util_link_or_copy(object, manifest_path);
+	} else {
+		ok = false;
+	}
+	json_object_put(runtimeManifest);
+	run_callback(stage_update, NULL);
+	if(ok && access(java, F_OK) == 0) {
+		return java;
+	}
+	free(java);
+	return NULL;
+}
+
+char *microlauncher_java_runtime_install(const char *component, const char *runtime_dir, struct Callbacks callbacks, GCancellable *cancellable, char *failedResource) {
+	G_LOCK(install);
+	char *java = java_runtime_install_locked(component, runtime_dir, callbacks, cancellable, failedResource);
+	G_UNLOCK(install);
+	return java;
+}
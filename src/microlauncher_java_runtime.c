@@ -10,6 +10,7 @@
 enum {
 	PROP_VERSION = 1,
 	PROP_LOCATION,
+	PROP_VM,
 	N_PROPERTIES
 };
 
@@ -30,6 +31,13 @@ static PropertyDef prop_definitions[N_PROPERTIES] = {
 		offsetof(JavaRuntime, location),
 		G_PARAM_READWRITE,
 		g_free
+	},
+	[PROP_VM] = {
+		"vm",
+		G_TYPE_STRING,
+		offsetof(JavaRuntime, vm),
+		G_PARAM_READABLE,
+		g_free
 	}
 };
 // clang-format on
@@ -41,6 +49,7 @@ static void microlauncher_java_runtime_init(JavaRuntime *self) {
 		PropertyDef def = prop_definitions[i];
 		gobj_util_init_prop(G_OBJECT(self), def);
 	}
+	g_mutex_init(&self->probe_lock);
 }
 
 void microlauncher_java_runtime_dispose(GObject *self) {
@@ -51,6 +60,11 @@ void microlauncher_java_runtime_dispose(GObject *self) {
 	G_OBJECT_CLASS(microlauncher_java_runtime_parent_class)->dispose(self);
 }
 
+static void microlauncher_java_runtime_finalize(GObject *self) {
+	g_mutex_clear(&MICROLAUNCHER_JAVA_RUNTIME(self)->probe_lock);
+	G_OBJECT_CLASS(microlauncher_java_runtime_parent_class)->finalize(self);
+}
+
 static void set_property(GObject *object, guint property_id, const GValue *value, GParamSpec *pspec) {
 	PropertyDef def = prop_definitions[property_id];
 	if(gobj_util_set_prop(object, def, value)) {
@@ -59,56 +73,83 @@ static void set_property(GObject *object, guint property_id, const GValue *value
 	G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
 }
 
-static void get_property(GObject *object, guint property_id, GValue *value, GParamSpec *pspec) {
-	JavaRuntime *self = MICROLAUNCHER_JAVA_RUNTIME(object);
-	PropertyDef def = prop_definitions[property_id];
-	if(property_id == PROP_VERSION && !self->version && self->location) {
-		// #ifdef G_OS_WIN32
-		// 		if(!str_ends_with(self->location, "java.exe")) {
-		// 			if(!str_ends_with(self->location, "javaw.exe")) {
-		// 				return;
-		// 			}
-		// 		}
-		// #else
-		// 		if(!str_ends_with(self->location, "java")) {
-		// 			return;
-		// 		}
-		// #endif
-		char *out = util_str_execv(NULL, (char *[]){self->location, "-version", NULL});
-		if(!out) {
-			return;
+static void java_runtime_probe(JavaRuntime *self) {
+	// #ifdef G_OS_WIN32
+	// 		if(!str_ends_with(self->location, "java.exe")) {
+	// 			if(!str_ends_with(self->location, "javaw.exe")) {
+	// 				return;
+	// 			}
+	// 		}
+	// #else
+	// 		if(!str_ends_with(self->location, "java")) {
+	// 			return;
+	// 		}
+	// #endif
+	char *out = util_str_execv(NULL, (char *[]){self->location, "-version", NULL});
+	if(!out) {
+		return;
+	}
+	// g_print("%s", out);
+	int minStr, maxStr;
+	char *str, *str2;
+	str = strstr(out, "version ");
+	if(str) {
+		minStr = (str - out) + strlen("version ");
+		str2 = out + strlen(out);
+		str = strchr(out, '\n');
+		if(str) {
+			str2 = MIN(str2, str);
 		}
-		// g_print("%s", out);
-		int minStr, maxStr;
-		char *str, *str2;
-		str = strstr(out, "version ");
+		str = strchr(out, ' ');
 		if(str) {
-			minStr = (str - out) + strlen("version ");
-			str2 = out + strlen(out);
-			str = strchr(out, '\n');
-			if(str) {
-				str2 = MIN(str2, str);
-			}
-			str = strchr(out, ' ');
+			str2 = MIN(str2, str);
+		}
+		maxStr = (str2 - out);
+		if(out[minStr] == '"') {
+			str = strchr(out + minStr + 1, '"');
 			if(str) {
-				str2 = MIN(str2, str);
-			}
-			maxStr = (str2 - out);
-			if(out[minStr] == '"') {
-				str = strchr(out + minStr + 1, '"');
-				if(str) {
-					maxStr = str - out;
-					minStr++;
-				}
-			}
-			char *ver = g_memdup2(out + minStr, maxStr - minStr + 1);
-			if(ver) {
-				ver[maxStr - minStr] = '\0';
-				self->version = ver;
-				g_object_notify_by_pspec(object, properties[PROP_VERSION]);
+				maxStr = str - out;
+				minStr++;
 			}
 		}
-		free(out);
+		char *ver = g_memdup2(out + minStr, maxStr - minStr + 1);
+		if(ver) {
+			ver[maxStr - minStr] = '\0';
+			free(self->version);
+			self->version = ver;
+		}
+	}
+	// VM name is on the line like "OpenJDK 64-Bit Server VM (build ...)"
+	str = strstr(out, " VM ");
+	if(str) {
+		str2 = str;
+		while(str2 > out && str2[-1] != '\n') {
+			str2--;
+		}
+		free(self->vm);
+		self->vm = g_strndup(str2, str - str2 + strlen(" VM"));
+	}
+	free(out);
+}
+
+/* Bound GTK labels must only be updated from the main thread */
+static gboolean notify_probed(gpointer data) {
+	g_object_notify_by_pspec(G_OBJECT(data), properties[PROP_VERSION]);
+	g_object_notify_by_pspec(G_OBJECT(data), properties[PROP_VM]);
+	return G_SOURCE_REMOVE;
+}
+
+static void get_property(GObject *object, guint property_id, GValue *value, GParamSpec *pspec) {
+	JavaRuntime *self = MICROLAUNCHER_JAVA_RUNTIME(object);
+	PropertyDef def = prop_definitions[property_id];
+	if(property_id == PROP_VERSION || property_id == PROP_VM) {
+		g_mutex_lock(&self->probe_lock);
+		if(!self->probed && self->location) {
+			java_runtime_probe(self);
+			self->probed = true;
+			g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, notify_probed, g_object_ref(self), g_object_unref);
+		}
+		g_mutex_unlock(&self->probe_lock);
 	}
 	if(gobj_util_get_prop(object, def, value)) {
 		return;
@@ -119,6 +160,7 @@ static void get_property(GObject *object, guint property_id, GValue *value, GPar
 static void microlauncher_java_runtime_class_init(JavaRuntimeClass *klass) {
 	GObjectClass *object_class = G_OBJECT_CLASS(klass);
 	object_class->dispose = microlauncher_java_runtime_dispose;
+	object_class->finalize = microlauncher_java_runtime_finalize;
 
 	for(guint i = 1; i < N_PROPERTIES; i++) {
 		PropertyDef def = prop_definitions[i];
@@ -141,11 +183,18 @@ int java_get_major_version(JavaRuntime *runtime) {
 	GValue value = G_VALUE_INIT;
 	g_object_get_property(G_OBJECT(runtime), "version", &value);
 	const char *str = g_value_get_string(&value);
-	if(!str) {
-		return -1;
+	int major = -1;
+	if(str) {
+		major = atoi(strncmp(str, "1.", 2) == 0 ? str + 2 : str);
 	}
-	if(strncmp(str, "1.", 2) == 0) {
-		str = str + 2;
-	}
-	return atoi(str);
+	g_value_unset(&value);
+	return major;
+}
+
+const char *java_get_vm_name(JavaRuntime *runtime) {
+	GValue value = G_VALUE_INIT;
+	// Probes the runtime on first use, the name stays owned by it
+	g_object_get_property(G_OBJECT(runtime), "vm", &value);
+	g_value_unset(&value);
+	return runtime->vm;
 }
@@ -0,0 +1,191 @@
+#include <curl/curl.h>
+#include <glib.h>
+#include <microlauncher.h>
+#include <microlauncher_launch.h>
+#include <microlauncher_supervisor.h>
+#include <stdlib.h>
+
+struct _LaunchContext {
+	MicrolauncherInstance *instance;
+	MicrolauncherAccount *user;
+	struct Settings settings;
+	struct Callbacks callbacks;
+	GCancellable *cancellable;
+	CURLSH *share;
+	/* Share is owned by someone else */
+	bool borrowed_share;
+	GMutex share_locks[CURL_LOCK_DATA_LAST];
+	GMutex mutex;
+	ChildWatch *child;
+	ChildExitFunc exit_func;
+	void *exit_userdata;
+	enum DownloadMode download_mode;
+	bool background;
+	struct DownloadStats download_stats;
+};
+
+static void share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr) {
+	LaunchContext *ctx = userptr;
+	g_mutex_lock(&ctx->share_locks[data]);
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *userptr) {
+	LaunchContext *ctx = userptr;
+	g_mutex_unlock(&ctx->share_locks[data]);
+}
+
+LaunchContext *microlauncher_launch_context_new(MicrolauncherInstance *instance, MicrolauncherAccount *user, struct Callbacks callbacks) {
+	LaunchContext *ctx = g_new0(LaunchContext, 1);
+	ctx->instance = instance ? g_object_ref(instance) : NULL;
+	ctx->user = user ? g_object_ref(user) : NULL;
+	ctx->callbacks = callbacks;
+	ctx->cancellable = g_cancellable_new();
+	g_mutex_init(&ctx->mutex);
+
+	// Strings may be replaced from GUI while launch is in progress
+	ctx->settings = *microlauncher_get_settings();
+	ctx->settings.user = NULL;
+	ctx->settings.instance = NULL;
+	ctx->settings.launcher_root = g_strdup(ctx->settings.launcher_root);
+	ctx->settings.lower_roots = g_strdupv(ctx->settings.lower_roots);
+	ctx->settings.gcKeep = g_strdupv(ctx->settings.gcKeep);
+	ctx->settings.manifest_url = g_strdup(ctx->settings.manifest_url);
+	ctx->settings.gpu_id = g_strdup(ctx->settings.gpu_id);
+	ctx->settings.peers = g_strdup(ctx->settings.peers);
+
+	for(int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+		g_mutex_init(&ctx->share_locks[i]);
+	}
+	ctx->share = curl_share_init();
+	if(ctx->share) {
+		curl_share_setopt(ctx->share, CURLSHOPT_LOCKFUNC, share_lock);
+		curl_share_setopt(ctx->share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+		curl_share_setopt(ctx->share, CURLSHOPT_USERDATA, ctx);
+		curl_share_setopt(ctx->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(ctx->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+		curl_share_setopt(ctx->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+	}
+	return ctx;
+}
+
+MicrolauncherInstance *microlauncher_launch_context_get_instance(LaunchContext *ctx) {
+	return ctx->instance;
+}
+
+MicrolauncherAccount *microlauncher_launch_context_get_user(LaunchContext *ctx) {
+	return ctx->user;
+}
+
+const struct Settings *microlauncher_launch_context_get_settings(LaunchContext *ctx) {
+	return &ctx->settings;
+}
+
+struct Callbacks microlauncher_launch_context_get_callbacks(LaunchContext *ctx) {
+	return ctx->callbacks;
+}
+
+GCancellable *microlauncher_launch_context_get_cancellable(LaunchContext *ctx) {
+	return ctx->cancellable;
+}
+
+CURLSH *microlauncher_launch_context_get_share(LaunchContext *ctx) {
+	return ctx->share;
+}
+
+void microlauncher_launch_context_set_share(LaunchContext *ctx, CURLSH *share) {
+	if(ctx->share && !ctx->borrowed_share) {
+		curl_share_cleanup(ctx->share);
+	}
+	ctx->share = share;
+	ctx->borrowed_share = true;
+}
+
+void microlauncher_launch_context_set_download_mode(LaunchContext *ctx, enum DownloadMode mode) {
+	ctx->download_mode = mode;
+}
+
+enum DownloadMode microlauncher_launch_context_get_download_mode(LaunchContext *ctx) {
+	return ctx->download_mode;
+}
+
+void microlauncher_launch_context_set_background(LaunchContext *ctx, bool background) {
+	ctx->background = background;
+}
+
+bool microlauncher_launch_context_get_background(LaunchContext *ctx) {
+	return ctx->background;
+}
+
+void microlauncher_launch_context_add_stats(LaunchContext *ctx, const struct DownloadStats *stats) {
+	g_mutex_lock(&ctx->mutex);
+	microlauncher_download_stats_add(&ctx->download_stats, stats);
+	g_mutex_unlock(&ctx->mutex);
+}
+
+struct DownloadStats microlauncher_launch_context_get_stats(LaunchContext *ctx) {
+	g_mutex_lock(&ctx->mutex);
+	struct DownloadStats stats = ctx->download_stats;
+	g_mutex_unlock(&ctx->mutex);
+	return stats;
+}
+
+static void child_exited(GPid pid, const struct ExitStatus *status, void *userdata) {
+	LaunchContext *ctx = userdata;
+	g_mutex_lock(&ctx->mutex);
+	ctx->child = NULL;
+	g_mutex_unlock(&ctx->mutex);
+	ctx->exit_func(pid, status, ctx->exit_userdata);
+}
+
+void microlauncher_launch_context_watch(LaunchContext *ctx, GPid pid, ChildExitFunc func, void *userdata) {
+	g_mutex_lock(&ctx->mutex);
+	ctx->exit_func = func;
+	ctx->exit_userdata = userdata;
+	// Held until child is set, in case it exits before we return
+	ctx->child = microlauncher_supervisor_watch(pid, child_exited, ctx);
+	g_mutex_unlock(&ctx->mutex);
+}
+
+GPid microlauncher_launch_context_get_pid(LaunchContext *ctx) {
+	g_mutex_lock(&ctx->mutex);
+	GPid pid = ctx->child ? microlauncher_supervisor_get_pid(ctx->child) : 0;
+	g_mutex_unlock(&ctx->mutex);
+	return pid;
+}
+
+void microlauncher_launch_context_cancel(LaunchContext *ctx) {
+	g_mutex_lock(&ctx->mutex);
+	if(ctx->child) {
+		microlauncher_supervisor_terminate(ctx->child);
+	} else {
+		g_cancellable_cancel(ctx->cancellable);
+	}
+	g_mutex_unlock(&ctx->mutex);
+}
+
+void microlauncher_launch_context_free(LaunchContext *ctx) {
+	if(!ctx) {
+		return;
+	}
+	if(ctx->share && !ctx->borrowed_share) {
+		curl_share_cleanup(ctx->share);
+	}
+	for(int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+		g_mutex_clear(&ctx->share_locks[i]);
+	}
+	g_mutex_clear(&ctx->mutex);
+	g_object_unref(ctx->cancellable);
+	if(ctx->instance) {
+		g_object_unref(ctx->instance);
+	}
+	if(ctx->user) {
+		g_object_unref(ctx->user);
+	}
+	free(ctx->settings.launcher_root);
+	g_strfreev(ctx->settings.lower_roots);
+	g_strfreev(ctx->settings.gcKeep);
+	free(ctx->settings.manifest_url);
+	free(ctx->settings.gpu_id);
+	free(ctx->settings.peers);
+	free(ctx);
+}
@@ -0,0 +1,187 @@
+#include <glib.h>
+#include <microlauncher.h>
+#include <microlauncher_gui.h>
+#include <microlauncher_service.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <util/util.h>
+
+static char *active_instance = NULL;
+static char *active_user = NULL;
+static bool use_saved_user = false;
+static bool bench_spawn = false;
+static bool bench_startup = false;
+
+static GOptionEntry entries[] =
+	{
+		{"instance", 'i', 0, G_OPTION_ARG_STRING, &active_instance, "Instance to launch", NULL},
+		{"user", 'u', 0, G_OPTION_ARG_STRING, &active_user, "Saved user GUID to authenticate as", NULL},
+		{"saved-user", 0, 0, G_OPTION_ARG_NONE, &use_saved_user, "Use saved user instead of explicitly specifying user", NULL},
+		{"bench-spawn", 0, 0, G_OPTION_ARG_NONE, &bench_spawn, "Measure process spawn latency once the GUI is running", NULL},
+		{"bench-startup", 0, 0, G_OPTION_ARG_NONE, &bench_startup, "Print time until the main window is shown and resident memory at that point", NULL},
+		G_OPTION_ENTRY_NULL};
+
+#ifdef G_OS_UNIX
+#define BENCH_SPAWN_RUNS 50
+
+static GPid bench_fork_execv(char *const *argv) {
+	GPid pid = fork();
+	if(pid == 0) {
+		execvp(argv[0], argv);
+		_exit(EXIT_FAILURE);
+	}
+	return pid;
+}
+
+struct SpawnTiming {
+	gint64 total;
+	gint64 min;
+};
+
+static void time_spawn(struct SpawnTiming *timing, char *const *argv, const struct SpawnOptions *opts) {
+	int status;
+	gint64 start = g_get_monotonic_time();
+	GPid pid = opts ? util_spawn(argv, opts) : bench_fork_execv(argv);
+	gint64 time = g_get_monotonic_time() - start;
+	if(pid > 0) {
+		util_waitpid(pid, &status);
+	}
+	timing->total += time;
+	timing->min = MIN(timing->min, time);
+}
+#endif
+
+void microlauncher_bench_spawn(void) {
+	if(!bench_spawn) {
+		return;
+	}
+#ifdef G_OS_UNIX
+	char *argv[] = {"true", NULL};
+	// Without umask and directory util_spawn uses posix_spawn
+	struct SpawnOptions plain = {
+		.umask = -1,
+		.stdout_fd = -1,
+		.stderr_fd = -1};
+	// What game launches use, umask makes it take the vfork path
+	struct SpawnOptions game = {
+		.dir = g_get_home_dir(),
+		.umask = GAME_UMASK,
+		.stdout_fd = -1,
+		.stderr_fd = -1};
+	struct SpawnTiming spawnTiming = {0, G_MAXINT64}, gameTiming = {0, G_MAXINT64}, forkTiming = {0, G_MAXINT64};
+	// Time until the parent can continue, which is what blocks the GUI thread
+	for(int i = 0; i < BENCH_SPAWN_RUNS; i++) {
+		time_spawn(&spawnTiming, argv, &plain);
+		time_spawn(&gameTiming, argv, &game);
+		time_spawn(&forkTiming, argv, NULL);
+	}
+	g_print("Spawn latency over %d runs: posix_spawn avg %" G_GINT64_FORMAT " us, min %" G_GINT64_FORMAT " us; game launch (vfork) avg %" G_GINT64_FORMAT " us, min %" G_GINT64_FORMAT " us; fork+exec avg %" G_GINT64_FORMAT " us, min %" G_GINT64_FORMAT " us\n",
+			BENCH_SPAWN_RUNS, spawnTiming.total / BENCH_SPAWN_RUNS, spawnTiming.min, gameTiming.total / BENCH_SPAWN_RUNS, gameTiming.min, forkTiming.total / BENCH_SPAWN_RUNS, forkTiming.min);
+#else
+	g_print("Spawn benchmark is not supported on this platform\n");
+#endif
+}
+
+bool microlauncher_bench_startup(void) {
+	if(!bench_startup) {
+		return false;
+	}
+#ifdef __linux__
+	char *stat = NULL, *status = NULL;
+	unsigned long long starttime = 0;
+	long rss = 0;
+	// Counted from process creation so that dynamic linking is included
+	if(g_file_get_contents("/proc/self/stat", &stat, NULL, NULL)) {
+		char *p = strrchr(stat, ')');
+		// starttime is the 20th field after the command name
+		for(int i = 0; p && i < 20; i++) {
+			p = strchr(p + 1, ' ');
+		}
+		if(p) {
+			starttime = strtoull(p + 1, NULL, 10);
+		}
+		free(stat);
+	}
+	if(g_file_get_contents("/proc/self/status", &status, NULL, NULL)) {
+		char *p = strstr(status, "VmRSS:");
+		if(p) {
+			rss = strtol(p + strlen("VmRSS:"), NULL, 10);
+		}
+		free(status);
+	}
+	struct timespec now;
+	clock_gettime(CLOCK_BOOTTIME, &now);
+	double elapsed = now.tv_sec + now.tv_nsec / 1e9 - (double)starttime / sysconf(_SC_CLK_TCK);
+	g_print("Startup: window shown after %.0f ms, RSS %ld KiB\n", elapsed * 1000, rss);
+#else
+	g_print("Startup benchmark is not supported on this platform\n");
+#endif
+	return true;
+}
+
+static void cli_instance_finished(const struct ExitStatus *status, void *userdata) {
+	g_main_loop_quit(userdata);
+}
+
+int main(int argc, char **argv) {
+	if(argc > 1 && strequal(argv[1], "--supervise")) {
+		return microlauncher_supervise(argc, argv);
+	}
+	GOptionContext *context = g_option_context_new("");
+	g_option_context_add_main_entries(context, entries, NULL);
+	g_option_context_parse(context, &argc, &argv, NULL);
+	g_option_context_free(context);
+	// Desktop shortcuts launch through the resident service when there is one
+	if(active_instance && (use_saved_user || active_user)) {
+		GError *error = NULL;
+		if(microlauncher_service_launch(active_instance, use_saved_user ? NULL : active_user, &error)) {
+			return EXIT_SUCCESS;
+		}
+		if(error) {
+			fprintf(stderr, "%s\n", error->message);
+			g_error_free(error);
+			return EXIT_FAILURE;
+		}
+	}
+	if(!microlauncher_init(argv[0])) {
+		return EXIT_FAILURE;
+	}
+	struct Settings *settings = microlauncher_get_settings();
+
+	GSList *instances = *microlauncher_get_instances();
+	GSList *accounts = *microlauncher_get_accounts();
+	MicrolauncherAccount *user;
+	if(use_saved_user) {
+		user = settings->user;
+	} else {
+		user = microlauncher_account_get(accounts, active_user);
+	}
+	GMainLoop *loop = g_main_loop_new(NULL, false);
+	struct Callbacks cliCallbacks = {0};
+	cliCallbacks.instance_finished = cli_instance_finished;
+	cliCallbacks.userdata = loop;
+	LaunchContext *ctx = microlauncher_launch_context_new(microlauncher_instance_get(instances, active_instance), user, cliCallbacks);
+	bool launched = microlauncher_launch_instance(ctx);
+	if(launched && settings->lowFootprint) {
+		microlauncher_hand_off(ctx);
+	}
+	if(launched) {
+		g_main_loop_run(loop);
+	}
+	microlauncher_launch_context_free(ctx);
+	g_main_loop_unref(loop);
+	if(launched) {
+		microlauncher_deinit();
+		return EXIT_SUCCESS;
+	}
+
+	g_hash_table_unref(microlauncher_get_manifest());
+	int exit = microlauncher_gui_show();
+	microlauncher_save_settings();
+	microlauncher_deinit();
+	return exit;
+}
@@ -0,0 +1,65 @@
+#include <gtk/gtk.h>
+#include <microlauncher_mod_browser.h>
+#include <util/gtk_util.h>
+#include <webkit/webkit.h>
+
+static gboolean on_decide_policy(WebKitWebView *web_view,
+								 WebKitPolicyDecision *decision,
+								 WebKitPolicyDecisionType type,
+								 gpointer user_data) {
+
+	if(type == WEBKIT_POLICY_DECISION_TYPE_NAVIGATION_ACTION) {
+		WebKitNavigationPolicyDecision *nav_decision = WEBKIT_NAVIGATION_POLICY_DECISION(decision);
+		WebKitNavigationAction *action = webkit_navigation_policy_decision_get_navigation_action(nav_decision);
+		WebKitURIRequest *request = webkit_navigation_action_get_request(action);
+		const gchar *uri = webkit_uri_request_get_uri(request);
+
+		// If you want to block specific file extensions or patterns
+		if(g_str_has_suffix(uri, ".jar") || g_str_has_suffix(uri, ".zip") || g_str_has_suffix(uri, ".mrpack")) {
+			webkit_policy_decision_download(decision); // Stop the navigation/download entirely
+			g_print("Blocked download attempt for: %s\n", uri);
+			return TRUE; // Signal handled
+		}
+	}
+
+	else if(type == WEBKIT_POLICY_DECISION_TYPE_RESPONSE) {
+		WebKitResponsePolicyDecision *res_decision = WEBKIT_RESPONSE_POLICY_DECISION(decision);
+		WebKitURIResponse *response = webkit_response_policy_decision_get_response(res_decision);
+
+		// If the server explicitly says "this is a download" (Content-Disposition: attachment)
+		if(webkit_response_policy_decision_is_mime_type_supported(res_decision) == FALSE) {
+			webkit_policy_decision_ignore(decision);
+			g_print("Ignored unsupported MIME type (download prevented)\n");
+			return TRUE;
+		}
+	}
+
+	return FALSE; // Let WebKit handle it normally
+}
+
+static void on_download_mod_or_pack(WebKitNetworkSession *session, WebKitDownload *download, void *data) {
+	webkit_download_cancel(download);
+}
+
+void microlauncher_mod_browser_show(GtkWindow *parent) {
+	GtkWidget *widget;
+	GtkWindow *window = gtk_modal_dialog_new(parent);
+	gtk_window_set_default_size(window, 600, 800);
+	gtk_window_set_title(window, "Browse Mods");
+	gtk_window_set_transient_for(window, NULL);
+	gtk_window_set_modal(window, false);
+	GtkBox *box = GTK_BOX(gtk_box_new(GTK_ORIENTATION_VERTICAL, 0));
+	widget = gtk_entry_new();
+	gtk_widget_set_margin(widget, 10, 10, 10, 10);
+	gtk_editable_set_editable(GTK_EDITABLE(widget), false);
+	gtk_box_append(box, widget);
+	widget = webkit_web_view_new();
+	g_signal_connect(widget, "decide-policy", G_CALLBACK(on_decide_policy), NULL);
+	gtk_widget_set_vexpand(widget, true);
+	webkit_web_view_load_uri(WEBKIT_WEB_VIEW(widget), "https://modrinth.com/discover/mods");
+	WebKitNetworkSession *session = webkit_web_view_get_network_session(WEBKIT_WEB_VIEW(widget));
+	g_signal_connect(session, "download-started", G_CALLBACK(on_download_mod_or_pack), NULL);
+	gtk_box_append(box, widget);
+	gtk_window_set_child(window, GTK_WIDGET(box));
+	gtk_window_present(window);
+}
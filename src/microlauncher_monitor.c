@@ -0,0 +1,253 @@
+#include <glib.h>
+#include <json.h>
+#include <microlauncher_monitor.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/json_util.h>
+#include <util/util.h>
+#ifdef __linux__
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+struct ProcessCounters {
+	guint64 ticks;
+	guint64 read_bytes;
+	guint64 write_bytes;
+};
+
+struct _ProcessMonitor {
+	GPid pid;
+	guint source;
+	MonitorFunc func;
+	void *userdata;
+	/* pid -> ProcessCounters from previous sample */
+	GHashTable *counters;
+	gint64 last_time;
+	gint64 start;
+	gint64 start_real;
+	double cpu_sum;
+	int cpu_samples;
+	guint64 peak_rss;
+	guint64 peak_swap;
+	long clock_ticks;
+};
+
+#ifdef __linux__
+static bool read_proc(char *buf, size_t size, const char *fmt, long pid) {
+	char path[64];
+	snprintf(path, sizeof(path), fmt, pid);
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		return false;
+	}
+	ssize_t n = read(fd, buf, size - 1);
+	close(fd);
+	if(n <= 0) {
+		return false;
+	}
+	buf[n] = '\0';
+	return true;
+}
+
+static guint64 proc_field(const char *buf, const char *key) {
+	const char *line = strstr(buf, key);
+	return line ? g_ascii_strtoull(line + strlen(key), NULL, 10) : 0;
+}
+
+static bool sample_process(long pid, struct ProcessCounters *counters, struct ProcessSample *sample) {
+	char buf[4096];
+	if(!read_proc(buf, sizeof(buf), "/proc/%ld/stat", pid)) {
+		return false;
+	}
+	// Command name may contain spaces and parentheses
+	char *p = strrchr(buf, ')');
+	unsigned long utime, stime;
+	long threads;
+	if(!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %*d %*d %*d %*d %ld", &utime, &stime, &threads) != 3) {
+		return false;
+	}
+	counters->ticks = utime + stime;
+	sample->threads += threads;
+	sample->processes++;
+	if(read_proc(buf, sizeof(buf), "/proc/%ld/status", pid)) {
+		sample->rss += proc_field(buf, "VmRSS:") * 1024;
+		sample->swap += proc_field(buf, "VmSwap:") * 1024;
+	}
+	if(read_proc(buf, sizeof(buf), "/proc/%ld/io", pid)) {
+		counters->read_bytes = proc_field(buf, "\nread_bytes:");
+		counters->write_bytes = proc_field(buf, "\nwrite_bytes:");
+	}
+	return true;
+}
+
+static void queue_children(long pid, GQueue *queue) {
+	char path[64];
+	char buf[4096];
+	snprintf(path, sizeof(path), "/proc/%ld/task", pid);
+	DIR *dir = opendir(path);
+	if(!dir) {
+		return;
+	}
+	struct dirent *entry;
+	// Children are listed on the thread that spawned them
+	while((entry = readdir(dir))) {
+		if(entry->d_name[0] == '.') {
+			continue;
+		}
+		snprintf(path, sizeof(path), "/proc/%ld/task/%.16s/children", pid, entry->d_name);
+		int fd = open(path, O_RDONLY | O_CLOEXEC);
+		if(fd < 0) {
+			continue;
+		}
+		ssize_t n = read(fd, buf, sizeof(buf) - 1);
+		close(fd);
+		if(n <= 0) {
+			continue;
+		}
+		buf[n] = '\0';
+		char *end, *p = buf;
+		long child;
+		while((child = strtol(p, &end, 10)) > 0) {
+			g_queue_push_tail(queue, GINT_TO_POINTER(child));
+			p = end;
+		}
+	}
+	closedir(dir);
+}
+
+static guint64 counter_delta(guint64 now, guint64 before) {
+	return now > before ? now - before : 0;
+}
+
+static gboolean monitor_tick(gpointer data) {
+	ProcessMonitor *monitor = data;
+	struct ProcessSample sample = {0};
+	guint64 ticks = 0, read_bytes = 0, write_bytes = 0;
+	GHashTable *counters = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free);
+	GQueue queue = G_QUEUE_INIT;
+	g_queue_push_tail(&queue, GINT_TO_POINTER(monitor->pid));
+	while(!g_queue_is_empty(&queue)) {
+		long pid = GPOINTER_TO_INT(g_queue_pop_head(&queue));
+		struct ProcessCounters *current = g_new0(struct ProcessCounters, 1);
+		if(!sample_process(pid, current, &sample)) {
+			free(current);
+			continue;
+		}
+		// Processes that appeared since last sample count from zero
+		struct ProcessCounters *before = g_hash_table_lookup(monitor->counters, GINT_TO_POINTER(pid));
+		struct ProcessCounters zero = {0};
+		if(!before) {
+			before = &zero;
+		}
+		ticks += counter_delta(current->ticks, before->ticks);
+		read_bytes += counter_delta(current->read_bytes, before->read_bytes);
+		write_bytes += counter_delta(current->write_bytes, before->write_bytes);
+		g_hash_table_insert(counters, GINT_TO_POINTER(pid), current);
+		queue_children(pid, &queue);
+	}
+	g_hash_table_unref(monitor->counters);
+	monitor->counters = counters;
+
+	gint64 now = g_get_monotonic_time();
+	double elapsed = (now - monitor->last_time) / (double)G_USEC_PER_SEC;
+	bool primed = monitor->last_time != 0;
+	monitor->last_time = now;
+	if(!primed || sample.processes == 0 || elapsed <= 0) {
+		return G_SOURCE_CONTINUE;
+	}
+	sample.cpu = ticks * 100.0 / monitor->clock_ticks / elapsed;
+	sample.read_rate = read_bytes / elapsed;
+	sample.write_rate = write_bytes / elapsed;
+	monitor->cpu_sum += sample.cpu;
+	monitor->cpu_samples++;
+	monitor->peak_rss = MAX(monitor->peak_rss, sample.rss);
+	monitor->peak_swap = MAX(monitor->peak_swap, sample.swap);
+	if(monitor->func) {
+		monitor->func(&sample, monitor->userdata);
+	}
+	return G_SOURCE_CONTINUE;
+}
+#endif
+
+ProcessMonitor *microlauncher_monitor_new(GPid pid, guint interval_ms, MonitorFunc func, void *userdata) {
+#ifdef __linux__
+	ProcessMonitor *monitor = g_new0(ProcessMonitor, 1);
+	monitor->pid = pid;
+	monitor->func = func;
+	monitor->userdata = userdata;
+	monitor->counters = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free);
+	monitor->clock_ticks = sysconf(_SC_CLK_TCK);
+	monitor->start = g_get_monotonic_time();
+	monitor->start_real = g_get_real_time() / G_USEC_PER_SEC;
+	// First sample only sets the baseline
+	monitor_tick(monitor);
+	monitor->source = g_timeout_add(MAX(interval_ms, 100), monitor_tick, monitor);
+	return monitor;
+#else
+	return NULL;
+#endif
+}
+
+static void append_history(ProcessMonitor *monitor, const char *history_path) {
+	json_object *history = json_from_file(history_path);
+	if(!json_object_is_type(history, json_type_array)) {
+		json_object_put(history);
+		history = json_object_new_array();
+	}
+	json_object *obj = json_object_new_object();
+	json_object_object_add(obj, "start", json_object_new_int64(monitor->start_real));
+	json_object_object_add(obj, "length", json_object_new_int64((g_get_monotonic_time() - monitor->start) / G_USEC_PER_SEC));
+	json_object_object_add(obj, "peakRss", json_object_new_int64(monitor->peak_rss));
+	json_object_object_add(obj, "peakSwap", json_object_new_int64(monitor->peak_swap));
+	json_object_object_add(obj, "avgCpu", json_object_new_double(monitor->cpu_sum / monitor->cpu_samples));
+	json_object_array_add(history, obj);
+	size_t len = json_object_array_length(history);
+	if(len > MONITOR_HISTORY_MAX) {
+		json_object_array_del_idx(history, 0, len - MONITOR_HISTORY_MAX);
+	}
+	json_to_file(history, history_path, JSON_C_TO_STRING_NOSLASHESCAPE);
+	json_object_put(history);
+}
+
+void microlauncher_monitor_free(ProcessMonitor *monitor, const char *history_path) {
+	if(!monitor) {
+		return;
+	}
+	g_source_remove(monitor->source);
+	if(history_path && monitor->cpu_samples > 0) {
+		append_history(monitor, history_path);
+	}
+	g_hash_table_unref(monitor->counters);
+	free(monitor);
+}
+
+char *microlauncher_monitor_history_path(const char *launcher_root, const char *game_dir) {
+	char *key = g_compute_checksum_for_string(G_CHECKSUM_SHA1, game_dir, -1);
+	char *path = g_strdup_printf("%s/sessions/%s.json", launcher_root, key);
+	free(key);
+	return path;
+}
+
+int microlauncher_monitor_load_history(const char *history_path, struct SessionSummary *sessions, int count) {
+	json_object *history = json_from_file(history_path);
+	if(!json_object_is_type(history, json_type_array)) {
+		json_object_put(history);
+		return 0;
+	}
+	int n = 0;
+	for(int i = json_object_array_length(history) - 1; i >= 0 && n < count; i--) {
+		json_object *obj = json_object_array_get_idx(history, i);
+		struct SessionSummary *session = &sessions[n++];
+		session->start = json_get_int64(obj, "start");
+		session->length = json_get_int64(obj, "length");
+		session->peak_rss = json_get_int64(obj, "peakRss");
+		session->peak_swap = json_get_int64(obj, "peakSwap");
+		session->avg_cpu = json_object_get_double(json_object_object_get(obj, "avgCpu"));
+	}
+	json_object_put(history);
+	return n;
+}
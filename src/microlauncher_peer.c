@@ -0,0 +1,306 @@
+#include <gio/gio.h>
+#include <glib.h>
+#include <microlauncher.h>
+#include <microlauncher_download.h>
+#include <microlauncher_peer.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/util.h>
+#ifdef HAVE_AVAHI
+#include <avahi-client/client.h>
+#include <avahi-client/lookup.h>
+#include <avahi-client/publish.h>
+#include <avahi-common/error.h>
+#include <avahi-glib/glib-watch.h>
+#endif
+
+/* Seconds a connection may idle before it's dropped */
+#define PEER_IO_TIMEOUT 10
+#define PEER_MAX_HEADERS 64
+
+static const char *SERVED_DIRS[] = {"versions", "libraries", "assets", NULL};
+
+struct _PeerServer {
+	GSocketService *service;
+	char *root;
+	guint16 port;
+#ifdef HAVE_AVAHI
+	AvahiGLibPoll *poll;
+	AvahiClient *client;
+	AvahiEntryGroup *group;
+#endif
+};
+
+struct Discovery {
+	GMutex mutex;
+	char **configured;
+	/* mDNS service name -> base URL */
+	GHashTable *found;
+	bool running;
+#ifdef HAVE_AVAHI
+	GThread *thread;
+	GMainContext *context;
+	GMainLoop *loop;
+#endif
+};
+
+static struct Discovery discovery = {0};
+
+bool microlauncher_peer_path_served(const char *relative) {
+	if(!relative || relative[0] == '/' || strstr(relative, "..") || g_str_has_suffix(relative, ".part") || g_str_has_suffix(relative, DOWNLOAD_LOCK_SUFFIX)) {
+		return false;
+	}
+	for(const char **dir = SERVED_DIRS; *dir; dir++) {
+		size_t len = strlen(*dir);
+		if(strncmp(relative, *dir, len) == 0 && relative[len] == '/') {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void respond_status(GOutputStream *out, const char *status) {
+	char *response = g_strdup_printf("HTTP/1.1 %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", status);
+	g_output_stream_write_all(out, response, strlen(response), NULL, NULL, NULL);
+	free(response);
+}
+
+static void serve_file(GOutputStream *out, const char *path) {
+	GFile *file = g_file_new_for_path(path);
+	GFileInputStream *in = g_file_read(file, NULL, NULL);
+	GFileInfo *info = in ? g_file_input_stream_query_info(in, G_FILE_ATTRIBUTE_STANDARD_SIZE "," G_FILE_ATTRIBUTE_STANDARD_TYPE, NULL, NULL) : NULL;
+	if(!info || g_file_info_get_file_type(info) != G_FILE_TYPE_REGULAR) {
+		respond_status(out, "404 Not Found");
+	} else {
+		char *header = g_strdup_printf("HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: %" G_GOFFSET_FORMAT "\r\nConnection: close\r\n\r\n", g_file_info_get_size(info));
+		if(g_output_stream_write_all(out, header, strlen(header), NULL, NULL, NULL)) {
+			g_output_stream_splice(out, G_INPUT_STREAM(in), G_OUTPUT_STREAM_SPLICE_NONE, NULL, NULL);
+		}
+		free(header);
+	}
+	if(info) {
+		g_object_unref(info);
+	}
+	if(in) {
+		g_object_unref(in);
+	}
+	g_object_unref(file);
+}
+
+/* Minimal HTTP/1.1 GET, one request per connection. Runs in a thread of the service */
+static gboolean server_run(GThreadedSocketService *service, GSocketConnection *connection, GObject *source_object, PeerServer *server) {
+	g_socket_set_timeout(g_socket_connection_get_socket(connection), PEER_IO_TIMEOUT);
+	GOutputStream *out = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+	GDataInputStream *in = g_data_input_stream_new(g_io_stream_get_input_stream(G_IO_STREAM(connection)));
+	g_filter_input_stream_set_close_base_stream(G_FILTER_INPUT_STREAM(in), false);
+	char *request = g_data_input_stream_read_line(in, NULL, NULL, NULL);
+	// Headers don't matter, but are read so the client doesn't see a reset
+	char *line;
+	for(int i = 0; i < PEER_MAX_HEADERS && (line = g_data_input_stream_read_line(in, NULL, NULL, NULL)); i++) {
+		bool end = line[0] == '\0' || strequal(line, "\r");
+		free(line);
+		if(end) {
+			break;
+		}
+	}
+	char **parts = request ? g_strsplit(g_strchomp(request), " ", 3) : NULL;
+	if(!parts || g_strv_length(parts) != 3) {
+		respond_status(out, "400 Bad Request");
+	} else if(!strequal(parts[0], "GET")) {
+		respond_status(out, "405 Method Not Allowed");
+	} else {
+		char *relative = g_uri_unescape_string(parts[1][0] == '/' ? parts[1] + 1 : parts[1], NULL);
+		if(microlauncher_peer_path_served(relative)) {
+			char *path = g_build_filename(server->root, relative, NULL);
+			serve_file(out, path);
+			free(path);
+		} else {
+			respond_status(out, "404 Not Found");
+		}
+		free(relative);
+	}
+	g_strfreev(parts);
+	free(request);
+	g_object_unref(in);
+	return true;
+}
+
+#ifdef HAVE_AVAHI
+static void server_client_callback(AvahiClient *client, AvahiClientState state, void *userdata) {
+	PeerServer *server = userdata;
+	if(state != AVAHI_CLIENT_S_RUNNING || server->group) {
+		return;
+	}
+	server->group = avahi_entry_group_new(client, NULL, NULL);
+	if(!server->group) {
+		return;
+	}
+	char *name = g_strdup_printf("%s on %s", LAUNCHER_NAME, g_get_host_name());
+	if(avahi_entry_group_add_service(server->group, AVAHI_IF_UNSPEC, AVAHI_PROTO_UNSPEC, 0, name, PEER_SERVICE_TYPE, NULL, NULL, server->port, NULL) < 0 ||
+	   avahi_entry_group_commit(server->group) < 0) {
+		g_print("Can't announce peer cache: %s\n", avahi_strerror(avahi_client_errno(client)));
+	}
+	free(name);
+}
+#endif
+
+PeerServer *microlauncher_peer_server_new(const char *launcher_root, guint16 port, GError **error) {
+	PeerServer *server = g_new0(PeerServer, 1);
+	server->root = g_strdup(launcher_root);
+	server->port = port ? port : PEER_DEFAULT_PORT;
+	server->service = g_threaded_socket_service_new(PEER_SERVER_THREADS);
+	if(!g_socket_listener_add_inet_port(G_SOCKET_LISTENER(server->service), server->port, NULL, error)) {
+		microlauncher_peer_server_free(server);
+		return NULL;
+	}
+	g_signal_connect(server->service, "run", G_CALLBACK(server_run), server);
+	g_socket_service_start(server->service);
+#ifdef HAVE_AVAHI
+	server->poll = avahi_glib_poll_new(g_main_context_get_thread_default(), G_PRIORITY_DEFAULT);
+	server->client = avahi_client_new(avahi_glib_poll_get(server->poll), AVAHI_CLIENT_NO_FAIL, server_client_callback, server, NULL);
+#endif
+	return server;
+}
+
+void microlauncher_peer_server_free(PeerServer *server) {
+	if(!server) {
+		return;
+	}
+#ifdef HAVE_AVAHI
+	// Frees the entry group as well
+	if(server->client) {
+		avahi_client_free(server->client);
+	}
+	if(server->poll) {
+		avahi_glib_poll_free(server->poll);
+	}
+#endif
+	g_socket_service_stop(server->service);
+	g_socket_listener_close(G_SOCKET_LISTENER(server->service));
+	g_object_unref(server->service);
+	free(server->root);
+	free(server);
+}
+
+#ifdef HAVE_AVAHI
+static void resolve_callback(AvahiServiceResolver *resolver, AvahiIfIndex interface, AvahiProtocol protocol, AvahiResolverEvent event,
+							 const char *name, const char *type, const char *domain, const char *host_name, const AvahiAddress *address,
+							 uint16_t port, AvahiStringList *txt, AvahiLookupResultFlags flags, void *userdata) {
+	if(event == AVAHI_RESOLVER_FOUND && !(flags & AVAHI_LOOKUP_RESULT_OUR_OWN)) {
+		char addr[AVAHI_ADDRESS_STR_MAX];
+		avahi_address_snprint(addr, sizeof(addr), address);
+		g_mutex_lock(&discovery.mutex);
+		g_hash_table_replace(discovery.found, g_strdup(name), g_strdup_printf("http://%s:%u", addr, port));
+		g_mutex_unlock(&discovery.mutex);
+	}
+	avahi_service_resolver_free(resolver);
+}
+
+static void browse_callback(AvahiServiceBrowser *browser, AvahiIfIndex interface, AvahiProtocol protocol, AvahiBrowserEvent event,
+							const char *name, const char *type, const char *domain, AvahiLookupResultFlags flags, void *userdata) {
+	AvahiClient *client = userdata;
+	if(event == AVAHI_BROWSER_NEW) {
+		avahi_service_resolver_new(client, interface, protocol, name, type, domain, AVAHI_PROTO_INET, 0, resolve_callback, NULL);
+	} else if(event == AVAHI_BROWSER_REMOVE) {
+		g_mutex_lock(&discovery.mutex);
+		g_hash_table_remove(discovery.found, name);
+		g_mutex_unlock(&discovery.mutex);
+	}
+}
+
+static void discovery_client_callback(AvahiClient *client, AvahiClientState state, void *userdata) {
+}
+
+/* Browses in its own context, so peers are found while the calling thread blocks on downloads */
+static gpointer discovery_thread(gpointer data) {
+	g_main_context_push_thread_default(discovery.context);
+	AvahiGLibPoll *poll = avahi_glib_poll_new(discovery.context, G_PRIORITY_DEFAULT);
+	AvahiClient *client = avahi_client_new(avahi_glib_poll_get(poll), 0, discovery_client_callback, NULL, NULL);
+	AvahiServiceBrowser *browser = NULL;
+	if(client) {
+		browser = avahi_service_browser_new(client, AVAHI_IF_UNSPEC, AVAHI_PROTO_INET, PEER_SERVICE_TYPE, NULL, 0, browse_callback, client);
+	}
+	if(browser) {
+		g_main_loop_run(discovery.loop);
+		avahi_service_browser_free(browser);
+	}
+	if(client) {
+		avahi_client_free(client);
+	}
+	avahi_glib_poll_free(poll);
+	g_main_context_pop_thread_default(discovery.context);
+	return NULL;
+}
+#endif
+
+void microlauncher_peer_discovery_start(const char *configured) {
+	g_mutex_lock(&discovery.mutex);
+	g_strfreev(discovery.configured);
+	discovery.configured = NULL;
+	if(configured && configured[0]) {
+		discovery.configured = g_strsplit(configured, ",", -1);
+		for(char **url = discovery.configured; *url; url++) {
+			g_strstrip(*url);
+		}
+	}
+	if(!discovery.found) {
+		discovery.found = g_hash_table_new_full(g_str_hash, g_str_equal, free, free);
+	}
+	bool start = !discovery.running;
+	discovery.running = true;
+	g_mutex_unlock(&discovery.mutex);
+#ifdef HAVE_AVAHI
+	if(start) {
+		discovery.context = g_main_context_new();
+		discovery.loop = g_main_loop_new(discovery.context, false);
+		discovery.thread = g_thread_new("peer-discovery", discovery_thread, NULL);
+	}
+#else
+	(void)start;
+#endif
+}
+
+void microlauncher_peer_discovery_stop(void) {
+	g_mutex_lock(&discovery.mutex);
+	bool stop = discovery.running;
+	discovery.running = false;
+	g_mutex_unlock(&discovery.mutex);
+	if(!stop) {
+		return;
+	}
+#ifdef HAVE_AVAHI
+	g_main_loop_quit(discovery.loop);
+	g_thread_join(discovery.thread);
+	g_main_loop_unref(discovery.loop);
+	g_main_context_unref(discovery.context);
+#endif
+	g_mutex_lock(&discovery.mutex);
+	g_hash_table_remove_all(discovery.found);
+	g_mutex_unlock(&discovery.mutex);
+}
+
+char **microlauncher_peer_get_urls(void) {
+	GPtrArray *urls = g_ptr_array_new();
+	g_mutex_lock(&discovery.mutex);
+	if(discovery.running) {
+		for(char **url = discovery.configured; url && *url; url++) {
+			if((*url)[0]) {
+				g_ptr_array_add(urls, g_strdup(*url));
+			}
+		}
+		GHashTableIter iter;
+		char *url;
+		g_hash_table_iter_init(&iter, discovery.found);
+		while(g_hash_table_iter_next(&iter, NULL, (gpointer *)&url)) {
+			g_ptr_array_add(urls, g_strdup(url));
+		}
+	}
+	g_mutex_unlock(&discovery.mutex);
+	if(urls->len == 0) {
+		g_ptr_array_free(urls, TRUE);
+		return NULL;
+	}
+	g_ptr_array_add(urls, NULL);
+	return (char **)g_ptr_array_free(urls, FALSE);
+}
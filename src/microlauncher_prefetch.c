@@ -0,0 +1,227 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* readahead */
+#endif
+#include <fcntl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <microlauncher_prefetch.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <util/util.h>
+#ifdef G_OS_UNIX
+#include <unistd.h>
+#endif
+
+/* How long after launch files opened by the game are recorded */
+#define RECORD_DURATION (60 * G_TIME_SPAN_SECOND)
+#define RECORD_INTERVAL (100 * G_TIME_SPAN_MILLISECOND)
+
+struct _Prefetch {
+	char *list_path;
+	char *game_dir;
+	char *root_dir;
+	GPtrArray *paths;
+	GThread *thread;
+	GThread *recorder;
+	GPid pid;
+	gint stop;
+	GPtrArray *learned;
+	GHashTable *seen;
+};
+
+Prefetch *microlauncher_prefetch_new(const char *prefetch_dir, const char *game_dir) {
+	Prefetch *prefetch = g_new0(Prefetch, 1);
+	char *key = g_compute_checksum_for_string(G_CHECKSUM_SHA1, game_dir, -1);
+	prefetch->list_path = g_strdup_printf("%s/%s.txt", prefetch_dir, key);
+	free(key);
+	prefetch->game_dir = g_strdup(game_dir);
+	prefetch->root_dir = g_path_get_dirname(prefetch_dir);
+	prefetch->paths = g_ptr_array_new_with_free_func(g_free);
+	prefetch->learned = g_ptr_array_new_with_free_func(g_free);
+	prefetch->seen = g_hash_table_new(g_str_hash, g_str_equal);
+
+	// Files learned on previous launch go first, in the order they were opened
+	char *list = read_file_as_string(prefetch->list_path);
+	if(list) {
+		char **lines = g_strsplit(list, "\n", -1);
+		for(int i = 0; lines[i]; i++) {
+			if(lines[i][0]) {
+				microlauncher_prefetch_add(prefetch, lines[i]);
+			}
+		}
+		g_strfreev(lines);
+		free(list);
+	}
+	return prefetch;
+}
+
+void microlauncher_prefetch_add(Prefetch *prefetch, const char *path) {
+	if(path) {
+		g_ptr_array_add(prefetch->paths, g_strdup(path));
+	}
+}
+
+void microlauncher_prefetch_add_classpath(Prefetch *prefetch, const char *classpath) {
+	if(!classpath) {
+		return;
+	}
+	char **entries = g_strsplit(classpath, G_SEARCHPATH_SEPARATOR_S, -1);
+	for(int i = 0; entries[i]; i++) {
+		if(entries[i][0]) {
+			microlauncher_prefetch_add(prefetch, entries[i]);
+		}
+	}
+	g_strfreev(entries);
+}
+
+static void prefetch_file(const char *path) {
+#ifdef G_OS_UNIX
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		return;
+	}
+	struct stat st;
+	if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+#ifdef __linux__
+		readahead(fd, 0, st.st_size);
+#elif defined(POSIX_FADV_WILLNEED)
+		posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+	}
+	close(fd);
+#endif
+}
+
+static void prefetch_path(const char *path) {
+	GDir *dir = g_dir_open(path, 0, NULL);
+	if(!dir) {
+		prefetch_file(path);
+		return;
+	}
+	const char *name;
+	while((name = g_dir_read_name(dir))) {
+		char *child = g_build_filename(path, name, NULL);
+		prefetch_file(child);
+		free(child);
+	}
+	g_dir_close(dir);
+}
+
+static gpointer prefetch_thread(gpointer data) {
+	Prefetch *prefetch = data;
+	GHashTable *done = g_hash_table_new(g_str_hash, g_str_equal);
+	for(guint i = 0; i < prefetch->paths->len && !g_atomic_int_get(&prefetch->stop); i++) {
+		const char *path = g_ptr_array_index(prefetch->paths, i);
+		if(g_hash_table_add(done, (gpointer)path)) {
+			prefetch_path(path);
+		}
+	}
+	g_hash_table_destroy(done);
+	return NULL;
+}
+
+void microlauncher_prefetch_start(Prefetch *prefetch) {
+	prefetch->thread = g_thread_new("prefetch", prefetch_thread, prefetch);
+}
+
+static bool path_has_prefix(const char *path, const char *dir) {
+	size_t len = strlen(dir);
+	return strncmp(path, dir, len) == 0 && path[len] == '/';
+}
+
+#ifdef __linux__
+static void record_open_files(Prefetch *prefetch, const char *fd_dir) {
+	char link[PATH_MAX];
+	char target[PATH_MAX];
+	GDir *dir = g_dir_open(fd_dir, 0, NULL);
+	if(!dir) {
+		return;
+	}
+	const char *name;
+	while((name = g_dir_read_name(dir))) {
+		snprintf(link, PATH_MAX, "%s/%s", fd_dir, name);
+		ssize_t len = readlink(link, target, PATH_MAX - 1);
+		if(len <= 0) {
+			continue;
+		}
+		target[len] = '\0';
+		// Only game files, not sockets, devices or system libraries
+		if(!path_has_prefix(target, prefetch->root_dir) && !path_has_prefix(target, prefetch->game_dir)) {
+			continue;
+		}
+		if(g_hash_table_contains(prefetch->seen, target)) {
+			continue;
+		}
+		char *path = g_strdup(target);
+		g_ptr_array_add(prefetch->learned, path);
+		g_hash_table_add(prefetch->seen, path);
+	}
+	g_dir_close(dir);
+}
+
+static gpointer record_thread(gpointer data) {
+	Prefetch *prefetch = data;
+	char fd_dir[64];
+	snprintf(fd_dir, sizeof(fd_dir), "/proc/%d/fd", prefetch->pid);
+	gint64 end = g_get_monotonic_time() + RECORD_DURATION;
+	while(!g_atomic_int_get(&prefetch->stop) && g_get_monotonic_time() < end && g_file_test(fd_dir, G_FILE_TEST_IS_DIR)) {
+		record_open_files(prefetch, fd_dir);
+		g_usleep(RECORD_INTERVAL);
+	}
+	return NULL;
+}
+#endif
+
+/* Samples files opened by the game process so they can be prefetched next time */
+void microlauncher_prefetch_record(Prefetch *prefetch, GPid pid) {
+#ifdef __linux__
+	prefetch->pid = pid;
+	prefetch->recorder = g_thread_new("prefetch-record", record_thread, prefetch);
+#endif
+}
+
+static void save_learned(Prefetch *prefetch) {
+	String str = string_new(NULL);
+	for(guint i = 0; i < prefetch->learned->len; i++) {
+		string_append(&str, g_ptr_array_index(prefetch->learned, i));
+		string_append_char(&str, '\n');
+	}
+	char *tmp = g_strdup_printf("%s.tmp", prefetch->list_path);
+	FILE *fd = fopen_mkdir(tmp, "wb");
+	if(fd) {
+		bool ok = fwrite(str.data, 1, str.length, fd) == (size_t)str.length;
+		ok = fclose(fd) == 0 && ok;
+		if(!ok || g_rename(tmp, prefetch->list_path) != 0) {
+			g_remove(tmp);
+		}
+	}
+	free(tmp);
+	string_destroy(&str);
+}
+
+void microlauncher_prefetch_free(Prefetch *prefetch) {
+	if(!prefetch) {
+		return;
+	}
+	g_atomic_int_set(&prefetch->stop, 1);
+	if(prefetch->thread) {
+		g_thread_join(prefetch->thread);
+	}
+	if(prefetch->recorder) {
+		g_thread_join(prefetch->recorder);
+		// Keep previous list if the game exited before opening anything
+		if(prefetch->learned->len > 0) {
+			save_learned(prefetch);
+		}
+	}
+	g_hash_table_destroy(prefetch->seen);
+	g_ptr_array_free(prefetch->learned, TRUE);
+	g_ptr_array_free(prefetch->paths, TRUE);
+	free(prefetch->list_path);
+	free(prefetch->game_dir);
+	free(prefetch->root_dir);
+	free(prefetch);
+}
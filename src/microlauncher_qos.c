@@ -0,0 +1,227 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <microlauncher_qos.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/util.h>
+#ifdef G_OS_UNIX
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+#define CGROUP_ROOT "/sys/fs/cgroup"
+
+#ifdef __linux__
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+#endif
+
+const char *const IO_PRIORITY_NAMES[IO_PRIORITY_N] = {
+	[IO_PRIORITY_DEFAULT] = "default",
+	[IO_PRIORITY_LOW] = "low",
+	[IO_PRIORITY_IDLE] = "idle"};
+
+const char *const IO_PRIORITY_LABELS[IO_PRIORITY_N + 1] = {
+	[IO_PRIORITY_DEFAULT] = "Default",
+	[IO_PRIORITY_LOW] = "Low",
+	[IO_PRIORITY_IDLE] = "Idle",
+	[IO_PRIORITY_N] = NULL};
+
+enum IoPriority io_priority_from_name(const char *name) {
+	if(!name) {
+		return IO_PRIORITY_DEFAULT;
+	}
+	for(int i = 0; i < IO_PRIORITY_N; i++) {
+		if(strequal(IO_PRIORITY_NAMES[i], name)) {
+			return i;
+		}
+	}
+	return IO_PRIORITY_DEFAULT;
+}
+
+#ifdef __linux__
+static bool parse_cpu_list(const char *list, cpu_set_t *set) {
+	CPU_ZERO(set);
+	const char *p = list;
+	char *end;
+	while(*p) {
+		long first = strtol(p, &end, 10);
+		long last = first;
+		if(end == p || first < 0) {
+			return false;
+		}
+		p = end;
+		if(*p == '-') {
+			last = strtol(p + 1, &end, 10);
+			if(end == p + 1 || last < first) {
+				return false;
+			}
+			p = end;
+		}
+		for(long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+			CPU_SET(cpu, set);
+		}
+		while(*p == ',' || *p == ' ') {
+			p++;
+		}
+	}
+	return CPU_COUNT(set) > 0;
+}
+
+struct QosSpawn {
+	const struct QosSettings *qos;
+	char *const *argv;
+	const struct SpawnOptions *opts;
+};
+
+/* Affinity, nice and I/O priority are per thread on Linux and inherited by the child */
+static gpointer qos_spawn_thread(gpointer data) {
+	struct QosSpawn *spawn = data;
+	const struct QosSettings *qos = spawn->qos;
+	if(qos->cpu_affinity && *qos->cpu_affinity) {
+		cpu_set_t set;
+		if(!parse_cpu_list(qos->cpu_affinity, &set)) {
+			g_print("Invalid CPU affinity list: %s\n", qos->cpu_affinity);
+		} else if(sched_setaffinity(0, sizeof(set), &set) != 0) {
+			g_print("Failed to set CPU affinity: %s\n", strerror(errno));
+		}
+	}
+	if(qos->nice > 0 && setpriority(PRIO_PROCESS, syscall(SYS_gettid), MIN(qos->nice, 19)) != 0) {
+		g_print("Failed to set nice level: %s\n", strerror(errno));
+	}
+	if(qos->io_priority != IO_PRIORITY_DEFAULT) {
+		int ioprio = qos->io_priority == IO_PRIORITY_IDLE ? IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT : (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | 7;
+		if(syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio) != 0) {
+			g_print("Failed to set I/O priority: %s\n", strerror(errno));
+		}
+	}
+	return GINT_TO_POINTER(util_spawn(spawn->argv, spawn->opts));
+}
+#endif
+
+GPid microlauncher_qos_spawn(const struct QosSettings *qos, char *const *argv, const struct SpawnOptions *opts) {
+#ifdef __linux__
+	if((qos->cpu_affinity && *qos->cpu_affinity) || qos->nice > 0 || qos->io_priority != IO_PRIORITY_DEFAULT) {
+		// Thread is thrown away, so nothing has to be restored
+		struct QosSpawn spawn = {qos, argv, opts};
+		GThread *thread = g_thread_new("qos-spawn", qos_spawn_thread, &spawn);
+		return GPOINTER_TO_INT(g_thread_join(thread));
+	}
+	return util_spawn(argv, opts);
+#else
+	GPid pid = util_spawn(argv, opts);
+#ifdef G_OS_UNIX
+	if(pid && qos->nice > 0) {
+		setpriority(PRIO_PROCESS, pid, MIN(qos->nice, 19));
+	}
+#endif
+	return pid;
+#endif
+}
+
+#ifdef __linux__
+static bool cgroup_write(const char *dir, const char *file, const char *value) {
+	char *path = g_build_filename(dir, file, NULL);
+	FILE *fd = fopen(path, "w");
+	free(path);
+	if(!fd) {
+		return false;
+	}
+	bool ok = fputs(value, fd) >= 0;
+	ok = fclose(fd) == 0 && ok;
+	return ok;
+}
+
+/* Our own cgroup relative to CGROUP_ROOT */
+static char *cgroup_self(void) {
+	char *contents = NULL;
+	if(!g_file_get_contents("/proc/self/cgroup", &contents, NULL, NULL)) {
+		return NULL;
+	}
+	char *ret = NULL;
+	char **lines = g_strsplit(contents, "\n", -1);
+	for(int i = 0; lines[i]; i++) {
+		// Unified hierarchy only
+		if(g_str_has_prefix(lines[i], "0::/")) {
+			ret = g_strdup(lines[i] + 3);
+			break;
+		}
+	}
+	g_strfreev(lines);
+	free(contents);
+	return ret;
+}
+#endif
+
+char *microlauncher_qos_cgroup_new(const struct QosSettings *qos) {
+#ifdef __linux__
+	static gint counter;
+	if(qos->memory_high <= 0 && qos->cpu_weight <= 0) {
+		return NULL;
+	}
+	char *self = cgroup_self();
+	if(!self) {
+		g_print("cgroup v2 isn't available, skipping resource limits\n");
+		return NULL;
+	}
+	// Launcher's own cgroup has processes, so limits go on a sibling
+	char *parent = g_path_get_dirname(self);
+	char *path = g_strdup_printf(CGROUP_ROOT "%s/microlauncher-%d-%d", strequal(parent, "/") ? "" : parent, getpid(), g_atomic_int_add(&counter, 1));
+	free(self);
+	free(parent);
+	if(g_mkdir(path, 0755) != 0) {
+		g_print("cgroup %s isn't writable, skipping resource limits: %s\n", path, strerror(errno));
+		free(path);
+		return NULL;
+	}
+	char value[32];
+	if(qos->memory_high > 0) {
+		snprintf(value, sizeof(value), "%dM", qos->memory_high);
+		if(!cgroup_write(path, "memory.high", value)) {
+			g_print("memory controller isn't delegated, memory limit not applied\n");
+		}
+	}
+	if(qos->cpu_weight > 0) {
+		snprintf(value, sizeof(value), "%d", CLAMP(qos->cpu_weight, 1, 10000));
+		if(!cgroup_write(path, "cpu.weight", value)) {
+			g_print("cpu controller isn't delegated, CPU weight not applied\n");
+		}
+	}
+	return path;
+#else
+	return NULL;
+#endif
+}
+
+void microlauncher_qos_cgroup_attach(const char *path, GPid pid) {
+#ifdef __linux__
+	if(!path) {
+		return;
+	}
+	// No-op if the game was started in it
+	char value[32];
+	snprintf(value, sizeof(value), "%d", pid);
+	if(!cgroup_write(path, "cgroup.procs", value)) {
+		g_print("Failed to move game to cgroup %s\n", path);
+	}
+#endif
+}
+
+void microlauncher_qos_cgroup_remove(const char *path) {
+	// Fails while processes left behind by the game are still alive
+	if(path && g_rmdir(path) != 0) {
+		g_print("Failed to remove cgroup %s: %s\n", path, strerror(errno));
+	}
+}
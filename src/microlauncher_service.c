@@ -0,0 +1,323 @@
+#include <curl/curl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <microlauncher.h>
+#include <microlauncher_launch.h>
+#include <microlauncher_service.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <util/util.h>
+#include <util/xdgutil.h>
+
+#define CLI_BINARY "microlauncher-cli"
+
+static const char SERVICE_XML[] =
+	"<node>"
+	"  <interface name='" SERVICE_INTERFACE "'>"
+	"    <method name='Launch'>"
+	"      <arg type='s' name='instance' direction='in'/>"
+	"      <arg type='s' name='user' direction='in'/>"
+	"      <arg type='u' name='pid' direction='out'/>"
+	"    </method>"
+	"    <signal name='Stage'>"
+	"      <arg type='s' name='instance'/>"
+	"      <arg type='s' name='stage'/>"
+	"    </signal>"
+	"    <signal name='Exited'>"
+	"      <arg type='s' name='instance'/>"
+	"      <arg type='i' name='status'/>"
+	"    </signal>"
+	"  </interface>"
+	"</node>";
+
+static const char *CONFIG_FILES[] = {"settings.json", "accounts.json", "instances.json", NULL};
+
+struct Service {
+	GMainLoop *loop;
+	GDBusConnection *connection;
+	GDBusNodeInfo *introspection;
+	/* Kept between launches so connections and TLS sessions are reused */
+	CURLSH *share;
+	GMutex share_locks[CURL_LOCK_DATA_LAST];
+	GSList *monitors;
+	/* Launches still being prepared, running games only keep their own context */
+	guint preparing;
+	/* Config changed by another process after it was loaded */
+	bool stale;
+	int exit_code;
+};
+
+struct ServiceLaunch {
+	LaunchContext *ctx;
+	/* NULL once replied */
+	GDBusMethodInvocation *invocation;
+	char *instance;
+	char *error;
+	GPid pid;
+	bool ok;
+	bool exited;
+};
+
+static struct Service service;
+
+static void share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr) {
+	g_mutex_lock(&service.share_locks[data]);
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *userptr) {
+	g_mutex_unlock(&service.share_locks[data]);
+}
+
+static void reload_if_stale(void) {
+	if(service.stale && service.preparing == 0) {
+		g_print("Configuration changed, reloading\n");
+		microlauncher_reload_config();
+		service.stale = false;
+	}
+}
+
+static void config_changed(GFileMonitor *monitor, GFile *file, GFile *other_file, GFileMonitorEvent event_type, gpointer user_data) {
+	char *path = g_file_get_path(file);
+	// Token refreshes of launches write accounts.json too
+	if(!microlauncher_config_is_current(path)) {
+		service.stale = true;
+		reload_if_stale();
+	}
+	free(path);
+}
+
+static void emit_signal(const char *name, GVariant *parameters) {
+	if(service.connection) {
+		g_dbus_connection_emit_signal(service.connection, NULL, SERVICE_PATH, SERVICE_INTERFACE, name, parameters, NULL);
+	}
+}
+
+static void service_launch_free(struct ServiceLaunch *launch) {
+	microlauncher_launch_context_free(launch->ctx);
+	free(launch->instance);
+	free(launch->error);
+	free(launch);
+}
+
+static gboolean service_launch_free_idle(struct ServiceLaunch *launch) {
+	service_launch_free(launch);
+	return false;
+}
+
+static void service_stage_update(const char *msg, void *userdata) {
+	struct ServiceLaunch *launch = userdata;
+	if(msg) {
+		emit_signal("Stage", g_variant_new("(ss)", launch->instance, msg));
+	}
+}
+
+static void service_show_error(const char *msg, void *userdata) {
+	struct ServiceLaunch *launch = userdata;
+	g_printerr("%s: %s\n", launch->instance, msg);
+	free(launch->error);
+	launch->error = g_strdup(msg);
+}
+
+static void service_instance_started(GPid pid, void *userdata) {
+	struct ServiceLaunch *launch = userdata;
+	launch->pid = pid;
+}
+
+static void service_instance_finished(const struct ExitStatus *status, void *userdata) {
+	struct ServiceLaunch *launch = userdata;
+	emit_signal("Exited", g_variant_new("(si)", launch->instance, status->exited ? status->code : 128 + status->signal));
+	launch->exited = true;
+	// Context can't be freed from its own callback
+	if(!launch->invocation) {
+		g_idle_add(G_SOURCE_FUNC(service_launch_free_idle), launch);
+	}
+}
+
+static void service_launch_thread(GTask *task, gpointer source_object, struct ServiceLaunch *launch, GCancellable *cancellable) {
+	launch->ok = microlauncher_launch_instance(launch->ctx);
+}
+
+static void service_launch_done(GObject *source_object, GAsyncResult *res, gpointer data) {
+	struct ServiceLaunch *launch = data;
+	if(launch->ok) {
+		g_dbus_method_invocation_return_value(launch->invocation, g_variant_new("(u)", (guint32)launch->pid));
+	} else {
+		g_dbus_method_invocation_return_dbus_error(launch->invocation, SERVICE_ERROR_FAILED, launch->error ? launch->error : "Launch failed");
+	}
+	launch->invocation = NULL;
+	if(!launch->ok || launch->exited) {
+		service_launch_free(launch);
+	}
+	service.preparing--;
+	reload_if_stale();
+}
+
+static void service_launch(GVariant *parameters, GDBusMethodInvocation *invocation) {
+	const char *name, *userId;
+	g_variant_get(parameters, "(&s&s)", &name, &userId);
+	MicrolauncherInstance *inst = microlauncher_instance_get(*microlauncher_get_instances(), name);
+	MicrolauncherAccount *user = userId[0] ? microlauncher_account_get(*microlauncher_get_accounts(), userId) : microlauncher_get_settings()->user;
+	if(!inst || !user) {
+		g_dbus_method_invocation_return_dbus_error(invocation, SERVICE_ERROR_FAILED, inst ? "No such user" : "No such instance");
+		return;
+	}
+	struct ServiceLaunch *launch = g_new0(struct ServiceLaunch, 1);
+	launch->invocation = invocation;
+	launch->instance = g_strdup(name);
+	struct Callbacks callbacks = {
+		.instance_started = service_instance_started,
+		.instance_finished = service_instance_finished,
+		.stage_update = service_stage_update,
+		.show_error = service_show_error,
+		.userdata = launch};
+	launch->ctx = microlauncher_launch_context_new(inst, user, callbacks);
+	if(service.share) {
+		microlauncher_launch_context_set_share(launch->ctx, service.share);
+	}
+	service.preparing++;
+	GTask *task = g_task_new(NULL, NULL, service_launch_done, launch);
+	g_task_set_task_data(task, launch, NULL);
+	g_task_run_in_thread(task, (GTaskThreadFunc)service_launch_thread);
+	g_object_unref(task);
+}
+
+static void service_method_call(GDBusConnection *connection, const char *sender, const char *object_path, const char *interface_name, const char *method_name, GVariant *parameters, GDBusMethodInvocation *invocation, gpointer user_data) {
+	if(strequal(method_name, "Launch")) {
+		service_launch(parameters, invocation);
+	} else {
+		g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD, "Unknown method %s", method_name);
+	}
+}
+
+static const GDBusInterfaceVTable service_vtable = {
+	.method_call = service_method_call};
+
+static void bus_acquired(GDBusConnection *connection, const char *name, gpointer user_data) {
+	GError *error = NULL;
+	service.connection = connection;
+	if(!g_dbus_connection_register_object(connection, SERVICE_PATH, service.introspection->interfaces[0], &service_vtable, NULL, NULL, &error)) {
+		g_printerr("Can't register service object: %s\n", error->message);
+		g_error_free(error);
+		service.exit_code = EXIT_FAILURE;
+		g_main_loop_quit(service.loop);
+	}
+}
+
+static void name_lost(GDBusConnection *connection, const char *name, gpointer user_data) {
+	g_printerr("Can't own %s, is another service running?\n", name);
+	service.exit_code = EXIT_FAILURE;
+	g_main_loop_quit(service.loop);
+}
+
+static gpointer load_manifest_thread(gpointer data) {
+	g_hash_table_unref(microlauncher_get_manifest());
+	return NULL;
+}
+
+int microlauncher_service_run(void) {
+	char path[PATH_MAX];
+	service.exit_code = EXIT_SUCCESS;
+	service.introspection = g_dbus_node_info_new_for_xml(SERVICE_XML, NULL);
+	service.loop = g_main_loop_new(NULL, false);
+	for(int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+		g_mutex_init(&service.share_locks[i]);
+	}
+	service.share = curl_share_init();
+	if(service.share) {
+		curl_share_setopt(service.share, CURLSHOPT_LOCKFUNC, share_lock);
+		curl_share_setopt(service.share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+		curl_share_setopt(service.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(service.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+		curl_share_setopt(service.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+	}
+	// Edits from the GUI or by hand are picked up between launches
+	for(const char **name = CONFIG_FILES; *name; name++) {
+		snprintf(path, PATH_MAX, "%s/microlauncher/%s", XDG_DATA_HOME, *name);
+		GFile *file = g_file_new_for_path(path);
+		GFileMonitor *monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE, NULL, NULL);
+		g_object_unref(file);
+		if(monitor) {
+			g_signal_connect(monitor, "changed", G_CALLBACK(config_changed), NULL);
+			service.monitors = g_slist_prepend(service.monitors, monitor);
+		}
+	}
+	guint owner = g_bus_own_name(G_BUS_TYPE_SESSION, SERVICE_NAME, G_BUS_NAME_OWNER_FLAGS_NONE, bus_acquired, NULL, name_lost, NULL, NULL);
+	g_thread_unref(g_thread_new("manifest", load_manifest_thread, NULL));
+	g_main_loop_run(service.loop);
+
+	g_bus_unown_name(owner);
+	g_slist_free_full(service.monitors, g_object_unref);
+	if(service.share) {
+		curl_share_cleanup(service.share);
+	}
+	for(int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+		g_mutex_clear(&service.share_locks[i]);
+	}
+	g_dbus_node_info_unref(service.introspection);
+	g_main_loop_unref(service.loop);
+	return service.exit_code;
+}
+
+bool microlauncher_service_launch(const char *instance, const char *user, GError **error) {
+	GDBusConnection *connection = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+	if(!connection) {
+		return false;
+	}
+	GError *err = NULL;
+	// Downloads may take a while, wait until the game has started
+	GVariant *ret = g_dbus_connection_call_sync(connection, SERVICE_NAME, SERVICE_PATH, SERVICE_INTERFACE, "Launch",
+												g_variant_new("(ss)", instance, user ? user : ""), G_VARIANT_TYPE("(u)"),
+												G_DBUS_CALL_FLAGS_NONE, G_MAXINT, NULL, &err);
+	g_object_unref(connection);
+	if(ret) {
+		g_variant_unref(ret);
+		return true;
+	}
+	if(g_error_matches(err, G_DBUS_ERROR, G_DBUS_ERROR_SERVICE_UNKNOWN) || g_error_matches(err, G_DBUS_ERROR, G_DBUS_ERROR_NAME_HAS_NO_OWNER)) {
+		g_error_free(err);
+		return false;
+	}
+	g_dbus_error_strip_remote_error(err);
+	g_propagate_error(error, err);
+	return false;
+}
+
+bool microlauncher_service_set_activatable(bool activatable) {
+	char path[PATH_MAX];
+	snprintf(path, PATH_MAX, "%s/dbus-1/services/" SERVICE_NAME ".service", XDG_DATA_HOME);
+	if(!activatable) {
+		return g_remove(path) == 0 || access(path, F_OK) != 0;
+	}
+	// Installed next to the launcher
+	char *exec = NULL;
+	if(g_path_is_absolute(EXEC_BINARY)) {
+		char *dir = g_path_get_dirname(EXEC_BINARY);
+		exec = g_build_filename(dir, CLI_BINARY, NULL);
+		free(dir);
+		if(access(exec, X_OK) != 0) {
+			g_clear_pointer(&exec, free);
+		}
+	}
+	if(!exec) {
+		exec = g_find_program_in_path(CLI_BINARY);
+	}
+	if(!exec) {
+		return false;
+	}
+	FILE *fd = fopen_mkdir(path, "wb");
+	if(!fd) {
+		free(exec);
+		return false;
+	}
+	fprintf(fd,
+			"[D-BUS Service]\n"
+			"Name=" SERVICE_NAME "\n"
+			"Exec=%s service\n",
+			exec);
+	fclose(fd);
+	free(exec);
+	return true;
+}
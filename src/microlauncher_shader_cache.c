@@ -0,0 +1,200 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <microlauncher_shader_cache.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <util/util.h>
+
+/* Touched on every launch, its mtime orders caches for trimming */
+#define STAMP_FILE ".last-used"
+/* In the shadercache directory, touched on every trim */
+#define TRIM_STAMP_FILE ".last-trim"
+
+struct CacheEntry {
+	char *path;
+	guint64 size;
+	gint64 last_used;
+};
+
+char *microlauncher_shader_cache_dir(const char *launcher_root, const char *game_dir, const char *gpu_id) {
+	char *key = g_compute_checksum_for_string(G_CHECKSUM_SHA1, game_dir, -1);
+	// Keyed by GPU first, so switching devices doesn't mix up their caches
+	char *gpu = g_strdup(gpu_id && *gpu_id ? gpu_id : "default");
+	g_strdelimit(gpu, "/\\:!", '_');
+	key[16] = '\0';
+	char *path = g_build_filename(launcher_root, "shadercache", gpu, key, NULL);
+	free(gpu);
+	free(key);
+	return path;
+}
+
+static void touch_stamp(const char *cache_dir) {
+	char *path = g_build_filename(cache_dir, STAMP_FILE, NULL);
+	FILE *fd = fopen_mkdir(path, "wb");
+	if(fd) {
+		fclose(fd);
+	}
+	free(path);
+}
+
+char **microlauncher_shader_cache_setenv(char **envp, const char *cache_dir, int budget) {
+	touch_stamp(cache_dir);
+	char *path = g_build_filename(cache_dir, "mesa", NULL);
+	envp = g_environ_setenv(envp, "MESA_SHADER_CACHE_DIR", path, FALSE);
+	free(path);
+	if(budget > 0) {
+		char *size = g_strdup_printf("%dM", budget);
+		envp = g_environ_setenv(envp, "MESA_SHADER_CACHE_MAX_SIZE", size, FALSE);
+		free(size);
+	}
+	path = g_build_filename(cache_dir, "nvidia", NULL);
+	envp = g_environ_setenv(envp, "__GL_SHADER_DISK_CACHE", "1", FALSE);
+	envp = g_environ_setenv(envp, "__GL_SHADER_DISK_CACHE_PATH", path, FALSE);
+	// Size is managed by trimming instead
+	envp = g_environ_setenv(envp, "__GL_SHADER_DISK_CACHE_SKIP_CLEANUP", "1", FALSE);
+	free(path);
+	return envp;
+}
+
+guint64 microlauncher_shader_cache_size(const char *path) {
+	GStatBuf st;
+	if(g_lstat(path, &st) != 0) {
+		return 0;
+	}
+	if(!S_ISDIR(st.st_mode)) {
+#ifdef G_OS_WIN32
+		return st.st_size;
+#else
+		return (guint64)st.st_blocks * 512;
+#endif
+	}
+	guint64 size = 0;
+	GDir *dir = g_dir_open(path, 0, NULL);
+	const char *entry;
+	while(dir && (entry = g_dir_read_name(dir))) {
+		char *child = g_build_filename(path, entry, NULL);
+		size += microlauncher_shader_cache_size(child);
+		free(child);
+	}
+	if(dir) {
+		g_dir_close(dir);
+	}
+	return size;
+}
+
+static gint compare_last_used(gconstpointer a, gconstpointer b) {
+	const struct CacheEntry *ea = a, *eb = b;
+	return (ea->last_used > eb->last_used) - (ea->last_used < eb->last_used);
+}
+
+static void collect_caches(const char *gpu_dir, GSList **caches, guint64 *total) {
+	GDir *dir = g_dir_open(gpu_dir, 0, NULL);
+	const char *entry;
+	while(dir && (entry = g_dir_read_name(dir))) {
+		struct CacheEntry *cache = g_new0(struct CacheEntry, 1);
+		cache->path = g_build_filename(gpu_dir, entry, NULL);
+		char *stamp = g_build_filename(cache->path, STAMP_FILE, NULL);
+		GStatBuf st;
+		cache->last_used = g_stat(stamp, &st) == 0 ? st.st_mtime : 0;
+		free(stamp);
+		cache->size = microlauncher_shader_cache_size(cache->path);
+		*total += cache->size;
+		*caches = g_slist_insert_sorted(*caches, cache, compare_last_used);
+	}
+	if(dir) {
+		g_dir_close(dir);
+	}
+}
+
+static void cache_entry_free(struct CacheEntry *cache) {
+	free(cache->path);
+	free(cache);
+}
+
+/* Caches of root the running processes point Mesa to, games of other launcher processes included */
+static GHashTable *caches_in_use(const char *root) {
+	GHashTable *used = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+#ifdef __linux__
+	const char *var = "MESA_SHADER_CACHE_DIR=";
+	GDir *proc = g_dir_open("/proc", 0, NULL);
+	const char *pid;
+	while(proc && (pid = g_dir_read_name(proc))) {
+		if(!g_ascii_isdigit(*pid)) {
+			continue;
+		}
+		char *path = g_build_filename("/proc", pid, "environ", NULL);
+		char *env = NULL;
+		gsize len = 0;
+		g_file_get_contents(path, &env, &len, NULL);
+		free(path);
+		// Variables are separated by null characters
+		for(gsize i = 0; env && i < len; i += strlen(env + i) + 1) {
+			const char *value = env + i + strlen(var);
+			if(g_str_has_prefix(env + i, var) && path_is_under(value, root)) {
+				g_hash_table_add(used, g_path_get_dirname(value));
+			}
+		}
+		free(env);
+	}
+	if(proc) {
+		g_dir_close(proc);
+	}
+#endif
+	return used;
+}
+
+/* Claims the trim unless another launch did one within SHADER_CACHE_TRIM_INTERVAL */
+static bool trim_due(const char *root) {
+	char *path = g_build_filename(root, TRIM_STAMP_FILE, NULL);
+	GStatBuf st;
+	bool due = g_stat(path, &st) != 0 || g_get_real_time() - (gint64)st.st_mtime * G_TIME_SPAN_SECOND >= SHADER_CACHE_TRIM_INTERVAL;
+	if(due) {
+		FILE *fd = fopen_mkdir(path, "wb");
+		if(fd) {
+			fclose(fd);
+		}
+	}
+	free(path);
+	return due;
+}
+
+bool microlauncher_shader_cache_trim(const char *launcher_root, int budget, const char *keep, guint64 *total) {
+	char *root = g_build_filename(launcher_root, "shadercache", NULL);
+	if(!trim_due(root)) {
+		free(root);
+		return false;
+	}
+	GSList *caches = NULL;
+	*total = 0;
+	GDir *dir = g_dir_open(root, 0, NULL);
+	const char *entry;
+	while(dir && (entry = g_dir_read_name(dir))) {
+		char *gpu_dir = g_build_filename(root, entry, NULL);
+		collect_caches(gpu_dir, &caches, total);
+		free(gpu_dir);
+	}
+	if(dir) {
+		g_dir_close(dir);
+	}
+	guint64 limit = (guint64)budget * 1024 * 1024;
+	GHashTable *used = budget > 0 && *total > limit ? caches_in_use(root) : NULL;
+	for(GSList *node = caches; budget > 0 && node && *total > limit; node = node->next) {
+		struct CacheEntry *cache = node->data;
+		if(strequal(cache->path, keep) || g_hash_table_contains(used, cache->path)) {
+			continue;
+		}
+		g_print("Removing shader cache %s (%" G_GUINT64_FORMAT " MiB)\n", cache->path, cache->size >> 20);
+		if(rmdir_recursive(cache->path, NULL)) {
+			*total -= cache->size;
+		}
+	}
+	if(used) {
+		g_hash_table_destroy(used);
+	}
+	g_slist_free_full(caches, (GDestroyNotify)cache_entry_free);
+	free(root);
+	return true;
+}
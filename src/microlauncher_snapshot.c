@@ -0,0 +1,363 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <microlauncher.h>
+#include <microlauncher_snapshot.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <util/util.h>
+
+struct CloneState {
+	GCancellable *cancellable;
+	GMutex mutex;
+	GCond cond;
+	guint pending;
+	guint64 total_size;
+	guint64 done_size;
+	char *failed_path;
+	struct DownloadStats stats;
+};
+
+struct CloneJob {
+	char *src;
+	char *dest;
+	guint64 size;
+	bool hardlink;
+};
+
+/* Mods, resource packs and shader packs are replaced by updates instead of being written to */
+static bool immutable(const char *name) {
+	return str_ends_with(name, ".jar") || str_ends_with(name, ".zip") || str_ends_with(name, ".litemod");
+}
+
+static bool clone_stopped(struct CloneState *state) {
+	g_mutex_lock(&state->mutex);
+	bool stopped = state->failed_path != NULL;
+	g_mutex_unlock(&state->mutex);
+	return stopped || g_cancellable_is_cancelled(state->cancellable);
+}
+
+static void clone_fail(struct CloneState *state, const char *path) {
+	g_mutex_lock(&state->mutex);
+	if(!state->failed_path) {
+		state->failed_path = g_strdup(path);
+	}
+	g_mutex_unlock(&state->mutex);
+}
+
+static void clone_job(gpointer data, gpointer userdata) {
+	struct CloneJob *job = data;
+	struct CloneState *state = userdata;
+	if(!clone_stopped(state)) {
+		bool ok = job->hardlink ? util_link_or_copy(job->src, job->dest) : util_clone_file(job->src, job->dest);
+		if(!ok) {
+			clone_fail(state, job->src);
+		}
+	}
+	g_mutex_lock(&state->mutex);
+	if(job->hardlink) {
+		state->stats.present++;
+		state->stats.present_size += job->size;
+	} else {
+		state->stats.fetched++;
+		state->stats.fetched_size += job->size;
+	}
+	state->done_size += job->size;
+	state->pending--;
+	g_cond_signal(&state->cond);
+	g_mutex_unlock(&state->mutex);
+	free(job->src);
+	free(job->dest);
+	free(job);
+}
+
+/* Creates directories and symlinks right away, files are handed to pool */
+static void clone_directory(struct CloneState *state, GThreadPool *pool, const char *src, const char *dest) {
+	GDir *dir = g_dir_open(src, 0, NULL);
+	if(!dir) {
+		clone_fail(state, src);
+		return;
+	}
+	const char *name;
+	while(!clone_stopped(state) && (name = g_dir_read_name(dir))) {
+		char *child = g_build_filename(src, name, NULL);
+		char *target = g_build_filename(dest, name, NULL);
+		GStatBuf st;
+		if(g_lstat(child, &st) != 0) {
+			clone_fail(state, child);
+		} else if(S_ISDIR(st.st_mode)) {
+			if(g_mkdir(target, st.st_mode & 0777) != 0) {
+				clone_fail(state, target);
+			} else {
+				clone_directory(state, pool, child, target);
+			}
+#ifndef G_OS_WIN32
+		} else if(S_ISLNK(st.st_mode)) {
+			char *link = g_file_read_link(child, NULL);
+			if(!link || symlink(link, target) != 0) {
+				clone_fail(state, child);
+			}
+			free(link);
+#endif
+		} else if(S_ISREG(st.st_mode)) {
+			struct CloneJob *job = g_new(struct CloneJob, 1);
+			job->src = g_strdup(child);
+			job->dest = g_strdup(target);
+			job->size = st.st_size;
+			job->hardlink = immutable(name);
+			g_mutex_lock(&state->mutex);
+			state->pending++;
+			state->total_size += st.st_size;
+			g_mutex_unlock(&state->mutex);
+			g_thread_pool_push(pool, job, NULL);
+		}
+		free(child);
+		free(target);
+	}
+	g_dir_close(dir);
+}
+
+/* dest must not exist, it is removed again if cloning fails */
+static bool clone_tree(LaunchContext *ctx, const char *src, const char *dest, const char *label) {
+	struct Callbacks callbacks = microlauncher_launch_context_get_callbacks(ctx);
+	char *str;
+	GStatBuf st;
+	if(g_stat(src, &st) != 0 || !S_ISDIR(st.st_mode)) {
+		str = g_strdup_printf("Directory %s doesn't exist", src);
+		run_callback(show_error, str);
+		free(str);
+		return false;
+	}
+	if(g_file_test(dest, G_FILE_TEST_EXISTS)) {
+		str = g_strdup_printf("%s already exists", dest);
+		run_callback(show_error, str);
+		free(str);
+		return false;
+	}
+	char *parent = g_path_get_dirname(dest);
+	g_mkdir_with_parents(parent, 0755);
+	free(parent);
+	if(g_mkdir(dest, st.st_mode & 0777) != 0) {
+		str = g_strdup_printf("Failed to create %s", dest);
+		run_callback(show_error, str);
+		free(str);
+		return false;
+	}
+
+	struct CloneState state = {0};
+	state.cancellable = microlauncher_launch_context_get_cancellable(ctx);
+	g_mutex_init(&state.mutex);
+	g_cond_init(&state.cond);
+	run_callback(stage_update, label);
+	GThreadPool *pool = g_thread_pool_new(clone_job, &state, SNAPSHOT_THREADS, FALSE, NULL);
+	clone_directory(&state, pool, src, dest);
+	// Progress is reported from the calling thread so callbacks don't have to be thread safe
+	g_mutex_lock(&state.mutex);
+	while(state.pending > 0) {
+		g_cond_wait_until(&state.cond, &state.mutex, g_get_monotonic_time() + 100 * G_TIME_SPAN_MILLISECOND);
+		guint64 done_size = state.done_size;
+		guint64 total_size = state.total_size;
+		g_mutex_unlock(&state.mutex);
+		if(total_size > 0) {
+			run_callback(progress_update, (double)done_size / total_size, label);
+		}
+		g_mutex_lock(&state.mutex);
+	}
+	g_mutex_unlock(&state.mutex);
+	g_thread_pool_free(pool, FALSE, TRUE);
+	run_callback(stage_update, NULL);
+	microlauncher_launch_context_add_stats(ctx, &state.stats);
+
+	bool ok = !state.failed_path && !g_cancellable_is_cancelled(state.cancellable);
+	if(state.failed_path) {
+		str = g_strdup_printf("Failed to clone %s", state.failed_path);
+		run_callback(show_error, str);
+		free(str);
+	}
+	if(!ok) {
+		rmdir_recursive(dest, NULL);
+	}
+	free(state.failed_path);
+	g_mutex_clear(&state.mutex);
+	g_cond_clear(&state.cond);
+	return ok;
+}
+
+static char *snapshot_path(MicrolauncherInstance *instance, const char *name) {
+	char *dir = g_strconcat(instance->location, SNAPSHOT_DIR_SUFFIX, NULL);
+	char *path = g_build_filename(dir, name, NULL);
+	free(dir);
+	return path;
+}
+
+/* Names become directories next to the instance */
+static bool snapshot_name_valid(const char *name) {
+	return name && *name && *name != '.' && !strchr(name, '/') && !strchr(name, '\\') && !strchr(name, ':');
+}
+
+static MicrolauncherInstance *context_instance(LaunchContext *ctx) {
+	struct Callbacks callbacks = microlauncher_launch_context_get_callbacks(ctx);
+	MicrolauncherInstance *instance = microlauncher_launch_context_get_instance(ctx);
+	if(!instance || !instance->location) {
+		run_callback(show_error, "Instance has no directory");
+		return NULL;
+	}
+	return instance;
+}
+
+MicrolauncherInstance *microlauncher_snapshot_duplicate(LaunchContext *ctx) {
+	MicrolauncherInstance *instance = context_instance(ctx);
+	if(!instance) {
+		return NULL;
+	}
+	MicrolauncherInstance *copy = microlauncher_instance_clone(instance);
+	char *name = g_strdup_printf("%s (Copy)", instance->name);
+	free(copy->name);
+	copy->name = microlauncher_instance_unique_name(name);
+	free(name);
+	char *location = g_strdup_printf("%s-copy", instance->location);
+	for(int i = 2; g_file_test(location, G_FILE_TEST_EXISTS); i++) {
+		free(location);
+		location = g_strdup_printf("%s-copy-%d", instance->location, i);
+	}
+	free(copy->location);
+	copy->location = location;
+	if(instance->icon && g_str_has_prefix(instance->icon, instance->location)) {
+		free(copy->icon);
+		copy->icon = g_strconcat(copy->location, instance->icon + strlen(instance->location), NULL);
+	}
+	if(!clone_tree(ctx, instance->location, copy->location, "Duplicating instance")) {
+		g_object_unref(copy);
+		return NULL;
+	}
+	return copy;
+}
+
+char *microlauncher_snapshot_create(LaunchContext *ctx, const char *name) {
+	struct Callbacks callbacks = microlauncher_launch_context_get_callbacks(ctx);
+	MicrolauncherInstance *instance = context_instance(ctx);
+	if(!instance) {
+		return NULL;
+	}
+	char *snapshot;
+	if(name) {
+		snapshot = g_strdup(name);
+	} else {
+		GDateTime *now = g_date_time_new_now_local();
+		snapshot = g_date_time_format(now, "%Y-%m-%d %H-%M-%S");
+		g_date_time_unref(now);
+	}
+	if(!snapshot_name_valid(snapshot)) {
+		run_callback(show_error, "Invalid snapshot name");
+		free(snapshot);
+		return NULL;
+	}
+	char *path = snapshot_path(instance, snapshot);
+	bool ok = clone_tree(ctx, instance->location, path, "Taking snapshot");
+	free(path);
+	if(!ok) {
+		free(snapshot);
+		return NULL;
+	}
+	return snapshot;
+}
+
+static gint compare_mtime(gconstpointer a, gconstpointer b, gpointer userdata) {
+	GHashTable *mtimes = userdata;
+	gint64 ma = GPOINTER_TO_SIZE(g_hash_table_lookup(mtimes, *(char **)a));
+	gint64 mb = GPOINTER_TO_SIZE(g_hash_table_lookup(mtimes, *(char **)b));
+	return ma < mb ? -1 : ma > mb ? 1 : g_strcmp0(*(char **)a, *(char **)b);
+}
+
+char **microlauncher_snapshot_list(MicrolauncherInstance *instance) {
+	GPtrArray *names = g_ptr_array_new();
+	GHashTable *mtimes = g_hash_table_new(g_str_hash, g_str_equal);
+	char *dir_path = g_strconcat(instance->location, SNAPSHOT_DIR_SUFFIX, NULL);
+	GDir *dir = instance->location ? g_dir_open(dir_path, 0, NULL) : NULL;
+	const char *name;
+	while(dir && (name = g_dir_read_name(dir))) {
+		char *path = g_build_filename(dir_path, name, NULL);
+		GStatBuf st;
+		if(g_stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+			char *copy = g_strdup(name);
+			g_ptr_array_add(names, copy);
+			g_hash_table_insert(mtimes, copy, GSIZE_TO_POINTER(st.st_mtime));
+		}
+		free(path);
+	}
+	if(dir) {
+		g_dir_close(dir);
+	}
+	free(dir_path);
+	g_ptr_array_sort_with_data(names, compare_mtime, mtimes);
+	g_hash_table_destroy(mtimes);
+	g_ptr_array_add(names, NULL);
+	return (char **)g_ptr_array_free(names, FALSE);
+}
+
+/* The snapshot is cloned beside the instance directory first, so the swap itself is two renames */
+bool microlauncher_snapshot_restore(LaunchContext *ctx, const char *name) {
+	struct Callbacks callbacks = microlauncher_launch_context_get_callbacks(ctx);
+	MicrolauncherInstance *instance = context_instance(ctx);
+	if(!instance) {
+		return false;
+	}
+	if(!snapshot_name_valid(name)) {
+		run_callback(show_error, "Invalid snapshot name");
+		return false;
+	}
+	char *path = snapshot_path(instance, name);
+	char *restored = g_strdup_printf("%s.restore-%08x", instance->location, g_random_int());
+	bool ok = clone_tree(ctx, path, restored, "Restoring snapshot");
+	free(path);
+	if(!ok) {
+		free(restored);
+		return false;
+	}
+	char *old = g_strdup_printf("%s.old-%08x", instance->location, g_random_int());
+	bool moved = g_file_test(instance->location, G_FILE_TEST_EXISTS);
+	if(moved && g_rename(instance->location, old) != 0) {
+		ok = false;
+	} else if(g_rename(restored, instance->location) != 0) {
+		if(moved) {
+			g_rename(old, instance->location);
+		}
+		ok = false;
+	}
+	if(ok) {
+		rmdir_recursive(old, NULL);
+	} else {
+		char *str = g_strdup_printf("Failed to replace %s", instance->location);
+		run_callback(show_error, str);
+		free(str);
+		rmdir_recursive(restored, NULL);
+	}
+	free(old);
+	free(restored);
+	return ok;
+}
+
+bool microlauncher_snapshot_delete(LaunchContext *ctx, const char *name) {
+	struct Callbacks callbacks = microlauncher_launch_context_get_callbacks(ctx);
+	MicrolauncherInstance *instance = context_instance(ctx);
+	if(!instance) {
+		return false;
+	}
+	if(!snapshot_name_valid(name)) {
+		run_callback(show_error, "Invalid snapshot name");
+		return false;
+	}
+	char *path = snapshot_path(instance, name);
+	GError *error = NULL;
+	bool ok = g_file_test(path, G_FILE_TEST_IS_DIR) && rmdir_recursive(path, &error);
+	if(!ok) {
+		char *str = g_strdup_printf("Failed to delete snapshot %s: %s", name, error ? error->message : "doesn't exist");
+		run_callback(show_error, str);
+		free(str);
+	}
+	g_clear_error(&error);
+	free(path);
+	return ok;
+}
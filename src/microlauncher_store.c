@@ -0,0 +1,49 @@
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <microlauncher_store.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/util.h>
+#include <util/xdgutil.h>
+
+char *microlauncher_store_get_dir(void) {
+	return g_build_filename(XDG_DATA_HOME, STORE_DIR, NULL);
+}
+
+char *microlauncher_store_object_path(const char *sha1) {
+	char prefix[3] = {sha1[0], sha1[1], '\0'};
+	return g_build_filename(XDG_DATA_HOME, STORE_DIR, "objects", prefix, sha1, NULL);
+}
+
+/* Links src to a temporary name next to dest and renames it, so dest is either missing or complete */
+static bool publish(const char *src, const char *dest) {
+	char *tmp_path = g_strdup_printf("%s.%08x.part", dest, g_random_int());
+	bool ok = util_link_or_copy(src, tmp_path) && g_rename(tmp_path, dest) == 0;
+	if(!ok) {
+		g_remove(tmp_path);
+	}
+	free(tmp_path);
+	return ok;
+}
+
+bool microlauncher_store_materialize(const char *sha1, const char *dest) {
+	if(!sha1 || strlen(sha1) != SHA_DIGEST_LENGTH * 2) {
+		return false;
+	}
+	char *object = microlauncher_store_object_path(sha1);
+	bool ok = g_file_test(object, G_FILE_TEST_IS_REGULAR) && publish(object, dest);
+	free(object);
+	return ok;
+}
+
+void microlauncher_store_add(const char *path, const char *sha1) {
+	if(!sha1 || strlen(sha1) != SHA_DIGEST_LENGTH * 2) {
+		return;
+	}
+	char *object = microlauncher_store_object_path(sha1);
+	if(!g_file_test(object, G_FILE_TEST_EXISTS)) {
+		publish(path, object);
+	}
+	free(object);
+}
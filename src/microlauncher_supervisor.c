@@ -0,0 +1,165 @@
+#include <glib.h>
+#include <microlauncher_supervisor.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#ifdef G_OS_UNIX
+#include <glib-unix.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef SYS_pidfd_send_signal
+#define SYS_pidfd_send_signal 424
+#endif
+#endif
+#ifdef G_OS_WIN32
+#include <windows.h>
+#endif
+
+struct _ChildWatch {
+	GPid pid;
+	int pidfd;
+	guint source;
+	guint kill_timeout;
+	bool terminating;
+	ChildExitFunc func;
+	void *userdata;
+};
+
+#ifdef __linux__
+// Not all libc versions have wrappers for these
+static int sys_pidfd_open(pid_t pid) {
+	return syscall(SYS_pidfd_open, pid, 0);
+}
+
+static int sys_pidfd_send_signal(int pidfd, int sig) {
+	return syscall(SYS_pidfd_send_signal, pidfd, sig, NULL, 0);
+}
+#endif
+
+static void watch_finish(ChildWatch *watch, const struct ExitStatus *status) {
+	if(watch->kill_timeout) {
+		g_source_remove(watch->kill_timeout);
+	}
+	watch->func(watch->pid, status, watch->userdata);
+#ifdef G_OS_WIN32
+	g_spawn_close_pid(watch->pid);
+#else
+	if(watch->pidfd >= 0) {
+		close(watch->pidfd);
+	}
+#endif
+	free(watch);
+}
+
+#ifdef __linux__
+static gboolean pidfd_ready(gint fd, GIOCondition condition, gpointer data) {
+	ChildWatch *watch = data;
+	siginfo_t info = {0};
+	struct ExitStatus status = {0};
+	if(waitid(P_PID, watch->pid, &info, WEXITED | WNOHANG) == 0) {
+		if(info.si_pid == 0) {
+			return G_SOURCE_CONTINUE; /* not exited yet */
+		}
+		status.exited = info.si_code == CLD_EXITED;
+		status.code = status.exited ? info.si_status : 0;
+		status.signal = status.exited ? 0 : info.si_status;
+		status.core_dumped = info.si_code == CLD_DUMPED;
+	}
+	watch->source = 0;
+	watch_finish(watch, &status);
+	return G_SOURCE_REMOVE;
+}
+#endif
+
+static void child_watch_ready(GPid pid, gint wait_status, gpointer data) {
+	ChildWatch *watch = data;
+	struct ExitStatus status = {0};
+#ifdef G_OS_WIN32
+	status.exited = true;
+	status.code = wait_status;
+#else
+	if(WIFEXITED(wait_status)) {
+		status.exited = true;
+		status.code = WEXITSTATUS(wait_status);
+	} else if(WIFSIGNALED(wait_status)) {
+		status.signal = WTERMSIG(wait_status);
+#ifdef WCOREDUMP
+		status.core_dumped = WCOREDUMP(wait_status);
+#endif
+	}
+#endif
+	watch->source = 0;
+	watch_finish(watch, &status);
+}
+
+ChildWatch *microlauncher_supervisor_watch(GPid pid, ChildExitFunc func, void *userdata) {
+	ChildWatch *watch = g_new0(ChildWatch, 1);
+	watch->pid = pid;
+	watch->pidfd = -1;
+	watch->func = func;
+	watch->userdata = userdata;
+#ifdef __linux__
+	// Child isn't reaped until we do it, so pid can't be reused before pidfd is open
+	watch->pidfd = sys_pidfd_open(pid);
+	if(watch->pidfd >= 0) {
+		watch->source = g_unix_fd_add(watch->pidfd, G_IO_IN, pidfd_ready, watch);
+		return watch;
+	}
+#endif
+	// Kernel without pidfd or other platforms, this doesn't need a thread either
+	watch->source = g_child_watch_add(pid, child_watch_ready, watch);
+	return watch;
+}
+
+GPid microlauncher_supervisor_get_pid(ChildWatch *watch) {
+	return watch->pid;
+}
+
+static void watch_signal(ChildWatch *watch, int sig) {
+#ifdef G_OS_WIN32
+	TerminateProcess(watch->pid, 1);
+#else
+#ifdef __linux__
+	if(watch->pidfd >= 0) {
+		sys_pidfd_send_signal(watch->pidfd, sig);
+		return;
+	}
+#endif
+	// Reaped only right before our callback on this context, so pid is still ours
+	kill(watch->pid, sig);
+#endif
+}
+
+#ifndef G_OS_WIN32
+static gboolean kill_timeout(gpointer data) {
+	ChildWatch *watch = data;
+	watch->kill_timeout = 0;
+	g_print("Process didn't exit in %d seconds, killing\n", SUPERVISOR_TERM_TIMEOUT);
+	watch_signal(watch, SIGKILL);
+	return G_SOURCE_REMOVE;
+}
+#endif
+
+void microlauncher_supervisor_terminate(ChildWatch *watch) {
+#ifdef G_OS_WIN32
+	watch_signal(watch, 0);
+#else
+	if(watch->terminating) {
+		if(watch->kill_timeout) {
+			g_source_remove(watch->kill_timeout);
+			watch->kill_timeout = 0;
+		}
+		watch_signal(watch, SIGKILL);
+		return;
+	}
+	watch->terminating = true;
+	watch_signal(watch, SIGTERM);
+	watch->kill_timeout = g_timeout_add_seconds(SUPERVISOR_TERM_TIMEOUT, kill_timeout, watch);
+#endif
+}
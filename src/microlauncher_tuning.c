@@ -0,0 +1,207 @@
+#include <glib.h>
+#include <microlauncher_tuning.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/util.h>
+
+#define MIB (1024L * 1024L)
+
+const char *const TUNING_PROFILE_NAMES[TUNING_N] = {
+	[TUNING_OFF] = "off",
+	[TUNING_BALANCED] = "balanced",
+	[TUNING_LOW_LATENCY] = "low-latency",
+	[TUNING_LOW_MEMORY] = "low-memory"};
+
+const char *const TUNING_PROFILE_LABELS[TUNING_N + 1] = {
+	[TUNING_OFF] = "Off",
+	[TUNING_BALANCED] = "Balanced",
+	[TUNING_LOW_LATENCY] = "Low latency",
+	[TUNING_LOW_MEMORY] = "Low memory",
+	[TUNING_N] = NULL};
+
+enum TuningProfile tuning_profile_from_name(const char *name) {
+	if(!name) {
+		return TUNING_OFF;
+	}
+	for(int i = 0; i < TUNING_N; i++) {
+		if(strequal(TUNING_PROFILE_NAMES[i], name)) {
+			return i;
+		}
+	}
+	return TUNING_OFF;
+}
+
+static int count_mods(const char *gameDir) {
+	int n = 0;
+	char *path = g_build_filename(gameDir, "mods", NULL);
+	GDir *dir = g_dir_open(path, 0, NULL);
+	const char *entry;
+	while(dir && (entry = g_dir_read_name(dir))) {
+		if(str_ends_with(entry, ".jar")) {
+			n++;
+		}
+	}
+	if(dir) {
+		g_dir_close(dir);
+	}
+	free(path);
+	return n;
+}
+
+static bool transparent_hugepages_available(void) {
+#ifdef __linux__
+	char *str = read_file_as_string("/sys/kernel/mm/transparent_hugepage/enabled");
+	if(!str) {
+		return false;
+	}
+	// Active mode is bracketed, e.g. "always [madvise] never"
+	bool available = strstr(str, "[always]") || strstr(str, "[madvise]");
+	free(str);
+	return available;
+#else
+	return false;
+#endif
+}
+
+/* Name of the option used to detect whether user already set it: "Xmx" for -Xmx4G, "UseG1GC" for -XX:+UseG1GC */
+static const char *option_name(const char *arg, char *buf, size_t n) {
+	if(strncmp(arg, "-XX:", 4) == 0) {
+		arg += 4;
+		if(*arg == '+' || *arg == '-') {
+			arg++;
+		}
+		snprintf(buf, n, "%s", arg);
+		char *eq = strchr(buf, '=');
+		if(eq) {
+			*eq = '\0';
+		}
+	} else if(strncmp(arg, "-Xm", 3) == 0 || strncmp(arg, "-Xss", 4) == 0) {
+		snprintf(buf, n, "%.3s", arg + 1);
+	} else {
+		snprintf(buf, n, "%s", arg);
+	}
+	return buf;
+}
+
+static bool user_sets_option(GSList *userArgs, const char *arg) {
+	char name[128], userName[128];
+	option_name(arg, name, sizeof(name));
+	for(GSList *node = userArgs; node; node = node->next) {
+		if(strequal(option_name(node->data, userName, sizeof(userName)), name)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool user_sets_gc(GSList *userArgs) {
+	for(GSList *node = userArgs; node; node = node->next) {
+		const char *arg = node->data;
+		if(strncmp(arg, "-XX:+Use", 8) == 0 && str_ends_with(arg, "GC")) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static long get_heap_size(enum TuningProfile profile, int mods) {
+	long total = util_get_total_memory() / MIB;
+	long heap, max;
+	if(total <= 0) {
+		return 0;
+	}
+	switch(profile) {
+		case TUNING_LOW_MEMORY:
+			heap = 1024 + mods * 24;
+			max = total / 4;
+			break;
+		case TUNING_LOW_LATENCY:
+			// Concurrent collectors need headroom to run without stalling allocation
+			heap = 3072 + mods * 48;
+			max = total / 2;
+			break;
+		default:
+			heap = 2048 + mods * 40;
+			max = total / 2;
+			break;
+	}
+	heap = MIN(heap, MIN(max, 16384));
+	heap = MAX(heap, 512);
+	return heap - heap % 256;
+}
+
+int microlauncher_tuning_get_args(enum TuningProfile profile, int javaMajor, const char *vmName, const char *gameDir, GSList *userArgs, char **argv, char **str_to_free) {
+	if(profile == TUNING_OFF) {
+		return 0;
+	}
+	const char *args[32];
+	char xmx[32], xms[32];
+	int n = 0;
+	int mods = count_mods(gameDir);
+	long heap = get_heap_size(profile, mods);
+	bool hotspot = !vmName || !strstr(vmName, "OpenJ9");
+	// Xms above a user's Xmx stops the JVM, so the heap is left alone entirely if either is set
+	bool userHeap = user_sets_option(userArgs, "-Xmx") || user_sets_option(userArgs, "-Xms");
+	if(heap > 0 && !userHeap) {
+		snprintf(xmx, sizeof(xmx), "-Xmx%ldM", heap);
+		args[n++] = xmx;
+		// A full initial heap is committed at start, only worth it when pauses matter more than memory
+		if(profile == TUNING_LOW_LATENCY) {
+			snprintf(xms, sizeof(xms), "-Xms%ldM", heap);
+			args[n++] = xms;
+		} else {
+			args[n++] = "-Xms512M";
+		}
+	}
+	if(hotspot && !user_sets_gc(userArgs)) {
+		if(profile == TUNING_LOW_LATENCY && javaMajor >= 15) {
+			args[n++] = "-XX:+UseZGC";
+			// Generational mode is default since 23 and the flag is obsolete afterwards
+			if(javaMajor >= 21 && javaMajor < 23) {
+				args[n++] = "-XX:+ZGenerational";
+			}
+		} else {
+			args[n++] = "-XX:+UseG1GC";
+			args[n++] = "-XX:+ParallelRefProcEnabled";
+			args[n++] = profile == TUNING_LOW_LATENCY ? "-XX:MaxGCPauseMillis=50" : "-XX:MaxGCPauseMillis=200";
+			if(profile == TUNING_LOW_MEMORY) {
+				args[n++] = "-XX:MinHeapFreeRatio=10";
+				args[n++] = "-XX:MaxHeapFreeRatio=30";
+				if(javaMajor >= 12) {
+					// Return unused heap to the OS while idle
+					args[n++] = "-XX:G1PeriodicGCInterval=15000";
+				}
+			} else {
+				args[n++] = "-XX:+UnlockExperimentalVMOptions";
+				args[n++] = "-XX:G1NewSizePercent=30";
+				args[n++] = "-XX:G1MaxNewSizePercent=40";
+				args[n++] = "-XX:G1HeapRegionSize=8M";
+				args[n++] = "-XX:G1ReservePercent=20";
+				args[n++] = "-XX:InitiatingHeapOccupancyPercent=15";
+			}
+		}
+	}
+	if(hotspot) {
+		args[n++] = "-XX:+DisableExplicitGC";
+		if(profile == TUNING_LOW_LATENCY) {
+			// Touches the whole heap at start, which delays startup and keeps it resident
+			args[n++] = "-XX:+AlwaysPreTouch";
+		}
+		if(profile != TUNING_LOW_MEMORY && transparent_hugepages_available()) {
+			args[n++] = "-XX:+UseTransparentHugePages";
+		}
+	}
+	g_print("JVM tuning: %s, %d mods, heap %ldM\n", TUNING_PROFILE_NAMES[profile], mods, heap);
+
+	int j = 0;
+	for(int i = 0; i < n; i++) {
+		if(user_sets_option(userArgs, args[i])) {
+			continue;
+		}
+		argv[j] = str_to_free[j] = g_strdup(args[i]);
+		j++;
+	}
+	return j;
+}
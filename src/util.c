@@ -1,11 +1,24 @@
+#define _GNU_SOURCE /* copy_file_range */
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #ifdef G_OS_UNIX
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <errno.h>
+#include <sys/file.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <uuid/uuid.h>
+
+extern char **environ;
+#endif
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
 #endif
 #ifdef G_OS_WIN32
 #include <processthreadsapi.h>
@@ -14,6 +27,7 @@
 #endif
 #include <openssl/sha.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <util/util.h>
 #include <zip.h>
@@ -208,7 +222,8 @@ gboolean rmdir_recursive(const gchar *path, GError **error) {
 	while((entry = g_dir_read_name(dir))) {
 		gchar *full_path = g_build_filename(path, entry, NULL);
 
-		if(g_file_test(full_path, G_FILE_TEST_IS_DIR)) {
+		// Symlinked directories are removed as links, their contents aren't ours
+		if(g_file_test(full_path, G_FILE_TEST_IS_DIR) && !g_file_test(full_path, G_FILE_TEST_IS_SYMLINK)) {
 			if(!rmdir_recursive(full_path, error)) {
 				ok = FALSE;
 			}
@@ -329,6 +344,19 @@ bool str_ends_with(const char *str, const char *suffix) {
 	return strncmp(str + lenstr - lensuffix, suffix, lensuffix) == 0;
 }
 
+bool path_is_under(const char *path, const char *dir) {
+	if(!path || !dir)
+		return false;
+	size_t len = strlen(dir);
+	while(len > 0 && G_IS_DIR_SEPARATOR(dir[len - 1])) {
+		len--;
+	}
+	// Only the root itself ends up empty
+	if(len == 0)
+		return dir[0] != '\0' && G_IS_DIR_SEPARATOR(path[0]);
+	return strncmp(path, dir, len) == 0 && (path[len] == '\0' || G_IS_DIR_SEPARATOR(path[len]));
+}
+
 int strsplit(char *src, char delim, char **dest, int max) {
 	char *s;
 	char *str = src;
@@ -475,6 +503,145 @@ void extract_zip(const char *sourcepath, const char *destpath, const char **excl
 	}
 }
 
+bool util_copy_file(const char *src, const char *dest) {
+	char buf[BUFSIZ];
+	size_t n;
+	bool ok = true;
+	FILE *in = fopen(src, "rb");
+	if(!in) {
+		return false;
+	}
+	FILE *out = fopen_mkdir(dest, "wb");
+	if(!out) {
+		fclose(in);
+		return false;
+	}
+	while((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+		if(fwrite(buf, 1, n, out) != n) {
+			ok = false;
+			break;
+		}
+	}
+	fclose(in);
+	fclose(out);
+#ifndef G_OS_WIN32
+	struct stat st;
+	if(ok && stat(src, &st) == 0) {
+		chmod(dest, st.st_mode & 0777);
+	}
+#endif
+	return ok;
+}
+
+bool util_clone_file(const char *src, const char *dest) {
+#ifdef __linux__
+	int in = open(src, O_RDONLY | O_CLOEXEC);
+	if(in >= 0) {
+		gchar *dirname = g_path_get_dirname(dest);
+		g_mkdir_with_parents(dirname, 0775);
+		g_free(dirname);
+		int out = open(dest, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		bool ok = out >= 0 && ioctl(out, FICLONE, in) == 0;
+		struct stat st, outSt;
+		if(!ok && out >= 0 && fstat(in, &st) == 0) {
+			// Copied by the kernel without going through userspace, NFS and CIFS copy on the server
+			ssize_t n;
+			while((n = copy_file_range(in, NULL, out, NULL, 1 << 30, 0)) > 0)
+				;
+			ok = n == 0 && fstat(out, &outSt) == 0 && outSt.st_size == st.st_size;
+		}
+		if(ok && fstat(in, &st) == 0) {
+			fchmod(out, st.st_mode & 0777);
+		}
+		if(out >= 0) {
+			close(out);
+		}
+		close(in);
+		if(ok) {
+			return true;
+		}
+	}
+#endif
+	/* Filesystem can't share extents */
+	return util_copy_file(src, dest);
+}
+
+static int lock_path_flags(const char *lock_path, bool wait, bool *busy) {
+#ifdef G_OS_UNIX
+	gchar *dirname = g_path_get_dirname(lock_path);
+	g_mkdir_with_parents(dirname, 0775);
+	g_free(dirname);
+	while(true) {
+		int fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0664);
+		if(fd < 0) {
+			return -1;
+		}
+		if(flock(fd, wait ? LOCK_EX : LOCK_EX | LOCK_NB) != 0) {
+			*busy = errno == EWOULDBLOCK;
+			close(fd);
+			return -1;
+		}
+		// The previous holder unlinks the file on release, the lock is only ours if the path still leads to it
+		struct stat fdSt, pathSt;
+		if(fstat(fd, &fdSt) == 0 && stat(lock_path, &pathSt) == 0 && fdSt.st_dev == pathSt.st_dev && fdSt.st_ino == pathSt.st_ino) {
+			return fd;
+		}
+		close(fd);
+	}
+#else
+	return -1;
+#endif
+}
+
+int util_lock_path(const char *lock_path) {
+	bool busy = false;
+	return lock_path_flags(lock_path, true, &busy);
+}
+
+bool util_try_lock_path(const char *lock_path, int *fd) {
+	bool busy = false;
+	*fd = lock_path_flags(lock_path, false, &busy);
+	return !busy;
+}
+
+void util_unlock_path(int fd, const char *lock_path) {
+#ifdef G_OS_UNIX
+	if(fd < 0) {
+		return;
+	}
+	unlink(lock_path);
+	close(fd);
+#endif
+}
+
+bool util_link_or_copy(const char *src, const char *dest) {
+	GStatBuf srcSt, destSt;
+	if(g_stat(src, &srcSt) != 0) {
+		return false;
+	}
+	if(g_stat(dest, &destSt) == 0) {
+		if(srcSt.st_dev == destSt.st_dev && srcSt.st_ino == destSt.st_ino) {
+			return true; /* already linked */
+		}
+		g_remove(dest);
+	} else {
+		gchar *dirname = g_path_get_dirname(dest);
+		g_mkdir_with_parents(dirname, 0775);
+		g_free(dirname);
+	}
+#ifdef G_OS_WIN32
+	if(CreateHardLinkA(dest, src, NULL)) {
+		return true;
+	}
+#else
+	if(link(src, dest) == 0) {
+		return true;
+	}
+#endif
+	/* Different filesystem or no hardlink support */
+	return util_clone_file(src, dest);
+}
+
 char *get_escaped_command(char *const *cmdline) {
 	String str = string_new(NULL);
 	bool toquote;
@@ -532,6 +699,265 @@ char **get_commandv(char *cmdline) {
 	return heap;
 }
 
+#ifdef G_OS_UNIX
+#if defined(__linux__) && defined(SYS_close_range) && !defined(CLOSE_RANGE_CLOEXEC)
+#define CLOSE_RANGE_CLOEXEC (1U << 2)
+#endif
+
+/* Marks fds from first to last close-on-exec in the child, only syscalls since it may share our memory */
+static void cloexec_range(int first, int last, long max_fd) {
+#if defined(__linux__) && defined(SYS_close_range)
+	// Kernels before 5.9 don't have close_range, 5.11 added the flag
+	if(syscall(SYS_close_range, (unsigned int)first, (unsigned int)last, CLOSE_RANGE_CLOEXEC) == 0) {
+		return;
+	}
+#endif
+	for(int fd = first; fd <= last && fd < max_fd; fd++) {
+		int flags = fcntl(fd, F_GETFD);
+		if(flags != -1 && !(flags & FD_CLOEXEC)) {
+			fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+		}
+	}
+}
+
+/* Called in the child, which has its own descriptor table, so the flags of ours stay as they are */
+static void cloexec_except(const int *keep_fds, long max_fd) {
+	int first = STDERR_FILENO + 1;
+	for(;;) {
+		// Lowest kept fd not below first, the list is short and unsorted
+		int next = -1;
+		for(const int *keep_fd = keep_fds; keep_fd && *keep_fd >= 0; keep_fd++) {
+			if(*keep_fd >= first && (next < 0 || *keep_fd < next)) {
+				next = *keep_fd;
+			}
+		}
+		if(next < 0) {
+			cloexec_range(first, G_MAXINT, max_fd);
+			break;
+		}
+		if(next > first) {
+			cloexec_range(first, next - 1, max_fd);
+		}
+		int flags = fcntl(next, F_GETFD);
+		if(flags != -1) {
+			fcntl(next, F_SETFD, flags & ~FD_CLOEXEC);
+		}
+		first = next + 1;
+	}
+}
+
+#if defined(__linux__) && defined(SYS_clone3)
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+/* struct clone_args of linux/sched.h, up to the cgroup member */
+struct CloneArgs {
+	guint64 flags;
+	guint64 pidfd;
+	guint64 child_tid;
+	guint64 parent_tid;
+	guint64 exit_signal;
+	guint64 stack;
+	guint64 stack_size;
+	guint64 tls;
+	guint64 set_tid;
+	guint64 set_tid_size;
+	guint64 cgroup;
+};
+#endif
+
+/* Forks with the child already in the cgroup at cgroup_fd, so nothing it starts can escape it */
+static pid_t fork_into(int cgroup_fd) {
+#if defined(__linux__) && defined(SYS_clone3)
+	if(cgroup_fd >= 0) {
+		struct CloneArgs args = {0};
+		args.flags = CLONE_INTO_CGROUP;
+		args.exit_signal = SIGCHLD;
+		args.cgroup = cgroup_fd;
+		pid_t pid = syscall(SYS_clone3, &args, sizeof(args));
+		// Kernels before 5.7 don't know clone3 or CLONE_INTO_CGROUP
+		if(pid >= 0 || (errno != ENOSYS && errno != E2BIG && errno != EINVAL)) {
+			return pid;
+		}
+	}
+#endif
+	return fork();
+}
+
+/* For what posix_spawn can't do: umask, and chdir, cgroups or closing fds on older libcs.
+ * Without a cgroup the child shares our memory until it execs, like posix_spawn does on Linux */
+static GPid spawn_fork(char *const *argv, const struct SpawnOptions *opts, char *const *envp, int cgroup_fd) {
+	long max_fd = sysconf(_SC_OPEN_MAX);
+#ifdef __linux__
+	// None of our signal handlers may run in the child while it shares our memory
+	sigset_t all, old;
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	GPid pid = cgroup_fd < 0 ? vfork() : fork_into(cgroup_fd);
+#else
+	GPid pid = fork_into(cgroup_fd);
+#endif
+	if(pid == 0) {
+		// Same as the signal attributes of posix_spawn below, handlers don't survive exec anyway
+		struct sigaction sa;
+		for(int sig = 1; sig < NSIG; sig++) {
+			if(sigaction(sig, NULL, &sa) == 0 && sa.sa_handler != SIG_DFL && sa.sa_handler != SIG_IGN) {
+				signal(sig, SIG_DFL);
+			}
+		}
+		int sigdefault[] = {SIGPIPE, SIGCHLD, SIGINT, SIGTERM, SIGHUP};
+		for(size_t i = 0; i < G_N_ELEMENTS(sigdefault); i++) {
+			signal(sigdefault[i], SIG_DFL);
+		}
+		sigset_t sigmask;
+		sigemptyset(&sigmask);
+		sigprocmask(SIG_SETMASK, &sigmask, NULL);
+		if(opts->stdout_fd >= 0) {
+			dup2(opts->stdout_fd, STDOUT_FILENO);
+		}
+		if(opts->stderr_fd >= 0) {
+			dup2(opts->stderr_fd, STDERR_FILENO);
+		}
+		if(opts->dir && chdir(opts->dir) != 0) {
+			_exit(EXIT_FAILURE);
+		}
+		if(opts->umask >= 0) {
+			umask(opts->umask);
+		}
+		cloexec_except(opts->keep_fds, max_fd > 0 ? max_fd : 1024);
+#ifdef __linux__
+		execvpe(argv[0], argv, (char **)envp);
+#else
+		environ = (char **)envp;
+		execvp(argv[0], argv);
+#endif
+		_exit(EXIT_FAILURE);
+	}
+#ifdef __linux__
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+#endif
+	return pid == -1 ? 0 : pid;
+}
+#endif
+
+GPid util_spawn(char *const *argv, const struct SpawnOptions *opts) {
+#ifndef G_OS_WIN32
+	char *const *envp = opts->envp ? opts->envp : environ;
+	int cgroup_fd = -1;
+#ifdef __linux__
+	if(opts->cgroup) {
+		cgroup_fd = open(opts->cgroup, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	}
+#ifndef POSIX_SPAWN_SETCGROUP
+	// posix_spawn of older glibc can't place the child in a cgroup
+	if(cgroup_fd >= 0) {
+		GPid pid = spawn_fork(argv, opts, envp, cgroup_fd);
+		close(cgroup_fd);
+		return pid;
+	}
+#endif
+#endif
+	// posix_spawn has no umask action, changing ours around it would affect other threads
+	bool use_fork = opts->umask >= 0;
+#ifndef HAVE_POSIX_SPAWN_CHDIR
+	use_fork = use_fork || opts->dir;
+#endif
+#ifndef POSIX_SPAWN_CLOEXEC_DEFAULT
+#ifdef HAVE_POSIX_SPAWN_CLOSEFROM
+	// closefrom can't leave kept fds open
+	use_fork = use_fork || (opts->keep_fds && opts->keep_fds[0] >= 0);
+#else
+	use_fork = true;
+#endif
+#endif
+	if(use_fork) {
+		GPid pid = spawn_fork(argv, opts, envp, cgroup_fd);
+		if(cgroup_fd >= 0) {
+			close(cgroup_fd);
+		}
+		return pid;
+	}
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	sigset_t sigmask, sigdefault;
+	short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawnattr_init(&attr);
+
+	// Signal mask and ignored signals survive exec, don't pass ours to the game
+	sigemptyset(&sigmask);
+	posix_spawnattr_setsigmask(&attr, &sigmask);
+	sigemptyset(&sigdefault);
+	sigaddset(&sigdefault, SIGPIPE);
+	sigaddset(&sigdefault, SIGCHLD);
+	sigaddset(&sigdefault, SIGINT);
+	sigaddset(&sigdefault, SIGTERM);
+	sigaddset(&sigdefault, SIGHUP);
+	posix_spawnattr_setsigdefault(&attr, &sigdefault);
+
+	if(opts->stdout_fd >= 0) {
+		posix_spawn_file_actions_adddup2(&actions, opts->stdout_fd, STDOUT_FILENO);
+	}
+	if(opts->stderr_fd >= 0) {
+		posix_spawn_file_actions_adddup2(&actions, opts->stderr_fd, STDERR_FILENO);
+	}
+#ifdef HAVE_POSIX_SPAWN_CHDIR
+	if(opts->dir) {
+		posix_spawn_file_actions_addchdir_np(&actions, opts->dir);
+	}
+#endif
+#ifdef POSIX_SPAWN_CLOEXEC_DEFAULT
+	flags |= POSIX_SPAWN_CLOEXEC_DEFAULT;
+	for(int fd = STDIN_FILENO; fd <= STDERR_FILENO; fd++) {
+		posix_spawn_file_actions_addinherit_np(&actions, fd);
+	}
+	for(const int *keep_fd = opts->keep_fds; keep_fd && *keep_fd >= 0; keep_fd++) {
+		posix_spawn_file_actions_addinherit_np(&actions, *keep_fd);
+	}
+#elif defined(HAVE_POSIX_SPAWN_CLOSEFROM)
+	posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+#endif
+#ifdef POSIX_SPAWN_SETCGROUP
+	if(cgroup_fd >= 0) {
+		posix_spawnattr_setcgroup_np(&attr, cgroup_fd);
+		flags |= POSIX_SPAWN_SETCGROUP;
+	}
+#endif
+	posix_spawnattr_setflags(&attr, flags);
+
+	pid_t pid;
+	int err = posix_spawnp(&pid, argv[0], &actions, &attr, argv, envp);
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+	if(cgroup_fd >= 0) {
+		close(cgroup_fd);
+	}
+	return err == 0 ? pid : 0;
+#else
+	STARTUPINFO si = {0};
+	PROCESS_INFORMATION pi = {0};
+	char *cmdline = get_escaped_command(argv);
+	String env = {0};
+	if(opts->envp) {
+		// Environment block is a sequence of null terminated strings ending with an empty string
+		env = string_new(NULL);
+		for(char *const *var = opts->envp; *var; var++) {
+			string_append_n(&env, *var, strlen(*var) + 1);
+		}
+		string_append_char(&env, '\0');
+	}
+	si.cb = sizeof(si);
+	bool ok = CreateProcessA(NULL, cmdline, NULL, NULL, false, CREATE_NO_WINDOW, env.data, opts->dir, &si, &pi);
+	free(cmdline);
+	free(env.data);
+	if(ok) {
+		CloseHandle(pi.hThread);
+		return pi.hProcess;
+	}
+	return NULL;
+#endif
+}
+
 char *util_str_execv(const char *dir, char *const *argv) {
 	String str;
 #ifndef G_OS_WIN32
@@ -539,26 +965,19 @@ char *util_str_execv(const char *dir, char *const *argv) {
 	if(pipe(pipefd) == -1) {
 		return NULL;
 	}
-
-	GPid pid = fork();
-	if(pid == -1) {
+	fcntl(pipefd[0], F_SETFD, FD_CLOEXEC);
+	fcntl(pipefd[1], F_SETFD, FD_CLOEXEC);
+	struct SpawnOptions opts = {
+		.dir = dir,
+		.umask = -1,
+		.stdout_fd = pipefd[1],
+		.stderr_fd = pipefd[1]};
+	GPid pid = util_spawn(argv, &opts);
+	close(pipefd[1]);
+	if(!pid) {
 		close(pipefd[0]);
-		close(pipefd[1]);
 		return NULL;
 	}
-	if(pid == 0) {
-		close(pipefd[0]);
-		dup2(pipefd[1], STDOUT_FILENO);
-		dup2(pipefd[1], STDERR_FILENO);
-		close(pipefd[1]);
-
-		if(dir) {
-			chdir(dir);
-		}
-		execvp(argv[0], argv);
-		_exit(EXIT_FAILURE);
-	}
-	close(pipefd[1]);
 
 	char buffer[BUFSIZ];
 	ssize_t bytes_read;
@@ -568,6 +987,7 @@ char *util_str_execv(const char *dir, char *const *argv) {
 		string_append_n(&str, buffer, bytes_read);
 	}
 	close(pipefd[0]);
+	waitpid(pid, NULL, 0);
 #else
 	HANDLE hReadPipe, hWritePipe;
 	SECURITY_ATTRIBUTES sa;
@@ -607,31 +1027,6 @@ char *util_str_execv(const char *dir, char *const *argv) {
 	return str.data;
 }
 
-GPid util_fork_execv(const char *dir, char *const *argv, mode_t u_mask) {
-#ifndef G_OS_WIN32
-	GPid pid = fork();
-	if(pid == 0) {
-		if(dir) {
-			chdir(dir);
-		}
-		umask(u_mask);
-		execvp(argv[0], argv);
-		_exit(EXIT_FAILURE);
-	}
-	return pid;
-#else
-	STARTUPINFO si = {0};
-	PROCESS_INFORMATION pi = {0};
-	char *cmdline = get_escaped_command(argv);
-	if(CreateProcessA(NULL, cmdline, NULL, NULL, false, CREATE_NO_WINDOW, NULL, dir, &si, &pi)) {
-		CloseHandle(pi.hThread);
-		return pi.hProcess;
-	} else {
-		return NULL;
-	}
-#endif
-}
-
 bool util_waitpid(GPid pid, int *exitcode) {
 #ifndef G_OS_WIN32
 	int status;
@@ -666,3 +1061,22 @@ bool util_kill_process(GPid pid) {
 #error Not implemented
 #endif
 }
+
+/* Physical memory in bytes, 0 if unknown */
+guint64 util_get_total_memory(void) {
+#ifdef G_OS_WIN32
+	MEMORYSTATUSEX status;
+	status.dwLength = sizeof(status);
+	if(GlobalMemoryStatusEx(&status)) {
+		return status.ullTotalPhys;
+	}
+	return 0;
+#else
+	long pages = sysconf(_SC_PHYS_PAGES);
+	long pageSize = sysconf(_SC_PAGE_SIZE);
+	if(pages <= 0 || pageSize <= 0) {
+		return 0;
+	}
+	return (guint64)pages * pageSize;
+#endif
+}
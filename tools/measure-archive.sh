@@ -0,0 +1,43 @@
+#!/bin/sh
+# Measures export and import throughput for an instance shaped like a typical modpack: a fetched version plus
+# a mods directory of jars and a config directory of small text files. Import runs into an empty launcher root
+# and then again into the same root, where every game file is already present.
+# Usage: tools/measure-archive.sh [version] [mods] [KiB per mod], microlauncher-cli is taken from $CLI or PATH.
+# Needs network access to fetch the version once.
+set -eu
+CLI=${CLI:-microlauncher-cli}
+VERSION=${1:-1.20.1}
+MODS=${2:-150}
+MOD_KIB=${3:-1024}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT INT TERM
+
+export XDG_DATA_HOME="$DIR/data"
+GAME="$DIR/game"
+mkdir -p "$XDG_DATA_HOME/microlauncher" "$GAME/mods" "$GAME/config"
+printf '[{"name": "Modpack", "location": "%s", "version": "%s"}]\n' "$GAME" "$VERSION" >"$XDG_DATA_HOME/microlauncher/instances.json"
+i=0
+while [ "$i" -lt "$MODS" ]; do
+	# Jars are compressed already, random data behaves the same when archived
+	head -c "$((MOD_KIB * 1024))" /dev/urandom >"$GAME/mods/mod-$i.jar"
+	i=$((i + 1))
+done
+i=0
+while [ "$i" -lt $((MODS * 2)) ]; do
+	seq 1 200 | sed "s/^/option$i./;s/$/=true/" >"$GAME/config/mod-$i.cfg"
+	i=$((i + 1))
+done
+
+summary() {
+	grep '"event":"summary"' "$1" | tail -n 1
+}
+
+MICROLAUNCHER_LAUNCHER_ROOT="$DIR/a" "$CLI" prefetch -i Modpack >/dev/null
+MICROLAUNCHER_LAUNCHER_ROOT="$DIR/a" "$CLI" export -i Modpack -a "$DIR/modpack.zip" >"$DIR/export.log"
+echo "Export: $(summary "$DIR/export.log")"
+
+# Page cache holds the archive in both imports, only the launcher root differs
+MICROLAUNCHER_LAUNCHER_ROOT="$DIR/b" "$CLI" import -a "$DIR/modpack.zip" -d "$DIR/import-1" >"$DIR/import-1.log"
+echo "Import into empty root: $(summary "$DIR/import-1.log")"
+MICROLAUNCHER_LAUNCHER_ROOT="$DIR/b" "$CLI" import -a "$DIR/modpack.zip" -d "$DIR/import-2" >"$DIR/import-2.log"
+echo "Import into populated root: $(summary "$DIR/import-2.log")"
@@ -0,0 +1,96 @@
+#!/bin/sh
+# Measures the time from launch until the game logs a line of its main menu, with class data sharing off and
+# with the archive of the instance in use. When there is no archive yet, the first launch with class data
+# sharing creates it: quit the game from its menu then, an archive is only kept after a clean exit.
+# Runs on a copy of the config in a temporary data directory, the launcher root is the configured one.
+# Usage: tools/measure-cds.sh instance [runs] [marker], microlauncher-cli is taken from $CLI or PATH.
+# marker defaults to "Sound engine started", which 1.12 and later log once the menu is loading.
+set -eu
+CLI=${CLI:-microlauncher-cli}
+INSTANCE=$1
+RUNS=${2:-5}
+MARKER=${3:-Sound engine started}
+CONFIG="${XDG_DATA_HOME:-$HOME/.local/share}/microlauncher"
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT INT TERM
+
+if [ -z "${MICROLAUNCHER_LAUNCHER_ROOT:-}" ]; then
+	MICROLAUNCHER_LAUNCHER_ROOT=$(python3 -c "
+import json, sys
+try:
+    print(json.load(open(sys.argv[1])).get('launcherRoot') or '')
+except OSError:
+    print('')
+" "$CONFIG/settings.json")
+	[ -n "$MICROLAUNCHER_LAUNCHER_ROOT" ] || MICROLAUNCHER_LAUNCHER_ROOT="${XDG_DATA_HOME:-$HOME/.local/share}/minecraft"
+fi
+export MICROLAUNCHER_LAUNCHER_ROOT
+export XDG_DATA_HOME="$DIR/data"
+mkdir -p "$XDG_DATA_HOME/microlauncher"
+cp "$CONFIG"/instances.json "$CONFIG"/accounts.json "$CONFIG"/settings.json "$XDG_DATA_HOME/microlauncher/"
+
+set_cds() {
+	python3 -c "
+import json, sys
+path = sys.argv[1]
+settings = json.load(open(path))
+settings['classDataSharing'] = sys.argv[2] == 'true'
+json.dump(settings, open(path, 'w'), indent=2)
+" "$XDG_DATA_HOME/microlauncher/settings.json" "$1"
+}
+
+median() {
+	sort -n | awk '{ v[NR] = $1 } END { print (NR % 2) ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2 }'
+}
+
+# Prints milliseconds until MARKER was logged, stops the game unless it is creating an archive
+launch() {
+	: >"$DIR/events"
+	: >"$DIR/log"
+	start=$(date +%s%N)
+	"$CLI" launch -i "$INSTANCE" >"$DIR/events" 2>"$DIR/log" &
+	cli=$!
+	until grep -qF "$MARKER" "$DIR/log"; do
+		if ! kill -0 "$cli" 2>/dev/null; then
+			echo "Game exited before logging \"$MARKER\"" >&2
+			tail -n 20 "$DIR/log" >&2
+			exit 1
+		fi
+		sleep 0.05
+	done
+	echo $((($(date +%s%N) - start) / 1000000))
+	if grep -q "Creating class data sharing archive" "$DIR/log"; then
+		echo "Creating the archive, quit the game from its menu" >&2
+	else
+		pid=$(grep '"event":"started"' "$DIR/events" | sed -n 's/.*"pid":\([0-9]*\).*/\1/p')
+		kill "$pid" 2>/dev/null || true
+	fi
+	wait "$cli" || true
+}
+
+set_cds false
+: >"$DIR/off"
+i=0
+while [ "$i" -lt "$RUNS" ]; do
+	launch >>"$DIR/off"
+	i=$((i + 1))
+done
+
+set_cds true
+launch >"$DIR/first"
+if grep -q "Creating class data sharing archive" "$DIR/log"; then
+	echo "Training launch: $(cat "$DIR/first") ms"
+fi
+: >"$DIR/on"
+i=0
+while [ "$i" -lt "$RUNS" ]; do
+	launch >>"$DIR/on"
+	if ! grep -q "Using class data sharing archive" "$DIR/log"; then
+		echo "No archive was used, was the training launch quit from the menu?"
+		exit 1
+	fi
+	i=$((i + 1))
+done
+off=$(median <"$DIR/off")
+on=$(median <"$DIR/on")
+echo "Class data sharing off: $off ms, with archive: $on ms, saved $(awk "BEGIN { print $off - $on }") ms (median of $RUNS)"
@@ -0,0 +1,41 @@
+#!/bin/sh
+# Compares startup of the launcher with the mod browser loaded on demand against WebKit loaded at startup,
+# which is what linking it into the launcher did. WebKit is preloaded into the same binary for the latter.
+# Prints the median time until the main window is drawn and the median RSS at that point over several runs.
+# Usage: tools/measure-startup.sh [runs], microlauncher is taken from $GUI or PATH. Needs a display.
+set -eu
+GUI=${GUI:-microlauncher}
+RUNS=${1:-10}
+WEBKIT=${WEBKIT:-$(pkg-config --variable=libdir webkitgtk-6.0)/libwebkitgtk-6.0.so.4}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT INT TERM
+
+if [ ! -e "$WEBKIT" ]; then
+	echo "$WEBKIT not found, set WEBKIT to the WebKitGTK 6 library"
+	exit 1
+fi
+
+median() {
+	sort -n | awk '{ v[NR] = $1 } END { print (NR % 2) ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2 }'
+}
+
+measure() {
+	label=$1
+	shift
+	: >"$DIR/ms"
+	: >"$DIR/rss"
+	i=0
+	while [ "$i" -lt "$RUNS" ]; do
+		line=$(env "$@" "$GUI" --bench-startup 2>/dev/null | grep '^Startup:')
+		echo "$line" | sed 's/.*after \([0-9]*\) ms.*/\1/' >>"$DIR/ms"
+		echo "$line" | sed 's/.*RSS \([0-9]*\) KiB.*/\1/' >>"$DIR/rss"
+		i=$((i + 1))
+	done
+	echo "$label: $(median <"$DIR/ms") ms, $(median <"$DIR/rss") KiB RSS"
+}
+
+# First run warms the page cache for both
+"$GUI" --bench-startup >/dev/null 2>&1 || true
+LD_PRELOAD="$WEBKIT" "$GUI" --bench-startup >/dev/null 2>&1 || true
+measure "WebKit at startup" LD_PRELOAD="$WEBKIT"
+measure "Loaded on demand"
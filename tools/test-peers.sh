@@ -0,0 +1,65 @@
+#!/bin/sh
+# Fetches a version into one launcher root, serves it and fetches the same version into a second root from it.
+# A peer that refuses connections and one that accepts but never answers come first in MICROLAUNCHER_PEERS,
+# both must be skipped after their first failure instead of costing a timeout per file.
+# Usage: tools/test-peers.sh [version], microlauncher-cli is taken from $CLI or PATH. Needs network access once.
+set -eu
+CLI=${CLI:-microlauncher-cli}
+VERSION=${1:-1.12.2}
+PORT=${PORT:-25591}
+STALL_PORT=${STALL_PORT:-25592}
+DIR=$(mktemp -d)
+SERVE_PID=
+STALL_PID=
+cleanup() {
+	[ -n "$SERVE_PID" ] && kill "$SERVE_PID" 2>/dev/null || true
+	[ -n "$STALL_PID" ] && kill "$STALL_PID" 2>/dev/null || true
+	rm -rf "$DIR"
+}
+trap cleanup EXIT INT TERM
+
+export XDG_DATA_HOME="$DIR/data"
+MICROLAUNCHER_LAUNCHER_ROOT="$DIR/a" "$CLI" prefetch -v "$VERSION" >"$DIR/a.log"
+MICROLAUNCHER_LAUNCHER_ROOT="$DIR/a" "$CLI" serve --port "$PORT" >"$DIR/serve.log" 2>&1 &
+SERVE_PID=$!
+# Accepts connections and never answers
+python3 -c "
+import socket, time
+s = socket.socket()
+s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+s.bind(('127.0.0.1', $STALL_PORT))
+s.listen(64)
+conns = []
+while True:
+    conns.append(s.accept()[0])
+" &
+STALL_PID=$!
+sleep 1
+
+start=$(date +%s)
+MICROLAUNCHER_LAUNCHER_ROOT="$DIR/b" MICROLAUNCHER_PEERS="http://127.0.0.1:1,http://127.0.0.1:$STALL_PORT,http://127.0.0.1:$PORT" \
+	"$CLI" prefetch -v "$VERSION" >"$DIR/b.log"
+seconds=$(($(date +%s) - start))
+tail -n 1 "$DIR/b.log"
+echo "Second root took ${seconds}s"
+
+status=0
+grep -q '"ok": *true' "$DIR/b.log" || {
+	echo "prefetch from peers failed"
+	status=1
+}
+for sub in versions libraries assets/objects; do
+	(cd "$DIR/a/$sub" && find . -type f ! -name '*.lock' ! -name '*.part' -exec sha1sum {} + | sort -k 2) >"$DIR/a.sums"
+	(cd "$DIR/b/$sub" && find . -type f ! -name '*.lock' ! -name '*.part' -exec sha1sum {} + | sort -k 2) >"$DIR/b.sums"
+	if ! cmp -s "$DIR/a.sums" "$DIR/b.sums"; then
+		echo "$sub differs between roots"
+		status=1
+	fi
+done
+# Without the negative cache every file would wait for the stalled peer
+if [ "$seconds" -gt 120 ]; then
+	echo "Dead peers weren't skipped"
+	status=1
+fi
+[ "$status" -eq 0 ] && echo "OK"
+exit "$status"
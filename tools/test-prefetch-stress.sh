@@ -0,0 +1,48 @@
+#!/bin/sh
+# Runs several prefetch processes against one empty launcher root at the same time, then hashes every file
+# against the version metadata with verify and checks that no partial downloads or locks were left behind.
+# Usage: tools/test-prefetch-stress.sh [processes] [version], microlauncher-cli is taken from $CLI or PATH.
+# Needs network access.
+set -eu
+CLI=${CLI:-microlauncher-cli}
+PROCESSES=${1:-4}
+VERSION=${2:-1.12.2}
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT INT TERM
+
+export XDG_DATA_HOME="$DIR/data"
+export MICROLAUNCHER_LAUNCHER_ROOT="$DIR/root"
+
+pids=
+i=0
+while [ "$i" -lt "$PROCESSES" ]; do
+	"$CLI" prefetch -v "$VERSION" >"$DIR/prefetch-$i.log" 2>"$DIR/prefetch-$i.err" &
+	pids="$pids $!"
+	i=$((i + 1))
+done
+status=0
+i=0
+for pid in $pids; do
+	if ! wait "$pid"; then
+		echo "prefetch $i failed, see below"
+		tail -n 5 "$DIR/prefetch-$i.err"
+		status=1
+	fi
+	i=$((i + 1))
+done
+# Files are fetched by one process each, the others wait for its lock and find them present
+grep -h '"event":"summary"' "$DIR"/prefetch-*.log
+
+if ! "$CLI" verify -v "$VERSION" >"$DIR/verify.log" 2>&1; then
+	echo "verify found missing or corrupt files:"
+	grep '"event":"file"' "$DIR/verify.log" | head -n 20
+	status=1
+fi
+leftovers=$(find "$MICROLAUNCHER_LAUNCHER_ROOT" \( -name '*.part' -o -name '*.lock' \) | head -n 20)
+if [ -n "$leftovers" ]; then
+	echo "Partial downloads or locks left behind:"
+	echo "$leftovers"
+	status=1
+fi
+[ "$status" -eq 0 ] && echo "OK"
+exit "$status"
@@ -0,0 +1,72 @@
+#!/bin/sh
+# Starts the launcher service on a private session bus and changes its config from outside while it runs.
+# Rewriting a file with the same contents must be ignored, a new instance must be launchable without a restart.
+# Usage: tools/test-service.sh, microlauncher-cli is taken from $CLI or PATH. Needs dbus-run-session and gdbus.
+set -eu
+if [ -z "${TEST_SERVICE_BUS:-}" ]; then
+	TEST_SERVICE_BUS=1 exec dbus-run-session -- "$0" "$@"
+fi
+CLI=${CLI:-microlauncher-cli}
+NAME=io.github.lassebq.microlauncher.Service
+DIR=$(mktemp -d)
+SERVICE_PID=
+cleanup() {
+	[ -n "$SERVICE_PID" ] && kill "$SERVICE_PID" 2>/dev/null || true
+	rm -rf "$DIR"
+}
+trap cleanup EXIT INT TERM
+
+export XDG_DATA_HOME="$DIR/data"
+CONFIG="$XDG_DATA_HOME/microlauncher"
+mkdir -p "$CONFIG" "$DIR/game"
+echo '[]' >"$CONFIG/instances.json"
+echo '[]' >"$CONFIG/accounts.json"
+echo '{}' >"$CONFIG/settings.json"
+
+launch() {
+	gdbus call --session --dest "$NAME" --object-path /io/github/lassebq/microlauncher/Service \
+		--method "$NAME.Launch" "$1" "" 2>&1 || true
+}
+
+"$CLI" service >"$DIR/service.log" 2>&1 &
+SERVICE_PID=$!
+i=0
+until gdbus introspect --session --dest "$NAME" --object-path /io/github/lassebq/microlauncher/Service >/dev/null 2>&1; do
+	i=$((i + 1))
+	if [ "$i" -gt 50 ]; then
+		echo "Service didn't appear on the bus"
+		cat "$DIR/service.log"
+		exit 1
+	fi
+	sleep 0.1
+done
+
+status=0
+launch Test | grep -q "No such instance" || {
+	echo "Unknown instance wasn't rejected"
+	status=1
+}
+
+# Same contents, e.g. written by the service itself
+cp "$CONFIG/settings.json" "$CONFIG/settings.json.new"
+mv "$CONFIG/settings.json.new" "$CONFIG/settings.json"
+sleep 1
+if grep -q "Configuration changed" "$DIR/service.log"; then
+	echo "Unchanged config was reloaded"
+	status=1
+fi
+
+printf '[{"name": "Test", "location": "%s", "version": "1.12.2"}]\n' "$DIR/game" >"$CONFIG/instances.json"
+sleep 1
+# Found now, fails later because there is no account
+launch Test | grep -q "No such user" || {
+	echo "Changed config wasn't reloaded"
+	status=1
+}
+if ! kill -0 "$SERVICE_PID" 2>/dev/null; then
+	echo "Service exited after the config was changed"
+	status=1
+fi
+grep -q "Configuration changed, reloading" "$DIR/service.log" || status=1
+[ "$status" -eq 0 ] && echo "OK"
+exit "$status"